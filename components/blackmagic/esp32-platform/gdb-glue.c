@@ -3,7 +3,10 @@
 #include <stdbool.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
-#include <freertos/stream_buffer.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <spsc-ring.h>
+#include "gdb-glue.h"
 
 #define GDB_TX_BUFFER_SIZE 4096
 #define GDB_RX_BUFFER_SIZE 4096
@@ -11,10 +14,15 @@
 #define TAG "gdb-glue"
 
 typedef struct {
-    StreamBufferHandle_t rx_stream;
-    bool rx_stream_full;
+    SpscRing rx_ring;
+    uint8_t rx_ring_storage[GDB_RX_BUFFER_SIZE];
+    SemaphoreHandle_t rx_producer_lock; // USB and network GDB may both feed the ring
+    SemaphoreHandle_t swd_lock; // held by gdb except while it waits for the host
+    bool swd_held; // only the gdb thread uses it
+    volatile bool rx_stream_full;
     uint8_t tx_buffer[GDB_TX_BUFFER_SIZE];
     size_t tx_buffer_index;
+    GdbGlueStats stats; // only the gdb thread writes them
 } GDBGlue;
 
 static GDBGlue gdb_glue;
@@ -25,18 +33,62 @@ void network_gdb_send(uint8_t* buffer, size_t size);
 
 /* USB-CDC */
 void usb_gdb_tx_char(uint8_t c, bool flush);
+void usb_gdb_rx_resume(void);
+bool usb_gdb_connected(void);
+
+/* DAP-Link */
+bool dap_is_connected(void);
+
+/* SWD */
+extern uint32_t swd_transaction_cnt;
 
 size_t gdb_glue_get_free_size(void) {
-    return xStreamBufferSpacesAvailable(gdb_glue.rx_stream);
+    return spsc_ring_free(&gdb_glue.rx_ring);
 }
 
 void gdb_glue_receive(uint8_t* buffer, size_t size) {
-    size_t ret = xStreamBufferSend(gdb_glue.rx_stream, buffer, size, portMAX_DELAY);
-    ESP_ERROR_CHECK(ret != size);
+    xSemaphoreTake(gdb_glue.rx_producer_lock, portMAX_DELAY);
+    size_t written = 0;
+    while(written < size) {
+        size_t ret = spsc_ring_write(&gdb_glue.rx_ring, buffer + written, size - written);
+        written += ret;
+
+        if(ret == 0) {
+            // wait for gdb to take some data
+            vTaskDelay(1);
+        }
+    }
+    xSemaphoreGive(gdb_glue.rx_producer_lock);
+}
+
+size_t gdb_glue_receive_from(GdbGlueRead read) {
+    size_t total = 0;
+
+    // free space is checked under the lock, so this never waits for the consumer
+    xSemaphoreTake(gdb_glue.rx_producer_lock, portMAX_DELAY);
+    while(true) {
+        uint8_t* data;
+        size_t free = spsc_ring_reserve(&gdb_glue.rx_ring, &data);
+        if(free == 0) {
+            // flag first, then look again: gdb may have freed space before seeing the flag
+            gdb_glue.rx_stream_full = true;
+            free = spsc_ring_reserve(&gdb_glue.rx_ring, &data);
+            if(free == 0) break;
+            gdb_glue.rx_stream_full = false;
+        }
+
+        size_t size = read(data, free);
+        spsc_ring_commit(&gdb_glue.rx_ring, size);
+        total += size;
+        if(size < free) break;
+    }
+    xSemaphoreGive(gdb_glue.rx_producer_lock);
+
+    return total;
 }
 
 bool gdb_glue_can_receive() {
-    uint16_t max_len = xStreamBufferSpacesAvailable(gdb_glue.rx_stream);
+    uint16_t max_len = spsc_ring_free(&gdb_glue.rx_ring);
     bool can_receive = true;
 
     if(max_len <= 0) {
@@ -48,32 +100,101 @@ bool gdb_glue_can_receive() {
     return can_receive;
 }
 
+bool gdb_glue_interrupt(void) {
+    const uint8_t interrupt = 0x03;
+    bool sent = false;
+
+    // never wait here, the caller may be in a hurry
+    if(xSemaphoreTake(gdb_glue.rx_producer_lock, 0) == pdTRUE) {
+        sent = spsc_ring_write(&gdb_glue.rx_ring, &interrupt, sizeof(interrupt)) > 0;
+        xSemaphoreGive(gdb_glue.rx_producer_lock);
+    }
+
+    return sent;
+}
+
+bool gdb_glue_connected(void) {
+    return network_gdb_connected() || usb_gdb_connected();
+}
+
+static bool gdb_glue_swd_in_use(void) {
+    return gdb_glue_connected() || dap_is_connected();
+}
+
+bool gdb_glue_swd_claim(void) {
+    if(gdb_glue_swd_in_use()) return false;
+    if(xSemaphoreTake(gdb_glue.swd_lock, 0) != pdTRUE) return false;
+
+    // a host that connected meanwhile would only wait, but it gets the target first
+    if(gdb_glue_swd_in_use()) {
+        xSemaphoreGive(gdb_glue.swd_lock);
+        return false;
+    }
+
+    return true;
+}
+
+void gdb_glue_swd_release(void) {
+    xSemaphoreGive(gdb_glue.swd_lock);
+}
+
+// gdb only touches SWD after reading from the host, so it owns the port unless it waits
+static void gdb_glue_swd_hold(bool hold) {
+    if(hold && !gdb_glue.swd_held) {
+        xSemaphoreTake(gdb_glue.swd_lock, portMAX_DELAY);
+    } else if(!hold && gdb_glue.swd_held) {
+        xSemaphoreGive(gdb_glue.swd_lock);
+    }
+    gdb_glue.swd_held = hold;
+}
+
 size_t gdb_glue_get_packet_size() {
     return GDB_RX_PACKET_MAX_SIZE;
 }
 
+void gdb_glue_get_stats(GdbGlueStats* stats) {
+    *stats = gdb_glue.stats;
+    stats->swd_transactions = swd_transaction_cnt;
+}
+
 const char* gdb_glue_get_bm_version() {
     return FIRMWARE_VERSION;
 }
 
 void gdb_glue_init(void) {
-    gdb_glue.rx_stream = xStreamBufferCreate(GDB_RX_BUFFER_SIZE, 1);
+    spsc_ring_init(&gdb_glue.rx_ring, gdb_glue.rx_ring_storage, GDB_RX_BUFFER_SIZE);
+    gdb_glue.rx_producer_lock = xSemaphoreCreateMutex();
+    gdb_glue.swd_lock = xSemaphoreCreateMutex();
+    gdb_glue.swd_held = false;
     gdb_glue.rx_stream_full = false;
     gdb_glue.tx_buffer_index = 0;
 }
 
 unsigned char gdb_if_getchar_to(int timeout) {
     uint8_t data;
-    size_t received = xStreamBufferReceive(gdb_glue.rx_stream, &data, sizeof(uint8_t), timeout);
+    size_t received = spsc_ring_read(&gdb_glue.rx_ring, &data, sizeof(uint8_t));
+
+    // a polling read keeps the port, e.g. while gdb watches a running target
+    if(received == 0 && timeout != 0) {
+        gdb_glue_swd_hold(false);
+        received = spsc_ring_receive(&gdb_glue.rx_ring, &data, sizeof(uint8_t), timeout);
+    }
+    gdb_glue_swd_hold(true);
 
     if(received == 0) {
         return -1;
     }
 
+    gdb_glue.stats.rx_bytes++;
+    if(data == '$') {
+        gdb_glue.stats.rx_packets++;
+    }
+
     if(gdb_glue.rx_stream_full &&
-       xStreamBufferSpacesAvailable(gdb_glue.rx_stream) >= GDB_RX_PACKET_MAX_SIZE) {
+       spsc_ring_free(&gdb_glue.rx_ring) >= GDB_RX_PACKET_MAX_SIZE) {
         gdb_glue.rx_stream_full = false;
         ESP_LOGW(TAG, "Stream freed");
+        usb_gdb_rx_resume();
     }
 
     return data;
@@ -84,6 +205,11 @@ unsigned char gdb_if_getchar(void) {
 }
 
 void gdb_if_putchar(unsigned char c, int flush) {
+    gdb_glue.stats.tx_bytes++;
+    if(c == '$') {
+        gdb_glue.stats.tx_packets++;
+    }
+
     if(network_gdb_connected()) {
         gdb_glue.tx_buffer[gdb_glue.tx_buffer_index] = c;
         gdb_glue.tx_buffer_index++;
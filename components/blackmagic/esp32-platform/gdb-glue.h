@@ -1,6 +1,17 @@
 #pragma once
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+typedef size_t (*GdbGlueRead)(uint8_t* buffer, size_t size);
+
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t rx_packets; /*!< '$' seen, the protocol escapes it inside packets*/
+    uint32_t tx_packets;
+    uint32_t swd_transactions; /*!< SWDIO turnarounds to read an ACK, one per transaction*/
+} GdbGlueStats;
 
 /**
  * Init gdb stream glue
@@ -20,18 +31,57 @@ size_t gdb_glue_get_free_size(void);
  */
 void gdb_glue_receive(uint8_t* buffer, size_t size);
 
+/**
+ * Read into the rx stream until it is full or read returns short, never waits for gdb.
+ * The rest stays with the source, the consumer calls back once the stream has room.
+ * @param read fills up to size bytes, returns the count
+ * @return size_t bytes received
+ */
+size_t gdb_glue_receive_from(GdbGlueRead read);
+
 /**
  * 
  * @return bool 
  */
 bool gdb_glue_can_receive();
 
+/**
+ * Interrupt the target as GDB Ctrl-C does
+ * @return bool false if it was dropped, the rx stream is full or busy
+ */
+bool gdb_glue_interrupt(void);
+
+/**
+ * Check if a GDB host is connected over any transport
+ * @return bool
+ */
+bool gdb_glue_connected(void);
+
+/**
+ * Take the SWD port for a local user, e.g. the MSC flasher or a trigger halt.
+ * Fails while a GDB or DAP host is connected or gdb is busy with the target, gdb input
+ * waits until the port is released. Release it from the same task.
+ * @return bool
+ */
+bool gdb_glue_swd_claim(void);
+
+/**
+ * Give the SWD port back
+ */
+void gdb_glue_swd_release(void);
+
 /**
  * Get gdb packet size
  * @return size_t 
  */
 size_t gdb_glue_get_packet_size();
 
+/**
+ * Get traffic counters, they wrap
+ * @param stats
+ */
+void gdb_glue_get_stats(GdbGlueStats* stats);
+
 /**
  * Get blackmagic version
  * @return const char* 
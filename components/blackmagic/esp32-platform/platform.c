@@ -10,9 +10,13 @@
 #include <esp_rom_gpio.h>
 
 uint32_t swd_delay_cnt = 0;
+uint32_t swd_transaction_cnt = 0;
 // static const char* TAG = "gdb-platform";
 
 void __attribute__((always_inline)) platform_swdio_mode_float(void) {
+    // every SWD transaction releases the line once, to read the ACK
+    swd_transaction_cnt++;
+
     // gpio_set_direction(SWDIO_PIN, GPIO_MODE_INPUT);
     // gpio_set_pull_mode(SWDIO_PIN, GPIO_FLOATING);
 
@@ -2,6 +2,7 @@
 #include <timing.h>
 
 extern uint32_t swd_delay_cnt;
+extern uint32_t swd_transaction_cnt;
 
 void platform_swdio_mode_float(void);
 void platform_swdio_mode_drive(void);
@@ -35,7 +36,7 @@ void led_set_blue(uint8_t value);
 #define TCK_PIN (-1)
 
 #undef PLATFORM_HAS_TRACESWO
-#define TRACESWO_PIN 18
+#define TRACESWO_PIN 10
 
 // ON ESP32 we dont have the PORTS, this is dummy value until code is corrected
 #define SWCLK_PORT (0)
@@ -1,3 +1,5 @@
+#include <string.h>
+#include <sys/param.h>
 #include <driver/gpio.h>
 #include <driver/periph_ctrl.h>
 #include <hal/uart_ll.h>
@@ -5,6 +7,14 @@
 
 #include <hal/gpio_hal.h>
 #include <esp_rom_gpio.h>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <soc/lldesc.h>
+#include <soc/uhci_struct.h>
+#include <soc/uhci_reg.h>
+#include <soc/soc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "simple-uart.h"
 
@@ -15,10 +25,21 @@ typedef struct {
     uint8_t uart_index;
     void* isr_context;
     uart_isr rx_isr;
+
+    uint8_t* tx_buffer; /*!< TX ring, one byte is always kept free*/
+    uint32_t tx_size;
+    uint32_t tx_head; /*!< written by producers*/
+    uint32_t tx_tail; /*!< written by the isr*/
+    SemaphoreHandle_t tx_space; /*!< given by the isr when the ring has been drained a bit*/
+    StaticSemaphore_t tx_space_struct;
+    portMUX_TYPE tx_mux;
+
+    UartStats stats;
 } uart_context_t;
 
 typedef struct {
     uint32_t baud_rate;
+    uint32_t actual_baud_rate;
     uart_stop_bits_t stop_bits;
     uart_parity_t parity;
     uart_word_length_t data_bits;
@@ -27,7 +48,7 @@ typedef struct {
 #define UART_CONTEX_INIT_DEF(uart_num)                                                    \
     {                                                                                     \
         .hal.dev = UART_LL_GET_HW(uart_num), .uart_index = uart_num, .isr_context = NULL, \
-        .rx_isr = NULL                                                                    \
+        .rx_isr = NULL, .tx_buffer = NULL, .tx_mux = portMUX_INITIALIZER_UNLOCKED         \
     }
 
 static uart_context_t uart_context[UART_NUM_MAX] = {
@@ -43,15 +64,110 @@ static UartInnerConfig uart_config[UART_NUM_MAX] = {
     {0},
 };
 
+static portMUX_TYPE uart_isr_mux = portMUX_INITIALIZER_UNLOCKED;
+
 #define UART_HAL(uart_num) &(uart_context[uart_num].hal)
 
 /***********************************************/
 
 #define UART_FIFO_LIMIT (UART_LL_FIFO_DEF_LEN)
-#define UART_TX_FIFO_THRESH 0x1
-#define UART_RX_FIFO_THRESH 0x16
+#define UART_TX_FIFO_THRESH 0x20 // refill before the fifo runs dry
+#define UART_TX_RING_DEFAULT_SIZE 1024
+#define UART_RTS_THRESH (UART_FIFO_LIMIT - 0x10) // room for the bytes the target sends late
+#define UART_BAUD_RATE_MIN 300
+#define UART_BAUD_RATE_MAX (APB_CLK_FREQ / 16)
+#define UART_BAUD_RATE_TOLERANCE 20 // per mille, a 10 bit frame still samples fine at 2%
+#define UART_AUTOBAUD_PULSE_MAX 0xFFF // pulse counters are 12 bits wide, saturate there
+#define UART_ERROR_INTR \
+    (UART_INTR_RXFIFO_OVF | UART_INTR_FRAM_ERR | UART_INTR_PARITY_ERR | UART_INTR_BRK_DET)
+
+/***********************************************/
+
+/*
+ * RX tuning depends on the baud rate. At low rates every byte is passed on as soon as it
+ * arrives, so interactive echo is instant. At high rates the FIFO fills in tens of
+ * microseconds, so the threshold leaves room for ISR latency and the timeouts are longer,
+ * so that one burst does not turn into many small interrupts or DMA descriptors.
+ */
+
+typedef struct {
+    uint32_t max_baud_rate;
+    uart_sclk_t sclk;
+    uint8_t rx_full_thresh; // bytes
+    uint8_t rx_timeout; // symbols
+    uint16_t rx_idle_thresh; // bit times, closes the DMA rx descriptor
+} UartBaudProfile;
+
+static const UartBaudProfile uart_baud_profiles[] = {
+    // REF_TICK keeps the rate exact if APB is scaled, 1 MHz is still precise enough here
+    {38400, UART_SCLK_REF_TICK, 1, 2, 10},
+    {460800, UART_SCLK_APB, 0x16, 4, 20},
+    {1500000, UART_SCLK_APB, 0x40, 8, 40},
+    {UINT32_MAX, UART_SCLK_APB, 0x60, 16, 80},
+};
+
+static const UartBaudProfile* simple_uart_get_baud_profile(uint32_t baud_rate) {
+    size_t i = 0;
+    while(baud_rate > uart_baud_profiles[i].max_baud_rate) {
+        i++;
+    }
+    return &uart_baud_profiles[i];
+}
+
+/***********************************************/
+
+/*
+ * UHCI DMA engine. There is only one UHCI on the ESP32-S2, so only one UART can use it.
+ * RX: a circular list of descriptors, the DMA closes a descriptor when it is full or when the
+ * line is idle. The ISR only moves the head cursor and wakes the consumer, data is copied
+ * out in simple_uart_read() and the descriptor is given back to the DMA.
+ * TX: the DMA sends straight from the TX ring, one contiguous segment at a time.
+ */
+
+#define UART_DMA_NONE 0xFF
+#define UART_DMA_RX_DESC_COUNT 32
+#define UART_DMA_RX_DESC_SIZE 256
+#define UART_DMA_TX_MAX_LENGTH 4095 // descriptor length field is 12 bits
+
+#define UART_DMA_RX_INTR (UHCI_IN_DONE_INT_ENA | UHCI_IN_SUC_EOF_INT_ENA)
+#define UART_DMA_RX_STALL_INTR (UHCI_IN_DSCR_EMPTY_INT_ENA | UHCI_IN_DSCR_ERR_INT_ENA)
+#define UART_DMA_TX_INTR (UHCI_OUT_TOTAL_EOF_INT_ENA)
+
+typedef struct {
+    uint8_t uart_num;
+
+    lldesc_t rx_desc[UART_DMA_RX_DESC_COUNT];
+    volatile uint32_t rx_head; // descriptors completed by the DMA
+    uint32_t rx_tail; // descriptor being read
+    uint32_t rx_offset; // read position inside the tail descriptor
+    volatile bool rx_stalled;
+
+    lldesc_t tx_desc;
+    uint32_t tx_length; // length of the segment in flight
+    bool tx_busy;
+} UartDma;
+
+static DMA_ATTR uint8_t uart_dma_rx_buffer[UART_DMA_RX_DESC_COUNT][UART_DMA_RX_DESC_SIZE];
+static DMA_ATTR UartDma uart_dma = {
+    .uart_num = UART_DMA_NONE,
+};
+
+static portMUX_TYPE uart_dma_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define UART_USES_DMA(uart_num) (uart_dma.uart_num == (uart_num))
 
 static void simple_uart_isr(void* arg);
+static void simple_uart_dma_isr(void* arg);
+
+static void simple_uart_init_rx_pin(uint8_t uart_num, int rx_pin_num) {
+    if(rx_pin_num >= 0) {
+        gpio_hal_iomux_func_sel(GPIO_PIN_MUX_REG[rx_pin_num], PIN_FUNC_GPIO);
+        gpio_set_pull_mode(rx_pin_num, GPIO_PULLUP_ONLY);
+        gpio_set_direction(rx_pin_num, GPIO_MODE_INPUT);
+        esp_rom_gpio_connect_in_signal(
+            rx_pin_num, UART_PERIPH_SIGNAL(uart_num, SOC_UART_RX_PIN_IDX), 0);
+    }
+}
 
 static void simple_uart_init_pins(uint8_t uart_num, int tx_pin_num, int rx_pin_num) {
     if(tx_pin_num >= 0) {
@@ -61,12 +177,23 @@ static void simple_uart_init_pins(uint8_t uart_num, int tx_pin_num, int rx_pin_n
             tx_pin_num, UART_PERIPH_SIGNAL(uart_num, SOC_UART_TX_PIN_IDX), 0, 0);
     }
 
-    if(rx_pin_num >= 0) {
-        gpio_hal_iomux_func_sel(GPIO_PIN_MUX_REG[rx_pin_num], PIN_FUNC_GPIO);
-        gpio_set_pull_mode(rx_pin_num, GPIO_PULLUP_ONLY);
-        gpio_set_direction(rx_pin_num, GPIO_MODE_INPUT);
+    simple_uart_init_rx_pin(uart_num, rx_pin_num);
+}
+
+static void simple_uart_init_flow_pins(uint8_t uart_num, int rts_pin_num, int cts_pin_num) {
+    if(rts_pin_num >= 0) {
+        gpio_hal_iomux_func_sel(GPIO_PIN_MUX_REG[rts_pin_num], PIN_FUNC_GPIO);
+        esp_rom_gpio_connect_out_signal(
+            rts_pin_num, UART_PERIPH_SIGNAL(uart_num, SOC_UART_RTS_PIN_IDX), 0, 0);
+    }
+
+    if(cts_pin_num >= 0) {
+        // target without flow control leaves CTS floating, treat it as "ready"
+        gpio_hal_iomux_func_sel(GPIO_PIN_MUX_REG[cts_pin_num], PIN_FUNC_GPIO);
+        gpio_set_pull_mode(cts_pin_num, GPIO_PULLDOWN_ONLY);
+        gpio_set_direction(cts_pin_num, GPIO_MODE_INPUT);
         esp_rom_gpio_connect_in_signal(
-            rx_pin_num, UART_PERIPH_SIGNAL(uart_num, SOC_UART_RX_PIN_IDX), 0);
+            cts_pin_num, UART_PERIPH_SIGNAL(uart_num, SOC_UART_CTS_PIN_IDX), 0);
     }
 }
 
@@ -75,19 +202,206 @@ static void simple_uart_init_module(uint8_t uart_num) {
     periph_module_reset(uart_periph_signal[uart_num].module);
 }
 
+/***********************************************/
+
+static void simple_uart_dma_rx_start(lldesc_t* desc) {
+    UHCI0.dma_in_link.addr = (uint32_t)desc & 0xFFFFF;
+    UHCI0.dma_in_link.start = 1;
+}
+
+static void simple_uart_dma_rx_link(void) {
+    for(size_t i = 0; i < UART_DMA_RX_DESC_COUNT; i++) {
+        lldesc_t* desc = &uart_dma.rx_desc[i];
+        desc->size = UART_DMA_RX_DESC_SIZE;
+        desc->length = 0;
+        desc->offset = 0;
+        desc->sosf = 0;
+        desc->eof = 0;
+        desc->owner = 1;
+        desc->buf = uart_dma_rx_buffer[i];
+        desc->empty = (uint32_t)&uart_dma.rx_desc[(i + 1) % UART_DMA_RX_DESC_COUNT];
+    }
+}
+
+static void simple_uart_dma_init(uint8_t uart_num) {
+    uart_dma.uart_num = uart_num;
+    uart_dma.rx_head = 0;
+    uart_dma.rx_tail = 0;
+    uart_dma.rx_offset = 0;
+    uart_dma.rx_stalled = false;
+    uart_dma.tx_length = 0;
+    uart_dma.tx_busy = false;
+
+    periph_module_enable(PERIPH_UHCI0_MODULE);
+    periph_module_reset(PERIPH_UHCI0_MODULE);
+
+    UHCI0.conf0.in_rst = 1;
+    UHCI0.conf0.in_rst = 0;
+    UHCI0.conf0.out_rst = 1;
+    UHCI0.conf0.out_rst = 0;
+
+    // transparent mode: no SLIP separators, no packet headers, no CRC
+    UHCI0.conf0.val = 0;
+    UHCI0.conf1.val = 0;
+    UHCI0.escape_conf.val = 0;
+    UHCI0.conf0.clk_en = 1;
+    UHCI0.conf0.uart_idle_eof_en = 1;
+    if(uart_num == UART_NUM_0) {
+        UHCI0.conf0.uart0_ce = 1;
+    } else {
+        UHCI0.conf0.uart1_ce = 1;
+    }
+
+    simple_uart_dma_rx_link();
+
+    UHCI0.int_clr.val = UINT32_MAX;
+    UHCI0.int_ena.val = UART_DMA_RX_INTR | UART_DMA_RX_STALL_INTR | UART_DMA_TX_INTR;
+    esp_intr_alloc(ETS_UHCI0_INTR_SOURCE, 0, simple_uart_dma_isr, &uart_dma, NULL);
+
+    simple_uart_dma_rx_start(&uart_dma.rx_desc[0]);
+}
+
+static uint32_t simple_uart_dma_read(uint8_t* data, const uint32_t data_size) {
+    uint32_t read = 0;
+
+    while(read < data_size && uart_dma.rx_tail != uart_dma.rx_head) {
+        lldesc_t* desc = &uart_dma.rx_desc[uart_dma.rx_tail % UART_DMA_RX_DESC_COUNT];
+        uint32_t chunk = MIN(desc->length - uart_dma.rx_offset, data_size - read);
+
+        memcpy(data + read, desc->buf + uart_dma.rx_offset, chunk);
+        read += chunk;
+        uart_dma.rx_offset += chunk;
+
+        if(uart_dma.rx_offset >= desc->length) {
+            // give the descriptor back to the DMA
+            desc->length = 0;
+            desc->eof = 0;
+            desc->owner = 1;
+            uart_dma.rx_offset = 0;
+            uart_dma.rx_tail++;
+        }
+    }
+
+    // the DMA ran into a descriptor we were holding, continue from it
+    portENTER_CRITICAL_SAFE(&uart_dma_mux);
+    if(uart_dma.rx_stalled && uart_dma.rx_head - uart_dma.rx_tail < UART_DMA_RX_DESC_COUNT) {
+        uart_dma.rx_stalled = false;
+        simple_uart_dma_rx_start(&uart_dma.rx_desc[uart_dma.rx_head % UART_DMA_RX_DESC_COUNT]);
+    }
+    portEXIT_CRITICAL_SAFE(&uart_dma_mux);
+
+    return read;
+}
+
+// must be called with tx_mux held
+static void simple_uart_dma_tx_start(uart_context_t* context) {
+    if(uart_dma.tx_busy || context->tx_tail == context->tx_head) return;
+
+    uint32_t end = context->tx_head > context->tx_tail ? context->tx_head : context->tx_size;
+    uint32_t length = MIN(end - context->tx_tail, UART_DMA_TX_MAX_LENGTH);
+
+    lldesc_t* desc = &uart_dma.tx_desc;
+    desc->size = length;
+    desc->length = length;
+    desc->offset = 0;
+    desc->sosf = 0;
+    desc->eof = 1;
+    desc->owner = 1;
+    desc->buf = &context->tx_buffer[context->tx_tail];
+    desc->empty = 0;
+
+    uart_dma.tx_length = length;
+    uart_dma.tx_busy = true;
+    UHCI0.dma_out_link.addr = (uint32_t)desc & 0xFFFFF;
+    UHCI0.dma_out_link.start = 1;
+}
+
+static void simple_uart_dma_isr(void* arg) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    uint32_t status = UHCI0.int_st.val;
+    if(status == 0) {
+        return;
+    }
+    UHCI0.int_clr.val = status;
+
+    if(status & UART_DMA_RX_INTR) {
+        uint32_t head = uart_dma.rx_head;
+        while(head - uart_dma.rx_tail < UART_DMA_RX_DESC_COUNT &&
+              uart_dma.rx_desc[head % UART_DMA_RX_DESC_COUNT].owner == 0) {
+            head++;
+        }
+        uart_dma.rx_head = head;
+
+        uint32_t pending = (head - uart_dma.rx_tail) * UART_DMA_RX_DESC_SIZE;
+        UartStats* stats = &uart_context[uart_dma.uart_num].stats;
+        stats->rx_high_water = MAX(stats->rx_high_water, pending);
+    }
+
+    if(status & UART_DMA_RX_STALL_INTR) {
+        if(!uart_dma.rx_stalled) {
+            uart_context[uart_dma.uart_num].stats.dma_stalls++;
+        }
+        uart_dma.rx_stalled = true;
+    }
+
+    if(status & UART_DMA_TX_INTR) {
+        uart_context_t* context = &uart_context[uart_dma.uart_num];
+
+        portENTER_CRITICAL_ISR(&context->tx_mux);
+        context->tx_tail = (context->tx_tail + uart_dma.tx_length) % context->tx_size;
+        uart_dma.tx_busy = false;
+        simple_uart_dma_tx_start(context);
+        portEXIT_CRITICAL_ISR(&context->tx_mux);
+
+        xSemaphoreGiveFromISR(context->tx_space, &xHigherPriorityTaskWoken);
+    }
+
+    if(status & (UART_DMA_RX_INTR | UART_DMA_RX_STALL_INTR)) {
+        uart_context_t* context = &uart_context[uart_dma.uart_num];
+        if(context->rx_isr) {
+            context->rx_isr(context->isr_context);
+        } else {
+            // purge rx ring
+            uint8_t data[16];
+            while(simple_uart_dma_read(data, sizeof(data)) > 0) {
+            }
+        }
+    }
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/***********************************************/
+
 void simple_uart_init(UartConfig* cfg) {
-    uart_context[cfg->uart_num].rx_isr = cfg->rx_isr;
-    uart_context[cfg->uart_num].isr_context = cfg->isr_context;
+    uart_context_t* context = &uart_context[cfg->uart_num];
+    bool dma = cfg->dma && uart_dma.uart_num == UART_DMA_NONE;
+
+    context->rx_isr = cfg->rx_isr;
+    context->isr_context = cfg->isr_context;
+
+    // the DMA reads the ring directly, so it must be in DMA capable memory
+    context->tx_size = cfg->tx_buffer_size > 0 ? cfg->tx_buffer_size : UART_TX_RING_DEFAULT_SIZE;
+    context->tx_buffer = heap_caps_malloc(
+        context->tx_size, dma ? MALLOC_CAP_DMA : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    context->tx_head = 0;
+    context->tx_tail = 0;
+    context->tx_space = xSemaphoreCreateBinaryStatic(&context->tx_space_struct);
 
     simple_uart_init_pins(cfg->uart_num, cfg->tx_pin_num, cfg->rx_pin_num);
     simple_uart_init_module(cfg->uart_num);
 
-    uart_hal_set_sclk(UART_HAL(cfg->uart_num), UART_SCLK_APB);
-    uart_hal_set_rxfifo_full_thr(UART_HAL(cfg->uart_num), UART_RX_FIFO_THRESH);
     uart_hal_set_txfifo_empty_thr(UART_HAL(cfg->uart_num), UART_TX_FIFO_THRESH);
     uart_hal_rxfifo_rst(UART_HAL(cfg->uart_num));
-    uart_hal_set_hw_flow_ctrl(UART_HAL(cfg->uart_num), UART_HW_FLOWCTRL_DISABLE, 0);
-    uart_hal_set_rx_timeout(UART_HAL(cfg->uart_num), 0x16);
+    uart_hw_flowcontrol_t flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    if(cfg->hw_flow_control) {
+        if(cfg->rts_pin_num >= 0) flow_ctrl |= UART_HW_FLOWCTRL_RTS;
+        if(cfg->cts_pin_num >= 0) flow_ctrl |= UART_HW_FLOWCTRL_CTS;
+        simple_uart_init_flow_pins(cfg->uart_num, cfg->rts_pin_num, cfg->cts_pin_num);
+    }
+    // RTS follows the RX FIFO level, in DMA mode it fills only when the DMA ring is full
+    uart_hal_set_hw_flow_ctrl(UART_HAL(cfg->uart_num), flow_ctrl, UART_RTS_THRESH);
 
     simple_uart_set_baud_rate(cfg->uart_num, cfg->baud_rate);
     simple_uart_set_stop_bits(cfg->uart_num, cfg->stop_bits);
@@ -122,31 +436,131 @@ void simple_uart_init(UartConfig* cfg) {
     uart_hal_clr_intsts_mask(UART_HAL(cfg->uart_num), UART_INTR_RS485_CLASH);
     uart_hal_clr_intsts_mask(UART_HAL(cfg->uart_num), UART_INTR_CMD_CHAR_DET);
 
+    // errors are counted in both modes, in DMA mode data itself goes through UHCI
+    uart_hal_ena_intr_mask(UART_HAL(cfg->uart_num), UART_ERROR_INTR);
+
+    if(dma) {
+        simple_uart_dma_init(cfg->uart_num);
+        return;
+    }
+
     // enable rx interrupts
     uart_hal_ena_intr_mask(UART_HAL(cfg->uart_num), UART_INTR_RXFIFO_FULL);
     uart_hal_ena_intr_mask(UART_HAL(cfg->uart_num), UART_INTR_RXFIFO_TOUT);
 }
 
-void simple_uart_write(uint8_t uart_num, const uint8_t* data, const uint32_t data_size) {
-    uint32_t to_write = data_size;
-    while(to_write > 0) {
-        while(uart_hal_get_txfifo_len(UART_HAL(uart_num)) == 0) {
-            ; /* Wait */
+void simple_uart_get_stats(uint8_t uart_num, UartStats* stats) {
+    uart_context_t* context = &uart_context[uart_num];
+
+    portENTER_CRITICAL_SAFE(&context->tx_mux);
+    *stats = context->stats;
+    portEXIT_CRITICAL_SAFE(&context->tx_mux);
+}
+
+uint32_t simple_uart_get_tx_free(uint8_t uart_num) {
+    uart_context_t* context = &uart_context[uart_num];
+    if(context->tx_buffer == NULL) return 0;
+
+    portENTER_CRITICAL_SAFE(&context->tx_mux);
+    uint32_t used = (context->tx_head + context->tx_size - context->tx_tail) % context->tx_size;
+    portEXIT_CRITICAL_SAFE(&context->tx_mux);
+
+    return context->tx_size - 1 - used;
+}
+
+uint32_t
+    simple_uart_write_nonblock(uint8_t uart_num, const uint8_t* data, const uint32_t data_size) {
+    uart_context_t* context = &uart_context[uart_num];
+    uint32_t written = 0;
+
+    if(context->tx_buffer == NULL) return 0;
+
+    portENTER_CRITICAL_SAFE(&context->tx_mux);
+    while(written < data_size) {
+        // contiguous free space after the head
+        uint32_t end;
+        if(context->tx_head >= context->tx_tail) {
+            end = context->tx_tail == 0 ? context->tx_size - 1 : context->tx_size;
+        } else {
+            end = context->tx_tail - 1;
         }
 
-        uint32_t write_size = 0;
-        uart_hal_write_txfifo(
-            UART_HAL(uart_num), data + (data_size - to_write), to_write, &write_size);
-        to_write -= write_size;
+        uint32_t chunk = MIN(end - context->tx_head, data_size - written);
+        if(chunk == 0) break;
+
+        memcpy(&context->tx_buffer[context->tx_head], data + written, chunk);
+        context->tx_head = (context->tx_head + chunk) % context->tx_size;
+        written += chunk;
     }
+
+    if(written > 0) {
+        uint32_t used = context->tx_head + context->tx_size - context->tx_tail;
+        used %= context->tx_size;
+        context->stats.tx_bytes += written;
+        context->stats.tx_high_water = MAX(context->stats.tx_high_water, used);
+
+        if(UART_USES_DMA(uart_num)) {
+            simple_uart_dma_tx_start(context);
+        } else {
+            uart_hal_ena_intr_mask(&context->hal, UART_INTR_TXFIFO_EMPTY);
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&context->tx_mux);
+
+    return written;
+}
+
+void simple_uart_wait_tx_space(uint8_t uart_num, TickType_t timeout) {
+    uart_context_t* context = &uart_context[uart_num];
+    if(context->tx_buffer == NULL) return;
+
+    xSemaphoreTake(context->tx_space, timeout);
+}
+
+void simple_uart_write(uint8_t uart_num, const uint8_t* data, const uint32_t data_size) {
+    uart_context_t* context = &uart_context[uart_num];
+    uint32_t written = 0;
+
+    if(context->tx_buffer == NULL) return;
+
+    while(true) {
+        written += simple_uart_write_nonblock(uart_num, data + written, data_size - written);
+        if(written >= data_size) break;
+
+        // sleep until the isr frees some space
+        xSemaphoreTake(context->tx_space, 1);
+    }
+}
+
+void simple_uart_set_rx_isr(uint8_t uart_num, uart_isr rx_isr, void* isr_context) {
+    portENTER_CRITICAL(&uart_isr_mux);
+    uart_context[uart_num].rx_isr = rx_isr;
+    uart_context[uart_num].isr_context = isr_context;
+    portEXIT_CRITICAL(&uart_isr_mux);
+}
+
+void simple_uart_set_rx_pin(uint8_t uart_num, int rx_pin_num) {
+    simple_uart_init_rx_pin(uart_num, rx_pin_num);
 }
 
 bool simple_uart_available(uint8_t uart_num) {
+    if(UART_USES_DMA(uart_num)) {
+        return uart_dma.rx_tail != uart_dma.rx_head;
+    }
+
     const int num_rx = uart_hal_get_rxfifo_len(UART_HAL(uart_num));
     return num_rx > 0;
 }
 
 uint32_t simple_uart_read(uint8_t uart_num, uint8_t* data, const uint32_t data_size) {
+    UartStats* stats = &uart_context[uart_num].stats;
+
+    if(UART_USES_DMA(uart_num)) {
+        uint32_t read = simple_uart_dma_read(data, data_size);
+        stats->rx_bytes += read;
+        return read;
+    }
+
     const int num_rx = uart_hal_get_rxfifo_len(UART_HAL(uart_num));
     int read = ((data_size) < (num_rx) ? (data_size) : (num_rx));
 
@@ -154,10 +568,37 @@ uint32_t simple_uart_read(uint8_t uart_num, uint8_t* data, const uint32_t data_s
         return 0;
     }
 
+    stats->rx_high_water = MAX(stats->rx_high_water, num_rx);
+
     uart_hal_read_rxfifo(UART_HAL(uart_num), data, &read);
+    stats->rx_bytes += read;
     return read;
 }
 
+static void simple_uart_tx_fifo_fill(uart_context_t* context) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&context->tx_mux);
+    while(context->tx_tail != context->tx_head) {
+        uint32_t end = context->tx_head > context->tx_tail ? context->tx_head : context->tx_size;
+        const uint8_t* data = &context->tx_buffer[context->tx_tail];
+        uint32_t written = 0;
+
+        uart_hal_write_txfifo(&context->hal, data, end - context->tx_tail, &written);
+        if(written == 0) break;
+
+        context->tx_tail = (context->tx_tail + written) % context->tx_size;
+    }
+
+    if(context->tx_tail == context->tx_head) {
+        uart_hal_disable_intr_mask(&context->hal, UART_INTR_TXFIFO_EMPTY);
+    }
+    portEXIT_CRITICAL_ISR(&context->tx_mux);
+
+    xSemaphoreGiveFromISR(context->tx_space, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
 static void simple_uart_isr(void* arg) {
     uart_context_t* context = arg;
     uart_hal_context_t* hal_context = &context->hal;
@@ -169,7 +610,19 @@ static void simple_uart_isr(void* arg) {
     }
     uart_hal_clr_intsts_mask(hal_context, uart_intr_status);
 
+    if(uart_intr_status & UART_ERROR_INTR) {
+        if(uart_intr_status & UART_INTR_RXFIFO_OVF) {
+            context->stats.fifo_overflows++;
+            // the fifo is stuck in overflow state until it is reset
+            if(!UART_USES_DMA(hal_num)) uart_hal_rxfifo_rst(hal_context);
+        }
+        if(uart_intr_status & UART_INTR_FRAM_ERR) context->stats.frame_errors++;
+        if(uart_intr_status & UART_INTR_PARITY_ERR) context->stats.parity_errors++;
+        if(uart_intr_status & UART_INTR_BRK_DET) context->stats.breaks++;
+    }
+
     if(uart_intr_status & UART_INTR_TXFIFO_EMPTY) {
+        simple_uart_tx_fifo_fill(context);
     }
     if((uart_intr_status & UART_INTR_RXFIFO_TOUT) || (uart_intr_status & UART_INTR_RXFIFO_FULL)) {
         if(context->rx_isr) {
@@ -184,9 +637,40 @@ static void simple_uart_isr(void* arg) {
     }
 }
 
-void simple_uart_set_baud_rate(uint8_t uart_num, uint32_t baud_rate) {
+uint32_t simple_uart_calc_baud_rate(uint32_t baud_rate) {
+    if(baud_rate < UART_BAUD_RATE_MIN || baud_rate > UART_BAUD_RATE_MAX) {
+        return 0;
+    }
+
+    const UartBaudProfile* profile = simple_uart_get_baud_profile(baud_rate);
+    uint32_t sclk_freq = profile->sclk == UART_SCLK_REF_TICK ? REF_CLK_FREQ : APB_CLK_FREQ;
+
+    // integer divider with 4 bit fraction, same as the hardware
+    uint32_t divider = (sclk_freq << 4) / baud_rate;
+    return (sclk_freq << 4) / divider;
+}
+
+bool simple_uart_set_baud_rate(uint8_t uart_num, uint32_t baud_rate) {
+    uint32_t actual_baud_rate = simple_uart_calc_baud_rate(baud_rate);
+    if(actual_baud_rate == 0) {
+        return false;
+    }
+
+    const UartBaudProfile* profile = simple_uart_get_baud_profile(baud_rate);
+    uart_hal_context_t* hal = UART_HAL(uart_num);
+
     uart_config[uart_num].baud_rate = baud_rate;
-    uart_hal_set_baudrate(UART_HAL(uart_num), baud_rate);
+    uart_config[uart_num].actual_baud_rate = actual_baud_rate;
+
+    uart_hal_set_sclk(hal, profile->sclk);
+    uart_hal_set_baudrate(hal, baud_rate);
+    uart_hal_set_rxfifo_full_thr(hal, profile->rx_full_thresh);
+    uart_hal_set_rx_timeout(hal, profile->rx_timeout);
+    hal->dev->idle_conf.rx_idle_thrhd = profile->rx_idle_thresh;
+
+    uint32_t error = actual_baud_rate > baud_rate ? actual_baud_rate - baud_rate :
+                                                    baud_rate - actual_baud_rate;
+    return (uint64_t)error * 1000 <= (uint64_t)baud_rate * UART_BAUD_RATE_TOLERANCE;
 }
 
 void simple_uart_set_stop_bits(uint8_t uart_num, uart_stop_bits_t stop_bits) {
@@ -208,6 +692,10 @@ uint32_t simple_uart_get_baud_rate(uint8_t uart_num) {
     return uart_config[uart_num].baud_rate;
 }
 
+uint32_t simple_uart_get_actual_baud_rate(uint8_t uart_num) {
+    return uart_config[uart_num].actual_baud_rate;
+}
+
 uart_stop_bits_t simple_uart_get_stop_bits(uint8_t uart_num) {
     return uart_config[uart_num].stop_bits;
 }
@@ -218,4 +706,44 @@ uart_parity_t simple_uart_get_parity(uint8_t uart_num) {
 
 uart_word_length_t simple_uart_get_data_bits(uint8_t uart_num) {
     return uart_config[uart_num].data_bits;
-}
\ No newline at end of file
+}
+
+/***********************************************/
+
+/*
+ * The hardware detector tracks the shortest low and high pulse on RX. Those are usually one
+ * bit long, the caller turns them into a rate and checks it. The counters run on the UART
+ * clock source, so the detector needs APB, REF_TICK is too coarse to time a bit.
+ */
+
+void simple_uart_autobaud_start(uint8_t uart_num) {
+    uart_hal_context_t* hal = UART_HAL(uart_num);
+
+    if(uart_config[uart_num].baud_rate != 0) {
+        uart_hal_set_sclk(hal, UART_SCLK_APB);
+        uart_hal_set_baudrate(hal, uart_config[uart_num].baud_rate);
+    }
+
+    // toggling the enable bit resets the counters
+    uart_ll_set_autobaud_en(hal->dev, false);
+    uart_ll_set_autobaud_en(hal->dev, true);
+}
+
+void simple_uart_autobaud_get(uint8_t uart_num, UartAutobaud* result) {
+    uart_hal_context_t* hal = UART_HAL(uart_num);
+    uint32_t low_pulse = uart_ll_get_low_pulse_cnt(hal->dev);
+    uint32_t high_pulse = uart_ll_get_high_pulse_cnt(hal->dev);
+
+    result->edges = uart_ll_get_rxd_edge_cnt(hal->dev);
+    result->low_pulse = low_pulse < UART_AUTOBAUD_PULSE_MAX ? low_pulse : 0;
+    result->high_pulse = high_pulse < UART_AUTOBAUD_PULSE_MAX ? high_pulse : 0;
+    result->clock = APB_CLK_FREQ;
+}
+
+void simple_uart_autobaud_stop(uint8_t uart_num) {
+    uart_ll_set_autobaud_en(UART_HAL(uart_num)->dev, false);
+
+    if(uart_config[uart_num].baud_rate != 0) {
+        simple_uart_set_baud_rate(uart_num, uart_config[uart_num].baud_rate);
+    }
+}
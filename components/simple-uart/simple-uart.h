@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <hal/uart_types.h>
 #include <soc/soc_caps.h>
+#include <freertos/FreeRTOS.h>
 
 #define UART_NUM_0 (0) /*!< UART port 0 */
 #define UART_NUM_1 (1) /*!< UART port 1 */
@@ -28,22 +29,94 @@ typedef struct {
     int rx_pin_num; /*!< UART rx pin*/
     void* isr_context; /*!< UART isr context*/
     uart_isr rx_isr; /*!< UART isr callback*/
+    bool dma; /*!< Use UHCI DMA for rx and tx, only one UART can have it*/
+    uint32_t tx_buffer_size; /*!< TX ring size, 0 for default*/
+    bool hw_flow_control; /*!< RTS/CTS flow control, pins below are used only if set*/
+    int rts_pin_num; /*!< UART rts pin, -1 if not used*/
+    int cts_pin_num; /*!< UART cts pin, -1 if not used*/
 } UartConfig;
 
+typedef struct {
+    uint32_t rx_bytes; /*!< bytes handed to the rx consumer*/
+    uint32_t tx_bytes; /*!< bytes accepted to the TX ring*/
+    uint32_t fifo_overflows; /*!< hardware RX FIFO overflows, data was lost*/
+    uint32_t frame_errors;
+    uint32_t parity_errors;
+    uint32_t breaks;
+    uint32_t dma_stalls; /*!< DMA ran out of RX descriptors*/
+    uint32_t rx_high_water; /*!< max bytes waiting in the RX FIFO or DMA ring*/
+    uint32_t tx_high_water; /*!< max bytes waiting in the TX ring*/
+} UartStats;
+
+typedef struct {
+    uint32_t edges; /*!< RX edges seen since the detection started*/
+    uint32_t low_pulse; /*!< shortest low pulse in clock cycles, 0 if none fits the counter*/
+    uint32_t high_pulse; /*!< shortest high pulse in clock cycles, 0 if none fits the counter*/
+    uint32_t clock; /*!< pulse counter clock, Hz*/
+} UartAutobaud;
+
 /**
  * Init UART driver
+ * In DMA mode the rx isr callback is only a notification, it is called when rx data is
+ * ready (line idle or buffer full), the data is fetched with simple_uart_read()
  * @param config 
  */
 void simple_uart_init(UartConfig* config);
 
 /**
- * Write data to UART
+ * Write data to UART, sleeps until all data is queued in the TX ring
  * @param uart_num 
  * @param data 
  * @param data_size 
  */
 void simple_uart_write(uint8_t uart_num, const uint8_t* data, const uint32_t data_size);
 
+/**
+ * Queue data to the TX ring without blocking
+ * @param uart_num 
+ * @param data 
+ * @param data_size 
+ * @return uint32_t number of bytes accepted, the caller must hold the rest back
+ */
+uint32_t
+    simple_uart_write_nonblock(uint8_t uart_num, const uint8_t* data, const uint32_t data_size);
+
+/**
+ * Wait until the TX ring is drained a bit, or timeout
+ * @param uart_num 
+ * @param timeout 
+ */
+void simple_uart_wait_tx_space(uint8_t uart_num, TickType_t timeout);
+
+/**
+ * Get free space in the TX ring
+ * @param uart_num 
+ * @return uint32_t 
+ */
+uint32_t simple_uart_get_tx_free(uint8_t uart_num);
+
+/**
+ * Get UART counters
+ * @param uart_num 
+ * @param stats 
+ */
+void simple_uart_get_stats(uint8_t uart_num, UartStats* stats);
+
+/**
+ * Replace the rx isr callback, passing NULL detaches the consumer and the rx fifo is purged
+ * @param uart_num 
+ * @param rx_isr 
+ * @param isr_context 
+ */
+void simple_uart_set_rx_isr(uint8_t uart_num, uart_isr rx_isr, void* isr_context);
+
+/**
+ * Route UART rx signal to another pin
+ * @param uart_num 
+ * @param rx_pin_num 
+ */
+void simple_uart_set_rx_pin(uint8_t uart_num, int rx_pin_num);
+
 /**
  * Check if rx data available
  * @param uart_num 
@@ -62,11 +135,20 @@ bool simple_uart_available(uint8_t uart_num);
 uint32_t simple_uart_read(uint8_t uart_num, uint8_t* data, const uint32_t data_size);
 
 /**
- * Set UART baud rate
+ * Set UART baud rate, also retunes clock source, RX FIFO threshold and timeouts
+ * Rates out of range are ignored
  * @param uart_num 
  * @param baud_rate 
+ * @return bool false if the rate is out of range or the divider cannot hit it within 2%
  */
-void simple_uart_set_baud_rate(uint8_t uart_num, uint32_t baud_rate);
+bool simple_uart_set_baud_rate(uint8_t uart_num, uint32_t baud_rate);
+
+/**
+ * Get the rate the UART would actually run at
+ * @param baud_rate 
+ * @return uint32_t 0 if the rate is out of range
+ */
+uint32_t simple_uart_calc_baud_rate(uint32_t baud_rate);
 
 /**
  * Set UART stop bits
@@ -97,6 +179,13 @@ void simple_uart_set_data_bits(uint8_t uart_num, uart_word_length_t data_bits);
  */
 uint32_t simple_uart_get_baud_rate(uint8_t uart_num);
 
+/**
+ * Get actual UART baud rate, after divider rounding
+ * @param uart_num 
+ * @return uint32_t 
+ */
+uint32_t simple_uart_get_actual_baud_rate(uint8_t uart_num);
+
 /**
  * @brief Get the UART stop bits
  * 
@@ -119,4 +208,24 @@ uart_parity_t simple_uart_get_parity(uint8_t uart_num);
  * @param uart_num 
  * @return uart_word_length_t 
  */
-uart_word_length_t simple_uart_get_data_bits(uint8_t uart_num);
\ No newline at end of file
+uart_word_length_t simple_uart_get_data_bits(uint8_t uart_num);
+
+/**
+ * Start measuring RX pulse widths with the hardware baud rate detector, restarts the counters
+ * Reception goes on at the current rate meanwhile
+ * @param uart_num 
+ */
+void simple_uart_autobaud_start(uint8_t uart_num);
+
+/**
+ * Get what the baud rate detector has seen so far
+ * @param uart_num 
+ * @param result 
+ */
+void simple_uart_autobaud_get(uint8_t uart_num, UartAutobaud* result);
+
+/**
+ * Stop the baud rate detector, restores the clock source of the current rate
+ * @param uart_num 
+ */
+void simple_uart_autobaud_stop(uint8_t uart_num);
@@ -0,0 +1,114 @@
+/**
+ * @file bench-spsc-ring.c
+ *
+ * Host benchmark for the SPSC ring. A producer thread streams data to a consumer thread in
+ * chunks of several sizes, once through the lock-free ring and once through the same ring
+ * guarded by a mutex on every call, which stands in for the critical section taken by
+ * each FreeRTOS stream buffer call. Numbers are relative, the host is not an ESP32-S2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spsc-ring.h>
+
+#define BENCH_RING_SIZE 4096
+#define BENCH_BYTES (64u * 1024 * 1024)
+#define BENCH_BYTE_BY_BYTE_BYTES (4u * 1024 * 1024)
+
+typedef struct {
+    SpscRing ring;
+    uint8_t storage[BENCH_RING_SIZE];
+    pthread_mutex_t lock;
+    bool locked;
+    size_t chunk;
+    size_t total;
+} BenchContext;
+
+static double bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static size_t bench_write(BenchContext* context, const uint8_t* data, size_t size) {
+    if(!context->locked) return spsc_ring_write(&context->ring, data, size);
+
+    pthread_mutex_lock(&context->lock);
+    size_t written = spsc_ring_write(&context->ring, data, size);
+    pthread_mutex_unlock(&context->lock);
+    return written;
+}
+
+static size_t bench_read(BenchContext* context, uint8_t* data, size_t size) {
+    if(!context->locked) return spsc_ring_read(&context->ring, data, size);
+
+    pthread_mutex_lock(&context->lock);
+    size_t read = spsc_ring_read(&context->ring, data, size);
+    pthread_mutex_unlock(&context->lock);
+    return read;
+}
+
+static void* bench_producer(void* arg) {
+    BenchContext* context = arg;
+    uint8_t chunk[BENCH_RING_SIZE];
+    size_t sent = 0;
+
+    memset(chunk, 0x55, sizeof(chunk));
+    while(sent < context->total) {
+        size_t size = context->chunk;
+        if(size > context->total - sent) size = context->total - sent;
+        size_t written = bench_write(context, chunk, size);
+        if(written == 0) sched_yield();
+        sent += written;
+    }
+
+    return NULL;
+}
+
+static void bench_run(BenchContext* context, size_t chunk, bool locked) {
+    uint8_t buffer[BENCH_RING_SIZE];
+    pthread_t producer;
+    size_t received = 0;
+
+    spsc_ring_init(&context->ring, context->storage, BENCH_RING_SIZE);
+    context->chunk = chunk;
+    context->locked = locked;
+    context->total = chunk == 1 ? BENCH_BYTE_BY_BYTE_BYTES : BENCH_BYTES;
+
+    double start = bench_now();
+    pthread_create(&producer, NULL, bench_producer, context);
+
+    // both sides poll, the benchmark measures the ring and not the wake-up latency
+    while(received < context->total) {
+        size_t read = bench_read(context, buffer, chunk);
+        if(read == 0) sched_yield();
+        received += read;
+    }
+
+    pthread_join(producer, NULL);
+    double elapsed = bench_now() - start;
+
+    printf(
+        "%-9s chunk %5zu: %8.1f MB/s, %7.1f ns per call\n",
+        locked ? "locked" : "lock-free",
+        chunk,
+        context->total / elapsed / 1e6,
+        elapsed * 1e9 / ((double)context->total / chunk));
+}
+
+int main(void) {
+    static BenchContext context;
+    const size_t chunks[] = {1, 16, 64, 512, 4096};
+
+    pthread_mutex_init(&context.lock, NULL);
+
+    for(size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        bench_run(&context, chunks[i], false);
+        bench_run(&context, chunks[i], true);
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+struct ShimTask {
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+};
+
+static _Thread_local struct ShimTask* shim_current_task = NULL;
+
+static uint64_t shim_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if(shim_current_task == NULL) {
+        // never freed, threads of the tests live as long as the process
+        struct ShimTask* task = calloc(1, sizeof(struct ShimTask));
+        assert(task != NULL);
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&task->notified, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_init(&task->lock, NULL);
+
+        shim_current_task = task;
+    }
+
+    return shim_current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdTRUE;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* task_woken) {
+    xTaskNotifyGive(task);
+    if(task_woken != NULL) {
+        *task_woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+    struct ShimTask* task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&task->lock);
+    while(task->notify_value == 0 && timeout != 0) {
+        int ret;
+        if(timeout == portMAX_DELAY) {
+            ret = pthread_cond_wait(&task->notified, &task->lock);
+        } else {
+            ret = pthread_cond_timedwait(&task->notified, &task->lock, &deadline);
+        }
+
+        if(ret == ETIMEDOUT) break;
+    }
+
+    uint32_t value = task->notify_value;
+    if(value > 0) {
+        task->notify_value = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+
+    return value;
+}
+
+void vTaskSetTimeOutState(TimeOut_t* time_out) {
+    time_out->start_ms = shim_now_ms();
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* time_out, TickType_t* remaining) {
+    if(*remaining == portMAX_DELAY) {
+        return pdFALSE;
+    }
+
+    uint64_t now = shim_now_ms();
+    uint64_t elapsed = now - time_out->start_ms;
+    if(elapsed >= *remaining) {
+        *remaining = 0;
+        return pdTRUE;
+    }
+
+    *remaining -= (TickType_t)elapsed;
+    time_out->start_ms = now;
+    return pdFALSE;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file FreeRTOS.h
+ *
+ * Host shim, just enough of FreeRTOS for the SPSC ring: ticks are milliseconds,
+ * tasks are pthreads and task notifications are a counter behind a condition variable.
+ */
+#pragma once
+#include <stdint.h>
+#include <assert.h>
+
+typedef long BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define configASSERT(x) assert(x)
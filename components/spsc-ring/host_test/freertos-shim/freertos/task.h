@@ -0,0 +1,29 @@
+/**
+ * @file task.h
+ *
+ * Host shim, see FreeRTOS.h
+ */
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct ShimTask* TaskHandle_t;
+
+typedef struct {
+    uint64_t start_ms;
+} TimeOut_t;
+
+/**
+ * Get the calling thread task, created on first use
+ * @return TaskHandle_t
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* task_woken);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+
+void vTaskSetTimeOutState(TimeOut_t* time_out);
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* time_out, TickType_t* remaining);
@@ -0,0 +1,296 @@
+/**
+ * @file test-spsc-ring.c
+ *
+ * Host unit tests for the SPSC ring, exits with a non-zero code on the first failure
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <spsc-ring.h>
+
+#define CHECK(x)                                                                 \
+    do {                                                                         \
+        if(!(x)) {                                                               \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, \
+                    __func__, #x);                                               \
+            exit(1);                                                             \
+        }                                                                        \
+    } while(0)
+
+#define RING_SIZE 8
+
+static void test_empty(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t data[RING_SIZE];
+    const uint8_t* peek;
+    SpscRing ring;
+
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    CHECK(spsc_ring_available(&ring) == 0);
+    CHECK(spsc_ring_free(&ring) == RING_SIZE);
+    CHECK(spsc_ring_peek(&ring, &peek) == 0);
+    CHECK(spsc_ring_read(&ring, data, sizeof(data)) == 0);
+    CHECK(spsc_ring_receive(&ring, data, sizeof(data), 0) == 0);
+}
+
+static void test_full(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t data[RING_SIZE + 4] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    uint8_t* reserve;
+    SpscRing ring;
+
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    CHECK(spsc_ring_write(&ring, data, sizeof(data)) == RING_SIZE);
+    CHECK(spsc_ring_available(&ring) == RING_SIZE);
+    CHECK(spsc_ring_free(&ring) == 0);
+    CHECK(spsc_ring_write(&ring, data, 1) == 0);
+    CHECK(spsc_ring_reserve(&ring, &reserve) == 0);
+
+    uint8_t out[RING_SIZE];
+    CHECK(spsc_ring_read(&ring, out, 1) == 1);
+    CHECK(out[0] == 1);
+    CHECK(spsc_ring_free(&ring) == 1);
+    CHECK(spsc_ring_read(&ring, out, sizeof(out)) == RING_SIZE - 1);
+    CHECK(memcmp(out, data + 1, RING_SIZE - 1) == 0);
+    CHECK(spsc_ring_available(&ring) == 0);
+}
+
+static void test_wrap_around(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t in[6] = {10, 11, 12, 13, 14, 15};
+    uint8_t out[6];
+    const uint8_t* peek;
+    SpscRing ring;
+
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    CHECK(spsc_ring_write(&ring, in, 6) == 6);
+    CHECK(spsc_ring_read(&ring, out, 6) == 6);
+
+    // second write starts at index 6 and wraps after two bytes
+    CHECK(spsc_ring_write(&ring, in, 6) == 6);
+    CHECK(spsc_ring_peek(&ring, &peek) == 2);
+    CHECK(peek == &storage[6]);
+    CHECK(peek[0] == 10 && peek[1] == 11);
+    spsc_ring_consume(&ring, 2);
+    CHECK(spsc_ring_peek(&ring, &peek) == 4);
+    CHECK(peek == &storage[0]);
+    CHECK(memcmp(peek, in + 2, 4) == 0);
+    spsc_ring_consume(&ring, 4);
+    CHECK(spsc_ring_available(&ring) == 0);
+
+    // a copying read crosses the wrap in one call
+    CHECK(spsc_ring_write(&ring, in, 6) == 6);
+    CHECK(spsc_ring_read(&ring, out, 6) == 6);
+    CHECK(memcmp(out, in, 6) == 0);
+}
+
+static void test_reserve_commit_split(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t out[RING_SIZE];
+    uint8_t* reserve;
+    SpscRing ring;
+
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    spsc_ring_commit(&ring, 6);
+    CHECK(spsc_ring_read(&ring, out, 6) == 6);
+
+    // the whole ring is free, but only two bytes are contiguous before the end
+    CHECK(spsc_ring_free(&ring) == RING_SIZE);
+    CHECK(spsc_ring_reserve(&ring, &reserve) == 2);
+    CHECK(reserve == &storage[6]);
+    reserve[0] = 'a';
+    reserve[1] = 'b';
+    spsc_ring_commit(&ring, 2);
+
+    CHECK(spsc_ring_reserve(&ring, &reserve) == 6);
+    CHECK(reserve == &storage[0]);
+    memcpy(reserve, "cdef", 4);
+    spsc_ring_commit(&ring, 4);
+
+    // a partial commit leaves the rest reserved for the next call
+    CHECK(spsc_ring_reserve(&ring, &reserve) == 2);
+    CHECK(reserve == &storage[4]);
+
+    CHECK(spsc_ring_read(&ring, out, sizeof(out)) == 6);
+    CHECK(memcmp(out, "abcdef", 6) == 0);
+}
+
+static void test_counter_overflow(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t in[5] = {1, 2, 3, 4, 5};
+    uint8_t out[5];
+    SpscRing ring;
+
+    // free running counters wrap around SIZE_MAX
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    ring.head = ring.tail = SIZE_MAX - 2;
+
+    CHECK(spsc_ring_write(&ring, in, 5) == 5);
+    CHECK(ring.head == 2);
+    CHECK(spsc_ring_available(&ring) == 5);
+    CHECK(spsc_ring_free(&ring) == RING_SIZE - 5);
+    CHECK(spsc_ring_read(&ring, out, 5) == 5);
+    CHECK(memcmp(out, in, 5) == 0);
+    CHECK(spsc_ring_available(&ring) == 0);
+}
+
+static void test_reset(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t in[5] = {1, 2, 3, 4, 5};
+    uint8_t out[5];
+    SpscRing ring;
+
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    CHECK(spsc_ring_write(&ring, in, 5) == 5);
+    spsc_ring_reset(&ring);
+    CHECK(spsc_ring_available(&ring) == 0);
+    CHECK(spsc_ring_free(&ring) == RING_SIZE);
+    CHECK(spsc_ring_write(&ring, in, 3) == 3);
+    CHECK(spsc_ring_read(&ring, out, 5) == 3);
+    CHECK(memcmp(out, in, 3) == 0);
+}
+
+static void test_threshold_notification(void) {
+    uint8_t storage[RING_SIZE];
+    uint8_t in[RING_SIZE] = {0};
+    uint8_t out[RING_SIZE];
+    SpscRing ring;
+
+    spsc_ring_init(&ring, storage, RING_SIZE);
+    spsc_ring_set_threshold(&ring, 4);
+
+    // nothing is notified until a consumer has waited once
+    CHECK(spsc_ring_write(&ring, in, 4) == 4);
+    CHECK(ulTaskNotifyTake(pdTRUE, 0) == 0);
+    CHECK(spsc_ring_wait(&ring, 0));
+    CHECK(spsc_ring_read(&ring, out, sizeof(out)) == 4);
+
+    // below the threshold the consumer keeps sleeping
+    CHECK(spsc_ring_write(&ring, in, 2) == 2);
+    CHECK(ulTaskNotifyTake(pdTRUE, 0) == 0);
+    CHECK(spsc_ring_write(&ring, in, 1) == 1);
+    CHECK(ulTaskNotifyTake(pdTRUE, 0) == 0);
+
+    // one notification when the threshold is crossed, none above it
+    CHECK(spsc_ring_write(&ring, in, 1) == 1);
+    CHECK(ulTaskNotifyTake(pdTRUE, 0) == 1);
+    CHECK(spsc_ring_write(&ring, in, 2) == 2);
+    CHECK(ulTaskNotifyTake(pdTRUE, 0) == 0);
+
+    // crossing from below in one big commit counts once too
+    CHECK(spsc_ring_read(&ring, out, sizeof(out)) == 6);
+    BaseType_t task_woken = pdFALSE;
+    CHECK(spsc_ring_write_from_isr(&ring, in, 6, &task_woken) == 6);
+    CHECK(task_woken == pdTRUE);
+    CHECK(ulTaskNotifyTake(pdTRUE, 0) == 1);
+
+    // wait returns on timeout with partial data below the threshold
+    CHECK(spsc_ring_read(&ring, out, sizeof(out)) == 6);
+    CHECK(spsc_ring_write(&ring, in, 1) == 1);
+    CHECK(spsc_ring_wait(&ring, 5));
+    CHECK(spsc_ring_available(&ring) == 1);
+}
+
+#define STRESS_RING_SIZE 512
+#define STRESS_BYTES (64u * 1024 * 1024)
+#define STRESS_TIMEOUT_MS 2000
+
+typedef struct {
+    SpscRing ring;
+    uint8_t storage[STRESS_RING_SIZE];
+} StressContext;
+
+static uint32_t stress_random(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void* stress_producer(void* arg) {
+    StressContext* context = arg;
+    uint32_t random = 0x12345678;
+    uint8_t chunk[STRESS_RING_SIZE];
+    size_t sent = 0;
+
+    while(sent < STRESS_BYTES) {
+        size_t size = 1 + stress_random(&random) % sizeof(chunk);
+        if(size > STRESS_BYTES - sent) size = STRESS_BYTES - sent;
+
+        if(stress_random(&random) & 1) {
+            for(size_t i = 0; i < size; i++) {
+                chunk[i] = (uint8_t)(sent + i);
+            }
+            sent += spsc_ring_write(&context->ring, chunk, size);
+        } else {
+            uint8_t* data;
+            size_t reserved = spsc_ring_reserve(&context->ring, &data);
+            if(size > reserved) size = reserved;
+            for(size_t i = 0; i < size; i++) {
+                data[i] = (uint8_t)(sent + i);
+            }
+            spsc_ring_commit(&context->ring, size);
+            sent += size;
+        }
+    }
+
+    return NULL;
+}
+
+static void test_stress(void) {
+    static StressContext context;
+    pthread_t producer;
+    uint32_t random = 0x9abcdef0;
+    uint8_t chunk[STRESS_RING_SIZE];
+    size_t received = 0;
+
+    spsc_ring_init(&context.ring, context.storage, STRESS_RING_SIZE);
+    spsc_ring_set_threshold(&context.ring, 64);
+    CHECK(pthread_create(&producer, NULL, stress_producer, &context) == 0);
+
+    while(received < STRESS_BYTES) {
+        // the producer never stops before the end, so a timeout here is a lost wake-up
+        spsc_ring_wait(&context.ring, STRESS_TIMEOUT_MS);
+        CHECK(spsc_ring_available(&context.ring) >= context.ring.threshold);
+
+        if(stress_random(&random) & 1) {
+            size_t size = spsc_ring_read(&context.ring, chunk, sizeof(chunk));
+            for(size_t i = 0; i < size; i++) {
+                CHECK(chunk[i] == (uint8_t)(received + i));
+            }
+            received += size;
+        } else {
+            const uint8_t* data;
+            size_t size = spsc_ring_peek(&context.ring, &data);
+            for(size_t i = 0; i < size; i++) {
+                CHECK(data[i] == (uint8_t)(received + i));
+            }
+            spsc_ring_consume(&context.ring, size);
+            received += size;
+        }
+
+        // the producer stays below the threshold at the tail of the stream
+        if(STRESS_BYTES - received < 64) {
+            spsc_ring_set_threshold(&context.ring, 1);
+        }
+    }
+
+    pthread_join(producer, NULL);
+    CHECK(received == STRESS_BYTES);
+    CHECK(spsc_ring_available(&context.ring) == 0);
+}
+
+int main(void) {
+    test_empty();
+    test_full();
+    test_wrap_around();
+    test_reserve_commit_split();
+    test_counter_overflow();
+    test_reset();
+    test_threshold_notification();
+    test_stress();
+
+    printf("spsc-ring: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <string.h>
+#include <sys/param.h>
+#include "spsc-ring.h"
+
+/*
+ * Head and tail are free running counters, the index is counter & (size - 1).
+ * Each side writes only its own counter, so no lock is needed. Counters are published
+ * with sequentially consistent atomics, so that a producer that commits and a consumer
+ * that goes to sleep cannot both miss each other's update.
+ */
+
+#define RING_LOAD(x) __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define RING_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+void spsc_ring_init(SpscRing* ring, uint8_t* storage, size_t size) {
+    configASSERT(size > 0 && (size & (size - 1)) == 0);
+
+    ring->buffer = storage;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->threshold = 1;
+    ring->consumer = NULL;
+}
+
+void spsc_ring_set_threshold(SpscRing* ring, size_t threshold) {
+    ring->threshold = MAX(threshold, 1);
+}
+
+size_t spsc_ring_available(SpscRing* ring) {
+    return RING_LOAD(ring->head) - RING_LOAD(ring->tail);
+}
+
+size_t spsc_ring_free(SpscRing* ring) {
+    return ring->size - spsc_ring_available(ring);
+}
+
+void spsc_ring_reset(SpscRing* ring) {
+    RING_STORE(ring->tail, RING_LOAD(ring->head));
+}
+
+/***** Producer *****/
+
+size_t spsc_ring_reserve(SpscRing* ring, uint8_t** data) {
+    size_t head = ring->head;
+    size_t free = ring->size - (head - RING_LOAD(ring->tail));
+    size_t index = head & (ring->size - 1);
+
+    *data = &ring->buffer[index];
+    return MIN(free, ring->size - index);
+}
+
+// returns the consumer to wake up, if any
+static TaskHandle_t spsc_ring_publish(SpscRing* ring, size_t size) {
+    if(size == 0) return NULL;
+
+    size_t head = ring->head + size;
+    RING_STORE(ring->head, head);
+
+    TaskHandle_t consumer = RING_LOAD(ring->consumer);
+    if(consumer == NULL) return NULL;
+
+    // wake up only when the threshold is crossed, not on every commit
+    size_t available = head - RING_LOAD(ring->tail);
+    if(available >= ring->threshold && available - size < ring->threshold) {
+        return consumer;
+    }
+
+    return NULL;
+}
+
+void spsc_ring_commit(SpscRing* ring, size_t size) {
+    TaskHandle_t consumer = spsc_ring_publish(ring, size);
+    if(consumer != NULL) {
+        xTaskNotifyGive(consumer);
+    }
+}
+
+void spsc_ring_commit_from_isr(SpscRing* ring, size_t size, BaseType_t* task_woken) {
+    TaskHandle_t consumer = spsc_ring_publish(ring, size);
+    if(consumer != NULL) {
+        vTaskNotifyGiveFromISR(consumer, task_woken);
+    }
+}
+
+static size_t spsc_ring_copy_in(SpscRing* ring, const uint8_t* data, size_t size) {
+    size_t written = 0;
+    size_t head = ring->head;
+    size_t free = ring->size - (head - RING_LOAD(ring->tail));
+    size = MIN(size, free);
+
+    // at most two chunks, before and after the wrap
+    while(written < size) {
+        size_t index = (head + written) & (ring->size - 1);
+        size_t chunk = MIN(size - written, ring->size - index);
+        memcpy(&ring->buffer[index], data + written, chunk);
+        written += chunk;
+    }
+
+    return written;
+}
+
+size_t spsc_ring_write(SpscRing* ring, const uint8_t* data, size_t size) {
+    size_t written = spsc_ring_copy_in(ring, data, size);
+    spsc_ring_commit(ring, written);
+    return written;
+}
+
+size_t spsc_ring_write_from_isr(
+    SpscRing* ring,
+    const uint8_t* data,
+    size_t size,
+    BaseType_t* task_woken) {
+    size_t written = spsc_ring_copy_in(ring, data, size);
+    spsc_ring_commit_from_isr(ring, written, task_woken);
+    return written;
+}
+
+/***** Consumer *****/
+
+size_t spsc_ring_peek(SpscRing* ring, const uint8_t** data) {
+    size_t tail = ring->tail;
+    size_t available = RING_LOAD(ring->head) - tail;
+    size_t index = tail & (ring->size - 1);
+
+    *data = &ring->buffer[index];
+    return MIN(available, ring->size - index);
+}
+
+void spsc_ring_consume(SpscRing* ring, size_t size) {
+    RING_STORE(ring->tail, ring->tail + size);
+}
+
+size_t spsc_ring_read(SpscRing* ring, uint8_t* data, size_t size) {
+    size_t read = 0;
+
+    while(read < size) {
+        const uint8_t* chunk_data;
+        size_t chunk = MIN(spsc_ring_peek(ring, &chunk_data), size - read);
+        if(chunk == 0) break;
+
+        memcpy(data + read, chunk_data, chunk);
+        spsc_ring_consume(ring, chunk);
+        read += chunk;
+    }
+
+    return read;
+}
+
+bool spsc_ring_wait(SpscRing* ring, TickType_t timeout) {
+    TimeOut_t time_out;
+    vTaskSetTimeOutState(&time_out);
+
+    RING_STORE(ring->consumer, xTaskGetCurrentTaskHandle());
+
+    while(spsc_ring_available(ring) < ring->threshold) {
+        // notification may be a stale one, so check the ring again after it
+        if(xTaskCheckForTimeOut(&time_out, &timeout) == pdTRUE) break;
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+
+    return spsc_ring_available(ring) > 0;
+}
+
+size_t spsc_ring_receive(SpscRing* ring, uint8_t* data, size_t size, TickType_t timeout) {
+    if(!spsc_ring_wait(ring, timeout)) return 0;
+    return spsc_ring_read(ring, data, size);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file spsc-ring.h
+ *
+ * Lock-free single producer / single consumer byte ring.
+ * Producer and consumer may each be a task or an ISR, but there must be only one of each.
+ * Storage is provided by the caller, so it can live in internal RAM or in PSRAM.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+typedef struct {
+    uint8_t* buffer;
+    size_t size; /*!< power of two*/
+    size_t head; /*!< free running, written by the producer only*/
+    size_t tail; /*!< free running, written by the consumer only*/
+    size_t threshold; /*!< consumer is woken up when this many bytes are available*/
+    TaskHandle_t consumer; /*!< task waiting in spsc_ring_wait, uses its notification value*/
+} SpscRing;
+
+/**
+ * Init ring
+ * @param ring
+ * @param storage
+ * @param size must be a power of two
+ */
+void spsc_ring_init(SpscRing* ring, uint8_t* storage, size_t size);
+
+/**
+ * Set the amount of data that wakes up the consumer, 1 by default
+ * @param ring
+ * @param threshold
+ */
+void spsc_ring_set_threshold(SpscRing* ring, size_t threshold);
+
+/**
+ * Get the number of bytes that can be read
+ * @param ring
+ * @return size_t
+ */
+size_t spsc_ring_available(SpscRing* ring);
+
+/**
+ * Get the number of bytes that can be written
+ * @param ring
+ * @return size_t
+ */
+size_t spsc_ring_free(SpscRing* ring);
+
+/**
+ * Drop all data, consumer side
+ * @param ring
+ */
+void spsc_ring_reset(SpscRing* ring);
+
+/***** Producer *****/
+
+/**
+ * Get the contiguous free space at the head
+ * @param ring
+ * @param data pointer to write to
+ * @return size_t size of the region, 0 if the ring is full
+ */
+size_t spsc_ring_reserve(SpscRing* ring, uint8_t** data);
+
+/**
+ * Publish data written to the reserved region
+ * @param ring
+ * @param size
+ */
+void spsc_ring_commit(SpscRing* ring, size_t size);
+
+/**
+ * Publish data written to the reserved region, from ISR
+ * @param ring
+ * @param size
+ * @param task_woken
+ */
+void spsc_ring_commit_from_isr(SpscRing* ring, size_t size, BaseType_t* task_woken);
+
+/**
+ * Copy data to the ring
+ * @param ring
+ * @param data
+ * @param size
+ * @return size_t number of bytes written, the rest did not fit
+ */
+size_t spsc_ring_write(SpscRing* ring, const uint8_t* data, size_t size);
+
+/**
+ * Copy data to the ring, from ISR
+ * @param ring
+ * @param data
+ * @param size
+ * @param task_woken
+ * @return size_t number of bytes written, the rest did not fit
+ */
+size_t spsc_ring_write_from_isr(
+    SpscRing* ring,
+    const uint8_t* data,
+    size_t size,
+    BaseType_t* task_woken);
+
+/***** Consumer *****/
+
+/**
+ * Get the contiguous data at the tail without copying
+ * @param ring
+ * @param data pointer to read from
+ * @return size_t size of the region, 0 if the ring is empty
+ */
+size_t spsc_ring_peek(SpscRing* ring, const uint8_t** data);
+
+/**
+ * Release data returned by spsc_ring_peek
+ * @param ring
+ * @param size
+ */
+void spsc_ring_consume(SpscRing* ring, size_t size);
+
+/**
+ * Copy data out of the ring
+ * @param ring
+ * @param data
+ * @param size
+ * @return size_t number of bytes read
+ */
+size_t spsc_ring_read(SpscRing* ring, uint8_t* data, size_t size);
+
+/**
+ * Wait until the threshold is reached or timeout
+ * @param ring
+ * @param timeout
+ * @return true if there is any data
+ */
+bool spsc_ring_wait(SpscRing* ring, TickType_t timeout);
+
+/**
+ * Wait for data and copy it out of the ring
+ * @param ring
+ * @param data
+ * @param size
+ * @param timeout
+ * @return size_t number of bytes read
+ */
+size_t spsc_ring_receive(SpscRing* ring, uint8_t* data, size_t size, TickType_t timeout);
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+
+"""Write <name>.gz next to the build output for every given asset.
+
+The output is reproducible (no name, no time in the header) and is only rewritten when it
+changes, so an unchanged bundle does not relink the firmware.
+"""
+
+import io
+import os
+import sys
+import gzip
+
+
+def compress(data):
+    buffer = io.BytesIO()
+    with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=buffer, mtime=0) as f:
+        f.write(data)
+    return buffer.getvalue()
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: gzip_assets.py <output dir> <asset>...")
+
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+
+    for path in sys.argv[2:]:
+        with open(path, "rb") as f:
+            packed = compress(f.read())
+
+        out_path = os.path.join(out_dir, os.path.basename(path) + ".gz")
+        if os.path.exists(out_path):
+            with open(out_path, "rb") as f:
+                if f.read() == packed:
+                    continue
+
+        with open(out_path, "wb") as f:
+            f.write(packed)
+
+
+if __name__ == "__main__":
+    main()
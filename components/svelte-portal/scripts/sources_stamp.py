@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+
+"""Tie the committed bundle to the portal sources it was built from.
+
+"write" records a hash of every file under src/ in public/build/sources.sha256, it runs
+after every 'npm run build'. "check" fails when src/ no longer matches that record, so a
+firmware is never built with a bundle that is older than its sources.
+
+The record is in sha256sum format relative to src/. Line endings are normalized first, so
+a checkout that converts them still matches.
+"""
+
+import os
+import sys
+import hashlib
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+SOURCES = os.path.join(ROOT, "src")
+STAMP = os.path.join(ROOT, "public", "build", "sources.sha256")
+
+
+def sources_stamp():
+    paths = []
+    for directory, _, files in os.walk(SOURCES):
+        for name in files:
+            path = os.path.relpath(os.path.join(directory, name), SOURCES)
+            paths.append(path.replace(os.sep, "/"))
+
+    lines = []
+    for path in sorted(paths):
+        with open(os.path.join(SOURCES, path), "rb") as f:
+            data = f.read().replace(b"\r\n", b"\n")
+        lines.append("%s  %s\n" % (hashlib.sha256(data).hexdigest(), path))
+
+    return "".join(lines)
+
+
+def main():
+    if len(sys.argv) != 2 or sys.argv[1] not in ("write", "check"):
+        sys.exit("usage: sources_stamp.py <write|check>")
+
+    stamp = sources_stamp()
+
+    if sys.argv[1] == "write":
+        with open(STAMP, "w", newline="\n") as f:
+            f.write(stamp)
+        return
+
+    try:
+        with open(STAMP, "r") as f:
+            recorded = f.read()
+    except FileNotFoundError:
+        sys.exit("no %s, the bundle was built without it" % os.path.relpath(STAMP, ROOT))
+
+    if recorded != stamp:
+        sys.exit("the bundle in public/build was not built from the current src/")
+
+
+if __name__ == "__main__":
+    main()
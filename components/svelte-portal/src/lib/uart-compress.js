@@ -0,0 +1,63 @@
+// Decoder for uart-compress frames: u8 type, u16 payload size, u16 data size, payload.
+// Type 0 payload is raw data, type 1 is an LZ4 block.
+
+const TYPE_RAW = 0;
+const TYPE_LZ4 = 1;
+const HEADER_SIZE = 5;
+
+function lz4_length(src, index, length) {
+    if (length == 15) {
+        let byte;
+        do {
+            byte = src[index++];
+            length += byte;
+        } while (byte == 255);
+    }
+    return [index, length];
+}
+
+function lz4_decompress(src, size) {
+    const out = new Uint8Array(size);
+    let index = 0;
+    let out_index = 0;
+
+    while (index < src.length) {
+        const token = src[index++];
+
+        let length;
+        [index, length] = lz4_length(src, index, token >> 4);
+        out.set(src.subarray(index, index + length), out_index);
+        index += length;
+        out_index += length;
+        if (index >= src.length) {
+            break;
+        }
+
+        const offset = src[index] | (src[index + 1] << 8);
+        index += 2;
+        [index, length] = lz4_length(src, index, token & 15);
+
+        // byte by byte, the match may overlap the output
+        let match = out_index - offset;
+        for (let i = 0; i < length + 4; i++) {
+            out[out_index++] = out[match++];
+        }
+    }
+
+    return out;
+}
+
+export default function decodeFrame(frame) {
+    const type = frame[0];
+    const payload_size = frame[1] | (frame[2] << 8);
+    const size = frame[3] | (frame[4] << 8);
+    const payload = frame.subarray(HEADER_SIZE, HEADER_SIZE + payload_size);
+
+    if (type == TYPE_LZ4) {
+        return lz4_decompress(payload, size);
+    } else if (type == TYPE_RAW) {
+        return payload;
+    }
+
+    return new Uint8Array(0);
+}
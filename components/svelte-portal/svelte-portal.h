@@ -10,4 +10,15 @@ extern const uint8_t build_bundle_js_end[] asm("_binary_bundle_js_end");
 extern const uint8_t assets_ega8_otf_start[] asm("_binary_ega8_otf_start");
 extern const uint8_t assets_ega8_otf_end[] asm("_binary_ega8_otf_end");
 extern const uint8_t assets_favicon_ico_start[] asm("_binary_favicon_ico_start");
-extern const uint8_t assets_favicon_ico_end[] asm("_binary_favicon_ico_end");
\ No newline at end of file
+extern const uint8_t assets_favicon_ico_end[] asm("_binary_favicon_ico_end");
+
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+extern const uint8_t build_bundle_css_gz_start[] asm("_binary_bundle_css_gz_start");
+extern const uint8_t build_bundle_css_gz_end[] asm("_binary_bundle_css_gz_end");
+extern const uint8_t build_bundle_js_gz_start[] asm("_binary_bundle_js_gz_start");
+extern const uint8_t build_bundle_js_gz_end[] asm("_binary_bundle_js_gz_end");
+extern const uint8_t assets_ega8_otf_gz_start[] asm("_binary_ega8_otf_gz_start");
+extern const uint8_t assets_ega8_otf_gz_end[] asm("_binary_ega8_otf_gz_end");
+extern const uint8_t assets_favicon_ico_gz_start[] asm("_binary_favicon_ico_gz_start");
+extern const uint8_t assets_favicon_ico_gz_end[] asm("_binary_favicon_ico_gz_end");
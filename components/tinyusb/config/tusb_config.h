@@ -15,6 +15,7 @@
 
 #pragma once
 #include "sdkconfig.h"
+#include "esp_attr.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,9 +38,19 @@ extern "C" {
  * - CFG_TUSB_MEM SECTION : __attribute__ (( section(".usb_ram") ))
  * - CFG_TUSB_MEM_ALIGN   : __attribute__ ((aligned(4)))
  */
+// Class FIFOs and transfer buffers are large, keep them in PSRAM.
+// ESP32-S2 device controller copies packets with the CPU, so no DMA-capable memory is required.
+#ifndef CONFIG_ESPUSB_MEM_IN_PSRAM
+#define CONFIG_ESPUSB_MEM_IN_PSRAM 1
+#endif
+
 #ifndef CFG_TUSB_MEM_SECTION
+#if CONFIG_ESPUSB_MEM_IN_PSRAM && CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY
+#define CFG_TUSB_MEM_SECTION EXT_RAM_ATTR
+#else
 #define CFG_TUSB_MEM_SECTION
 #endif
+#endif
 
 #ifndef CFG_TUSB_MEM_ALIGN
 #define CFG_TUSB_MEM_ALIGN __attribute__((aligned(4)))
@@ -84,15 +95,20 @@ extern "C" {
 #endif
 
 #ifndef CONFIG_ESPUSB_CDC_RX_BUFSIZE
-#define CONFIG_ESPUSB_CDC_RX_BUFSIZE 64
+#define CONFIG_ESPUSB_CDC_RX_BUFSIZE (4 * 1024)
 #endif
 
 #ifndef CONFIG_ESPUSB_CDC_TX_BUFSIZE
-#define CONFIG_ESPUSB_CDC_TX_BUFSIZE 64
+#define CONFIG_ESPUSB_CDC_TX_BUFSIZE (16 * 1024)
+#endif
+
+// Bulk transfer size, several full-speed packets are queued per transfer
+#ifndef CONFIG_ESPUSB_CDC_EP_BUFSIZE
+#define CONFIG_ESPUSB_CDC_EP_BUFSIZE 512
 #endif
 
 #ifndef CONFIG_ESPUSB_MSC_BUFSIZE
-#define CONFIG_ESPUSB_MSC_BUFSIZE 512
+#define CONFIG_ESPUSB_MSC_BUFSIZE 4096
 #endif
 
 #ifndef CONFIG_ESPUSB_HID_BUFSIZE
@@ -123,18 +139,21 @@ extern "C" {
 // DEVICE CONFIGURATION
 //--------------------------------------------------------------------
 #define CFG_TUD_CDC 2
-#define CFG_TUD_MSC CONFIG_ESPUSB_MSC
+#define CFG_TUD_MSC 1
 #define CFG_TUD_HID CONFIG_ESPUSB_HID
 #define CFG_TUD_MIDI CONFIG_ESPUSB_MIDI
 #define CFG_TUD_VENDOR 1
+#define CFG_TUD_NCM 1
 #define CFG_TUD_CUSTOM_CLASS CONFIG_ESPUSB_CUSTOM_CLASS
 #define CFG_TUD_DFU_RT CONFIG_ESPUSB_DFU
 
 //--------------------------------------------------------------------
 // CDC FIFO CONFIGURATION
 //--------------------------------------------------------------------
+// NOTE: TinyUSB uses the same FIFO sizes for every CDC interface
 #define CFG_TUD_CDC_RX_BUFSIZE CONFIG_ESPUSB_CDC_RX_BUFSIZE
 #define CFG_TUD_CDC_TX_BUFSIZE CONFIG_ESPUSB_CDC_TX_BUFSIZE
+#define CFG_TUD_CDC_EP_BUFSIZE CONFIG_ESPUSB_CDC_EP_BUFSIZE
 
 //--------------------------------------------------------------------
 // MSC BUFFER CONFIGURATION
@@ -143,6 +162,7 @@ extern "C" {
 // defined callbacks.
 //--------------------------------------------------------------------
 #define CFG_TUD_MSC_BUFSIZE CONFIG_ESPUSB_MSC_BUFSIZE
+#define CFG_TUD_MSC_EP_BUFSIZE CONFIG_ESPUSB_MSC_BUFSIZE
 
 //--------------------------------------------------------------------
 // HID BUFFER CONFIGURATION
@@ -157,6 +177,11 @@ extern "C" {
 #define CFG_TUD_VENDOR_RX_BUFSIZE (CONFIG_ESPUSB_VENDOR_RX_BUFSIZE * 2)
 #define CFG_TUD_VENDOR_TX_BUFSIZE (CONFIG_ESPUSB_VENDOR_TX_BUFSIZE * 2)
 
+//--------------------------------------------------------------------
+// NETWORK CONFIGURATION
+//--------------------------------------------------------------------
+#define CFG_TUD_NET_MTU 1514
+
 //--------------------------------------------------------------------
 // MIDI FIFO CONFIGURATION
 //--------------------------------------------------------------------
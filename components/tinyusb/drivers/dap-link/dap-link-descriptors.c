@@ -61,7 +61,20 @@ enum {
     ITF_NUM_TOTAL,
 };
 
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN)
+// CMSIS-DAP v2 interface: command OUT, response IN and SWO trace IN endpoints
+#define TUD_DAP_VENDOR_DESC_LEN (9 + 7 + 7 + 7)
+
+#define TUD_DAP_VENDOR_DESCRIPTOR(_itfnum, _stridx, _epout, _epin, _epswo, _epsize) \
+    /* Interface */                                                                  \
+    9, TUSB_DESC_INTERFACE, _itfnum, 0, 3, TUSB_CLASS_VENDOR_SPECIFIC, 0x00, 0x00, _stridx,  \
+        /* Endpoint Out */                                                           \
+        7, TUSB_DESC_ENDPOINT, _epout, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,    \
+        /* Endpoint In */                                                            \
+        7, TUSB_DESC_ENDPOINT, _epin, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,     \
+        /* Endpoint SWO */                                                           \
+        7, TUSB_DESC_ENDPOINT, _epswo, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_DAP_VENDOR_DESC_LEN)
 
 #if CFG_TUSB_MCU == OPT_MCU_LPC175X_6X || CFG_TUSB_MCU == OPT_MCU_LPC177X_8X || \
     CFG_TUSB_MCU == OPT_MCU_LPC40XX
@@ -71,6 +84,7 @@ enum {
 #define EPNUM_CDC_OUT 2
 #define EPNUM_VENDOR_IN 5
 #define EPNUM_VENDOR_OUT 5
+#define EPNUM_VENDOR_SWO 8
 #elif CFG_TUSB_MCU == OPT_MCU_SAMG || CFG_TUSB_MCU == OPT_MCU_SAMX7X
 // SAMG & SAME70 don't support a same endpoint number with different direction IN and OUT
 //    e.g EP1 OUT & EP1 IN cannot exist together
@@ -78,11 +92,13 @@ enum {
 #define EPNUM_CDC_OUT 3
 #define EPNUM_VENDOR_IN 4
 #define EPNUM_VENDOR_OUT 5
+#define EPNUM_VENDOR_SWO 6
 #else
 #define EPNUM_CDC_IN 2
 #define EPNUM_CDC_OUT 2
 #define EPNUM_VENDOR_IN 3
 #define EPNUM_VENDOR_OUT 3
+#define EPNUM_VENDOR_SWO 4
 #endif
 
 uint8_t const dap_link_desc_configuration[] = {
@@ -105,12 +121,13 @@ uint8_t const dap_link_desc_configuration[] = {
         0x80 | EPNUM_CDC_IN,
         TUD_OPT_HIGH_SPEED ? 512 : 64),
 
-    // Interface number, string index, EP Out & IN address, EP size
-    TUD_VENDOR_DESCRIPTOR(
+    // Interface number, string index, EP Out, IN & SWO address, EP size
+    TUD_DAP_VENDOR_DESCRIPTOR(
         ITF_NUM_VENDOR,
         5,
         EPNUM_VENDOR_OUT,
         0x80 | EPNUM_VENDOR_IN,
+        0x80 | EPNUM_VENDOR_SWO,
         TUD_OPT_HIGH_SPEED ? 512 : 64),
 };
 
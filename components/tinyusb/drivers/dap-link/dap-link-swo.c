@@ -0,0 +1,118 @@
+#include <string.h>
+#include <tusb.h>
+#include <device/usbd_pvt.h>
+#include <class/vendor/vendor_device.h>
+#include "dap-link-swo.h"
+
+#define DAP_SWO_PACKET_SIZE 512
+#define DAP_COMMAND_ENDPOINTS_COUNT 2
+#define DAP_VENDOR_DESC_LEN \
+    (sizeof(tusb_desc_interface_t) + DAP_COMMAND_ENDPOINTS_COUNT * sizeof(tusb_desc_endpoint_t))
+
+typedef struct {
+    uint8_t ep_swo;
+    void (*send_complete)(void* context);
+    void* send_complete_context;
+
+    // stock vendor driver gets a copy of the interface without the SWO endpoint
+    uint8_t vendor_desc[DAP_VENDOR_DESC_LEN];
+    CFG_TUSB_MEM_ALIGN uint8_t ep_buf[DAP_SWO_PACKET_SIZE];
+} DapLinkSwo;
+
+CFG_TUSB_MEM_SECTION static DapLinkSwo dap_link_swo;
+
+static void dap_link_swo_init(void) {
+    dap_link_swo.ep_swo = 0;
+}
+
+static void dap_link_swo_reset(uint8_t rhport) {
+    (void)rhport;
+    dap_link_swo.ep_swo = 0;
+}
+
+static uint16_t
+    dap_link_swo_open(uint8_t rhport, tusb_desc_interface_t const* desc_itf, uint16_t max_len) {
+    const uint16_t vendor_len = sizeof(dap_link_swo.vendor_desc);
+    const uint16_t driver_len = vendor_len + sizeof(tusb_desc_endpoint_t);
+
+    TU_VERIFY(TUSB_CLASS_VENDOR_SPECIFIC == desc_itf->bInterfaceClass, 0);
+    TU_VERIFY(desc_itf->bNumEndpoints == DAP_COMMAND_ENDPOINTS_COUNT + 1, 0);
+    TU_VERIFY(max_len >= driver_len, 0);
+
+    memcpy(dap_link_swo.vendor_desc, desc_itf, vendor_len);
+    ((tusb_desc_interface_t*)dap_link_swo.vendor_desc)->bNumEndpoints =
+        DAP_COMMAND_ENDPOINTS_COUNT;
+    TU_VERIFY(
+        vendord_open(rhport, (tusb_desc_interface_t const*)dap_link_swo.vendor_desc, vendor_len) ==
+            vendor_len,
+        0);
+
+    tusb_desc_endpoint_t const* desc_ep =
+        (tusb_desc_endpoint_t const*)((uint8_t const*)desc_itf + vendor_len);
+    TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType, 0);
+    TU_ASSERT(TUSB_DIR_IN == tu_edpt_dir(desc_ep->bEndpointAddress), 0);
+    TU_ASSERT(usbd_edpt_open(rhport, desc_ep), 0);
+    dap_link_swo.ep_swo = desc_ep->bEndpointAddress;
+
+    return driver_len;
+}
+
+static bool dap_link_swo_control_xfer_cb(
+    uint8_t rhport,
+    uint8_t stage,
+    tusb_control_request_t const* request) {
+    return tud_vendor_control_xfer_cb(rhport, stage, request);
+}
+
+static bool dap_link_swo_xfer_cb(
+    uint8_t rhport,
+    uint8_t ep_addr,
+    xfer_result_t result,
+    uint32_t xferred_bytes) {
+    if(ep_addr != dap_link_swo.ep_swo) {
+        return vendord_xfer_cb(rhport, ep_addr, result, xferred_bytes);
+    }
+
+    if(dap_link_swo.send_complete) {
+        dap_link_swo.send_complete(dap_link_swo.send_complete_context);
+    }
+
+    return true;
+}
+
+usbd_class_driver_t const dap_link_swo_driver = {
+#if CFG_TUSB_DEBUG >= 2
+    .name = "DAP-SWO",
+#endif
+    .init = dap_link_swo_init,
+    .reset = dap_link_swo_reset,
+    .open = dap_link_swo_open,
+    .control_xfer_cb = dap_link_swo_control_xfer_cb,
+    .xfer_cb = dap_link_swo_xfer_cb,
+    .sof = NULL,
+};
+
+size_t dap_link_swo_send(const uint8_t* data, size_t size) {
+    const uint8_t rhport = 0;
+    const uint8_t ep_swo = dap_link_swo.ep_swo;
+
+    if(ep_swo == 0 || size == 0) return 0;
+
+    // claim the endpoint, we are not in the TinyUSB task
+    if(!usbd_edpt_claim(rhport, ep_swo)) return 0;
+
+    if(size > DAP_SWO_PACKET_SIZE) size = DAP_SWO_PACKET_SIZE;
+    memcpy(dap_link_swo.ep_buf, data, size);
+
+    if(!usbd_edpt_xfer(rhport, ep_swo, dap_link_swo.ep_buf, size)) {
+        usbd_edpt_release(rhport, ep_swo);
+        return 0;
+    }
+
+    return size;
+}
+
+void dap_link_swo_set_send_complete_callback(void (*callback)(void* context), void* context) {
+    dap_link_swo.send_complete = callback;
+    dap_link_swo.send_complete_context = context;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <tusb.h>
+#include <device/usbd_pvt.h>
+
+/**
+ * Class driver that owns the CMSIS-DAP v2 vendor interface.
+ * First two endpoints (commands) are served by the TinyUSB vendor driver,
+ * the third one is the SWO streaming trace endpoint.
+ */
+extern usbd_class_driver_t const dap_link_swo_driver;
+
+/**
+ * Queue data to the SWO endpoint
+ * @param data 
+ * @param size 
+ * @return size_t queued size, 0 if the endpoint is busy or not mounted
+ */
+size_t dap_link_swo_send(const uint8_t* data, size_t size);
+
+/**
+ * Set callback that will be called from the TinyUSB task when the SWO transfer is completed
+ * @param callback 
+ * @param context 
+ */
+void dap_link_swo_set_send_complete_callback(void (*callback)(void* context), void* context);
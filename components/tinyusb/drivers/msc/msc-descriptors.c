@@ -0,0 +1,124 @@
+#include <tusb.h>
+#include "tusb_config.h"
+#include "msc-descriptors.h"
+
+//--------------------------------------------------------------------+
+// Device Descriptors
+//--------------------------------------------------------------------+
+tusb_desc_device_t const msc_desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+
+    // Use Interface Association Descriptor (IAD) for CDC
+    // As required by USB Specs IAD's subclass must be common class (2) and protocol must be IAD (1)
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+
+    .idVendor = 0x303A, // USB_ESPRESSIF_VID,
+    .idProduct = 0x4004, // USB_TUSB_PID,
+    .bcdDevice = 0x0100,
+
+    .iManufacturer = 0x01,
+    .iProduct = 0x02,
+    .iSerialNumber = 0x03,
+
+    .bNumConfigurations = 0x01,
+};
+
+//--------------------------------------------------------------------+
+// Configuration Descriptor
+//--------------------------------------------------------------------+
+enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_DATA 0x02
+
+#define EPNUM_MSC_DATA 0x03
+
+uint8_t const msc_desc_configuration[] = {
+    // Config number, interface count, string index, total length, attribute, power in mA
+    TUD_CONFIG_DESCRIPTOR(
+        1,
+        ITF_NUM_TOTAL,
+        0,
+        CONFIG_TOTAL_LEN,
+        TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP,
+        100),
+
+    // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+    TUD_CDC_DESCRIPTOR(
+        ITF_NUM_CDC,
+        4,
+        EPNUM_CDC_NOTIF,
+        8,
+        EPNUM_CDC_DATA,
+        0x80 | EPNUM_CDC_DATA,
+        64),
+
+    // Interface number, string index, EP Out & EP In address, EP size
+    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 5, EPNUM_MSC_DATA, 0x80 | EPNUM_MSC_DATA, 64),
+};
+
+//--------------------------------------------------------------------+
+// String Descriptors
+//--------------------------------------------------------------------+
+
+// array of pointer to string descriptors
+static char* msc_string_desc[] = {
+    (char[]){0x09, 0x04}, // 0: is supported language is English (0x0409)
+    "Flipper Devices Inc.", // 1: Manufacturer
+    "Blackmagic ESP32", // 2: Product
+    "blackmagic", // 3: Serials, should use chip ID
+    "Blackmagic ESP32", // 4: CDC Interface
+    "Blackmagic Flasher", // 5: MSC Interface
+};
+
+void msc_set_serial_number(const char* serial_number) {
+    msc_string_desc[3] = malloc(strlen("blackmagic_") + strlen(serial_number) + 1);
+    strcpy(msc_string_desc[3], "blackmagic_");
+    strcat(msc_string_desc[3], serial_number);
+}
+
+#define MAX_DESC_BUF_SIZE 32
+static uint16_t _desc_str[MAX_DESC_BUF_SIZE];
+
+// Invoked when received GET STRING DESCRIPTOR request
+// Application return pointer to descriptor, whose contents must exist long enough for transfer to complete
+uint16_t const* msc_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+
+    uint8_t chr_count;
+
+    if(index == 0) {
+        memcpy(&_desc_str[1], msc_string_desc[0], 2);
+        chr_count = 1;
+    } else {
+        // Convert ASCII string into UTF-16
+
+        if(index >= sizeof(msc_string_desc) / sizeof(msc_string_desc[0])) {
+            return NULL;
+        }
+
+        const char* str = msc_string_desc[index];
+
+        // Cap at max char
+        chr_count = strlen(str);
+        if(chr_count > MAX_DESC_BUF_SIZE - 1) {
+            chr_count = MAX_DESC_BUF_SIZE - 1;
+        }
+
+        for(uint8_t i = 0; i < chr_count; i++) {
+            _desc_str[1 + i] = str[i];
+        }
+    }
+
+    // first byte is length (including header), second byte is string type
+    _desc_str[0] = (TUSB_DESC_STRING << 8) | (2 * chr_count + 2);
+
+    return _desc_str;
+}
@@ -0,0 +1,6 @@
+#include <tusb.h>
+
+extern tusb_desc_device_t const msc_desc_device;
+extern uint8_t const msc_desc_configuration[];
+uint16_t const* msc_descriptor_string_cb(uint8_t index, uint16_t langid);
+void msc_set_serial_number(const char* serial_number);
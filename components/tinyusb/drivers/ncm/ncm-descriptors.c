@@ -0,0 +1,172 @@
+#include <tusb.h>
+#include <class/net/net_device.h>
+#include "tusb_config.h"
+#include "ncm-descriptors.h"
+
+//--------------------------------------------------------------------+
+// Device Descriptors
+//--------------------------------------------------------------------+
+tusb_desc_device_t const ncm_desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+
+    // Use Interface Association Descriptor (IAD) for CDC
+    // As required by USB Specs IAD's subclass must be common class (2) and protocol must be IAD (1)
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+
+    .idVendor = 0x303A, // USB_ESPRESSIF_VID,
+    .idProduct = 0x4003, // USB_TUSB_PID,
+    .bcdDevice = 0x0100,
+
+    .iManufacturer = 0x01,
+    .iProduct = 0x02,
+    .iSerialNumber = 0x03,
+
+    .bNumConfigurations = 0x01,
+};
+
+//--------------------------------------------------------------------+
+// Configuration Descriptor
+//--------------------------------------------------------------------+
+enum { ITF_NUM_NCM = 0, ITF_NUM_NCM_DATA, ITF_NUM_CDC, ITF_NUM_CDC_DATA, ITF_NUM_TOTAL };
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_NCM_DESC_LEN + TUD_CDC_DESC_LEN)
+
+// ESP32-S2 has only 5 IN endpoints including EP0, NCM and CDC take all of them
+#define EPNUM_NCM_NOTIF 0x81
+#define EPNUM_NCM_DATA 0x02
+
+#define EPNUM_CDC_NOTIF 0x83
+#define EPNUM_CDC_DATA 0x04
+
+enum {
+    STRID_LANGID = 0,
+    STRID_MANUFACTURER,
+    STRID_PRODUCT,
+    STRID_SERIAL,
+    STRID_CDC_INTERFACE,
+    STRID_NCM_INTERFACE,
+    STRID_MAC,
+};
+
+uint8_t const ncm_desc_configuration[] = {
+    // Config number, interface count, string index, total length, attribute, power in mA
+    TUD_CONFIG_DESCRIPTOR(
+        1,
+        ITF_NUM_TOTAL,
+        0,
+        CONFIG_TOTAL_LEN,
+        TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP,
+        100),
+
+    // Interface number, description string index, MAC address string index, EP notification address and size, EP data address (out, in), and size, max segment size.
+    TUD_CDC_NCM_DESCRIPTOR(
+        ITF_NUM_NCM,
+        STRID_NCM_INTERFACE,
+        STRID_MAC,
+        EPNUM_NCM_NOTIF,
+        64,
+        EPNUM_NCM_DATA,
+        0x80 | EPNUM_NCM_DATA,
+        64,
+        CFG_TUD_NET_MTU),
+
+    // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
+    TUD_CDC_DESCRIPTOR(
+        ITF_NUM_CDC,
+        STRID_CDC_INTERFACE,
+        EPNUM_CDC_NOTIF,
+        8,
+        EPNUM_CDC_DATA,
+        0x80 | EPNUM_CDC_DATA,
+        64),
+};
+
+//--------------------------------------------------------------------+
+// MAC address
+//--------------------------------------------------------------------+
+
+// Host side MAC address, set from the chip MAC before enumeration.
+// Device side (lwIP netif) address differs from it by the last byte.
+static uint8_t ncm_mac_address[6] = {0x02, 0x02, 0x84, 0x6A, 0x96, 0x00};
+
+void ncm_set_mac_address(const uint8_t mac[6]) {
+    memcpy(ncm_mac_address, mac, sizeof(ncm_mac_address));
+    // locally administered unicast, so it never clashes with the chip's own WiFi MAC
+    ncm_mac_address[0] = (ncm_mac_address[0] | 0x02) & ~0x01;
+}
+
+void ncm_get_mac_address(uint8_t mac[6]) {
+    memcpy(mac, ncm_mac_address, sizeof(ncm_mac_address));
+}
+
+//--------------------------------------------------------------------+
+// String Descriptors
+//--------------------------------------------------------------------+
+
+// array of pointer to string descriptors
+static char* ncm_string_desc[] = {
+    (char[]){0x09, 0x04}, // 0: is supported language is English (0x0409)
+    "Flipper Devices Inc.", // 1: Manufacturer
+    "Blackmagic ESP32", // 2: Product
+    "blackmagic", // 3: Serials, should use chip ID
+    "Blackmagic ESP32", // 4: CDC Interface
+    "Blackmagic Network", // 5: NCM Interface
+};
+
+void ncm_set_serial_number(const char* serial_number) {
+    ncm_string_desc[STRID_SERIAL] = malloc(strlen("blackmagic_") + strlen(serial_number) + 1);
+    strcpy(ncm_string_desc[STRID_SERIAL], "blackmagic_");
+    strcat(ncm_string_desc[STRID_SERIAL], serial_number);
+}
+
+#define MAX_DESC_BUF_SIZE 32
+static uint16_t _desc_str[MAX_DESC_BUF_SIZE];
+
+// Invoked when received GET STRING DESCRIPTOR request
+// Application return pointer to descriptor, whose contents must exist long enough for transfer to complete
+uint16_t const* ncm_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+
+    uint8_t chr_count;
+
+    if(index == STRID_LANGID) {
+        memcpy(&_desc_str[1], ncm_string_desc[0], 2);
+        chr_count = 1;
+    } else if(index == STRID_MAC) {
+        // Convert MAC address into UTF-16 hex string
+        const char* hex = "0123456789ABCDEF";
+        chr_count = 0;
+        for(uint8_t i = 0; i < sizeof(ncm_mac_address); i++) {
+            _desc_str[1 + chr_count++] = hex[(ncm_mac_address[i] >> 4) & 0xF];
+            _desc_str[1 + chr_count++] = hex[(ncm_mac_address[i] >> 0) & 0xF];
+        }
+    } else {
+        // Convert ASCII string into UTF-16
+
+        if(index >= sizeof(ncm_string_desc) / sizeof(ncm_string_desc[0])) {
+            return NULL;
+        }
+
+        const char* str = ncm_string_desc[index];
+
+        // Cap at max char
+        chr_count = strlen(str);
+        if(chr_count > MAX_DESC_BUF_SIZE - 1) {
+            chr_count = MAX_DESC_BUF_SIZE - 1;
+        }
+
+        for(uint8_t i = 0; i < chr_count; i++) {
+            _desc_str[1 + i] = str[i];
+        }
+    }
+
+    // first byte is length (including header), second byte is string type
+    _desc_str[0] = (TUSB_DESC_STRING << 8) | (2 * chr_count + 2);
+
+    return _desc_str;
+}
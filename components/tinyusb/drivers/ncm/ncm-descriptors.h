@@ -0,0 +1,8 @@
+#include <tusb.h>
+
+extern tusb_desc_device_t const ncm_desc_device;
+extern uint8_t const ncm_desc_configuration[];
+uint16_t const* ncm_descriptor_string_cb(uint8_t index, uint16_t langid);
+void ncm_set_serial_number(const char* serial_number);
+void ncm_set_mac_address(const uint8_t mac[6]);
+void ncm_get_mac_address(uint8_t mac[6]);
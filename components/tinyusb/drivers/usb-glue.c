@@ -1,6 +1,10 @@
 #include <tusb.h>
+#include <device/usbd_pvt.h>
 #include "dap-link/dap-link-descriptors.h"
+#include "dap-link/dap-link-swo.h"
 #include "dual-cdc/dual-cdc-descriptors.h"
+#include "ncm/ncm-descriptors.h"
+#include "msc/msc-descriptors.h"
 #include "usb-glue.h"
 
 #define TAG "usb-glue"
@@ -26,6 +30,18 @@ const USBDevice usb_device[] = {
             .desc_config = blackmagic_desc_fs_configuration,
             .desc_string_cb = blackmagic_descriptor_string_cb,
         },
+    [USBDeviceTypeNCM] =
+        {
+            .desc_device = (uint8_t const*)&ncm_desc_device,
+            .desc_config = ncm_desc_configuration,
+            .desc_string_cb = ncm_descriptor_string_cb,
+        },
+    [USBDeviceTypeMSC] =
+        {
+            .desc_device = (uint8_t const*)&msc_desc_device,
+            .desc_config = msc_desc_configuration,
+            .desc_string_cb = msc_descriptor_string_cb,
+        },
 };
 
 static USBDeviceType usb_device_type = USBDeviceTypeDualCDC;
@@ -39,6 +55,14 @@ typedef enum {
     DapCDCTypeUART = 0,
 } DapCDCType;
 
+typedef enum {
+    NcmCDCTypeUART = 0,
+} NcmCDCType;
+
+typedef enum {
+    MscCDCTypeUART = 0,
+} MscCDCType;
+
 typedef struct {
     void (*connected)(void* context);
     void* connected_context;
@@ -54,6 +78,10 @@ typedef struct {
     void* gdb_receive_context;
     void (*dap_receive)(void* context);
     void* dap_receive_context;
+    bool (*net_receive)(const uint8_t* data, uint16_t size, void* context);
+    void* net_receive_context;
+    UsbGlueMscCallbacks msc;
+    void* msc_context;
 } USBGlueCallbacks;
 
 static USBGlueCallbacks callbacks = {
@@ -71,6 +99,10 @@ static USBGlueCallbacks callbacks = {
     .gdb_receive_context = NULL,
     .dap_receive = NULL,
     .dap_receive_context = NULL,
+    .net_receive = NULL,
+    .net_receive_context = NULL,
+    .msc = {NULL, NULL, NULL, NULL},
+    .msc_context = NULL,
 };
 
 /***** Callbacks *****/
@@ -117,6 +149,15 @@ static void callback_dap_receive() {
     }
 }
 
+static bool callback_net_receive(const uint8_t* data, uint16_t size) {
+    if(callbacks.net_receive) {
+        return callbacks.net_receive(data, size, callbacks.net_receive_context);
+    }
+
+    // drop the packet
+    return true;
+}
+
 /***** Tiny USB *****/
 
 // Invoked when received GET DEVICE DESCRIPTOR
@@ -142,6 +183,18 @@ uint8_t const* tud_descriptor_bos_cb(void) {
     return dap_link_desc_bos;
 }
 
+// Invoked when the device stack collects class drivers
+// DAP-Link vendor interface carries an extra SWO endpoint, so it is served by our own driver
+usbd_class_driver_t const* usbd_app_driver_get_cb(uint8_t* driver_count) {
+    if(usb_device_type == USBDeviceTypeDapLink) {
+        *driver_count = 1;
+        return &dap_link_swo_driver;
+    }
+
+    *driver_count = 0;
+    return NULL;
+}
+
 bool tud_vendor_control_xfer_cb(
     uint8_t rhport,
     uint8_t stage,
@@ -220,6 +273,14 @@ void tud_cdc_line_state_cb(uint8_t interface, bool dtr, bool rts) {
         if(interface == DapCDCTypeUART) {
             callback_cdc_line_state(dtr, rts);
         }
+    } else if(usb_device_type == USBDeviceTypeNCM) {
+        if(interface == NcmCDCTypeUART) {
+            callback_cdc_line_state(dtr, rts);
+        }
+    } else if(usb_device_type == USBDeviceTypeMSC) {
+        if(interface == MscCDCTypeUART) {
+            callback_cdc_line_state(dtr, rts);
+        }
     }
 }
 
@@ -232,6 +293,130 @@ void tud_cdc_line_coding_cb(uint8_t interface, cdc_line_coding_t const* p_line_c
         if(interface == DapCDCTypeUART) {
             callback_cdc_line_coding(p_line_coding);
         }
+    } else if(usb_device_type == USBDeviceTypeNCM) {
+        if(interface == NcmCDCTypeUART) {
+            callback_cdc_line_coding(p_line_coding);
+        }
+    } else if(usb_device_type == USBDeviceTypeMSC) {
+        if(interface == MscCDCTypeUART) {
+            callback_cdc_line_coding(p_line_coding);
+        }
+    }
+}
+
+// Invoked when the network interface is (re)initialized by the host
+void tud_network_init_cb(void) {
+}
+
+// Invoked when a packet is received from the host, return false to keep it until renew
+bool tud_network_recv_cb(const uint8_t* src, uint16_t size) {
+    if(size == 0) return true;
+    bool accepted = callback_net_receive(src, size);
+    if(accepted) {
+        tud_network_recv_renew();
+    }
+    return accepted;
+}
+
+// Invoked from tud_network_xmit to copy the outgoing packet into the USB buffer
+uint16_t tud_network_xmit_cb(uint8_t* dst, void* ref, uint16_t arg) {
+    memcpy(dst, ref, arg);
+    return arg;
+}
+
+// Invoked when received SCSI_CMD_INQUIRY
+void tud_msc_inquiry_cb(
+    uint8_t lun,
+    uint8_t vendor_id[8],
+    uint8_t product_id[16],
+    uint8_t product_rev[4]) {
+    (void)lun;
+    const char vid[] = "Flipper";
+    const char pid[] = "Blackmagic Flash";
+    const char rev[] = "1.0";
+
+    memcpy(vendor_id, vid, strlen(vid));
+    memcpy(product_id, pid, strlen(pid));
+    memcpy(product_rev, rev, strlen(rev));
+}
+
+// Invoked when received Test Unit Ready command
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+    bool ready = false;
+    if(callbacks.msc.ready) {
+        ready = callbacks.msc.ready(callbacks.msc_context);
+    }
+
+    if(!ready) {
+        // medium not present, host will re-read the disk when it is back
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    }
+
+    return ready;
+}
+
+// Invoked when received SCSI_CMD_READ_CAPACITY_10 and SCSI_CMD_READ_FORMAT_CAPACITY
+void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size) {
+    (void)lun;
+    *block_count = 0;
+    *block_size = 512;
+
+    if(callbacks.msc.capacity) {
+        callbacks.msc.capacity(block_count, block_size, callbacks.msc_context);
+    }
+}
+
+// Invoked when received Start Stop Unit command
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject) {
+    (void)lun;
+    (void)power_condition;
+    (void)start;
+    (void)load_eject;
+    return true;
+}
+
+// Invoked when received SCSI READ10 command
+int32_t
+    tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) {
+    (void)lun;
+    if(callbacks.msc.read) {
+        return callbacks.msc.read(lba, offset, buffer, bufsize, callbacks.msc_context);
+    }
+    return -1;
+}
+
+// Invoked when received SCSI WRITE10 command
+// Returning less than bufsize makes the stack call us again with the rest of the data
+int32_t tud_msc_write10_cb(
+    uint8_t lun,
+    uint32_t lba,
+    uint32_t offset,
+    uint8_t* buffer,
+    uint32_t bufsize) {
+    (void)lun;
+    if(callbacks.msc.write) {
+        int32_t result = callbacks.msc.write(lba, offset, buffer, bufsize, callbacks.msc_context);
+        if(result == USB_GLUE_MSC_BUSY) {
+            // logical unit is becoming ready, the host retries the command
+            tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x01);
+            return -1;
+        }
+        return result;
+    }
+    return -1;
+}
+
+// Invoked when received a SCSI command not handled by the stack
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize) {
+    (void)buffer;
+    (void)bufsize;
+
+    switch(scsi_cmd[0]) {
+    case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+        return 0;
+    default:
+        tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+        return -1;
     }
 }
 
@@ -326,6 +511,9 @@ esp_err_t usb_glue_init(USBDeviceType device_type) {
         usb_glue_set_serial_number(mac, 6);
         dap_link_set_serial_number(usb_glue_get_serial_number());
         blackmagic_set_serial_number(usb_glue_get_serial_number());
+        ncm_set_serial_number(usb_glue_get_serial_number());
+        ncm_set_mac_address(mac);
+        msc_set_serial_number(usb_glue_get_serial_number());
         strncpy(dap_serial_number, usb_glue_get_serial_number(), sizeof(dap_serial_number) - 1);
         dap_serial_number[sizeof(dap_serial_number) - 1] = '\0';
         ESP_LOGI(TAG, "Serial number: %s", usb_glue_get_serial_number());
@@ -403,18 +591,22 @@ void usb_glue_dap_set_receive_callback(void (*callback)(void* context), void* co
     callbacks.dap_receive_context = context;
 }
 
-void usb_glue_cdc_send(const uint8_t* buf, size_t len, bool flush) {
+size_t usb_glue_cdc_send(const uint8_t* buf, size_t len, bool flush) {
+    size_t written;
+
     if(usb_device_type == USBDeviceTypeDualCDC) {
-        tud_cdc_n_write(BlackmagicCDCTypeUART, buf, len);
+        written = tud_cdc_n_write(BlackmagicCDCTypeUART, buf, len);
         if(flush) {
             tud_cdc_n_write_flush(BlackmagicCDCTypeUART);
         }
     } else {
-        tud_cdc_n_write(DapCDCTypeUART, buf, len);
+        written = tud_cdc_n_write(DapCDCTypeUART, buf, len);
         if(flush) {
             tud_cdc_n_write_flush(DapCDCTypeUART);
         }
     }
+
+    return written;
 }
 
 size_t usb_glue_cdc_receive(uint8_t* buf, size_t len) {
@@ -440,6 +632,11 @@ size_t usb_glue_gdb_receive(uint8_t* buf, size_t len) {
     return tud_cdc_n_read(BlackmagicCDCTypeGDB, buf, len);
 }
 
+bool usb_glue_gdb_connected(void) {
+    // DTR is set while the host has the port open
+    return usb_device_type == USBDeviceTypeDualCDC && tud_cdc_n_connected(BlackmagicCDCTypeGDB);
+}
+
 void usb_glue_dap_send(const uint8_t* buf, size_t len, bool flush) {
     if(usb_device_type == USBDeviceTypeDapLink) {
         tud_vendor_write(buf, len);
@@ -451,3 +648,68 @@ void usb_glue_dap_send(const uint8_t* buf, size_t len, bool flush) {
 size_t usb_glue_dap_receive(uint8_t* buf, size_t len) {
     return tud_vendor_read(buf, len);
 }
+
+size_t usb_glue_swo_send(const uint8_t* buf, size_t len) {
+    if(usb_device_type == USBDeviceTypeDapLink) {
+        return dap_link_swo_send(buf, len);
+    } else {
+        esp_system_abort("Wrong USB device type");
+    }
+}
+
+void usb_glue_swo_set_send_complete_callback(void (*callback)(void* context), void* context) {
+    dap_link_swo_set_send_complete_callback(callback, context);
+}
+
+typedef struct {
+    const uint8_t* buf;
+    uint16_t len;
+    bool sent;
+    TaskHandle_t caller;
+} UsbGlueNetXmit;
+
+static void usb_glue_net_xmit(void* param) {
+    UsbGlueNetXmit* xmit = param;
+
+    xmit->sent = tud_ready() && tud_network_can_xmit(xmit->len);
+    if(xmit->sent) {
+        tud_network_xmit((void*)xmit->buf, xmit->len);
+    }
+
+    xTaskNotifyGive(xmit->caller);
+}
+
+bool usb_glue_net_send(const uint8_t* buf, uint16_t len) {
+    if(usb_device_type != USBDeviceTypeNCM) {
+        esp_system_abort("Wrong USB device type");
+    }
+
+    UsbGlueNetXmit xmit = {
+        .buf = buf,
+        .len = len,
+        .sent = false,
+        .caller = xTaskGetCurrentTaskHandle(),
+    };
+
+    // the NCM transmit state is not thread safe, only the TinyUSB task may touch it
+    usbd_defer_func(usb_glue_net_xmit, &xmit, false);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    return xmit.sent;
+}
+
+void usb_glue_net_set_receive_callback(
+    bool (*callback)(const uint8_t* data, uint16_t size, void* context),
+    void* context) {
+    callbacks.net_receive = callback;
+    callbacks.net_receive_context = context;
+}
+
+void usb_glue_net_get_mac(uint8_t mac[6]) {
+    ncm_get_mac_address(mac);
+}
+
+void usb_glue_msc_set_callbacks(const UsbGlueMscCallbacks* msc_callbacks, void* context) {
+    callbacks.msc = *msc_callbacks;
+    callbacks.msc_context = context;
+}
@@ -7,8 +7,25 @@
 typedef enum {
     USBDeviceTypeDapLink,
     USBDeviceTypeDualCDC,
+    USBDeviceTypeNCM,
+    USBDeviceTypeMSC,
 } USBDeviceType;
 
+// write callback result: nothing consumed, the host gets NOT READY and retries the command
+#define USB_GLUE_MSC_BUSY (-2)
+
+typedef struct {
+    void (*capacity)(uint32_t* block_count, uint16_t* block_size, void* context);
+    bool (*ready)(void* context);
+    int32_t (*read)(uint32_t lba, uint32_t offset, void* buffer, uint32_t size, void* context);
+    int32_t (*write)(
+        uint32_t lba,
+        uint32_t offset,
+        const uint8_t* buffer,
+        uint32_t size,
+        void* context);
+} UsbGlueMscCallbacks;
+
 /***** Common *****/
 
 esp_err_t usb_glue_init(USBDeviceType device_type);
@@ -23,7 +40,7 @@ const char* usb_glue_get_serial_number();
 
 /***** USB-UART *****/
 
-void usb_glue_cdc_send(const uint8_t* buf, size_t len, bool flush);
+size_t usb_glue_cdc_send(const uint8_t* buf, size_t len, bool flush);
 
 void usb_glue_cdc_set_receive_callback(void (*callback)(void* context), void* context);
 
@@ -45,10 +62,55 @@ void usb_glue_gdb_set_receive_callback(void (*callback)(void* context), void* co
 
 size_t usb_glue_gdb_receive(uint8_t* buf, size_t len);
 
+bool usb_glue_gdb_connected(void);
+
 /***** USB-DAP *****/
 
 void usb_glue_dap_send(const uint8_t* buf, size_t len, bool flush);
 
 void usb_glue_dap_set_receive_callback(void (*callback)(void* context), void* context);
 
-size_t usb_glue_dap_receive(uint8_t* buf, size_t len);
\ No newline at end of file
+size_t usb_glue_dap_receive(uint8_t* buf, size_t len);
+/***** USB-SWO *****/
+
+size_t usb_glue_swo_send(const uint8_t* buf, size_t len);
+
+void usb_glue_swo_set_send_complete_callback(void (*callback)(void* context), void* context);
+
+/***** USB-NET *****/
+
+/**
+ * Send ethernet frame to the host. The frame is handed to the TinyUSB task and
+ * the call waits until it is copied, so it must not be called from that task.
+ * @param buf 
+ * @param len 
+ * @return true if the frame was queued
+ */
+bool usb_glue_net_send(const uint8_t* buf, uint16_t len);
+
+/**
+ * Set ethernet frame receive callback, called from the TinyUSB task.
+ * Frame data is valid only during the call.
+ * @param callback 
+ * @param context 
+ */
+void usb_glue_net_set_receive_callback(
+    bool (*callback)(const uint8_t* data, uint16_t size, void* context),
+    void* context);
+
+/**
+ * Get host side MAC address of the USB network interface
+ * @param mac 
+ */
+void usb_glue_net_get_mac(uint8_t mac[6]);
+
+/***** USB-MSC *****/
+
+/**
+ * Set mass storage callbacks, called from the TinyUSB task.
+ * Write callback may consume less than requested, the stack will call it again with the rest.
+ * It must not block, USB_GLUE_MSC_BUSY makes the host retry the whole command later.
+ * @param msc_callbacks 
+ * @param context 
+ */
+void usb_glue_msc_set_callbacks(const UsbGlueMscCallbacks* msc_callbacks, void* context);
@@ -6,7 +6,7 @@
 #include <simple-uart.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/stream_buffer.h>
+#include <spsc-ring.h>
 
 #define CLI_UART_PORT_NUM UART_NUM_1
 #define CLI_UART_TXD_PIN (17)
@@ -14,11 +14,13 @@
 #define CLI_UART_BAUD_RATE (115200)
 #define CLI_UART_TX_BUF_SIZE (64)
 #define CLI_UART_RX_BUF_SIZE (64)
+#define CLI_UART_RX_RING_SIZE (256)
 
 static Cli* cli_uart;
 static uint8_t uart_tx_buffer[CLI_UART_TX_BUF_SIZE];
 static size_t uart_tx_index = 0;
-static StreamBufferHandle_t uart_rx_stream;
+static uint8_t uart_rx_ring_storage[CLI_UART_RX_RING_SIZE];
+static SpscRing uart_rx_ring;
 
 static void cli_uart_write(const uint8_t* data, size_t data_size, void* context);
 static void cli_uart_flush(void* context);
@@ -29,7 +31,7 @@ static void cli_uart_rx_task(void* pvParameters) {
     while(1) {
         uint8_t data[CLI_UART_RX_BUF_SIZE];
         size_t length =
-            xStreamBufferReceive(uart_rx_stream, data, CLI_UART_RX_BUF_SIZE, portMAX_DELAY);
+            spsc_ring_receive(&uart_rx_ring, data, CLI_UART_RX_BUF_SIZE, portMAX_DELAY);
         if(length > 0) {
             for(size_t i = 0; i < length; i++) {
                 cli_handle_char(cli_uart, data[i]);
@@ -43,7 +45,7 @@ void cli_uart_init() {
     cli_set_write_cb(cli_uart, cli_uart_write);
     cli_set_flush_cb(cli_uart, cli_uart_flush);
 
-    uart_rx_stream = xStreamBufferCreate(CLI_UART_RX_BUF_SIZE * 4, 1);
+    spsc_ring_init(&uart_rx_ring, uart_rx_ring_storage, CLI_UART_RX_RING_SIZE);
 
     xTaskCreate(cli_uart_rx_task, "cli_uart_rx", 4096, NULL, 5, NULL);
 
@@ -55,7 +57,7 @@ void cli_uart_init() {
         .stop_bits = UART_STOP_BITS_1,
         .tx_pin_num = CLI_UART_TXD_PIN,
         .rx_pin_num = CLI_UART_RXD_PIN,
-        .isr_context = uart_rx_stream,
+        .isr_context = &uart_rx_ring,
         .rx_isr = cli_uart_rx_isr,
     };
 
@@ -64,6 +66,19 @@ void cli_uart_init() {
     cli_force_motd(cli_uart);
 }
 
+void cli_uart_suspend() {
+    simple_uart_set_rx_isr(CLI_UART_PORT_NUM, NULL, NULL);
+}
+
+void cli_uart_resume() {
+    simple_uart_set_baud_rate(CLI_UART_PORT_NUM, CLI_UART_BAUD_RATE);
+    simple_uart_set_data_bits(CLI_UART_PORT_NUM, UART_DATA_8_BITS);
+    simple_uart_set_parity(CLI_UART_PORT_NUM, UART_PARITY_DISABLE);
+    simple_uart_set_stop_bits(CLI_UART_PORT_NUM, UART_STOP_BITS_1);
+    simple_uart_set_rx_pin(CLI_UART_PORT_NUM, CLI_UART_RXD_PIN);
+    simple_uart_set_rx_isr(CLI_UART_PORT_NUM, cli_uart_rx_isr, &uart_rx_ring);
+}
+
 static void cli_uart_write(const uint8_t* data, size_t data_size, void* context) {
     for(size_t i = 0; i < data_size; i++) {
         uart_tx_buffer[uart_tx_index] = data[i];
@@ -84,17 +99,21 @@ static void cli_uart_flush(void* context) {
 }
 
 static void cli_uart_rx_isr(void* context) {
-    StreamBufferHandle_t stream = context;
+    SpscRing* ring = context;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    uint8_t data;
     while(simple_uart_available(CLI_UART_PORT_NUM)) {
-        simple_uart_read(CLI_UART_PORT_NUM, &data, 1);
+        uint8_t* data;
+        size_t length = spsc_ring_reserve(ring, &data);
 
-        size_t ret __attribute__((unused));
-        ret = xStreamBufferSendFromISR(stream, &data, 1, &xHigherPriorityTaskWoken);
-        // we will drop data if the stream overflows
-        // ESP_ERROR_CHECK(ret != 1);
+        if(length > 0) {
+            length = simple_uart_read(CLI_UART_PORT_NUM, data, length);
+            spsc_ring_commit_from_isr(ring, length, &xHigherPriorityTaskWoken);
+        } else {
+            // we will drop data if the ring overflows
+            uint8_t drop;
+            simple_uart_read(CLI_UART_PORT_NUM, &drop, 1);
+        }
     }
 
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
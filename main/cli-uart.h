@@ -1,3 +1,13 @@
 #pragma once
 
-void cli_uart_init();
\ No newline at end of file
+void cli_uart_init();
+
+/**
+ * Detach CLI from the UART, so the peripheral can be borrowed (e.g. by SWO capture)
+ */
+void cli_uart_suspend();
+
+/**
+ * Restore CLI UART settings and attach CLI back
+ */
+void cli_uart_resume();
\ No newline at end of file
@@ -10,6 +10,8 @@ void cli_config_get(Cli* cli, mstring_t* args) {
     mstring_t* value = mstring_alloc();
     WiFiMode wifi_mode;
     UsbMode usb_mode;
+    UartFlow uart_flow;
+    UartLinePins uart_pins;
 
     nvs_config_get_ap_ssid(value);
     cli_printf(cli, "ap_ssid: %s", mstring_get_cstr(value));
@@ -55,9 +57,33 @@ void cli_config_get(Cli* cli, mstring_t* args) {
     case UsbModeDAP:
         mstring_set(value, CFG_USB_MODE_DAP);
         break;
+    case UsbModeNET:
+        mstring_set(value, CFG_USB_MODE_NET);
+        break;
+    case UsbModeMSC:
+        mstring_set(value, CFG_USB_MODE_MSC);
+        break;
     }
 
     cli_printf(cli, "usb_mode: %s", mstring_get_cstr(value));
+    cli_write_eol(cli);
+
+    nvs_config_get_uart_flow(&uart_flow);
+    switch(uart_flow) {
+    case UartFlowNone:
+        mstring_set(value, CFG_UART_FLOW_NONE);
+        break;
+    case UartFlowRtsCts:
+        mstring_set(value, CFG_UART_FLOW_RTS_CTS);
+        break;
+    }
+
+    cli_printf(cli, "uart_flow: %s", mstring_get_cstr(value));
+    cli_write_eol(cli);
+
+    nvs_config_get_uart_pins(&uart_pins);
+    cli_printf(
+        cli, "uart_pins: rts %d cts %d dtr %d", uart_pins.rts, uart_pins.cts, uart_pins.dtr);
 
     mstring_free(value);
 }
@@ -110,12 +136,19 @@ void cli_config_set_wifi_mode(Cli* cli, mstring_t* args) {
 }
 
 static void cli_config_set_usb_mode_usage(Cli* cli) {
-    cli_write_str(cli, "config_set_usb_mode <" CFG_USB_MODE_BM "|" CFG_USB_MODE_DAP ">");
+    cli_write_str(
+        cli,
+        "config_set_usb_mode"
+        " <" CFG_USB_MODE_BM "|" CFG_USB_MODE_DAP "|" CFG_USB_MODE_NET "|" CFG_USB_MODE_MSC ">");
     cli_write_eol(cli);
     cli_write_str(cli, " " CFG_USB_MODE_BM " (Black Magic Probe mode)");
     cli_write_eol(cli);
     cli_write_str(cli, " " CFG_USB_MODE_DAP " (DAPLink mode)");
     cli_write_eol(cli);
+    cli_write_str(cli, " " CFG_USB_MODE_NET " (USB network mode)");
+    cli_write_eol(cli);
+    cli_write_str(cli, " " CFG_USB_MODE_MSC " (mass storage flasher mode)");
+    cli_write_eol(cli);
 }
 
 void cli_config_set_usb_mode(Cli* cli, mstring_t* args) {
@@ -132,6 +165,10 @@ void cli_config_set_usb_mode(Cli* cli, mstring_t* args) {
             usb_mode = UsbModeBM;
         } else if(mstring_cmp_cstr(mode, CFG_USB_MODE_DAP) == 0) {
             usb_mode = UsbModeDAP;
+        } else if(mstring_cmp_cstr(mode, CFG_USB_MODE_NET) == 0) {
+            usb_mode = UsbModeNET;
+        } else if(mstring_cmp_cstr(mode, CFG_USB_MODE_MSC) == 0) {
+            usb_mode = UsbModeMSC;
         } else {
             cli_config_set_usb_mode_usage(cli);
             break;
@@ -149,6 +186,75 @@ void cli_config_set_usb_mode(Cli* cli, mstring_t* args) {
     mstring_free(mode);
 }
 
+static void cli_config_set_uart_flow_usage(Cli* cli) {
+    cli_write_str(
+        cli, "config_set_uart_flow <" CFG_UART_FLOW_NONE "|" CFG_UART_FLOW_RTS_CTS ">");
+    cli_write_eol(cli);
+    cli_write_str(cli, " " CFG_UART_FLOW_NONE " (RTS pin follows the USB-UART RTS line)");
+    cli_write_eol(cli);
+    cli_write_str(cli, " " CFG_UART_FLOW_RTS_CTS " (hardware flow control)");
+    cli_write_eol(cli);
+}
+
+void cli_config_set_uart_flow(Cli* cli, mstring_t* args) {
+    mstring_t* flow = mstring_alloc();
+    UartFlow uart_flow;
+
+    do {
+        if(!cli_args_read_string_and_trim(args, flow)) {
+            cli_config_set_uart_flow_usage(cli);
+            break;
+        }
+
+        if(mstring_cmp_cstr(flow, CFG_UART_FLOW_NONE) == 0) {
+            uart_flow = UartFlowNone;
+        } else if(mstring_cmp_cstr(flow, CFG_UART_FLOW_RTS_CTS) == 0) {
+            uart_flow = UartFlowRtsCts;
+        } else {
+            cli_config_set_uart_flow_usage(cli);
+            break;
+        }
+
+        if(nvs_config_set_uart_flow(uart_flow) == ESP_OK) {
+            cli_write_str(cli, "OK");
+            cli_write_eol(cli);
+            cli_write_str(cli, "Reboot to apply");
+        } else {
+            cli_write_str(cli, "ERR");
+        }
+    } while(false);
+
+    mstring_free(flow);
+}
+
+static void cli_config_set_uart_pins_usage(Cli* cli) {
+    cli_write_str(cli, "config_set_uart_pins <rts> <cts> <dtr>, -1 to disable a pin");
+    cli_write_eol(cli);
+    cli_write_str(cli, " spare pins: 7 8 9 14 15 16 21 33 34 35 36 37");
+    cli_write_eol(cli);
+}
+
+void cli_config_set_uart_pins(Cli* cli, mstring_t* args) {
+    UartLinePins pins;
+
+    do {
+        if(!cli_args_read_int_and_trim(args, &pins.rts) ||
+           !cli_args_read_int_and_trim(args, &pins.cts) ||
+           !cli_args_read_int_and_trim(args, &pins.dtr)) {
+            cli_config_set_uart_pins_usage(cli);
+            break;
+        }
+
+        if(nvs_config_set_uart_pins(&pins) == ESP_OK) {
+            cli_write_str(cli, "OK");
+            cli_write_eol(cli);
+            cli_write_str(cli, "Reboot to apply");
+        } else {
+            cli_config_set_uart_pins_usage(cli);
+        }
+    } while(false);
+}
+
 void cli_config_set_ap_pass(Cli* cli, mstring_t* args) {
     mstring_t* pass = mstring_alloc();
 
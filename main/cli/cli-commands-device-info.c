@@ -2,6 +2,7 @@
 #include "cli-args.h"
 #include "cli-commands.h"
 #include "helpers.h"
+#include "metrics.h"
 #include <gdb-glue.h>
 #include <esp_mac.h>
 #include <esp_system.h>
@@ -156,4 +157,29 @@ void cli_device_info(Cli* cli, mstring_t* args) {
         cli,
         "chip_feature_IEEE802154: %s",
         (chip_info.features & CHIP_FEATURE_IEEE802154) ? "true" : "false");
-}
\ No newline at end of file
+}
+
+typedef struct {
+    Cli* cli;
+    bool first;
+} CliMetricsOutput;
+
+static bool cli_metrics_output(const char* data, size_t size, void* context) {
+    CliMetricsOutput* output = context;
+
+    // lines come with '\n', the terminal gets its own line ending between them
+    if(!output->first) {
+        cli_write_eol(output->cli);
+    }
+    output->first = false;
+    cli_write(output->cli, (const uint8_t*)data, size - 1);
+    return true;
+}
+
+void cli_metrics(Cli* cli, mstring_t* args) {
+    CliMetricsOutput output = {
+        .cli = cli,
+        .first = true,
+    };
+    metrics_write_prometheus(cli_metrics_output, &output);
+}
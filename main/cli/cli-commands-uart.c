@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <string.h>
+#include "cli.h"
+#include "cli-args.h"
+#include "cli-commands.h"
+#include "helpers.h"
+#include "usb-uart.h"
+#include "uart-capture.h"
+#include "uart-recorder.h"
+#include "uart-blackbox.h"
+#include "uart-trigger.h"
+#include "uart-autobaud.h"
+#include "network-uart.h"
+
+static void cli_uart_stats_line(Cli* cli, const char* name, uint32_t value) {
+    cli_printf(cli, "%-25s%u", name, value);
+    cli_write_eol(cli);
+}
+
+static void cli_uart_compress_line(Cli* cli, const UartCompressStats* stats) {
+    cli_printf(
+        cli,
+        " compress frames %u raw %u compressed %u cpu_us %u",
+        stats->frames,
+        stats->raw_bytes,
+        stats->compressed_bytes,
+        stats->cpu_us);
+    cli_write_eol(cli);
+}
+
+void cli_uart_stats(Cli* cli, mstring_t* args) {
+    UartStats uart;
+    usb_uart_get_stats(&uart);
+
+    cli_uart_stats_line(cli, "rx_bytes:", uart.rx_bytes);
+    cli_uart_stats_line(cli, "tx_bytes:", uart.tx_bytes);
+    cli_uart_stats_line(cli, "fifo_overflows:", uart.fifo_overflows);
+    cli_uart_stats_line(cli, "frame_errors:", uart.frame_errors);
+    cli_uart_stats_line(cli, "parity_errors:", uart.parity_errors);
+    cli_uart_stats_line(cli, "breaks:", uart.breaks);
+    cli_uart_stats_line(cli, "dma_stalls:", uart.dma_stalls);
+    cli_uart_stats_line(cli, "rx_high_water:", uart.rx_high_water);
+    cli_uart_stats_line(cli, "tx_high_water:", uart.tx_high_water);
+
+    UartCaptureStats capture;
+    uart_capture_get_stats(&capture);
+
+    cli_uart_stats_line(cli, "capture_size:", capture.size);
+    cli_uart_stats_line(cli, "capture_received:", capture.received);
+    cli_uart_stats_line(cli, "capture_overruns:", capture.overruns);
+
+    UartSinkStats sink;
+    for(size_t i = 0; uart_capture_get_sink_stats(i, &sink); i++) {
+        cli_printf(
+            cli,
+            "sink %-20s%s sent %u dropped %u failed %u lag %u high_water %u",
+            sink.name,
+            uart_capture_policy_name(sink.policy),
+            sink.sent,
+            sink.dropped,
+            sink.failed,
+            sink.lag,
+            sink.high_water);
+        cli_write_eol(cli);
+    }
+
+    cli_printf(
+        cli,
+        "%-25s%s",
+        "tcp_slow_policy:",
+        network_uart_slow_policy_name(network_uart_get_slow_policy()));
+    cli_write_eol(cli);
+
+    NetworkUartStats tcp;
+    for(size_t i = 0; network_uart_get_client_stats(i, &tcp); i++) {
+        cli_printf(
+            cli,
+            "tcp%-22u%s bytes %u segments %u rate %u window_us %u latency_avg_us %u "
+            "latency_max_us %u slow_disconnects %u",
+            (unsigned)i,
+            !tcp.connected ? "idle" :
+            tcp.observer   ? "observer" :
+            tcp.compressed ? "compressed" :
+                             "control",
+            tcp.bytes,
+            tcp.segments,
+            tcp.rate,
+            tcp.window_us,
+            tcp.latency_avg_us,
+            tcp.latency_max_us,
+            tcp.slow_disconnects);
+        cli_write_eol(cli);
+
+        if(tcp.compressed) {
+            cli_uart_compress_line(cli, &tcp.compress);
+        }
+    }
+}
+
+static void cli_uart_tcp_coalesce_usage(Cli* cli) {
+    cli_write_str(
+        cli,
+        "uart_tcp_coalesce [<default|slot> <flush_size> <max_window_ms> "
+        "<flush_on_newline 0|1>]");
+    cli_write_eol(cli);
+    cli_write_str(cli, " default applies to new connections, a slot to its current one");
+    cli_write_eol(cli);
+    cli_write_str(cli, " max_window_ms 0 sends every chunk right away");
+    cli_write_eol(cli);
+}
+
+static void cli_uart_tcp_coalesce_line(
+    Cli* cli,
+    const char* name,
+    const NetworkUartCoalesce* coalesce) {
+    cli_printf(
+        cli,
+        "%-8sflush_size %u max_window_ms %u flush_on_newline %u",
+        name,
+        coalesce->flush_size,
+        coalesce->max_window_ms,
+        coalesce->flush_on_newline);
+    cli_write_eol(cli);
+}
+
+void cli_uart_tcp_coalesce(Cli* cli, mstring_t* args) {
+    mstring_t* target = mstring_alloc();
+    NetworkUartCoalesce coalesce;
+    int flush_size, max_window_ms, flush_on_newline;
+    unsigned slot = 0;
+
+    do {
+        if(cli_args_read_string_and_trim(args, target)) {
+            bool is_default = mstring_cmp_cstr(target, "default") == 0;
+            if((!is_default && sscanf(mstring_get_cstr(target), "%u", &slot) != 1) ||
+               !cli_args_read_int_and_trim(args, &flush_size) ||
+               !cli_args_read_int_and_trim(args, &max_window_ms) ||
+               !cli_args_read_int_and_trim(args, &flush_on_newline) || flush_size <= 0 ||
+               max_window_ms < 0) {
+                cli_uart_tcp_coalesce_usage(cli);
+                break;
+            }
+
+            coalesce.flush_size = flush_size;
+            coalesce.max_window_ms = max_window_ms;
+            coalesce.flush_on_newline = flush_on_newline != 0;
+            if(is_default) {
+                network_uart_set_coalesce(&coalesce);
+            } else if(!network_uart_set_client_coalesce(slot, &coalesce)) {
+                cli_printf(cli, "tcp%u is not connected", slot);
+                cli_write_eol(cli);
+                break;
+            }
+        }
+
+        network_uart_get_coalesce(&coalesce);
+        cli_uart_tcp_coalesce_line(cli, "default", &coalesce);
+
+        NetworkUartStats tcp;
+        for(size_t i = 0; network_uart_get_client_stats(i, &tcp); i++) {
+            if(!tcp.connected) continue;
+
+            char name[8];
+            snprintf(name, sizeof(name), "tcp%u", (unsigned)i);
+            cli_uart_tcp_coalesce_line(cli, name, &tcp.coalesce);
+        }
+    } while(false);
+
+    mstring_free(target);
+}
+
+static void cli_uart_tcp_slow_policy_usage(Cli* cli) {
+    cli_write_str(cli, "uart_tcp_slow_policy [<drop_oldest|disconnect>]");
+    cli_write_eol(cli);
+}
+
+void cli_uart_tcp_slow_policy(Cli* cli, mstring_t* args) {
+    mstring_t* policy = mstring_alloc();
+
+    do {
+        if(cli_args_read_string_and_trim(args, policy)) {
+            if(mstring_cmp_cstr(policy, "drop_oldest") == 0) {
+                network_uart_set_slow_policy(NetworkUartSlowDropOldest);
+            } else if(mstring_cmp_cstr(policy, "disconnect") == 0) {
+                network_uart_set_slow_policy(NetworkUartSlowDisconnect);
+            } else {
+                cli_uart_tcp_slow_policy_usage(cli);
+                break;
+            }
+        }
+
+        cli_write_str(cli, network_uart_slow_policy_name(network_uart_get_slow_policy()));
+    } while(false);
+
+    mstring_free(policy);
+}
+
+static void cli_uart_record_usage(Cli* cli) {
+    cli_write_str(cli, "uart_record [<on|off|clear>]");
+    cli_write_eol(cli);
+    cli_write_str(cli, " download at http://<device>/api/v1/uart/record");
+    cli_write_eol(cli);
+}
+
+void cli_uart_record(Cli* cli, mstring_t* args) {
+    mstring_t* action = mstring_alloc();
+    UartRecorderStats stats;
+
+    do {
+        if(cli_args_read_string_and_trim(args, action)) {
+            if(mstring_cmp_cstr(action, "on") == 0) {
+                uart_recorder_set_enabled(true);
+            } else if(mstring_cmp_cstr(action, "off") == 0) {
+                uart_recorder_set_enabled(false);
+            } else if(mstring_cmp_cstr(action, "clear") == 0) {
+                uart_recorder_clear();
+            } else {
+                cli_uart_record_usage(cli);
+                break;
+            }
+        }
+
+        uart_recorder_get_stats(&stats);
+        cli_printf(cli, "%-25s%s", "enabled:", stats.enabled ? "on" : "off");
+        cli_write_eol(cli);
+        cli_uart_stats_line(cli, "size:", stats.size);
+        cli_uart_stats_line(cli, "used:", stats.used);
+        cli_uart_stats_line(cli, "chunks:", stats.chunks);
+        cli_uart_stats_line(cli, "recorded:", stats.recorded);
+        cli_uart_stats_line(cli, "lost:", stats.lost);
+        cli_uart_stats_line(cli, "evicted:", stats.evicted);
+    } while(false);
+
+    mstring_free(action);
+}
+
+static void cli_uart_blackbox_usage(Cli* cli) {
+    cli_write_str(cli, "uart_blackbox [<on|off|erase>]");
+    cli_write_eol(cli);
+    cli_write_str(cli, " download at http://<device>/api/v1/uart/blackbox?boot=&from=&to=");
+    cli_write_eol(cli);
+}
+
+void cli_uart_blackbox(Cli* cli, mstring_t* args) {
+    mstring_t* action = mstring_alloc();
+    UartBlackboxStats stats;
+
+    do {
+        if(cli_args_read_string_and_trim(args, action)) {
+            if(mstring_cmp_cstr(action, "on") == 0) {
+                uart_blackbox_set_enabled(true);
+            } else if(mstring_cmp_cstr(action, "off") == 0) {
+                uart_blackbox_set_enabled(false);
+            } else if(mstring_cmp_cstr(action, "erase") == 0) {
+                if(uart_blackbox_erase() != ESP_OK) {
+                    cli_write_str(cli, "ERR");
+                    break;
+                }
+            } else {
+                cli_uart_blackbox_usage(cli);
+                break;
+            }
+        }
+
+        uart_blackbox_get_stats(&stats);
+        if(!stats.present) {
+            cli_write_str(cli, "no blackbox partition");
+            break;
+        }
+
+        cli_printf(cli, "%-25s%s", "enabled:", stats.enabled ? "on" : "off");
+        cli_write_eol(cli);
+        cli_uart_stats_line(cli, "size:", stats.size);
+        cli_uart_stats_line(cli, "boot:", stats.boot);
+        cli_uart_stats_line(cli, "pages_written:", stats.pages_written);
+        cli_uart_stats_line(cli, "raw_bytes:", stats.raw_bytes);
+        cli_uart_stats_line(cli, "stored_bytes:", stats.stored_bytes);
+        cli_uart_stats_line(cli, "lost:", stats.lost);
+    } while(false);
+
+    mstring_free(action);
+}
+
+static void cli_uart_trigger_usage(Cli* cli) {
+    cli_write_str(cli, "uart_trigger [list]");
+    cli_write_eol(cli);
+    cli_write_str(cli, "uart_trigger add \"<pattern>\" <halt|mark|gpio|notify>... [pin <gpio>]");
+    cli_write_eol(cli);
+    cli_write_str(cli, "uart_trigger del <index>");
+    cli_write_eol(cli);
+    cli_write_str(cli, "uart_trigger clear");
+    cli_write_eol(cli);
+    cli_write_str(cli, "uart_trigger bench");
+    cli_write_eol(cli);
+}
+
+static void cli_uart_trigger_list(Cli* cli) {
+    UartTriggerInfo info;
+    UartTriggerStats stats;
+
+    for(size_t i = 0; uart_trigger_get(i, &info); i++) {
+        cli_printf(cli, "%u: \"%s\"", i, info.config.pattern);
+        for(uint32_t bit = 0; bit < 32; bit++) {
+            if(info.config.actions & (1 << bit)) {
+                cli_printf(cli, " %s", uart_trigger_action_name(1 << bit));
+            }
+        }
+        if(info.config.gpio != UART_TRIGGER_GPIO_NONE) {
+            cli_printf(cli, " pin %d", info.config.gpio);
+        }
+        cli_printf(cli, ", hits %u", info.hits);
+        if(info.config.actions & UartTriggerActionHalt) {
+            cli_printf(cli, ", halt failures %u", info.halt_failures);
+        }
+        cli_write_eol(cli);
+    }
+
+    uart_trigger_get_stats(&stats);
+    cli_uart_stats_line(cli, "bytes:", stats.bytes);
+    cli_uart_stats_line(cli, "cpu_us:", stats.cpu_us);
+    cli_uart_stats_line(cli, "lost:", stats.lost);
+    cli_uart_stats_line(cli, "states:", stats.states);
+    cli_uart_stats_line(cli, "classes:", stats.classes);
+}
+
+static size_t cli_uart_trigger_load(UartTriggerConfig* configs) {
+    UartTriggerInfo info;
+    size_t count = 0;
+
+    while(count < UART_TRIGGER_MAX && uart_trigger_get(count, &info)) {
+        configs[count++] = info.config;
+    }
+
+    return count;
+}
+
+static bool cli_uart_trigger_parse(mstring_t* args, UartTriggerConfig* config) {
+    mstring_t* word = mstring_alloc();
+    bool result = false;
+
+    do {
+        if(!cli_args_read_probably_quoted_string_and_trim(args, word)) break;
+        if(mstring_size(word) == 0 || mstring_size(word) > UART_TRIGGER_PATTERN_MAX) break;
+
+        strcpy(config->pattern, mstring_get_cstr(word));
+        config->actions = 0;
+        config->gpio = UART_TRIGGER_GPIO_NONE;
+
+        result = true;
+        while(result && cli_args_read_string_and_trim(args, word)) {
+            UartTriggerAction action;
+            if(mstring_cmp_cstr(word, "pin") == 0) {
+                result = cli_args_read_int_and_trim(args, &config->gpio);
+            } else if(uart_trigger_action_parse(mstring_get_cstr(word), &action)) {
+                config->actions |= action;
+            } else {
+                result = false;
+            }
+        }
+
+        if(config->actions == 0) result = false;
+        if((config->actions & UartTriggerActionGpio) && config->gpio == UART_TRIGGER_GPIO_NONE) {
+            result = false;
+        }
+    } while(false);
+
+    mstring_free(word);
+    return result;
+}
+
+void cli_uart_trigger(Cli* cli, mstring_t* args) {
+    UartTriggerConfig* configs = malloc(sizeof(UartTriggerConfig) * UART_TRIGGER_MAX);
+    if(configs == NULL) {
+        cli_write_str(cli, "no memory");
+        return;
+    }
+
+    mstring_t* action = mstring_alloc();
+    size_t count = cli_uart_trigger_load(configs);
+
+    do {
+        if(!cli_args_read_string_and_trim(args, action) || mstring_cmp_cstr(action, "list") == 0) {
+            cli_uart_trigger_list(cli);
+            break;
+        }
+
+        if(mstring_cmp_cstr(action, "add") == 0) {
+            if(count >= UART_TRIGGER_MAX) {
+                cli_write_str(cli, "too many triggers");
+                break;
+            }
+            if(!cli_uart_trigger_parse(args, &configs[count])) {
+                cli_uart_trigger_usage(cli);
+                break;
+            }
+            count++;
+        } else if(mstring_cmp_cstr(action, "del") == 0) {
+            int index;
+            if(!cli_args_read_int_and_trim(args, &index) || index < 0 || (size_t)index >= count) {
+                cli_uart_trigger_usage(cli);
+                break;
+            }
+            memmove(
+                &configs[index],
+                &configs[index + 1],
+                sizeof(UartTriggerConfig) * (count - index - 1));
+            count--;
+        } else if(mstring_cmp_cstr(action, "clear") == 0) {
+            count = 0;
+        } else if(mstring_cmp_cstr(action, "bench") == 0) {
+            cli_printf(cli, "%u bytes/s", uart_trigger_benchmark(64 * 1024));
+            break;
+        } else {
+            cli_uart_trigger_usage(cli);
+            break;
+        }
+
+        esp_err_t err = uart_trigger_set(configs, count);
+        if(err == ESP_ERR_INVALID_ARG) {
+            cli_write_str(cli, "ERR, bad pattern, or pin not a spare GPIO");
+            break;
+        } else if(err != ESP_OK) {
+            cli_write_str(cli, "ERR");
+            break;
+        }
+        cli_write_str(cli, "OK");
+    } while(false);
+
+    free(configs);
+    mstring_free(action);
+}
+
+static void cli_uart_autobaud_usage(Cli* cli) {
+    cli_write_str(cli, "uart_autobaud [<start|force>]");
+    cli_write_eol(cli);
+    cli_write_str(cli, " start tries the last detected rate first, force measures again");
+    cli_write_eol(cli);
+}
+
+void cli_uart_autobaud(Cli* cli, mstring_t* args) {
+    mstring_t* action = mstring_alloc();
+    UartAutobaudStatus status;
+
+    do {
+        if(cli_args_read_string_and_trim(args, action)) {
+            bool use_cache;
+            if(mstring_cmp_cstr(action, "start") == 0) {
+                use_cache = true;
+            } else if(mstring_cmp_cstr(action, "force") == 0) {
+                use_cache = false;
+            } else {
+                cli_uart_autobaud_usage(cli);
+                break;
+            }
+
+            if(uart_autobaud_start(use_cache) != ESP_OK) {
+                cli_write_str(cli, "already running");
+                break;
+            }
+        }
+
+        uart_autobaud_get_status(&status);
+        cli_printf(cli, "%-25s%s", "state:", uart_autobaud_state_name(status.state));
+        cli_write_eol(cli);
+        cli_uart_stats_line(cli, "bit_rate:", status.bit_rate);
+        cli_uart_stats_line(cli, "measured:", status.measured);
+        cli_uart_stats_line(cli, "edges:", status.edges);
+        cli_uart_stats_line(cli, "checked_bytes:", status.checked_bytes);
+        cli_uart_stats_line(cli, "errors:", status.errors);
+        cli_printf(cli, "%-25s%s", "cached:", status.cached ? "yes" : "no");
+    } while(false);
+
+    mstring_free(action);
+}
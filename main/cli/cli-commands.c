@@ -14,6 +14,7 @@ void cli_factory_reset(Cli* cli, mstring_t* args);
 void cli_gpio_get(Cli* cli, mstring_t* args);
 void cli_gpio_set(Cli* cli, mstring_t* args);
 void cli_led(Cli* cli, mstring_t* args);
+void cli_metrics(Cli* cli, mstring_t* args);
 void cli_help(Cli* cli, mstring_t* args);
 void cli_ping(Cli* cli, mstring_t* args);
 void cli_sw_reboot(Cli* cli, mstring_t* args);
@@ -30,9 +31,19 @@ void cli_config_set_ap_ssid(Cli* cli, mstring_t* args);
 void cli_config_set_sta_pass(Cli* cli, mstring_t* args);
 void cli_config_set_sta_ssid(Cli* cli, mstring_t* args);
 void cli_config_set_hostname(Cli* cli, mstring_t* args);
+void cli_config_set_uart_flow(Cli* cli, mstring_t* args);
+void cli_config_set_uart_pins(Cli* cli, mstring_t* args);
 
 void cli_nvs_dump(Cli* cli, mstring_t* args);
 
+void cli_uart_autobaud(Cli* cli, mstring_t* args);
+void cli_uart_blackbox(Cli* cli, mstring_t* args);
+void cli_uart_record(Cli* cli, mstring_t* args);
+void cli_uart_stats(Cli* cli, mstring_t* args);
+void cli_uart_tcp_coalesce(Cli* cli, mstring_t* args);
+void cli_uart_tcp_slow_policy(Cli* cli, mstring_t* args);
+void cli_uart_trigger(Cli* cli, mstring_t* args);
+
 const CliItem cli_items[] = {
     {
         .name = "!",
@@ -85,6 +96,16 @@ const CliItem cli_items[] = {
         .desc = "set MDNS host name, requires a reboot to apply",
         .callback = cli_config_set_hostname,
     },
+    {
+        .name = "config_set_uart_flow",
+        .desc = "set target UART flow control, requires a reboot to apply",
+        .callback = cli_config_set_uart_flow,
+    },
+    {
+        .name = "config_set_uart_pins",
+        .desc = "set target UART RTS, CTS and DTR pins, requires a reboot to apply",
+        .callback = cli_config_set_uart_pins,
+    },
     {
         .name = "device_info",
         .desc = "show device info (mac, fw version, chip info, etc)",
@@ -115,6 +136,11 @@ const CliItem cli_items[] = {
         .desc = "set led color",
         .callback = cli_led,
     },
+    {
+        .name = "metrics",
+        .desc = "show all metrics in the Prometheus text format",
+        .callback = cli_metrics,
+    },
     {
         .name = "nvs_dump",
         .desc = "show all NVS contents",
@@ -130,6 +156,41 @@ const CliItem cli_items[] = {
         .desc = "reboot device",
         .callback = cli_sw_reboot,
     },
+    {
+        .name = "uart_autobaud",
+        .desc = "detect the target UART baud rate, or show the last detection",
+        .callback = cli_uart_autobaud,
+    },
+    {
+        .name = "uart_blackbox",
+        .desc = "show, enable, disable or erase the persistent target UART log in flash",
+        .callback = cli_uart_blackbox,
+    },
+    {
+        .name = "uart_record",
+        .desc = "show, enable, disable or clear the timestamped target UART recording",
+        .callback = cli_uart_record,
+    },
+    {
+        .name = "uart_stats",
+        .desc = "show target UART counters, drops and buffer high-water marks",
+        .callback = cli_uart_stats,
+    },
+    {
+        .name = "uart_tcp_coalesce",
+        .desc = "show or set TCP UART coalescing, the default or per connection",
+        .callback = cli_uart_tcp_coalesce,
+    },
+    {
+        .name = "uart_tcp_slow_policy",
+        .desc = "show or set what happens to a TCP UART client that reads too slowly",
+        .callback = cli_uart_tcp_slow_policy,
+    },
+    {
+        .name = "uart_trigger",
+        .desc = "list, add or remove target UART pattern triggers",
+        .callback = cli_uart_trigger,
+    },
     {
         .name = "wifi_ap_clients",
         .desc = "list AP mode clients",
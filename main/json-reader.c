@@ -0,0 +1,395 @@
+#include <string.h>
+#include "json-reader.h"
+
+typedef struct {
+    JsonReader* reader;
+    size_t length;
+    size_t position;
+} JsonParser;
+
+static bool json_parse_value(JsonParser* parser, size_t depth);
+
+static char json_parse_peek(JsonParser* parser) {
+    return parser->position < parser->length ? parser->reader->text[parser->position] : '\0';
+}
+
+static void json_parse_space(JsonParser* parser) {
+    while(true) {
+        char c = json_parse_peek(parser);
+        if(c != ' ' && c != '\t' && c != '\r' && c != '\n') break;
+        parser->position++;
+    }
+}
+
+static JsonToken* json_parse_token(JsonParser* parser, JsonType type) {
+    JsonReader* reader = parser->reader;
+    if(reader->count >= reader->max_tokens) return NULL;
+
+    JsonToken* token = &reader->tokens[reader->count++];
+    token->type = type;
+    token->decoded = false;
+    token->start = parser->position;
+    token->end = parser->position;
+    token->next = reader->count;
+    token->size = 0;
+    return token;
+}
+
+static bool json_is_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool json_parse_string(JsonParser* parser) {
+    if(json_parse_peek(parser) != '"') return false;
+    parser->position++;
+
+    JsonToken* token = json_parse_token(parser, JsonTypeString);
+    if(token == NULL) return false;
+
+    const char* text = parser->reader->text;
+    while(parser->position < parser->length) {
+        char c = text[parser->position];
+        if(c == '"') {
+            token->end = parser->position++;
+            return true;
+        }
+        if((uint8_t)c < 0x20) return false;
+
+        if(c == '\\') {
+            parser->position++;
+            c = json_parse_peek(parser);
+            if(c == 'u') {
+                for(size_t i = 1; i <= 4; i++) {
+                    if(parser->position + i >= parser->length) return false;
+                    if(!json_is_hex(text[parser->position + i])) return false;
+                }
+                parser->position += 4;
+            } else if(c == '\0' || strchr("\"\\/bfnrt", c) == NULL) {
+                return false;
+            }
+        }
+        parser->position++;
+    }
+
+    return false;
+}
+
+static bool json_parse_literal(JsonParser* parser, const char* literal, JsonType type) {
+    size_t length = strlen(literal);
+    if(parser->length - parser->position < length) return false;
+    if(memcmp(parser->reader->text + parser->position, literal, length) != 0) return false;
+
+    JsonToken* token = json_parse_token(parser, type);
+    if(token == NULL) return false;
+    parser->position += length;
+    token->end = parser->position;
+    return true;
+}
+
+static bool json_parse_number(JsonParser* parser) {
+    JsonToken* token = json_parse_token(parser, JsonTypeNumber);
+    if(token == NULL) return false;
+
+    // loose on the form, the getters only take what they understand
+    bool digits = false;
+    while(true) {
+        char c = json_parse_peek(parser);
+        if(c >= '0' && c <= '9') {
+            digits = true;
+        } else if(c == '\0' || strchr("+-.eE", c) == NULL) {
+            break;
+        }
+        parser->position++;
+    }
+
+    token->end = parser->position;
+    return digits;
+}
+
+static bool json_parse_container(JsonParser* parser, size_t depth, bool object) {
+    if(depth >= JSON_READER_DEPTH_MAX) return false;
+
+    size_t index = parser->reader->count;
+    JsonToken* token = json_parse_token(parser, object ? JsonTypeObject : JsonTypeArray);
+    if(token == NULL) return false;
+    parser->position++;
+
+    char close = object ? '}' : ']';
+    json_parse_space(parser);
+    if(json_parse_peek(parser) == close) {
+        parser->position++;
+    } else {
+        while(true) {
+            json_parse_space(parser);
+            if(object) {
+                if(!json_parse_string(parser)) return false;
+                json_parse_space(parser);
+                if(json_parse_peek(parser) != ':') return false;
+                parser->position++;
+                json_parse_space(parser);
+            }
+            if(!json_parse_value(parser, depth + 1)) return false;
+            parser->reader->tokens[index].size++;
+
+            json_parse_space(parser);
+            char c = json_parse_peek(parser);
+            parser->position++;
+            if(c == close) break;
+            if(c != ',') return false;
+        }
+    }
+
+    // the token array does not move, but re-read it after the children anyway
+    token = &parser->reader->tokens[index];
+    token->end = parser->position;
+    token->next = parser->reader->count;
+    return true;
+}
+
+static bool json_parse_value(JsonParser* parser, size_t depth) {
+    switch(json_parse_peek(parser)) {
+    case '{':
+        return json_parse_container(parser, depth, true);
+    case '[':
+        return json_parse_container(parser, depth, false);
+    case '"':
+        return json_parse_string(parser);
+    case 't':
+        return json_parse_literal(parser, "true", JsonTypeBool);
+    case 'f':
+        return json_parse_literal(parser, "false", JsonTypeBool);
+    case 'n':
+        return json_parse_literal(parser, "null", JsonTypeNull);
+    default:
+        return json_parse_number(parser);
+    }
+}
+
+bool json_reader_parse(
+    JsonReader* reader,
+    char* text,
+    size_t length,
+    JsonToken* tokens,
+    size_t max_tokens) {
+    reader->text = text;
+    reader->tokens = tokens;
+    reader->max_tokens = max_tokens;
+    reader->count = 0;
+
+    if(length > UINT16_MAX) return false;
+
+    JsonParser parser = {
+        .reader = reader,
+        .length = length,
+        .position = 0,
+    };
+
+    json_parse_space(&parser);
+    if(!json_parse_value(&parser, 0)) return false;
+    json_parse_space(&parser);
+
+    return parser.position == length;
+}
+
+static const JsonToken* json_reader_token(const JsonReader* reader, int token) {
+    if(token < 0 || (size_t)token >= reader->count) return NULL;
+    return &reader->tokens[token];
+}
+
+bool json_reader_is(const JsonReader* reader, int token, JsonType type) {
+    const JsonToken* item = json_reader_token(reader, token);
+    return item != NULL && item->type == type;
+}
+
+size_t json_reader_size(const JsonReader* reader, int token) {
+    const JsonToken* item = json_reader_token(reader, token);
+    return item != NULL ? item->size : 0;
+}
+
+int json_reader_find(JsonReader* reader, int object, const char* key) {
+    if(!json_reader_is(reader, object, JsonTypeObject)) return -1;
+
+    int member = object + 1;
+    for(size_t i = 0; i < reader->tokens[object].size; i++) {
+        const char* name = json_reader_get_string(reader, member);
+        if(name != NULL && strcmp(name, key) == 0) return member + 1;
+        member = reader->tokens[member + 1].next;
+    }
+
+    return -1;
+}
+
+int json_reader_array_first(const JsonReader* reader, int array) {
+    if(!json_reader_is(reader, array, JsonTypeArray)) return -1;
+    return reader->tokens[array].size > 0 ? array + 1 : -1;
+}
+
+int json_reader_array_next(const JsonReader* reader, int array, int item) {
+    if(!json_reader_is(reader, array, JsonTypeArray)) return -1;
+    if(json_reader_token(reader, item) == NULL) return -1;
+
+    int next = reader->tokens[item].next;
+    return next < reader->tokens[array].next ? next : -1;
+}
+
+static int json_hex_value(const char* text) {
+    int value = 0;
+    for(size_t i = 0; i < 4; i++) {
+        char c = text[i];
+        value <<= 4;
+        if(c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if(c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else {
+            value |= c - 'A' + 10;
+        }
+    }
+    return value;
+}
+
+static size_t json_put_utf8(char* text, uint32_t code) {
+    if(code < 0x80) {
+        text[0] = code;
+        return 1;
+    } else if(code < 0x800) {
+        text[0] = 0xC0 | (code >> 6);
+        text[1] = 0x80 | (code & 0x3F);
+        return 2;
+    } else if(code < 0x10000) {
+        text[0] = 0xE0 | (code >> 12);
+        text[1] = 0x80 | ((code >> 6) & 0x3F);
+        text[2] = 0x80 | (code & 0x3F);
+        return 3;
+    } else {
+        text[0] = 0xF0 | (code >> 18);
+        text[1] = 0x80 | ((code >> 12) & 0x3F);
+        text[2] = 0x80 | ((code >> 6) & 0x3F);
+        text[3] = 0x80 | (code & 0x3F);
+        return 4;
+    }
+}
+
+static bool json_unescape(char* text, JsonToken* token) {
+    // the result is never longer than the source, the closing quote takes the terminator
+    size_t out = token->start;
+    size_t in = token->start;
+
+    while(in < token->end) {
+        char c = text[in++];
+        if(c != '\\') {
+            text[out++] = c;
+            continue;
+        }
+
+        c = text[in++];
+        switch(c) {
+        case 'b':
+            text[out++] = '\b';
+            break;
+        case 'f':
+            text[out++] = '\f';
+            break;
+        case 'n':
+            text[out++] = '\n';
+            break;
+        case 'r':
+            text[out++] = '\r';
+            break;
+        case 't':
+            text[out++] = '\t';
+            break;
+        case 'u': {
+            uint32_t code = json_hex_value(text + in);
+            in += 4;
+
+            // a surrogate pair takes two escapes, six bytes of source for four of output
+            if(code >= 0xD800 && code <= 0xDBFF && in + 6 <= token->end && text[in] == '\\' &&
+               text[in + 1] == 'u') {
+                uint32_t low = json_hex_value(text + in + 2);
+                if(low >= 0xDC00 && low <= 0xDFFF) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    in += 6;
+                }
+            }
+
+            if(code == 0) return false;
+            out += json_put_utf8(text + out, code);
+            break;
+        }
+        default:
+            text[out++] = c;
+            break;
+        }
+    }
+
+    text[out] = '\0';
+    token->end = out;
+    token->decoded = true;
+    return true;
+}
+
+const char* json_reader_get_string(JsonReader* reader, int token) {
+    if(!json_reader_is(reader, token, JsonTypeString)) return NULL;
+
+    JsonToken* item = &reader->tokens[token];
+    if(!item->decoded && !json_unescape(reader->text, item)) return NULL;
+
+    return reader->text + item->start;
+}
+
+static bool json_reader_get_integer(
+    const JsonReader* reader,
+    int token,
+    bool* negative,
+    uint32_t* magnitude) {
+    if(!json_reader_is(reader, token, JsonTypeNumber)) return false;
+
+    const JsonToken* item = &reader->tokens[token];
+    const char* text = reader->text;
+    size_t index = item->start;
+
+    *negative = text[index] == '-';
+    if(*negative) index++;
+    if(index == item->end) return false;
+
+    uint32_t value = 0;
+    for(; index < item->end; index++) {
+        char c = text[index];
+        if(c < '0' || c > '9') return false;
+        if(value > (UINT32_MAX - (c - '0')) / 10) return false;
+        value = value * 10 + (c - '0');
+    }
+
+    *magnitude = value;
+    return true;
+}
+
+bool json_reader_get_uint(const JsonReader* reader, int token, uint32_t* value) {
+    bool negative;
+    uint32_t magnitude;
+
+    if(!json_reader_get_integer(reader, token, &negative, &magnitude)) return false;
+    if(negative && magnitude != 0) return false;
+
+    *value = magnitude;
+    return true;
+}
+
+bool json_reader_get_int(const JsonReader* reader, int token, int32_t* value) {
+    bool negative;
+    uint32_t magnitude;
+
+    if(!json_reader_get_integer(reader, token, &negative, &magnitude)) return false;
+    if(magnitude > (uint32_t)INT32_MAX + negative) return false;
+
+    *value = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+    return true;
+}
+
+bool json_reader_get_bool(const JsonReader* reader, int token, bool* value) {
+    if(!json_reader_is(reader, token, JsonTypeBool)) return false;
+
+    *value = reader->text[reader->tokens[token].start] == 't';
+    return true;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file json-reader.h
+ * In-place JSON parsing. The text is split into tokens that point back into it, strings are
+ * unescaped in the same buffer when they are first read. Nothing is allocated.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_READER_DEPTH_MAX 8
+#define JSON_READER_ROOT 0
+
+typedef enum {
+    JsonTypeObject,
+    JsonTypeArray,
+    JsonTypeString,
+    JsonTypeNumber,
+    JsonTypeBool,
+    JsonTypeNull,
+} JsonType;
+
+typedef struct {
+    uint8_t type;
+    bool decoded; /*!< string escapes are already resolved*/
+    uint16_t start; /*!< strings exclude the quotes*/
+    uint16_t end;
+    uint16_t next; /*!< index of the token after this value and everything in it*/
+    uint16_t size; /*!< object members or array items*/
+} JsonToken;
+
+typedef struct {
+    char* text;
+    JsonToken* tokens;
+    size_t max_tokens;
+    size_t count;
+} JsonReader;
+
+/**
+ * Parse a document. Object members are a key token followed by the value tokens.
+ * @param reader
+ * @param text modified when strings are read, must outlive the reader
+ * @param length up to UINT16_MAX
+ * @param tokens
+ * @param max_tokens
+ * @return bool false if the text is not valid JSON or has too many tokens
+ */
+bool json_reader_parse(
+    JsonReader* reader,
+    char* text,
+    size_t length,
+    JsonToken* tokens,
+    size_t max_tokens);
+
+/**
+ * Find an object member. All functions taking a token accept -1 and fail on it.
+ * @param reader
+ * @param object
+ * @param key
+ * @return int value token, -1 if there is no such member
+ */
+int json_reader_find(JsonReader* reader, int object, const char* key);
+
+/**
+ * Check token type
+ * @param reader
+ * @param token
+ * @param type
+ * @return bool
+ */
+bool json_reader_is(const JsonReader* reader, int token, JsonType type);
+
+/**
+ * Get object member or array item count
+ * @param reader
+ * @param token
+ * @return size_t
+ */
+size_t json_reader_size(const JsonReader* reader, int token);
+
+/**
+ * Get the first array item
+ * @param reader
+ * @param array
+ * @return int -1 if the array is empty
+ */
+int json_reader_array_first(const JsonReader* reader, int array);
+
+/**
+ * Get the array item after the given one
+ * @param reader
+ * @param array
+ * @param item
+ * @return int -1 after the last item
+ */
+int json_reader_array_next(const JsonReader* reader, int array, int item);
+
+/**
+ * Get a string, unescaped in place
+ * @param reader
+ * @param token
+ * @return const char* NULL if the token is not a string
+ */
+const char* json_reader_get_string(JsonReader* reader, int token);
+
+/**
+ * Get an integer number
+ * @param reader
+ * @param token
+ * @param value
+ * @return bool false if the token is not a number or does not fit
+ */
+bool json_reader_get_uint(const JsonReader* reader, int token, uint32_t* value);
+
+/**
+ * Get a signed integer number
+ * @param reader
+ * @param token
+ * @param value
+ * @return bool false if the token is not a number or does not fit
+ */
+bool json_reader_get_int(const JsonReader* reader, int token, int32_t* value);
+
+/**
+ * Get a bool
+ * @param reader
+ * @param token
+ * @param value
+ * @return bool false if the token is not a bool
+ */
+bool json_reader_get_bool(const JsonReader* reader, int token, bool* value);
@@ -0,0 +1,242 @@
+#include <string.h>
+#include <math.h>
+#include "json-writer.h"
+
+void json_writer_init(
+    JsonWriter* writer,
+    char* buffer,
+    size_t size,
+    JsonWriterFlush flush,
+    void* context) {
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->used = 0;
+    writer->flush = flush;
+    writer->context = context;
+    writer->empty = 0;
+    writer->depth = 0;
+    writer->error = false;
+}
+
+static void json_writer_put(JsonWriter* writer, const char* data, size_t size) {
+    while(size > 0 && !writer->error) {
+        if(writer->used == writer->size) {
+            if(writer->flush == NULL ||
+               !writer->flush(writer->buffer, writer->used, writer->context)) {
+                writer->error = true;
+                return;
+            }
+            writer->used = 0;
+        }
+
+        size_t length = writer->size - writer->used;
+        if(length > size) length = size;
+
+        memcpy(writer->buffer + writer->used, data, length);
+        writer->used += length;
+        data += length;
+        size -= length;
+    }
+}
+
+static void json_writer_put_char(JsonWriter* writer, char c) {
+    json_writer_put(writer, &c, 1);
+}
+
+static void json_writer_put_escaped(JsonWriter* writer, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+
+    json_writer_put_char(writer, '"');
+    while(*text != '\0') {
+        // plain runs go in one piece
+        size_t run = 0;
+        while(text[run] != '\0' && text[run] != '"' && text[run] != '\\' &&
+              (uint8_t)text[run] >= 0x20) {
+            run++;
+        }
+        json_writer_put(writer, text, run);
+        text += run;
+        if(*text == '\0') break;
+
+        char escape[6] = {'\\', *text};
+        size_t length = 2;
+        switch(*text) {
+        case '"':
+        case '\\':
+            break;
+        case '\n':
+            escape[1] = 'n';
+            break;
+        case '\r':
+            escape[1] = 'r';
+            break;
+        case '\t':
+            escape[1] = 't';
+            break;
+        default:
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[(uint8_t)*text >> 4];
+            escape[5] = hex[(uint8_t)*text & 0xF];
+            length = 6;
+            break;
+        }
+        json_writer_put(writer, escape, length);
+        text++;
+    }
+    json_writer_put_char(writer, '"');
+}
+
+static void json_writer_put_uint64(JsonWriter* writer, uint64_t value) {
+    char text[20];
+    size_t index = sizeof(text);
+
+    // 64-bit division is a library call, most values do not need it
+    uint32_t low;
+    while(value > UINT32_MAX) {
+        text[--index] = '0' + value % 10;
+        value /= 10;
+    }
+    low = value;
+    do {
+        text[--index] = '0' + low % 10;
+        low /= 10;
+    } while(low > 0);
+
+    json_writer_put(writer, text + index, sizeof(text) - index);
+}
+
+static void json_writer_key(JsonWriter* writer, const char* key) {
+    if(writer->depth > 0) {
+        uint32_t bit = 1UL << writer->depth;
+        if(writer->empty & bit) {
+            writer->empty &= ~bit;
+        } else {
+            json_writer_put_char(writer, ',');
+        }
+    }
+
+    if(key != NULL) {
+        json_writer_put_escaped(writer, key);
+        json_writer_put_char(writer, ':');
+    }
+}
+
+static void json_writer_begin(JsonWriter* writer, const char* key, char open) {
+    json_writer_key(writer, key);
+    if(writer->depth + 1 >= JSON_WRITER_DEPTH_MAX) {
+        writer->error = true;
+        return;
+    }
+
+    writer->depth++;
+    writer->empty |= 1UL << writer->depth;
+    json_writer_put_char(writer, open);
+}
+
+static void json_writer_end(JsonWriter* writer, char close) {
+    if(writer->depth == 0) {
+        writer->error = true;
+        return;
+    }
+
+    writer->depth--;
+    json_writer_put_char(writer, close);
+}
+
+void json_writer_object_begin(JsonWriter* writer, const char* key) {
+    json_writer_begin(writer, key, '{');
+}
+
+void json_writer_object_end(JsonWriter* writer) {
+    json_writer_end(writer, '}');
+}
+
+void json_writer_array_begin(JsonWriter* writer, const char* key) {
+    json_writer_begin(writer, key, '[');
+}
+
+void json_writer_array_end(JsonWriter* writer) {
+    json_writer_end(writer, ']');
+}
+
+void json_writer_string(JsonWriter* writer, const char* key, const char* value) {
+    json_writer_key(writer, key);
+    json_writer_put_escaped(writer, value);
+}
+
+void json_writer_uint(JsonWriter* writer, const char* key, uint32_t value) {
+    json_writer_key(writer, key);
+    json_writer_put_uint64(writer, value);
+}
+
+void json_writer_int(JsonWriter* writer, const char* key, int32_t value) {
+    json_writer_int64(writer, key, value);
+}
+
+void json_writer_int64(JsonWriter* writer, const char* key, int64_t value) {
+    json_writer_key(writer, key);
+    if(value < 0) {
+        json_writer_put_char(writer, '-');
+        json_writer_put_uint64(writer, -(uint64_t)value);
+    } else {
+        json_writer_put_uint64(writer, value);
+    }
+}
+
+void json_writer_double(JsonWriter* writer, const char* key, double value) {
+    json_writer_key(writer, key);
+    if(!isfinite(value) || fabs(value) >= 1e18) {
+        json_writer_put(writer, "null", 4);
+        return;
+    }
+
+    if(value < 0) {
+        json_writer_put_char(writer, '-');
+        value = -value;
+    }
+
+    // scale only the fraction, value * 1000 would overflow uint64_t above ~1.8e16
+    uint64_t integer = value;
+    uint32_t fraction = (value - integer) * 1000 + 0.5;
+    if(fraction >= 1000) {
+        integer++;
+        fraction = 0;
+    }
+    json_writer_put_uint64(writer, integer);
+
+    if(fraction > 0) {
+        char text[4] = {'.', '0' + fraction / 100, '0' + fraction / 10 % 10, '0' + fraction % 10};
+        size_t length = sizeof(text);
+        while(text[length - 1] == '0') length--;
+        json_writer_put(writer, text, length);
+    }
+}
+
+void json_writer_bool(JsonWriter* writer, const char* key, bool value) {
+    json_writer_key(writer, key);
+    if(value) {
+        json_writer_put(writer, "true", 4);
+    } else {
+        json_writer_put(writer, "false", 5);
+    }
+}
+
+bool json_writer_finish(JsonWriter* writer) {
+    if(writer->depth != 0) writer->error = true;
+    if(writer->error) return false;
+
+    if(writer->flush != NULL) {
+        if(writer->used > 0 && !writer->flush(writer->buffer, writer->used, writer->context)) {
+            writer->error = true;
+        }
+        writer->used = 0;
+    } else if(writer->used < writer->size) {
+        writer->buffer[writer->used] = '\0';
+    } else {
+        writer->error = true;
+    }
+
+    return !writer->error;
+}
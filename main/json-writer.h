@@ -0,0 +1,125 @@
+/**
+ * @file json-writer.h
+ * Streaming JSON output through a fixed buffer. Nothing is allocated, full buffers go to
+ * the flush callback, without one the document has to fit in the buffer.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_WRITER_DEPTH_MAX 16
+
+/**
+ * Takes buffered output
+ * @return bool false stops the writer
+ */
+typedef bool (*JsonWriterFlush)(const char* data, size_t size, void* context);
+
+typedef struct {
+    char* buffer;
+    size_t size;
+    size_t used; /*!< length of the document if there is no flush callback*/
+    JsonWriterFlush flush;
+    void* context;
+    uint32_t empty; /*!< bit per nesting level, set until the first value*/
+    uint8_t depth;
+    bool error; /*!< flush failed, the buffer was too small or nesting was wrong*/
+} JsonWriter;
+
+/**
+ * Init writer
+ * @param writer
+ * @param buffer
+ * @param size
+ * @param flush NULL to keep the whole document in the buffer, it is then NUL-terminated
+ * @param context
+ */
+void json_writer_init(
+    JsonWriter* writer,
+    char* buffer,
+    size_t size,
+    JsonWriterFlush flush,
+    void* context);
+
+/**
+ * Begin an object. All value functions take the key, NULL for array items and the root.
+ * @param writer
+ * @param key
+ */
+void json_writer_object_begin(JsonWriter* writer, const char* key);
+
+/**
+ * End an object
+ * @param writer
+ */
+void json_writer_object_end(JsonWriter* writer);
+
+/**
+ * Begin an array
+ * @param writer
+ * @param key
+ */
+void json_writer_array_begin(JsonWriter* writer, const char* key);
+
+/**
+ * End an array
+ * @param writer
+ */
+void json_writer_array_end(JsonWriter* writer);
+
+/**
+ * Write a string, escaped
+ * @param writer
+ * @param key
+ * @param value
+ */
+void json_writer_string(JsonWriter* writer, const char* key, const char* value);
+
+/**
+ * Write an unsigned number
+ * @param writer
+ * @param key
+ * @param value
+ */
+void json_writer_uint(JsonWriter* writer, const char* key, uint32_t value);
+
+/**
+ * Write a signed number
+ * @param writer
+ * @param key
+ * @param value
+ */
+void json_writer_int(JsonWriter* writer, const char* key, int32_t value);
+
+/**
+ * Write a 64-bit signed number
+ * @param writer
+ * @param key
+ * @param value
+ */
+void json_writer_int64(JsonWriter* writer, const char* key, int64_t value);
+
+/**
+ * Write a number with up to three decimals, null if it is not finite.
+ * Does not need float printf support, which the nano newlib lacks.
+ * @param writer
+ * @param key
+ * @param value
+ */
+void json_writer_double(JsonWriter* writer, const char* key, double value);
+
+/**
+ * Write a bool
+ * @param writer
+ * @param key
+ * @param value
+ */
+void json_writer_bool(JsonWriter* writer, const char* key, bool value);
+
+/**
+ * Flush the rest of the document, or terminate it in the buffer
+ * @param writer
+ * @return bool false if anything went wrong on the way
+ */
+bool json_writer_finish(JsonWriter* writer);
@@ -2,6 +2,9 @@
 #include <driver/ledc.h>
 #include <esp_log.h>
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sys/param.h>
 
 #define LED_PIN_RED (6)
 #define LED_PIN_GREEN (5)
@@ -17,12 +20,70 @@
 #define LED_GREEN_MAX_VAL 20U
 #define LED_BLUE_MAX_VAL 20U
 
+#define LED_TASK_STACK_SIZE 2048
+#define LED_TASK_PRIORITY 2
+
+#define LED_ACTIVITY_ON_MS 50
+#define LED_ACTIVITY_OFF_MS 50
+
 typedef enum {
     LedChannelRed,
     LedChannelGreen,
     LedChannelBlue,
 } ledc_channel;
 
+typedef enum {
+    LedEffectNone,
+    LedEffectBlink,
+    LedEffectPulse,
+} LedEffect;
+
+typedef struct {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} LedColor;
+
+/**
+ * State is written by the callers and rendered by the led task,
+ * which is the only one who touches LEDC.
+ */
+typedef struct {
+    LedColor base;
+    LedColor effect_color;
+    LedEffect effect;
+    bool effect_restart;
+    uint32_t effect_duration_ms;
+    volatile bool activity;
+    TaskHandle_t task;
+} LedState;
+
+static LedState led_state = {
+    .base = {0, 0, 0},
+    .effect_color = {0, 0, 0},
+    .effect = LedEffectNone,
+    .effect_restart = false,
+    .effect_duration_ms = 0,
+    .activity = false,
+    .task = NULL,
+};
+
+static portMUX_TYPE led_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void led_task(void* pvParameters);
+
+static void led_notify(void) {
+    if(led_state.task == NULL) return;
+
+    if(xPortInIsrContext()) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(led_state.task, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    } else {
+        xTaskNotifyGive(led_state.task);
+    }
+}
+
 void led_init() {
     ESP_LOGI(TAG, "init");
     ledc_timer_config_t ledc_timer = {
@@ -62,29 +123,178 @@ void led_init() {
         .duty = LED_PWM_MAX_VAL, // Set duty to 100%
         .hpoint = 0};
     ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel_blue));
+
+    xTaskCreate(
+        led_task, "led_task", LED_TASK_STACK_SIZE, NULL, LED_TASK_PRIORITY, &led_state.task);
+    led_notify();
     ESP_LOGI(TAG, "init done");
 }
 
 void led_set(uint8_t red, uint8_t green, uint8_t blue) {
-    led_set_red(red);
-    led_set_green(green);
-    led_set_blue(blue);
+    portENTER_CRITICAL_SAFE(&led_mux);
+    led_state.base.red = red;
+    led_state.base.green = green;
+    led_state.base.blue = blue;
+    portEXIT_CRITICAL_SAFE(&led_mux);
+    led_notify();
 }
 
 void led_set_red(uint8_t value) {
-    uint32_t pwm_value = ((uint32_t)value * LED_RED_MAX_VAL) / 255;
-    ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, LedChannelRed, LED_PWM_MAX_VAL - pwm_value));
-    ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, LedChannelRed));
+    portENTER_CRITICAL_SAFE(&led_mux);
+    led_state.base.red = value;
+    portEXIT_CRITICAL_SAFE(&led_mux);
+    led_notify();
 }
 
 void led_set_green(uint8_t value) {
-    uint32_t pwm_value = ((uint32_t)value * LED_GREEN_MAX_VAL) / 255;
-    ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, LedChannelGreen, LED_PWM_MAX_VAL - pwm_value));
-    ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, LedChannelGreen));
+    portENTER_CRITICAL_SAFE(&led_mux);
+    led_state.base.green = value;
+    portEXIT_CRITICAL_SAFE(&led_mux);
+    led_notify();
 }
 
 void led_set_blue(uint8_t value) {
-    uint32_t pwm_value = ((uint32_t)value * LED_BLUE_MAX_VAL) / 255;
-    ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, LedChannelBlue, LED_PWM_MAX_VAL - pwm_value));
-    ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, LedChannelBlue));
+    portENTER_CRITICAL_SAFE(&led_mux);
+    led_state.base.blue = value;
+    portEXIT_CRITICAL_SAFE(&led_mux);
+    led_notify();
+}
+
+static void led_start_effect(
+    LedEffect effect,
+    uint8_t red,
+    uint8_t green,
+    uint8_t blue,
+    uint32_t duration_ms) {
+    portENTER_CRITICAL_SAFE(&led_mux);
+    led_state.effect = effect;
+    led_state.effect_color.red = red;
+    led_state.effect_color.green = green;
+    led_state.effect_color.blue = blue;
+    led_state.effect_duration_ms = duration_ms;
+    led_state.effect_restart = true;
+    portEXIT_CRITICAL_SAFE(&led_mux);
+    led_notify();
+}
+
+void led_blink(uint8_t red, uint8_t green, uint8_t blue, uint32_t duration_ms) {
+    led_start_effect(LedEffectBlink, red, green, blue, duration_ms);
+}
+
+void led_pulse(uint8_t red, uint8_t green, uint8_t blue, uint32_t duration_ms) {
+    led_start_effect(LedEffectPulse, red, green, blue, duration_ms);
+}
+
+void led_activity(void) {
+    // cheap enough to be called for every packet, task is woken only on the first one
+    if(led_state.activity) return;
+
+    portENTER_CRITICAL_SAFE(&led_mux);
+    led_state.activity = true;
+    portEXIT_CRITICAL_SAFE(&led_mux);
+    led_notify();
+}
+
+/***** Render *****/
+
+static void led_write_channel(ledc_channel channel, uint8_t value, uint32_t max_value) {
+    uint32_t pwm_value = ((uint32_t)value * max_value) / 255;
+    ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, channel, LED_PWM_MAX_VAL - pwm_value));
+    ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, channel));
+}
+
+static uint8_t led_scale(uint8_t value, uint32_t level, uint32_t max_level) {
+    return ((uint32_t)value * level) / max_level;
 }
+
+static void led_task(void* pvParameters) {
+    LedColor rendered = {0, 0, 0};
+    bool rendered_valid = false;
+
+    LedEffect effect = LedEffectNone;
+    LedColor effect_color = {0, 0, 0};
+    TickType_t effect_start = 0;
+    TickType_t effect_ticks = 0;
+
+    bool activity_on = false;
+    TickType_t activity_changed = 0;
+
+    TickType_t wait_ticks = portMAX_DELAY;
+
+    while(1) {
+        ulTaskNotifyTake(pdTRUE, wait_ticks);
+        TickType_t now = xTaskGetTickCount();
+
+        portENTER_CRITICAL(&led_mux);
+        LedColor color = led_state.base;
+        if(led_state.effect_restart) {
+            led_state.effect_restart = false;
+            effect = led_state.effect;
+            effect_color = led_state.effect_color;
+            effect_start = now;
+            effect_ticks = pdMS_TO_TICKS(led_state.effect_duration_ms);
+            if(effect_ticks == 0) effect_ticks = 1;
+        }
+        bool activity = led_state.activity;
+        portEXIT_CRITICAL(&led_mux);
+
+        wait_ticks = portMAX_DELAY;
+
+        // effect overrides the base color while running
+        if(effect != LedEffectNone) {
+            TickType_t elapsed = now - effect_start;
+            if(elapsed >= effect_ticks) {
+                effect = LedEffectNone;
+            } else if(effect == LedEffectBlink) {
+                color = effect_color;
+                wait_ticks = effect_ticks - elapsed;
+            } else {
+                // triangle fade in and out
+                TickType_t half = effect_ticks / 2 + 1;
+                TickType_t level = elapsed < half ? elapsed : effect_ticks - elapsed;
+                color.red = led_scale(effect_color.red, level, half);
+                color.green = led_scale(effect_color.green, level, half);
+                color.blue = led_scale(effect_color.blue, level, half);
+                wait_ticks = 1;
+            }
+        }
+
+        // activity flashes the blue channel, one flash per on/off period at most
+        if(activity_on) {
+            if(now - activity_changed >= pdMS_TO_TICKS(LED_ACTIVITY_ON_MS)) {
+                activity_on = false;
+                activity_changed = now;
+            }
+        } else if(activity) {
+            if(now - activity_changed >= pdMS_TO_TICKS(LED_ACTIVITY_OFF_MS)) {
+                activity_on = true;
+                activity_changed = now;
+
+                portENTER_CRITICAL(&led_mux);
+                led_state.activity = false;
+                portEXIT_CRITICAL(&led_mux);
+            }
+        }
+
+        if(activity_on) {
+            color.blue = 255;
+            wait_ticks = MIN(wait_ticks, pdMS_TO_TICKS(LED_ACTIVITY_ON_MS));
+        } else if(activity) {
+            wait_ticks = MIN(wait_ticks, pdMS_TO_TICKS(LED_ACTIVITY_OFF_MS));
+        }
+
+        if(!rendered_valid || color.red != rendered.red) {
+            led_write_channel(LedChannelRed, color.red, LED_RED_MAX_VAL);
+        }
+        if(!rendered_valid || color.green != rendered.green) {
+            led_write_channel(LedChannelGreen, color.green, LED_GREEN_MAX_VAL);
+        }
+        if(!rendered_valid || color.blue != rendered.blue) {
+            led_write_channel(LedChannelBlue, color.blue, LED_BLUE_MAX_VAL);
+        }
+
+        rendered = color;
+        rendered_valid = true;
+    }
+}
+
@@ -3,8 +3,36 @@
 
 void led_init();
 
+/**
+ * Set base led color. Non-blocking, safe to call from ISR,
+ * the color is applied by the led task.
+ */
 void led_set(uint8_t red, uint8_t green, uint8_t blue);
 
 void led_set_red(uint8_t value);
 void led_set_green(uint8_t value);
-void led_set_blue(uint8_t value);
\ No newline at end of file
+void led_set_blue(uint8_t value);
+
+/**
+ * Show the color for a while, then return to the base color. Non-blocking.
+ * @param red 
+ * @param green 
+ * @param blue 
+ * @param duration_ms 
+ */
+void led_blink(uint8_t red, uint8_t green, uint8_t blue, uint32_t duration_ms);
+
+/**
+ * Fade the color in and out, then return to the base color. Non-blocking.
+ * @param red 
+ * @param green 
+ * @param blue 
+ * @param duration_ms 
+ */
+void led_pulse(uint8_t red, uint8_t green, uint8_t blue, uint32_t duration_ms);
+
+/**
+ * Signal data activity, flashes are rate-limited by the led task.
+ * Cheap enough to be called on every packet.
+ */
+void led_activity(void);
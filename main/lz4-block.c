@@ -0,0 +1,118 @@
+#include <string.h>
+#include <sys/param.h>
+#include "lz4-block.h"
+
+/*
+ * Greedy single pass compressor, one hash table lookup per position. Ratio is a bit worse
+ * than the reference LZ4, but it needs nothing but the table and is fast enough for UART rates.
+ */
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+
+static uint32_t lz4_read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t lz4_hash(uint32_t value, uint8_t table_bits) {
+    return (value * 2654435761U) >> (32 - table_bits);
+}
+
+static uint8_t* lz4_write_length(uint8_t* out, const uint8_t* out_end, size_t length) {
+    while(length >= 255) {
+        if(out >= out_end) return NULL;
+        *out++ = 255;
+        length -= 255;
+    }
+
+    if(out >= out_end) return NULL;
+    *out++ = length;
+    return out;
+}
+
+// match_length 0 writes the last literals
+static uint8_t* lz4_write_sequence(
+    uint8_t* out,
+    const uint8_t* out_end,
+    const uint8_t* literals,
+    size_t literal_length,
+    size_t offset,
+    size_t match_length) {
+    if(out >= out_end) return NULL;
+    uint8_t* token = out++;
+    *token = MIN(literal_length, 15) << 4;
+
+    if(literal_length >= 15) {
+        out = lz4_write_length(out, out_end, literal_length - 15);
+        if(out == NULL) return NULL;
+    }
+
+    if(out + literal_length > out_end) return NULL;
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+
+    if(match_length == 0) return out;
+
+    if(out + 2 > out_end) return NULL;
+    *out++ = offset;
+    *out++ = offset >> 8;
+
+    size_t length = match_length - LZ4_MIN_MATCH;
+    *token |= MIN(length, 15);
+    if(length >= 15) {
+        out = lz4_write_length(out, out_end, length - 15);
+    }
+
+    return out;
+}
+
+size_t lz4_block_compress(
+    const uint8_t* src,
+    size_t src_size,
+    uint8_t* dst,
+    size_t dst_capacity,
+    uint16_t* table,
+    uint8_t table_bits) {
+    const uint8_t* out_end = dst + dst_capacity;
+    uint8_t* out = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    memset(table, 0, LZ4_BLOCK_TABLE_SIZE(table_bits));
+
+    if(src_size > LZ4_MF_LIMIT) {
+        size_t match_limit = src_size - LZ4_LAST_LITERALS;
+
+        while(ip < src_size - LZ4_MF_LIMIT) {
+            uint32_t sequence = lz4_read32(src + ip);
+            uint32_t hash = lz4_hash(sequence, table_bits);
+            size_t candidate = table[hash];
+            table[hash] = ip;
+
+            if(candidate >= ip || lz4_read32(src + candidate) != sequence) {
+                ip++;
+                continue;
+            }
+
+            size_t length = LZ4_MIN_MATCH;
+            while(ip + length < match_limit && src[candidate + length] == src[ip + length]) {
+                length++;
+            }
+
+            out = lz4_write_sequence(
+                out, out_end, src + anchor, ip - anchor, ip - candidate, length);
+            if(out == NULL) return 0;
+
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    out = lz4_write_sequence(out, out_end, src + anchor, src_size - anchor, 0, 0);
+    if(out == NULL) return 0;
+
+    return out - dst;
+}
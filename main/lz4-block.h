@@ -0,0 +1,30 @@
+/**
+ * @file lz4-block.h
+ * LZ4 block format compressor, output is readable by any LZ4 block decoder.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Hash table size in bytes, a bigger table finds more matches
+ */
+#define LZ4_BLOCK_TABLE_SIZE(table_bits) (sizeof(uint16_t) << (table_bits))
+
+/**
+ * Compress one independent block
+ * @param src
+ * @param src_size up to 64 KB
+ * @param dst
+ * @param dst_capacity
+ * @param table LZ4_BLOCK_TABLE_SIZE(table_bits) bytes of scratch memory
+ * @param table_bits
+ * @return size_t compressed size, 0 if it does not fit in dst_capacity
+ */
+size_t lz4_block_compress(
+    const uint8_t* src,
+    size_t src_size,
+    uint8_t* dst,
+    size_t dst_capacity,
+    uint16_t* table,
+    uint8_t table_bits);
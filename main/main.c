@@ -14,6 +14,11 @@
 #include "network-http.h"
 #include "network-gdb.h"
 #include "network-uart.h"
+#include "metrics.h"
+#include "uart-capture.h"
+#include "uart-recorder.h"
+#include "uart-blackbox.h"
+#include "uart-trigger.h"
 #include "factory-reset-service.h"
 
 #include <gdb-glue.h>
@@ -62,6 +67,15 @@ void app_main(void) {
     led_set_blue(255);
 
     nvs_init();
+
+    metrics_init();
+    uart_capture_init();
+
+    // before the UART starts, so the recording has everything since boot
+    uart_recorder_init();
+    uart_blackbox_init();
+    uart_trigger_init();
+
     network_init();
     network_http_server_init();
     network_gdb_server_init();
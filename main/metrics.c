@@ -0,0 +1,387 @@
+#include <string.h>
+#include <sys/param.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "helpers.h"
+#include "metrics.h"
+
+#define METRICS_TASKS_MAX 40
+#define METRICS_SERIES_MAX 192
+#define METRICS_LINE_SIZE 192
+
+typedef enum {
+    MetricsHeapFree,
+    MetricsHeapMinimum,
+    MetricsHeapLargest,
+} MetricsHeapValue;
+
+typedef struct {
+    uint32_t hash; /*!< 0 for a free slot*/
+    int64_t value;
+} MetricsSeries;
+
+typedef struct {
+    char text[METRICS_LINE_SIZE];
+    size_t length;
+} MetricsLine;
+
+static const char* TAG = "metrics";
+
+static const Metric* metrics[METRICS_MAX];
+static size_t metrics_count = 0;
+static portMUX_TYPE metrics_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// the sampler fills the scratch array, the published one is read under the lock
+static TaskStatus_t metrics_task_scratch[METRICS_TASKS_MAX] EXT_RAM_ATTR;
+static MetricsTask metrics_tasks[METRICS_TASKS_MAX] EXT_RAM_ATTR;
+static size_t metrics_task_count = 0;
+static uint32_t metrics_total_runtime = 0;
+static SemaphoreHandle_t metrics_tasks_lock = NULL;
+
+// last values written as JSON, open addressing by series name hash
+static MetricsSeries metrics_series[METRICS_SERIES_MAX] EXT_RAM_ATTR;
+
+esp_err_t metrics_register(const Metric* list, size_t count) {
+    esp_err_t err = ESP_OK;
+
+    portENTER_CRITICAL(&metrics_mux);
+    if(metrics_count + count > METRICS_MAX) {
+        err = ESP_ERR_NO_MEM;
+    } else {
+        for(size_t i = 0; i < count; i++) {
+            metrics[metrics_count++] = &list[i];
+        }
+    }
+    portEXIT_CRITICAL(&metrics_mux);
+
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "no room for %s", list[0].name);
+    }
+
+    return err;
+}
+
+static const Metric* metrics_get(size_t index) {
+    const Metric* metric = NULL;
+
+    portENTER_CRITICAL(&metrics_mux);
+    if(index < metrics_count) {
+        metric = metrics[index];
+    }
+    portEXIT_CRITICAL(&metrics_mux);
+
+    return metric;
+}
+
+uint32_t metrics_read_field(const void* stats, void* field) {
+    const uint32_t* value = (const uint32_t*)((const uint8_t*)stats + (uintptr_t)field);
+    return *value;
+}
+
+/*************** TASKS ***************/
+
+static void metrics_sample_tasks(void) {
+    uint32_t total_runtime = 0;
+    UBaseType_t count =
+        uxTaskGetSystemState(metrics_task_scratch, METRICS_TASKS_MAX, &total_runtime);
+    if(count == 0) {
+        ESP_LOGW(TAG, "more than %d tasks, not sampled", METRICS_TASKS_MAX);
+        return;
+    }
+
+    uint16_t cpu[METRICS_TASKS_MAX];
+    xSemaphoreTake(metrics_tasks_lock, portMAX_DELAY);
+
+    // the counters wrap, but not within a sample period
+    uint32_t elapsed = total_runtime - metrics_total_runtime;
+    metrics_total_runtime = total_runtime;
+
+    // the previous counters are still in the published array, a new task ran only since then
+    for(size_t i = 0; i < count; i++) {
+        const TaskStatus_t* status = &metrics_task_scratch[i];
+        uint32_t previous = 0;
+        for(size_t j = 0; j < metrics_task_count; j++) {
+            if(metrics_tasks[j].handle == (uint32_t)status->xHandle) {
+                previous = metrics_tasks[j].runtime;
+                break;
+            }
+        }
+
+        uint32_t runtime = status->ulRunTimeCounter - previous;
+        cpu[i] = elapsed ? MIN((uint64_t)runtime * 1000 / elapsed, 1000) : 0;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        const TaskStatus_t* status = &metrics_task_scratch[i];
+        MetricsTask* task = &metrics_tasks[i];
+
+        strlcpy(task->name, status->pcTaskName, sizeof(task->name));
+        task->handle = (uint32_t)status->xHandle;
+        task->number = status->xTaskNumber;
+        task->state = status->eCurrentState;
+        task->current_priority = status->uxCurrentPriority;
+        task->base_priority = status->uxBasePriority;
+        task->runtime = status->ulRunTimeCounter;
+        task->stack_base = (uint32_t)status->pxStackBase;
+        task->watermark = status->usStackHighWaterMark;
+        task->cpu_permille = cpu[i];
+    }
+    metrics_task_count = count;
+
+    xSemaphoreGive(metrics_tasks_lock);
+}
+
+bool metrics_get_task(size_t index, MetricsTask* task) {
+    if(metrics_tasks_lock == NULL) return false;
+
+    xSemaphoreTake(metrics_tasks_lock, portMAX_DELAY);
+    bool found = index < metrics_task_count;
+    if(found) {
+        memcpy(task, &metrics_tasks[index], sizeof(MetricsTask));
+    }
+    xSemaphoreGive(metrics_tasks_lock);
+
+    return found;
+}
+
+static void metrics_task(void* pvParameters) {
+    while(true) {
+        vTaskDelay(pdMS_TO_TICKS(METRICS_SAMPLE_PERIOD_MS));
+        metrics_sample_tasks();
+    }
+}
+
+/*************** SYSTEM ***************/
+
+static bool metrics_read_uptime(size_t index, MetricSample* sample, void* context) {
+    if(index > 0) return false;
+
+    sample->value = esp_timer_get_time() / 1000000;
+    return true;
+}
+
+static bool metrics_read_heap(size_t index, MetricSample* sample, void* context) {
+    static const char* names[] = {"internal", "psram"};
+    static const uint32_t caps[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM};
+    if(index >= COUNT_OF(names)) return false;
+
+    strlcpy(sample->label, names[index], sizeof(sample->label));
+    switch((MetricsHeapValue)(uintptr_t)context) {
+    case MetricsHeapFree:
+        sample->value = heap_caps_get_free_size(caps[index]);
+        break;
+    case MetricsHeapMinimum:
+        sample->value = heap_caps_get_minimum_free_size(caps[index]);
+        break;
+    case MetricsHeapLargest:
+        sample->value = heap_caps_get_largest_free_block(caps[index]);
+        break;
+    }
+
+    return true;
+}
+
+static bool metrics_read_task(size_t index, MetricSample* sample, void* context) {
+    MetricsTask task;
+    if(!metrics_get_task(index, &task)) return false;
+
+    strlcpy(sample->label, task.name, sizeof(sample->label));
+    sample->value = metrics_read_field(&task, context);
+    return true;
+}
+
+static const Metric metrics_system[] = {
+    {
+        .name = "bm_uptime_seconds",
+        .help = "Time since boot",
+        .type = MetricTypeGauge,
+        .read = metrics_read_uptime,
+    },
+    {
+        .name = "bm_heap_free_bytes",
+        .help = "Free heap",
+        .type = MetricTypeGauge,
+        .label = "heap",
+        .read = metrics_read_heap,
+        .context = (void*)MetricsHeapFree,
+    },
+    {
+        .name = "bm_heap_minimum_free_bytes",
+        .help = "Least free heap since boot",
+        .type = MetricTypeGauge,
+        .label = "heap",
+        .read = metrics_read_heap,
+        .context = (void*)MetricsHeapMinimum,
+    },
+    {
+        .name = "bm_heap_largest_free_block_bytes",
+        .help = "Largest free heap block",
+        .type = MetricTypeGauge,
+        .label = "heap",
+        .read = metrics_read_heap,
+        .context = (void*)MetricsHeapLargest,
+    },
+    {
+        .name = "bm_task_cpu_permille",
+        .help = "Task CPU load over the last sample period",
+        .type = MetricTypeGauge,
+        .label = "task",
+        .read = metrics_read_task,
+        .context = METRIC_FIELD(MetricsTask, cpu_permille),
+    },
+    {
+        .name = "bm_task_stack_free_bytes",
+        .help = "Least free task stack since the task started",
+        .type = MetricTypeGauge,
+        .label = "task",
+        .read = metrics_read_task,
+        .context = METRIC_FIELD(MetricsTask, watermark),
+    },
+};
+
+void metrics_init(void) {
+    metrics_tasks_lock = xSemaphoreCreateMutex();
+    metrics_sample_tasks();
+    metrics_register(metrics_system, COUNT_OF(metrics_system));
+
+    xTaskCreate(metrics_task, "metrics", 3072, NULL, 2, NULL);
+}
+
+/*************** OUTPUT ***************/
+
+static void metrics_line_add(MetricsLine* line, const char* text) {
+    while(*text != '\0' && line->length < sizeof(line->text) - 1) {
+        line->text[line->length++] = *text++;
+    }
+}
+
+static void metrics_line_add_char(MetricsLine* line, char c) {
+    char text[2] = {c, '\0'};
+    metrics_line_add(line, text);
+}
+
+static void metrics_line_add_int(MetricsLine* line, int64_t value) {
+    char text[21];
+    size_t index = sizeof(text) - 1;
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+    // the nano newlib printf has no 64-bit numbers
+    text[index] = '\0';
+    do {
+        text[--index] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude > 0);
+    if(value < 0) text[--index] = '-';
+
+    metrics_line_add(line, text + index);
+}
+
+static void metrics_line_add_series(MetricsLine* line, const Metric* metric, const char* label) {
+    metrics_line_add(line, metric->name);
+    if(metric->label == NULL) return;
+
+    metrics_line_add_char(line, '{');
+    metrics_line_add(line, metric->label);
+    metrics_line_add(line, "=\"");
+    for(; *label != '\0'; label++) {
+        if(*label == '\\' || *label == '"') {
+            metrics_line_add_char(line, '\\');
+            metrics_line_add_char(line, *label);
+        } else if(*label == '\n') {
+            metrics_line_add(line, "\\n");
+        } else {
+            metrics_line_add_char(line, *label);
+        }
+    }
+    metrics_line_add(line, "\"}");
+}
+
+static bool metrics_line_output(MetricsLine* line, MetricsOutput output, void* context) {
+    // a cut line still ends as a line
+    line->text[line->length++] = '\n';
+    bool result = output(line->text, line->length, context);
+    line->length = 0;
+    return result;
+}
+
+bool metrics_write_prometheus(MetricsOutput output, void* context) {
+    MetricsLine line = {.length = 0};
+    MetricSample sample;
+    const Metric* metric;
+
+    for(size_t i = 0; (metric = metrics_get(i)) != NULL; i++) {
+        metrics_line_add(&line, "# HELP ");
+        metrics_line_add(&line, metric->name);
+        metrics_line_add_char(&line, ' ');
+        metrics_line_add(&line, metric->help);
+        if(!metrics_line_output(&line, output, context)) return false;
+
+        metrics_line_add(&line, "# TYPE ");
+        metrics_line_add(&line, metric->name);
+        metrics_line_add(&line, metric->type == MetricTypeCounter ? " counter" : " gauge");
+        if(!metrics_line_output(&line, output, context)) return false;
+
+        for(size_t index = 0; metric->read(index, &sample, metric->context); index++) {
+            metrics_line_add_series(&line, metric, sample.label);
+            metrics_line_add_char(&line, ' ');
+            metrics_line_add_int(&line, sample.value);
+            if(!metrics_line_output(&line, output, context)) return false;
+        }
+    }
+
+    return true;
+}
+
+static uint32_t metrics_hash(const char* text) {
+    // FNV-1a, 0 marks a free slot
+    uint32_t hash = 2166136261UL;
+    for(; *text != '\0'; text++) {
+        hash = (hash ^ (uint8_t)*text) * 16777619UL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+static MetricsSeries* metrics_series_find(uint32_t hash) {
+    size_t slot = hash % METRICS_SERIES_MAX;
+
+    for(size_t i = 0; i < METRICS_SERIES_MAX; i++) {
+        MetricsSeries* series = &metrics_series[(slot + i) % METRICS_SERIES_MAX];
+        if(series->hash == hash || series->hash == 0) return series;
+    }
+
+    return NULL;
+}
+
+void metrics_write_json(JsonWriter* writer, const char* key, bool changes_only) {
+    MetricsLine line = {.length = 0};
+    MetricSample sample;
+    const Metric* metric;
+
+    json_writer_object_begin(writer, key);
+    for(size_t i = 0; (metric = metrics_get(i)) != NULL; i++) {
+        for(size_t index = 0; metric->read(index, &sample, metric->context); index++) {
+            line.length = 0;
+            metrics_line_add_series(&line, metric, sample.label);
+            line.text[line.length] = '\0';
+
+            // a full table only costs the delta encoding, those series are always written
+            uint32_t hash = metrics_hash(line.text);
+            MetricsSeries* series = metrics_series_find(hash);
+            bool changed = series == NULL || series->hash != hash || series->value != sample.value;
+            if(series != NULL) {
+                series->hash = hash;
+                series->value = sample.value;
+            }
+
+            if(changed || !changes_only) {
+                json_writer_int64(writer, line.text, sample.value);
+            }
+        }
+    }
+    json_writer_object_end(writer);
+}
@@ -0,0 +1,115 @@
+/**
+ * @file metrics.h
+ * Counters and gauges for scraping. Modules register static descriptors with a read
+ * callback, so nothing is counted twice and the hot paths pay nothing; values are read
+ * only when someone asks. Task CPU load comes from a sampler that diffs the FreeRTOS
+ * run-time counters once per METRICS_SAMPLE_PERIOD_MS.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "json-writer.h"
+
+#define METRICS_MAX 48
+#define METRICS_LABEL_MAX 24
+#define METRICS_SAMPLE_PERIOD_MS 1000
+
+// context for reading a uint32_t field of a stats struct, see metrics_read_field
+#define METRIC_FIELD(type, field) ((void*)offsetof(type, field))
+
+typedef enum {
+    MetricTypeCounter,
+    MetricTypeGauge,
+} MetricType;
+
+typedef struct {
+    char label[METRICS_LABEL_MAX]; /*!< label value, ignored if the metric has no label*/
+    int64_t value;
+} MetricSample;
+
+/**
+ * Read one instance of a metric
+ * @param index 0 for metrics without a label
+ * @param sample
+ * @param context
+ * @return bool false past the last instance
+ */
+typedef bool (*MetricRead)(size_t index, MetricSample* sample, void* context);
+
+typedef struct {
+    const char* name; /*!< Prometheus name, counters end with _total*/
+    const char* help;
+    MetricType type;
+    const char* label; /*!< label name if there are several instances, e.g. "sink"*/
+    MetricRead read;
+    void* context;
+} Metric;
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t handle;
+    uint32_t number;
+    eTaskState state;
+    uint32_t current_priority;
+    uint32_t base_priority;
+    uint32_t runtime; /*!< run-time counter, us*/
+    uint32_t stack_base;
+    uint32_t watermark; /*!< least free stack, bytes*/
+    uint32_t cpu_permille; /*!< load over the last sample period*/
+} MetricsTask;
+
+/**
+ * Output for the text format, called once per line, the line ends with '\n'
+ * @return bool false stops the output
+ */
+typedef bool (*MetricsOutput)(const char* data, size_t size, void* context);
+
+/**
+ * Register the system metrics and start the task sampler
+ */
+void metrics_init(void);
+
+/**
+ * Register metrics, safe to call before metrics_init
+ * @param metrics must stay valid, usually a static const array
+ * @param count
+ * @return esp_err_t ESP_ERR_NO_MEM if METRICS_MAX is reached, nothing is registered then
+ */
+esp_err_t metrics_register(const Metric* metrics, size_t count);
+
+/**
+ * Read a uint32_t stats field
+ * @param stats
+ * @param field METRIC_FIELD of it
+ * @return uint32_t
+ */
+uint32_t metrics_read_field(const void* stats, void* field);
+
+/**
+ * Write all metrics in the Prometheus text format
+ * @param output
+ * @param context
+ * @return bool false if the output failed
+ */
+bool metrics_write_prometheus(MetricsOutput output, void* context);
+
+/**
+ * Write all metrics as one JSON object, series names are the Prometheus ones.
+ * Remembers what was written, one caller only.
+ * @param writer
+ * @param key
+ * @param changes_only skip series that did not change since the previous call
+ */
+void metrics_write_json(JsonWriter* writer, const char* key, bool changes_only);
+
+/**
+ * Get a task from the last sample
+ * @param index
+ * @param task
+ * @return bool false past the last task
+ */
+bool metrics_get_task(size_t index, MetricsTask* task);
@@ -0,0 +1,741 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <general.h>
+#include <exception.h>
+#include <target.h>
+#include <target_internal.h>
+#include <gdb-glue.h>
+#include "led.h"
+#include "msc-flasher.h"
+
+#define TAG "msc-flasher"
+
+#define FLASHER_SECTOR_SIZE 512
+#define FLASHER_QUEUE_LENGTH 32
+#define FLASHER_MAX_SECTORS (64 * 1024) // whole volume, sectors above are never deduplicated
+#define FLASHER_IDLE_TIMEOUT_MS 1000
+#define FLASHER_ERASE_AHEAD_SIZE (16 * 1024)
+#define FLASHER_MAX_REGIONS 8
+#define FLASHER_FILE_SIZES 8
+#define FLASHER_HEX_LINE_MAX 600
+#define FLASHER_TASK_STACK_SIZE 4096
+#define FLASHER_TASK_PRIORITY 5
+#define FLASHER_BLINK_MS 500
+
+#define UF2_MAGIC_START0 0x0A324655
+#define UF2_MAGIC_START1 0x9E5D5157
+#define UF2_MAGIC_END 0x0AB16F30
+#define UF2_FLAG_NOT_MAIN_FLASH 0x00000001
+#define UF2_PAYLOAD_MAX 476
+
+typedef struct {
+    uint32_t sector;
+    uint8_t data[FLASHER_SECTOR_SIZE];
+} FlasherSector;
+
+typedef enum {
+    FlasherFormatUnknown,
+    FlasherFormatBin,
+    FlasherFormatHex,
+    FlasherFormatUf2,
+} FlasherFormat;
+
+typedef enum {
+    FlasherStateIdle,
+    FlasherStateFlashing,
+    FlasherStateDraining, // result is ready, drop the rest of the file until the host is idle
+} FlasherState;
+
+typedef struct {
+    struct target_flash* flash;
+    uint8_t* erased; // bitmap of erased blocks
+} FlasherRegion;
+
+typedef struct {
+    FlasherState state;
+    FlasherFormat format;
+    target* target;
+    const char* error;
+    bool complete;
+    bool swd_claimed;
+
+    FlasherRegion regions[FLASHER_MAX_REGIONS];
+    size_t region_count;
+    target_addr erase_limit;
+
+    uint32_t start_sector;
+    uint32_t last_sector;
+    uint32_t bytes_written;
+    int64_t start_time;
+
+    target_addr bin_base;
+
+    uint32_t uf2_blocks_total;
+    uint32_t uf2_blocks_done;
+
+    char hex_line[FLASHER_HEX_LINE_MAX];
+    size_t hex_line_length;
+    bool hex_in_line;
+    uint32_t hex_base;
+} FlasherSession;
+
+typedef struct {
+    const char* state;
+    const char* format;
+    const char* result;
+    uint32_t bytes;
+    uint32_t time_ms;
+} FlasherReport;
+
+typedef struct {
+    uint32_t sector;
+    uint32_t size;
+} FlasherFileSize;
+
+static uint8_t flasher_queue_storage[FLASHER_QUEUE_LENGTH * sizeof(FlasherSector)] EXT_RAM_ATTR;
+static StaticQueue_t flasher_queue_struct;
+static QueueHandle_t flasher_queue = NULL;
+
+// used only by the TinyUSB task and by the flasher task respectively
+static FlasherSector flasher_tx_sector;
+static FlasherSector flasher_rx_sector;
+
+static FlasherSession session;
+
+// sectors of the session already processed, a host retrying a busy write sends them again
+static uint8_t flasher_sectors_done[FLASHER_MAX_SECTORS / 8] EXT_RAM_ATTR;
+
+static portMUX_TYPE flasher_mux = portMUX_INITIALIZER_UNLOCKED;
+static FlasherFileSize flasher_file_sizes[FLASHER_FILE_SIZES];
+static size_t flasher_file_size_index = 0;
+static FlasherReport flasher_report = {
+    .state = "idle",
+    .format = "-",
+    .result = "-",
+    .bytes = 0,
+    .time_ms = 0,
+};
+static volatile bool flasher_media_changed = false;
+
+/***** Target *****/
+
+static void flasher_destroy_callback(struct target_controller* tc, target* t) {
+    (void)tc;
+    if(session.target == t) {
+        session.target = NULL;
+    }
+}
+
+static void flasher_printf(struct target_controller* tc, const char* fmt, va_list ap) {
+    (void)tc;
+    (void)fmt;
+    (void)ap;
+}
+
+static struct target_controller flasher_controller = {
+    .destroy_callback = flasher_destroy_callback,
+    .printf = flasher_printf,
+};
+
+static void flasher_regions_free(FlasherSession* s) {
+    for(size_t i = 0; i < s->region_count; i++) {
+        free(s->regions[i].erased);
+    }
+    s->region_count = 0;
+}
+
+static bool flasher_regions_init(FlasherSession* s) {
+    s->region_count = 0;
+    s->bin_base = UINT32_MAX;
+
+    for(struct target_flash* f = s->target->flash; f != NULL; f = f->next) {
+        if(s->region_count >= FLASHER_MAX_REGIONS) break;
+
+        size_t blocks = f->length / f->blocksize;
+        uint8_t* erased = calloc((blocks + 7) / 8, 1);
+        if(erased == NULL) {
+            flasher_regions_free(s);
+            return false;
+        }
+
+        s->regions[s->region_count].flash = f;
+        s->regions[s->region_count].erased = erased;
+        s->region_count++;
+
+        if(f->start < s->bin_base) {
+            s->bin_base = f->start;
+        }
+    }
+
+    return s->region_count > 0;
+}
+
+static FlasherRegion* flasher_find_region(FlasherSession* s, target_addr addr) {
+    for(size_t i = 0; i < s->region_count; i++) {
+        struct target_flash* f = s->regions[i].flash;
+        if(addr >= f->start && addr - f->start < f->length) {
+            return &s->regions[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool flasher_block_erased(FlasherRegion* region, size_t block) {
+    return (region->erased[block / 8] & (1 << (block % 8))) != 0;
+}
+
+static void flasher_block_set_erased(FlasherRegion* region, size_t block) {
+    region->erased[block / 8] |= (1 << (block % 8));
+}
+
+// Erase blocks under [addr, addr + length) that were not erased yet.
+// When the image end is known, erase up to FLASHER_ERASE_AHEAD_SIZE ahead in one call.
+static bool
+    flasher_erase(FlasherSession* s, FlasherRegion* region, target_addr addr, size_t length) {
+    struct target_flash* f = region->flash;
+    size_t block_count = f->length / f->blocksize;
+    size_t block = (addr - f->start) / f->blocksize;
+    size_t last = (addr + length - 1 - f->start) / f->blocksize;
+
+    size_t ahead_end = 0;
+    if(s->erase_limit > f->start) {
+        ahead_end = (MIN(s->erase_limit, f->start + f->length) - f->start + f->blocksize - 1) /
+                    f->blocksize;
+    }
+
+    for(; block <= last; block++) {
+        if(flasher_block_erased(region, block)) continue;
+
+        size_t ahead = MIN(block + FLASHER_ERASE_AHEAD_SIZE / f->blocksize, ahead_end);
+        size_t end_max = MIN(MAX(last + 1, ahead), block_count);
+
+        size_t end = block + 1;
+        while(end < end_max && !flasher_block_erased(region, end)) {
+            end++;
+        }
+
+        target_addr erase_addr = f->start + block * f->blocksize;
+        if(target_flash_erase(s->target, erase_addr, (end - block) * f->blocksize) != 0) {
+            s->error = "flash erase failed";
+            return false;
+        }
+
+        for(size_t i = block; i < end; i++) {
+            flasher_block_set_erased(region, i);
+        }
+        block = end - 1;
+    }
+
+    return true;
+}
+
+static bool
+    flasher_write(FlasherSession* s, target_addr addr, const uint8_t* data, size_t length) {
+    while(length > 0) {
+        FlasherRegion* region = flasher_find_region(s, addr);
+        if(region == NULL) {
+            s->error = "address is out of target flash";
+            return false;
+        }
+
+        struct target_flash* f = region->flash;
+        size_t chunk = MIN(length, f->start + f->length - addr);
+
+        if(!flasher_erase(s, region, addr, chunk)) {
+            return false;
+        }
+
+        if(target_flash_write(s->target, addr, data, chunk) != 0) {
+            s->error = "flash write failed";
+            return false;
+        }
+
+        addr += chunk;
+        data += chunk;
+        length -= chunk;
+        s->bytes_written += chunk;
+    }
+
+    return true;
+}
+
+/***** Formats *****/
+
+static uint32_t flasher_get_u32(const uint8_t* data) {
+    return ((uint32_t)data[0] << 0) | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) |
+           ((uint32_t)data[3] << 24);
+}
+
+static bool flasher_is_uf2(const uint8_t* data) {
+    return flasher_get_u32(&data[0]) == UF2_MAGIC_START0 &&
+           flasher_get_u32(&data[4]) == UF2_MAGIC_START1 &&
+           flasher_get_u32(&data[FLASHER_SECTOR_SIZE - 4]) == UF2_MAGIC_END;
+}
+
+static bool flasher_is_bin(const uint8_t* data) {
+    // Cortex-M vector table: initial SP in RAM, reset handler is a thumb address
+    uint32_t sp = flasher_get_u32(&data[0]);
+    uint32_t reset = flasher_get_u32(&data[4]);
+
+    return (sp & 0x3) == 0 && sp >= 0x10000000 && sp < 0x40000000 && (reset & 0x1) == 1 &&
+           reset < 0x20000000;
+}
+
+static FlasherFormat flasher_detect_format(const uint8_t* data) {
+    if(flasher_is_uf2(data)) return FlasherFormatUf2;
+    if(data[0] == ':') return FlasherFormatHex;
+    if(flasher_is_bin(data)) return FlasherFormatBin;
+    return FlasherFormatUnknown;
+}
+
+static const char* flasher_format_name(FlasherFormat format) {
+    switch(format) {
+    case FlasherFormatBin:
+        return "BIN";
+    case FlasherFormatHex:
+        return "HEX";
+    case FlasherFormatUf2:
+        return "UF2";
+    default:
+        return "-";
+    }
+}
+
+static uint32_t flasher_get_file_size(uint32_t sector) {
+    uint32_t size = 0;
+
+    portENTER_CRITICAL(&flasher_mux);
+    for(size_t i = 0; i < FLASHER_FILE_SIZES; i++) {
+        if(flasher_file_sizes[i].size != 0 && flasher_file_sizes[i].sector == sector) {
+            size = flasher_file_sizes[i].size;
+        }
+    }
+    portEXIT_CRITICAL(&flasher_mux);
+
+    return size;
+}
+
+static bool flasher_process_bin(FlasherSession* s, const FlasherSector* item) {
+    // sectors before the image start belong to other files
+    if(item->sector < s->start_sector) return true;
+
+    uint32_t offset = (item->sector - s->start_sector) * FLASHER_SECTOR_SIZE;
+    size_t length = FLASHER_SECTOR_SIZE;
+    uint32_t file_size = flasher_get_file_size(s->start_sector);
+
+    if(file_size != 0) {
+        if(offset >= file_size) return true;
+        if(offset + length > file_size) length = file_size - offset;
+        s->erase_limit = s->bin_base + file_size;
+    }
+
+    target_addr addr = s->bin_base + offset;
+    if(flasher_find_region(s, addr) == NULL) {
+        // not our data, image can't be larger than the target flash
+        return true;
+    }
+
+    if(!flasher_write(s, addr, item->data, length)) {
+        return false;
+    }
+
+    if(file_size != 0 && s->bytes_written >= file_size) {
+        s->complete = true;
+    }
+
+    return true;
+}
+
+static bool flasher_process_uf2(FlasherSession* s, const FlasherSector* item) {
+    const uint8_t* data = item->data;
+    if(!flasher_is_uf2(data)) return true;
+
+    uint32_t flags = flasher_get_u32(&data[8]);
+    target_addr addr = flasher_get_u32(&data[12]);
+    uint32_t payload_size = flasher_get_u32(&data[16]);
+    uint32_t blocks_total = flasher_get_u32(&data[24]);
+
+    if(payload_size > UF2_PAYLOAD_MAX) {
+        s->error = "invalid UF2 block";
+        return false;
+    }
+
+    if((flags & UF2_FLAG_NOT_MAIN_FLASH) == 0) {
+        if(!flasher_write(s, addr, &data[32], payload_size)) {
+            return false;
+        }
+    }
+
+    s->uf2_blocks_total = blocks_total;
+    s->uf2_blocks_done++;
+    if(s->uf2_blocks_done >= s->uf2_blocks_total) {
+        s->complete = true;
+    }
+
+    return true;
+}
+
+static int flasher_hex_nibble(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool flasher_process_hex_line(FlasherSession* s) {
+    uint8_t record[FLASHER_HEX_LINE_MAX / 2];
+    size_t record_length = s->hex_line_length / 2;
+
+    if(s->hex_line_length % 2 != 0 || record_length < 5) {
+        s->error = "invalid HEX record";
+        return false;
+    }
+
+    uint8_t checksum = 0;
+    for(size_t i = 0; i < record_length; i++) {
+        int high = flasher_hex_nibble(s->hex_line[i * 2]);
+        int low = flasher_hex_nibble(s->hex_line[i * 2 + 1]);
+        if(high < 0 || low < 0) {
+            s->error = "invalid HEX record";
+            return false;
+        }
+        record[i] = (high << 4) | low;
+        checksum += record[i];
+    }
+
+    uint8_t count = record[0];
+    uint16_t offset = (record[1] << 8) | record[2];
+    uint8_t type = record[3];
+    const uint8_t* data = &record[4];
+
+    if(checksum != 0 || record_length != (size_t)count + 5) {
+        s->error = "HEX checksum error";
+        return false;
+    }
+
+    switch(type) {
+    case 0x00:
+        return flasher_write(s, s->hex_base + offset, data, count);
+    case 0x01:
+        s->complete = true;
+        break;
+    case 0x02:
+        s->hex_base = ((data[0] << 8) | data[1]) << 4;
+        break;
+    case 0x04:
+        s->hex_base = ((data[0] << 8) | data[1]) << 16;
+        break;
+    default:
+        // start address records are not needed
+        break;
+    }
+
+    return true;
+}
+
+static bool flasher_process_hex(FlasherSession* s, const FlasherSector* item) {
+    // text must come in order
+    if(item->sector != s->start_sector && item->sector != s->last_sector + 1) return true;
+
+    for(size_t i = 0; i < FLASHER_SECTOR_SIZE && !s->complete; i++) {
+        char c = item->data[i];
+
+        if(c == ':') {
+            s->hex_in_line = true;
+            s->hex_line_length = 0;
+        } else if(c == '\r' || c == '\n') {
+            if(s->hex_in_line && s->hex_line_length > 0) {
+                if(!flasher_process_hex_line(s)) return false;
+            }
+            s->hex_in_line = false;
+        } else if(s->hex_in_line) {
+            if(s->hex_line_length >= FLASHER_HEX_LINE_MAX) {
+                s->error = "HEX line is too long";
+                return false;
+            }
+            s->hex_line[s->hex_line_length++] = c;
+        }
+    }
+
+    return true;
+}
+
+/***** Session *****/
+
+static void flasher_report_update(const char* state, FlasherSession* s) {
+    uint32_t time_ms = (esp_timer_get_time() - s->start_time) / 1000;
+
+    portENTER_CRITICAL(&flasher_mux);
+    flasher_report.state = state;
+    flasher_report.format = flasher_format_name(s->format);
+    flasher_report.result = s->error != NULL ? s->error : (s->complete ? "OK" : "-");
+    flasher_report.bytes = s->bytes_written;
+    flasher_report.time_ms = time_ms;
+    portEXIT_CRITICAL(&flasher_mux);
+}
+
+static bool flasher_start(FlasherSession* s, const FlasherSector* item) {
+    FlasherFormat format = flasher_detect_format(item->data);
+    if(format == FlasherFormatUnknown) return false;
+
+    memset(s, 0, sizeof(FlasherSession));
+    s->format = format;
+    s->start_sector = item->sector;
+    s->last_sector = item->sector;
+    s->start_time = esp_timer_get_time();
+    s->state = FlasherStateDraining;
+
+    ESP_LOGI(TAG, "start %s at sector %u", flasher_format_name(format), (unsigned)item->sector);
+
+    memset(flasher_sectors_done, 0, sizeof(flasher_sectors_done));
+
+    // held until the session ends, gdb waits and DAP is a different USB mode
+    s->swd_claimed = gdb_glue_swd_claim();
+    if(!s->swd_claimed) {
+        s->error = "SWD is in use by GDB";
+    } else {
+        volatile struct exception e;
+        TRY_CATCH (e, EXCEPTION_ALL) {
+            if(adiv5_swdp_scan(0) > 0) {
+                s->target = target_attach_n(1, &flasher_controller);
+            }
+        }
+
+        if(s->target == NULL) {
+            s->error = "no target found";
+        } else if(!flasher_regions_init(s)) {
+            s->error = "target has no flash";
+            target_detach(s->target);
+            s->target = NULL;
+        }
+    }
+
+    if(s->error != NULL) {
+        if(s->swd_claimed) {
+            gdb_glue_swd_release();
+            s->swd_claimed = false;
+        }
+        ESP_LOGE(TAG, "%s", s->error);
+        flasher_report_update("error", s);
+        flasher_media_changed = true;
+        led_blink(255, 0, 0, FLASHER_BLINK_MS);
+        return false;
+    }
+
+    s->state = FlasherStateFlashing;
+    flasher_report_update("flashing", s);
+    return true;
+}
+
+static void flasher_process(FlasherSession* s, const FlasherSector* item) {
+    bool result = true;
+    volatile struct exception e;
+
+    TRY_CATCH (e, EXCEPTION_ALL) {
+        switch(s->format) {
+        case FlasherFormatBin:
+            result = flasher_process_bin(s, item);
+            break;
+        case FlasherFormatHex:
+            result = flasher_process_hex(s, item);
+            break;
+        case FlasherFormatUf2:
+            result = flasher_process_uf2(s, item);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if(e.type) {
+        s->error = "target communication error";
+    } else if(!result && s->error == NULL) {
+        s->error = "programming failed";
+    }
+
+    s->last_sector = item->sector;
+    led_activity();
+}
+
+static void flasher_finish(FlasherSession* s) {
+    // BIN without a known size ends when the host stops writing
+    if(s->format == FlasherFormatBin && flasher_get_file_size(s->start_sector) == 0) {
+        s->complete = true;
+    }
+
+    if(s->error == NULL && !s->complete) {
+        s->error = "transfer is incomplete";
+    }
+
+    volatile struct exception e;
+    TRY_CATCH (e, EXCEPTION_ALL) {
+        if(s->target != NULL) {
+            if(target_flash_done(s->target) != 0 && s->error == NULL) {
+                s->error = "flash finalization failed";
+            }
+
+            if(s->error == NULL) {
+                target_reset(s->target);
+            }
+        }
+    }
+    if(e.type && s->error == NULL) {
+        s->error = "target communication error";
+    }
+
+    TRY_CATCH (e, EXCEPTION_ALL) {
+        if(s->target != NULL) {
+            target_detach(s->target);
+        }
+    }
+    s->target = NULL;
+    flasher_regions_free(s);
+    gdb_glue_swd_release();
+    s->swd_claimed = false;
+
+    flasher_report_update(s->error == NULL ? "done" : "error", s);
+    ESP_LOGI(
+        TAG,
+        "%s, %u bytes",
+        s->error == NULL ? "done" : s->error,
+        (unsigned)s->bytes_written);
+
+    if(s->error == NULL) {
+        led_blink(0, 255, 0, FLASHER_BLINK_MS);
+    } else {
+        led_blink(255, 0, 0, FLASHER_BLINK_MS);
+    }
+
+    s->state = FlasherStateDraining;
+    flasher_media_changed = true;
+}
+
+// marks the sector as done, returns true if it already was
+static bool flasher_sector_take(uint32_t sector) {
+    if(sector >= FLASHER_MAX_SECTORS) return false;
+
+    uint8_t mask = 1 << (sector % 8);
+    bool done = flasher_sectors_done[sector / 8] & mask;
+    flasher_sectors_done[sector / 8] |= mask;
+    return done;
+}
+
+static void flasher_task(void* pvParameters) {
+    while(1) {
+        TickType_t timeout = session.state == FlasherStateIdle ?
+                                 portMAX_DELAY :
+                                 pdMS_TO_TICKS(FLASHER_IDLE_TIMEOUT_MS);
+
+        if(xQueueReceive(flasher_queue, &flasher_rx_sector, timeout) != pdTRUE) {
+            // host is idle
+            if(session.state == FlasherStateFlashing) {
+                flasher_finish(&session);
+            }
+            session.state = FlasherStateIdle;
+            continue;
+        }
+
+        if(session.state == FlasherStateIdle) {
+            if(!flasher_start(&session, &flasher_rx_sector)) continue;
+        }
+
+        if(session.state == FlasherStateFlashing) {
+            if(flasher_sector_take(flasher_rx_sector.sector)) continue;
+            flasher_process(&session, &flasher_rx_sector);
+
+            if(session.error != NULL || session.complete) {
+                flasher_finish(&session);
+            }
+        }
+    }
+}
+
+/***** API *****/
+
+void msc_flasher_init(void) {
+    flasher_queue = xQueueCreateStatic(
+        FLASHER_QUEUE_LENGTH, sizeof(FlasherSector), flasher_queue_storage, &flasher_queue_struct);
+
+    xTaskCreate(
+        flasher_task,
+        "msc_flasher",
+        FLASHER_TASK_STACK_SIZE,
+        NULL,
+        FLASHER_TASK_PRIORITY,
+        NULL);
+}
+
+bool msc_flasher_write_sector(uint32_t sector, const uint8_t* data) {
+    flasher_tx_sector.sector = sector;
+    memcpy(flasher_tx_sector.data, data, FLASHER_SECTOR_SIZE);
+
+    // called from the TinyUSB task, it must not wait for the flasher
+    return xQueueSend(flasher_queue, &flasher_tx_sector, 0) == pdTRUE;
+}
+
+void msc_flasher_set_file_size(uint32_t sector, uint32_t size) {
+    portENTER_CRITICAL(&flasher_mux);
+    for(size_t i = 0; i < FLASHER_FILE_SIZES; i++) {
+        if(flasher_file_sizes[i].sector == sector) {
+            flasher_file_sizes[i].size = size;
+            portEXIT_CRITICAL(&flasher_mux);
+            return;
+        }
+    }
+
+    flasher_file_sizes[flasher_file_size_index].sector = sector;
+    flasher_file_sizes[flasher_file_size_index].size = size;
+    flasher_file_size_index = (flasher_file_size_index + 1) % FLASHER_FILE_SIZES;
+    portEXIT_CRITICAL(&flasher_mux);
+}
+
+size_t msc_flasher_get_status(char* buffer, size_t size) {
+    portENTER_CRITICAL(&flasher_mux);
+    FlasherReport report = flasher_report;
+    portEXIT_CRITICAL(&flasher_mux);
+
+    uint32_t speed = report.time_ms > 0 ? ((uint64_t)report.bytes * 1000) / report.time_ms : 0;
+
+    int length = snprintf(
+        buffer,
+        size,
+        "Blackmagic ESP32 flasher\r\n"
+        "\r\n"
+        "State: %s\r\n"
+        "Format: %s\r\n"
+        "Result: %s\r\n"
+        "Bytes: %u\r\n"
+        "Time: %u ms\r\n"
+        "Speed: %u B/s\r\n",
+        report.state,
+        report.format,
+        report.result,
+        (unsigned)report.bytes,
+        (unsigned)report.time_ms,
+        (unsigned)speed);
+
+    if(length < 0) return 0;
+    return MIN((size_t)length, size - 1);
+}
+
+bool msc_flasher_take_media_changed(void) {
+    if(flasher_media_changed) {
+        flasher_media_changed = false;
+        return true;
+    }
+
+    return false;
+}
+
+bool msc_flasher_busy(void) {
+    return session.state == FlasherStateFlashing;
+}
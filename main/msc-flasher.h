@@ -0,0 +1,49 @@
+/**
+ * @file msc-flasher.h
+ * 
+ * Streaming target programmer, fed with sectors written to the virtual drive
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Init flasher task
+ */
+void msc_flasher_init(void);
+
+/**
+ * Queue a data area sector, never blocks
+ * @param sector sector index relative to the data area start
+ * @param data 512 bytes
+ * @return false if the queue is full, sector is not consumed
+ */
+bool msc_flasher_write_sector(uint32_t sector, const uint8_t* data);
+
+/**
+ * Set size of the file that starts at the given sector (learned from the root directory)
+ * @param sector sector index relative to the data area start
+ * @param size 
+ */
+void msc_flasher_set_file_size(uint32_t sector, uint32_t size);
+
+/**
+ * Fill human readable status text
+ * @param buffer 
+ * @param size 
+ * @return size_t text length
+ */
+size_t msc_flasher_get_status(char* buffer, size_t size);
+
+/**
+ * Returns true once after programming is finished
+ * @return bool 
+ */
+bool msc_flasher_take_media_changed(void);
+
+/**
+ * Returns true while a target is being programmed
+ * @return bool 
+ */
+bool msc_flasher_busy(void);
@@ -19,12 +19,16 @@
 #include "usb.h"
 #include "delay.h"
 #include "network-gdb.h"
+#include "msc-flasher.h"
+#include "helpers.h"
+#include "metrics.h"
 #include <gdb-glue.h>
 
 #define PORT 2345
 #define KEEPALIVE_IDLE 5
 #define KEEPALIVE_INTERVAL 5
 #define KEEPALIVE_COUNT 3
+#define NETWORK_GDB_BLINK_MS 50
 #define TAG "network-gdb"
 
 typedef struct {
@@ -137,11 +141,9 @@ static void network_gdb_server_task(void* pvParameters) {
 
         ESP_LOGI(TAG, "Socket accepted ip address: %s", addr_str);
 
-        // continue only if DAP-Link is not connected
-        if(!dap_is_connected()) {
-            led_set_blue(255);
-            delay(10);
-            led_set_blue(0);
+        // continue only if DAP-Link is not connected and the target is not being flashed
+        if(!dap_is_connected() && !msc_flasher_busy()) {
+            led_blink(0, 0, 255, NETWORK_GDB_BLINK_MS);
 
             ESP_LOGI(TAG, "DAP-Link is connected, not accepting connection");
 
@@ -153,11 +155,9 @@ static void network_gdb_server_task(void* pvParameters) {
             network_gdb.connected = false;
             network_gdb.socket_id = -1;
 
-            led_set_blue(255);
-            delay(10);
-            led_set_blue(0);
+            led_blink(0, 0, 255, NETWORK_GDB_BLINK_MS);
         } else {
-            ESP_LOGE(TAG, "DAP-Link is connected, not accepting connection");
+            ESP_LOGE(TAG, "Target is busy, not accepting connection");
         }
 
         shutdown(sock, 0);
@@ -169,9 +169,57 @@ CLEAN_UP:
     vTaskDelete(NULL);
 }
 
+static bool network_gdb_metric_read(size_t index, MetricSample* sample, void* context) {
+    if(index > 0) return false;
+
+    GdbGlueStats stats;
+    gdb_glue_get_stats(&stats);
+    sample->value = metrics_read_field(&stats, context);
+    return true;
+}
+
+static const Metric network_gdb_metrics[] = {
+    {
+        .name = "bm_gdb_rx_packets_total",
+        .help = "GDB packets received, network and USB",
+        .type = MetricTypeCounter,
+        .read = network_gdb_metric_read,
+        .context = METRIC_FIELD(GdbGlueStats, rx_packets),
+    },
+    {
+        .name = "bm_gdb_tx_packets_total",
+        .help = "GDB packets sent, network and USB",
+        .type = MetricTypeCounter,
+        .read = network_gdb_metric_read,
+        .context = METRIC_FIELD(GdbGlueStats, tx_packets),
+    },
+    {
+        .name = "bm_gdb_rx_bytes_total",
+        .help = "GDB bytes received",
+        .type = MetricTypeCounter,
+        .read = network_gdb_metric_read,
+        .context = METRIC_FIELD(GdbGlueStats, rx_bytes),
+    },
+    {
+        .name = "bm_gdb_tx_bytes_total",
+        .help = "GDB bytes sent",
+        .type = MetricTypeCounter,
+        .read = network_gdb_metric_read,
+        .context = METRIC_FIELD(GdbGlueStats, tx_bytes),
+    },
+    {
+        .name = "bm_swd_transactions_total",
+        .help = "SWD transactions with the target",
+        .type = MetricTypeCounter,
+        .read = network_gdb_metric_read,
+        .context = METRIC_FIELD(GdbGlueStats, swd_transactions),
+    },
+};
+
 void network_gdb_server_init(void) {
     network_gdb.connected = false;
     network_gdb.socket_id = -1;
+    metrics_register(network_gdb_metrics, COUNT_OF(network_gdb_metrics));
 
     esp_wifi_set_ps(WIFI_PS_NONE);
     xTaskCreate(network_gdb_server_task, "network_gdb_server", 4096, (void*)AF_INET, 5, NULL);
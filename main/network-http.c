@@ -1,22 +1,31 @@
+#include <sys/param.h>
 
 #include <esp_http_server.h>
 #include <svelte-portal.h>
 #include <esp_log.h>
-#include <cJSON.h>
 #include <esp_wifi.h>
 #include <esp_system.h>
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
 #include "network.h"
 #include "nvs.h"
 #include "nvs-config.h"
 #include "led.h"
 #include "helpers.h"
 #include "usb-uart.h"
+#include "json-writer.h"
+#include "json-reader.h"
+#include "metrics.h"
 
 #define TAG "network-http"
 #define JSON_ERROR(error_text) "{\"error\": \"" error_text "\"}"
 #define JSON_RESULT(result_text) "{\"result\": \"" result_text "\"}"
 
 #define WIFI_SCAN_SIZE 20
+#define HTTP_CHUNK_SIZE 1024
+#define HTTP_BODY_SIZE 1024
+#define HTTP_BODY_TOKENS 128
 
 static httpd_handle_t server = NULL;
 typedef struct {
@@ -85,11 +94,24 @@ static const char* get_group_cipher(int group_cipher) {
     }
 }
 
+/*
+ * Static files are embedded twice, as is and gzipped at build time. The gzip variant goes to
+ * every client that accepts it. ETags are computed once at start, so a reload costs a 304
+ * per file. No URL carries a content hash and every file keeps its name across firmware
+ * updates, so all of them are revalidated.
+ */
+
+#define HTTP_RESOURCE_TABLE_SIZE 16 // power of 2, at least twice the resource count
+#define HTTP_ETAG_SIZE 24
+#define HTTP_CACHE_CONTROL "no-cache"
+
 typedef struct {
     const char* uri;
     const char* type;
     const uint8_t* addr_start;
     const uint8_t* addr_end;
+    const uint8_t* gzip_start;
+    const uint8_t* gzip_end;
 } HttpResource;
 
 const HttpResource http_resources[] = {
@@ -98,78 +120,159 @@ const HttpResource http_resources[] = {
         .type = "text/html",
         .addr_start = index_html_start,
         .addr_end = index_html_end,
+        .gzip_start = index_html_gz_start,
+        .gzip_end = index_html_gz_end,
     },
     {
         .uri = "/index.html",
         .type = "text/html",
         .addr_start = index_html_start,
         .addr_end = index_html_end,
+        .gzip_start = index_html_gz_start,
+        .gzip_end = index_html_gz_end,
     },
     {
         .uri = "/build/bundle.css",
         .type = "text/css",
         .addr_start = build_bundle_css_start,
         .addr_end = build_bundle_css_end,
+        .gzip_start = build_bundle_css_gz_start,
+        .gzip_end = build_bundle_css_gz_end,
     },
     {
         .uri = "/build/bundle.js",
         .type = "application/javascript",
         .addr_start = build_bundle_js_start,
         .addr_end = build_bundle_js_end,
+        .gzip_start = build_bundle_js_gz_start,
+        .gzip_end = build_bundle_js_gz_end,
     },
     {
         .uri = "/assets/ega8.otf",
         .type = "application/x-font-opentype",
         .addr_start = assets_ega8_otf_start,
         .addr_end = assets_ega8_otf_end,
+        .gzip_start = assets_ega8_otf_gz_start,
+        .gzip_end = assets_ega8_otf_gz_end,
     },
     {
         .uri = "/assets/favicon.ico",
         .type = "image/x-icon",
         .addr_start = assets_favicon_ico_start,
         .addr_end = assets_favicon_ico_end,
+        .gzip_start = assets_favicon_ico_gz_start,
+        .gzip_end = assets_favicon_ico_gz_end,
     },
     {
         .uri = "/favicon.ico",
         .type = "image/x-icon",
         .addr_start = assets_favicon_ico_start,
         .addr_end = assets_favicon_ico_end,
+        .gzip_start = assets_favicon_ico_gz_start,
+        .gzip_end = assets_favicon_ico_gz_end,
     },
 };
 
-static esp_err_t http_common_get_handler(httpd_req_t* req) {
-    const uint8_t* file_start = NULL;
-    const uint8_t* file_end = NULL;
+_Static_assert(
+    COUNT_OF(http_resources) * 2 <= HTTP_RESOURCE_TABLE_SIZE,
+    "resource table is too small");
 
+// index + 1 of the resource, 0 is an empty slot
+static uint8_t http_resource_table[HTTP_RESOURCE_TABLE_SIZE];
+static char http_resource_etags[COUNT_OF(http_resources)][2][HTTP_ETAG_SIZE];
+
+static uint32_t http_uri_hash(const char* uri) {
+    // FNV-1a over the path, the query is not part of the resource name
+    uint32_t hash = 2166136261u;
+    for(; *uri != '\0' && *uri != '?'; uri++) {
+        hash = (hash ^ (uint8_t)*uri) * 16777619u;
+    }
+    return hash;
+}
+
+static bool http_uri_equal(const char* path, const char* uri) {
+    size_t length = strlen(path);
+    return strncmp(path, uri, length) == 0 && (uri[length] == '\0' || uri[length] == '?');
+}
+
+static void http_resources_init(void) {
     for(size_t i = 0; i < COUNT_OF(http_resources); i++) {
-        if(strcmp(http_resources[i].uri, req->uri) == 0) {
-            file_start = http_resources[i].addr_start;
-            file_end = http_resources[i].addr_end;
-            httpd_resp_set_type(req, http_resources[i].type);
-            break;
+        const HttpResource* resource = &http_resources[i];
+        uint32_t slot = http_uri_hash(resource->uri);
+        while(http_resource_table[slot % HTTP_RESOURCE_TABLE_SIZE] != 0) {
+            slot++;
         }
+        http_resource_table[slot % HTTP_RESOURCE_TABLE_SIZE] = i + 1;
+
+        // strong ETags, one per representation
+        uint32_t size = resource->addr_end - resource->addr_start;
+        uint32_t crc = esp_rom_crc32_le(0, resource->addr_start, size);
+        snprintf(http_resource_etags[i][0], HTTP_ETAG_SIZE, "\"%08x-%x\"", crc, size);
+        snprintf(http_resource_etags[i][1], HTTP_ETAG_SIZE, "\"%08x-%x-gz\"", crc, size);
     }
+}
+
+static int http_resource_find(const char* uri) {
+    uint32_t slot = http_uri_hash(uri);
+    for(size_t probe = 0; probe < HTTP_RESOURCE_TABLE_SIZE; probe++, slot++) {
+        uint8_t entry = http_resource_table[slot % HTTP_RESOURCE_TABLE_SIZE];
+        if(entry == 0) break;
+        if(http_uri_equal(http_resources[entry - 1].uri, uri)) return entry - 1;
+    }
+    return -1;
+}
+
+static bool http_req_header_contains(httpd_req_t* req, const char* field, const char* value) {
+    size_t length = httpd_req_get_hdr_value_len(req, field);
+    if(length == 0 || length > 256) return false;
 
-    if(file_start == NULL) {
+    char* header = malloc(length + 1);
+    if(header == NULL) return false;
+
+    bool result = httpd_req_get_hdr_value_str(req, field, header, length + 1) == ESP_OK &&
+                  strstr(header, value) != NULL;
+    free(header);
+    return result;
+}
+
+static esp_err_t http_common_get_handler(httpd_req_t* req) {
+    int index = http_resource_find(req->uri);
+    if(index < 0) {
         ESP_LOGE(TAG, "file not exist: %s", req->uri);
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "file not exist");
         return ESP_FAIL;
     }
 
-    esp_err_t err =
-        httpd_resp_send_chunk(req, (const char*)file_start, (ssize_t)(file_end - file_start));
+    const HttpResource* resource = &http_resources[index];
+    bool gzip = resource->gzip_start != NULL &&
+                http_req_header_contains(req, "Accept-Encoding", "gzip");
+    const char* etag = http_resource_etags[index][gzip];
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", HTTP_CACHE_CONTROL);
+    if(resource->gzip_start != NULL) {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+
+    if(http_req_header_contains(req, "If-None-Match", etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    const uint8_t* file_start = gzip ? resource->gzip_start : resource->addr_start;
+    const uint8_t* file_end = gzip ? resource->gzip_end : resource->addr_end;
+
+    httpd_resp_set_type(req, resource->type);
+    if(gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+
+    esp_err_t err = httpd_resp_send(req, (const char*)file_start, file_end - file_start);
     if(err != ESP_OK) {
         ESP_LOGE(TAG, "file sending failed, %d", err);
-        // Abort
-        httpd_resp_sendstr_chunk(req, NULL);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "file sending failed");
         return ESP_FAIL;
-    } else {
-        // HTTP response completion
-        httpd_resp_send_chunk(req, NULL, 0);
     }
 
-    ESP_LOGI(TAG, "file sending complete");
     return ESP_OK;
 }
 
@@ -178,6 +281,84 @@ static void httpd_resp_common(httpd_req_t* req) {
     httpd_resp_set_type(req, "application/json");
 }
 
+// handlers run one at a time in the server task, so they share the response buffer
+// and the request arena
+static char http_chunk[HTTP_CHUNK_SIZE];
+static char http_body[HTTP_BODY_SIZE];
+static JsonToken http_body_tokens[HTTP_BODY_TOKENS];
+
+static bool http_json_flush(const char* data, size_t size, void* context) {
+    return httpd_resp_send_chunk(context, data, size) == ESP_OK;
+}
+
+static void http_json_begin(httpd_req_t* req, JsonWriter* writer) {
+    json_writer_init(writer, http_chunk, sizeof(http_chunk), http_json_flush, req);
+}
+
+static esp_err_t http_json_end(httpd_req_t* req, JsonWriter* writer) {
+    if(!json_writer_finish(writer)) {
+        ESP_LOGE(TAG, "JSON response failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+typedef struct {
+    httpd_req_t* req;
+    size_t used;
+} HttpTextOutput;
+
+static bool http_text_write(const char* data, size_t size, void* context) {
+    HttpTextOutput* output = context;
+
+    if(output->used + size > sizeof(http_chunk)) {
+        if(httpd_resp_send_chunk(output->req, http_chunk, output->used) != ESP_OK) return false;
+        output->used = 0;
+    }
+    if(size > sizeof(http_chunk)) {
+        return httpd_resp_send_chunk(output->req, data, size) == ESP_OK;
+    }
+
+    memcpy(http_chunk + output->used, data, size);
+    output->used += size;
+    return true;
+}
+
+static const char* http_json_read(httpd_req_t* req, JsonReader* reader) {
+    size_t total_length = req->content_len;
+    size_t current_length = 0;
+
+    if(total_length >= HTTP_BODY_SIZE) {
+        return JSON_ERROR("request too long");
+    }
+
+    while(current_length < total_length) {
+        int received =
+            httpd_req_recv(req, http_body + current_length, total_length - current_length);
+        if(received <= 0) {
+            return JSON_ERROR("cannot receive request data");
+        }
+        current_length += received;
+    }
+
+    if(!json_reader_parse(reader, http_body, total_length, http_body_tokens, HTTP_BODY_TOKENS)) {
+        return JSON_ERROR("invalid JSON");
+    }
+
+    return NULL;
+}
+
+static bool http_json_get_mstring(JsonReader* reader, const char* key, mstring_t* value) {
+    const char* text =
+        json_reader_get_string(reader, json_reader_find(reader, JSON_READER_ROOT, key));
+    if(text == NULL) return false;
+
+    mstring_set(value, text);
+    return true;
+}
+
 static esp_err_t system_ping_handler(httpd_req_t* req) {
     httpd_resp_common(req);
     httpd_resp_sendstr(req, JSON_RESULT("OK"));
@@ -187,55 +368,74 @@ static esp_err_t system_ping_handler(httpd_req_t* req) {
 static esp_err_t system_tasks_handler(httpd_req_t* req) {
     httpd_resp_common(req);
 
-    uint32_t task_count = uxTaskGetNumberOfTasks();
-    TaskStatus_t* tasks = malloc(task_count * sizeof(TaskStatus_t));
-    task_count = uxTaskGetSystemState(tasks, task_count, NULL);
-
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "count", task_count);
-    cJSON* array = cJSON_AddArrayToObject(root, "list");
-
-    for(uint32_t i = 0; i < task_count; i++) {
-        cJSON* object = cJSON_CreateObject();
-        cJSON_AddNumberToObject(object, "handle", (uint32_t)tasks[i].xHandle);
-        cJSON_AddStringToObject(object, "name", tasks[i].pcTaskName);
-        cJSON_AddNumberToObject(object, "number", (uint32_t)tasks[i].xTaskNumber);
-
-        switch(tasks[i].eCurrentState) {
+    // the metrics sampler keeps a copy, no need to walk the task list here
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_array_begin(&writer, "list");
+
+    MetricsTask task;
+    size_t task_count = 0;
+    for(; metrics_get_task(task_count, &task); task_count++) {
+        json_writer_object_begin(&writer, NULL);
+        json_writer_uint(&writer, "handle", task.handle);
+        json_writer_string(&writer, "name", task.name);
+        json_writer_uint(&writer, "number", task.number);
+
+        switch(task.state) {
         case eRunning:
-            cJSON_AddStringToObject(object, "state", "Running");
+            json_writer_string(&writer, "state", "Running");
             break;
         case eReady:
-            cJSON_AddStringToObject(object, "state", "Ready");
+            json_writer_string(&writer, "state", "Ready");
             break;
         case eBlocked:
-            cJSON_AddStringToObject(object, "state", "Blocked");
+            json_writer_string(&writer, "state", "Blocked");
             break;
         case eSuspended:
-            cJSON_AddStringToObject(object, "state", "Suspended");
+            json_writer_string(&writer, "state", "Suspended");
             break;
         case eDeleted:
-            cJSON_AddStringToObject(object, "state", "Deleted");
+            json_writer_string(&writer, "state", "Deleted");
             break;
         case eInvalid:
-            cJSON_AddStringToObject(object, "state", "Invalid");
+            json_writer_string(&writer, "state", "Invalid");
             break;
         }
-        cJSON_AddNumberToObject(object, "current_priority", (uint32_t)tasks[i].uxCurrentPriority);
-        cJSON_AddNumberToObject(object, "base_priority", (uint32_t)tasks[i].uxBasePriority);
-        cJSON_AddNumberToObject(object, "runtime", (uint32_t)tasks[i].ulRunTimeCounter);
-        cJSON_AddNumberToObject(object, "stack_base", (uint32_t)tasks[i].pxStackBase);
-        cJSON_AddNumberToObject(object, "watermark", (uint32_t)tasks[i].usStackHighWaterMark);
+        json_writer_uint(&writer, "current_priority", task.current_priority);
+        json_writer_uint(&writer, "base_priority", task.base_priority);
+        json_writer_uint(&writer, "runtime", task.runtime);
+        json_writer_uint(&writer, "cpu_permille", task.cpu_permille);
+        json_writer_uint(&writer, "stack_base", task.stack_base);
+        json_writer_uint(&writer, "watermark", task.watermark);
+        json_writer_object_end(&writer);
+    }
+
+    json_writer_array_end(&writer);
+    json_writer_uint(&writer, "count", task_count);
+    json_writer_object_end(&writer);
 
-        cJSON_AddItemToArray(array, object);
+    return http_json_end(req, &writer);
+}
+
+static esp_err_t system_metrics_handler(httpd_req_t* req) {
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    HttpTextOutput output = {
+        .req = req,
+        .used = 0,
+    };
+    if(!metrics_write_prometheus(http_text_write, &output)) {
+        ESP_LOGE(TAG, "metrics sending failed");
+        return ESP_FAIL;
     }
 
-    const char* json_text = cJSON_Print(root);
-    httpd_resp_sendstr(req, json_text);
-    free((void*)json_text);
-    cJSON_Delete(root);
-    free((void*)tasks);
+    if(output.used > 0 && httpd_resp_send_chunk(req, http_chunk, output.used) != ESP_OK) {
+        return ESP_FAIL;
+    }
 
+    httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
@@ -246,86 +446,84 @@ static esp_err_t system_reboot(httpd_req_t* req) {
     return ESP_OK;
 }
 
+static void http_add_heap_info(JsonWriter* writer, const char* key, uint32_t caps) {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, caps);
+
+    json_writer_object_begin(writer, key);
+    json_writer_uint(writer, "total_free_bytes", info.total_free_bytes);
+    json_writer_uint(writer, "total_allocated_bytes", info.total_allocated_bytes);
+    json_writer_uint(writer, "largest_free_block", info.largest_free_block);
+    json_writer_uint(writer, "minimum_free_bytes", info.minimum_free_bytes);
+    json_writer_object_end(writer);
+}
+
 static esp_err_t system_info_get_handler(httpd_req_t* req) {
     httpd_resp_common(req);
-    cJSON* root = cJSON_CreateObject();
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
 
-    cJSON_AddStringToObject(root, "idf_version", IDF_VER);
-    cJSON_AddStringToObject(root, "firmware_commit", FW_GIT_COMMIT);
-    cJSON_AddStringToObject(root, "firmware_branch", FW_GIT_BRANCH);
-    cJSON_AddStringToObject(root, "firmware_branch_num", FW_GIT_BRANCH_NUM);
-    cJSON_AddStringToObject(root, "firmware_version", FW_GIT_VERSION);
-    cJSON_AddStringToObject(root, "firmware_build_date", FW_BUILD_DATE);
+    json_writer_string(&writer, "idf_version", IDF_VER);
+    json_writer_string(&writer, "firmware_commit", FW_GIT_COMMIT);
+    json_writer_string(&writer, "firmware_branch", FW_GIT_BRANCH);
+    json_writer_string(&writer, "firmware_branch_num", FW_GIT_BRANCH_NUM);
+    json_writer_string(&writer, "firmware_version", FW_GIT_VERSION);
+    json_writer_string(&writer, "firmware_build_date", FW_BUILD_DATE);
 
     switch(chip_info.model) {
     case CHIP_ESP32:
-        cJSON_AddStringToObject(root, "model", "ESP32");
+        json_writer_string(&writer, "model", "ESP32");
         break;
     case CHIP_ESP32S2:
-        cJSON_AddStringToObject(root, "model", "ESP32-S2");
+        json_writer_string(&writer, "model", "ESP32-S2");
         break;
     case CHIP_ESP32H2:
-        cJSON_AddStringToObject(root, "model", "ESP32-H2");
+        json_writer_string(&writer, "model", "ESP32-H2");
         break;
     case CHIP_ESP32S3:
-        cJSON_AddStringToObject(root, "model", "ESP32-S3");
+        json_writer_string(&writer, "model", "ESP32-S3");
         break;
     case CHIP_ESP32C3:
-        cJSON_AddStringToObject(root, "model", "ESP32-C3");
+        json_writer_string(&writer, "model", "ESP32-C3");
         break;
     default:
-        cJSON_AddStringToObject(root, "model", "UNKNOWN");
+        json_writer_string(&writer, "model", "UNKNOWN");
         break;
     }
-    cJSON_AddNumberToObject(root, "revision", chip_info.revision);
-    cJSON_AddNumberToObject(root, "cores", chip_info.cores);
+    json_writer_uint(&writer, "revision", chip_info.revision);
+    json_writer_uint(&writer, "cores", chip_info.cores);
 
     // main heap
-    multi_heap_info_t info;
-    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
-
-    cJSON* heap = cJSON_AddObjectToObject(root, "heap");
-    cJSON_AddNumberToObject(heap, "total_free_bytes", info.total_free_bytes);
-    cJSON_AddNumberToObject(heap, "total_allocated_bytes", info.total_allocated_bytes);
-    cJSON_AddNumberToObject(heap, "largest_free_block", info.largest_free_block);
-    cJSON_AddNumberToObject(heap, "minimum_free_bytes", info.minimum_free_bytes);
+    http_add_heap_info(&writer, "heap", MALLOC_CAP_INTERNAL);
 
     // psram heap
-    heap_caps_get_info(&info, MALLOC_CAP_SPIRAM);
-
-    cJSON* psram_heap = cJSON_AddObjectToObject(root, "psram_heap");
-    cJSON_AddNumberToObject(psram_heap, "total_free_bytes", info.total_free_bytes);
-    cJSON_AddNumberToObject(psram_heap, "total_allocated_bytes", info.total_allocated_bytes);
-    cJSON_AddNumberToObject(psram_heap, "largest_free_block", info.largest_free_block);
-    cJSON_AddNumberToObject(psram_heap, "minimum_free_bytes", info.minimum_free_bytes);
+    http_add_heap_info(&writer, "psram_heap", MALLOC_CAP_SPIRAM);
 
     // ip addr
-    cJSON_AddNumberToObject(root, "ip", network_get_ip());
+    json_writer_uint(&writer, "ip", network_get_ip());
 
     // mac
     uint8_t mac_addr[6] = {0};
     ESP_ERROR_CHECK(esp_read_mac(mac_addr, ESP_MAC_WIFI_STA));
 
-    cJSON* mac = cJSON_AddArrayToObject(root, "mac");
-    cJSON_AddItemToArray(mac, cJSON_CreateNumber(mac_addr[0]));
-    cJSON_AddItemToArray(mac, cJSON_CreateNumber(mac_addr[1]));
-    cJSON_AddItemToArray(mac, cJSON_CreateNumber(mac_addr[2]));
-    cJSON_AddItemToArray(mac, cJSON_CreateNumber(mac_addr[3]));
-    cJSON_AddItemToArray(mac, cJSON_CreateNumber(mac_addr[4]));
-    cJSON_AddItemToArray(mac, cJSON_CreateNumber(mac_addr[5]));
-
-    const char* json_text = cJSON_Print(root);
-    httpd_resp_sendstr(req, json_text);
-    free((void*)json_text);
-    cJSON_Delete(root);
-    return ESP_OK;
+    json_writer_array_begin(&writer, "mac");
+    for(size_t i = 0; i < sizeof(mac_addr); i++) {
+        json_writer_uint(&writer, NULL, mac_addr[i]);
+    }
+    json_writer_array_end(&writer);
+
+    json_writer_object_end(&writer);
+    return http_json_end(req, &writer);
 }
 
 static esp_err_t wifi_get_credentials_handler(httpd_req_t* req) {
     httpd_resp_common(req);
-    cJSON* root = cJSON_CreateObject();
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
 
     mstring_t* ap_ssid = mstring_alloc();
     mstring_t* ap_pass = mstring_alloc();
@@ -343,51 +541,52 @@ static esp_err_t wifi_get_credentials_handler(httpd_req_t* req) {
     nvs_config_get_sta_pass(sta_pass);
     nvs_config_get_hostname(hostname);
 
-    cJSON_AddStringToObject(root, "ap_ssid", mstring_get_cstr(ap_ssid));
-    cJSON_AddStringToObject(root, "ap_pass", mstring_get_cstr(ap_pass));
-    cJSON_AddStringToObject(root, "sta_ssid", mstring_get_cstr(sta_ssid));
-    cJSON_AddStringToObject(root, "sta_pass", mstring_get_cstr(sta_pass));
-    cJSON_AddStringToObject(root, "hostname", mstring_get_cstr(hostname));
+    json_writer_string(&writer, "ap_ssid", mstring_get_cstr(ap_ssid));
+    json_writer_string(&writer, "ap_pass", mstring_get_cstr(ap_pass));
+    json_writer_string(&writer, "sta_ssid", mstring_get_cstr(sta_ssid));
+    json_writer_string(&writer, "sta_pass", mstring_get_cstr(sta_pass));
+    json_writer_string(&writer, "hostname", mstring_get_cstr(hostname));
 
     switch(wifi_mode) {
     case WiFiModeAP:
-        cJSON_AddStringToObject(root, "wifi_mode", CFG_WIFI_MODE_AP);
+        json_writer_string(&writer, "wifi_mode", CFG_WIFI_MODE_AP);
         break;
     case WiFiModeSTA:
-        cJSON_AddStringToObject(root, "wifi_mode", CFG_WIFI_MODE_STA);
+        json_writer_string(&writer, "wifi_mode", CFG_WIFI_MODE_STA);
         break;
     case WiFiModeDisabled:
-        cJSON_AddStringToObject(root, "wifi_mode", CFG_WIFI_MODE_DISABLED);
+        json_writer_string(&writer, "wifi_mode", CFG_WIFI_MODE_DISABLED);
         break;
     }
 
     switch(usb_mode) {
     case UsbModeBM:
-        cJSON_AddStringToObject(root, "usb_mode", CFG_USB_MODE_BM);
+        json_writer_string(&writer, "usb_mode", CFG_USB_MODE_BM);
         break;
     case UsbModeDAP:
-        cJSON_AddStringToObject(root, "usb_mode", CFG_USB_MODE_DAP);
+        json_writer_string(&writer, "usb_mode", CFG_USB_MODE_DAP);
+        break;
+    case UsbModeNET:
+        json_writer_string(&writer, "usb_mode", CFG_USB_MODE_NET);
+        break;
+    case UsbModeMSC:
+        json_writer_string(&writer, "usb_mode", CFG_USB_MODE_MSC);
         break;
     }
 
-    const char* json_text = cJSON_Print(root);
-    httpd_resp_sendstr(req, json_text);
-    free((void*)json_text);
-    cJSON_Delete(root);
+    json_writer_object_end(&writer);
     mstring_free(ap_ssid);
     mstring_free(ap_pass);
     mstring_free(sta_ssid);
     mstring_free(sta_pass);
     mstring_free(hostname);
-    return ESP_OK;
+    return http_json_end(req, &writer);
 }
 
 static esp_err_t wifi_set_credentials_handler(httpd_req_t* req) {
     httpd_resp_common(req);
 
-    int total_length = req->content_len;
-    int cur_len = 0;
-    char* buffer = malloc(256);
+    JsonReader reader;
     mstring_t* ap_ssid = mstring_alloc();
     mstring_t* ap_pass = mstring_alloc();
     mstring_t* sta_ssid = mstring_alloc();
@@ -395,81 +594,46 @@ static esp_err_t wifi_set_credentials_handler(httpd_req_t* req) {
     mstring_t* wifi_mode = mstring_alloc();
     mstring_t* usb_mode = mstring_alloc();
     mstring_t* hostname = mstring_alloc();
-    const char* error_text = JSON_ERROR("unknown error");
-    int received = 0;
+    const char* error_text = http_json_read(req, &reader);
 
-    if(total_length >= 256) {
-        error_text = JSON_ERROR("request too long");
+    if(error_text != NULL) {
         goto err_fail;
     }
 
-    while(cur_len < total_length) {
-        received = httpd_req_recv(req, buffer + cur_len, total_length);
-        if(received <= 0) {
-            error_text = JSON_ERROR("cannot receive request data");
-            goto err_fail;
-        }
-        cur_len += received;
-    }
-    buffer[total_length] = '\0';
-
-    cJSON* root = cJSON_Parse(buffer);
-    if(cJSON_GetObjectItem(root, "ap_ssid") != NULL) {
-        mstring_set(ap_ssid, cJSON_GetObjectItem(root, "ap_ssid")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "ap_ssid", ap_ssid)) {
         error_text = JSON_ERROR("request dont have [ap_ssid] field");
         goto err_fail;
     }
 
-    if(cJSON_GetObjectItem(root, "ap_pass") != NULL) {
-        mstring_set(ap_pass, cJSON_GetObjectItem(root, "ap_pass")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "ap_pass", ap_pass)) {
         error_text = JSON_ERROR("request dont have [ap_pass] field");
         goto err_fail;
     }
 
-    if(cJSON_GetObjectItem(root, "sta_ssid") != NULL) {
-        mstring_set(sta_ssid, cJSON_GetObjectItem(root, "sta_ssid")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "sta_ssid", sta_ssid)) {
         error_text = JSON_ERROR("request dont have [sta_ssid] field");
         goto err_fail;
     }
 
-    if(cJSON_GetObjectItem(root, "sta_pass") != NULL) {
-        mstring_set(sta_pass, cJSON_GetObjectItem(root, "sta_pass")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "sta_pass", sta_pass)) {
         error_text = JSON_ERROR("request dont have [sta_pass] field");
         goto err_fail;
     }
 
-    if(cJSON_GetObjectItem(root, "wifi_mode") != NULL) {
-        mstring_set(wifi_mode, cJSON_GetObjectItem(root, "wifi_mode")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "wifi_mode", wifi_mode)) {
         error_text = JSON_ERROR("request dont have [wifi_mode] field");
         goto err_fail;
     }
 
-    if(cJSON_GetObjectItem(root, "usb_mode") != NULL) {
-        mstring_set(usb_mode, cJSON_GetObjectItem(root, "usb_mode")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "usb_mode", usb_mode)) {
         error_text = JSON_ERROR("request dont have [usb_mode] field");
         goto err_fail;
     }
 
-    if(cJSON_GetObjectItem(root, "hostname") != NULL) {
-        mstring_set(hostname, cJSON_GetObjectItem(root, "hostname")->valuestring);
-    } else {
-        cJSON_Delete(root);
+    if(!http_json_get_mstring(&reader, "hostname", hostname)) {
         error_text = JSON_ERROR("request dont have [hostname] field");
         goto err_fail;
     }
-    cJSON_Delete(root);
 
     if(strcmp(mstring_get_cstr(wifi_mode), CFG_WIFI_MODE_AP) != 0 &&
        strcmp(mstring_get_cstr(wifi_mode), CFG_WIFI_MODE_STA) != 0 &&
@@ -478,7 +642,9 @@ static esp_err_t wifi_set_credentials_handler(httpd_req_t* req) {
         goto err_fail;
     }
     if(strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_BM) != 0 &&
-       strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_DAP) != 0) {
+       strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_DAP) != 0 &&
+       strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_NET) != 0 &&
+       strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_MSC) != 0) {
         error_text = JSON_ERROR("invalid value in [usb_mode]");
         goto err_fail;
     }
@@ -522,6 +688,16 @@ static esp_err_t wifi_set_credentials_handler(httpd_req_t* req) {
             error_text = JSON_ERROR("cannot set [usb_mode]");
             goto err_fail;
         }
+    } else if(strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_NET) == 0) {
+        if(nvs_config_set_usb_mode(UsbModeNET) != ESP_OK) {
+            error_text = JSON_ERROR("cannot set [usb_mode]");
+            goto err_fail;
+        }
+    } else if(strcmp(mstring_get_cstr(usb_mode), CFG_USB_MODE_MSC) == 0) {
+        if(nvs_config_set_usb_mode(UsbModeMSC) != ESP_OK) {
+            error_text = JSON_ERROR("cannot set [usb_mode]");
+            goto err_fail;
+        }
     } else {
         if(nvs_config_set_usb_mode(UsbModeBM) != ESP_OK) {
             error_text = JSON_ERROR("cannot set [usb_mode]");
@@ -535,7 +711,6 @@ static esp_err_t wifi_set_credentials_handler(httpd_req_t* req) {
     }
 
     httpd_resp_sendstr(req, JSON_RESULT("WIFI settings saved"));
-    free(buffer);
     mstring_free(ap_ssid);
     mstring_free(ap_pass);
     mstring_free(sta_ssid);
@@ -547,12 +722,12 @@ static esp_err_t wifi_set_credentials_handler(httpd_req_t* req) {
 
 err_fail:
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, error_text);
-    free(buffer);
     mstring_free(ap_ssid);
     mstring_free(ap_pass);
     mstring_free(sta_ssid);
     mstring_free(sta_pass);
     mstring_free(wifi_mode);
+    mstring_free(usb_mode);
     mstring_free(hostname);
     return ESP_FAIL;
 }
@@ -569,77 +744,49 @@ static esp_err_t wifi_list_get_handler(httpd_req_t* req) {
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_info));
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
 
-    cJSON* root = cJSON_CreateObject();
-    cJSON* array = cJSON_AddArrayToObject(root, "net_list");
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_array_begin(&writer, "net_list");
 
     for(int i = 0; (i < WIFI_SCAN_SIZE) && (i < ap_count); i++) {
-        cJSON* object = cJSON_CreateObject();
-        cJSON_AddStringToObject(object, "ssid", (const char*)&ap_info[i].ssid);
-        cJSON_AddNumberToObject(object, "channel", ap_info[i].primary);
-        cJSON_AddNumberToObject(object, "rssi", ap_info[i].rssi);
-        cJSON_AddStringToObject(object, "auth", get_auth_mode(ap_info[i].authmode));
+        json_writer_object_begin(&writer, NULL);
+        json_writer_string(&writer, "ssid", (const char*)&ap_info[i].ssid);
+        json_writer_uint(&writer, "channel", ap_info[i].primary);
+        json_writer_int(&writer, "rssi", ap_info[i].rssi);
+        json_writer_string(&writer, "auth", get_auth_mode(ap_info[i].authmode));
         if(ap_info[i].authmode != WIFI_AUTH_WEP) {
-            cJSON_AddStringToObject(
-                object, "pairwise_cipher", get_pairwise_cipher(ap_info[i].pairwise_cipher));
-            cJSON_AddStringToObject(
-                object, "group_cipher", get_group_cipher(ap_info[i].group_cipher));
+            json_writer_string(
+                &writer, "pairwise_cipher", get_pairwise_cipher(ap_info[i].pairwise_cipher));
+            json_writer_string(
+                &writer, "group_cipher", get_group_cipher(ap_info[i].group_cipher));
         }
-        cJSON_AddItemToArray(array, object);
+        json_writer_object_end(&writer);
     }
-    cJSON_AddNumberToObject(root, "total", ap_count);
-    const char* json_text = cJSON_Print(root);
-    httpd_resp_sendstr(req, json_text);
-    free((void*)json_text);
+    json_writer_array_end(&writer);
+    json_writer_uint(&writer, "total", ap_count);
+    json_writer_object_end(&writer);
 
-    cJSON_Delete(root);
     free(ap_info);
-    return ESP_OK;
+    return http_json_end(req, &writer);
 }
 
 static esp_err_t gpio_led_set_handler(httpd_req_t* req) {
     httpd_resp_common(req);
 
-    int total_length = req->content_len;
-    int current_length = 0;
-    char* buffer = malloc(256);
-    const char* error_text = JSON_ERROR("unknown error");
-    int received = 0;
+    JsonReader reader;
+    const char* error_text = http_json_read(req, &reader);
     int32_t led_red = -1;
     int32_t led_green = -1;
     int32_t led_blue = -1;
 
-    if(total_length >= 256) {
-        error_text = JSON_ERROR("request too long");
+    if(error_text != NULL) {
         goto err_fail;
     }
 
-    while(current_length < total_length) {
-        received = httpd_req_recv(req, buffer + current_length, total_length);
-        if(received <= 0) {
-            error_text = JSON_ERROR("cannot receive request data");
-            goto err_fail;
-        }
-        current_length += received;
-    }
-    buffer[total_length] = '\0';
-
-    cJSON* root = cJSON_Parse(buffer);
-    cJSON* element;
-    element = cJSON_GetObjectItem(root, "red");
-    if(element != NULL && element->type == cJSON_Number) {
-        led_red = element->valuedouble;
-    }
-
-    element = cJSON_GetObjectItem(root, "green");
-    if(element != NULL && element->type == cJSON_Number) {
-        led_green = element->valuedouble;
-    }
-
-    element = cJSON_GetObjectItem(root, "blue");
-    if(element != NULL && element->type == cJSON_Number) {
-        led_blue = element->valuedouble;
-    }
-    cJSON_Delete(root);
+    json_reader_get_int(&reader, json_reader_find(&reader, JSON_READER_ROOT, "red"), &led_red);
+    json_reader_get_int(&reader, json_reader_find(&reader, JSON_READER_ROOT, "green"), &led_green);
+    json_reader_get_int(&reader, json_reader_find(&reader, JSON_READER_ROOT, "blue"), &led_blue);
 
     if((led_red < 0 && led_green < 0 && led_blue < 0) ||
        (led_red > 255 || led_green > 255 || led_blue > 255)) {
@@ -658,173 +805,707 @@ static esp_err_t gpio_led_set_handler(httpd_req_t* req) {
     }
 
     httpd_resp_sendstr(req, JSON_RESULT("OK"));
-    free(buffer);
     return ESP_OK;
 
 err_fail:
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, error_text);
-    free(buffer);
     return ESP_FAIL;
 }
 
 /*************** UART ***************/
-#include <stream_buffer.h>
+#include <lwip/sockets.h>
+#include "uart-capture.h"
+#include "uart-compress.h"
+#include "uart-recorder.h"
+#include "uart-blackbox.h"
+#include "uart-trigger.h"
+#include "uart-autobaud.h"
+#include "network-uart.h"
+#include "network-websocket.h"
+
+#define WEBSOCKET_STATS_PERIOD_MS 1000
+#define WEBSOCKET_STATS_TEXT_SIZE (16 * 1024)
+#define WEBSOCKET_METRICS_FULL_EVERY 10 // pushes, the rest only carry changed series
+#define WEBSOCKET_EVENT_TEXT_SIZE 256
+#define WEBSOCKET_CONFIG_TEXT_SIZE 160
+#define WEBSOCKET_CONFIG_TOKENS 16
+
+static void websocket_trigger_notify(size_t index, const char* pattern, void* context) {
+    char text[WEBSOCKET_EVENT_TEXT_SIZE];
+    JsonWriter writer;
+    json_writer_init(&writer, text, sizeof(text), NULL, NULL);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_uint(&writer, "trigger", index);
+    json_writer_string(&writer, "pattern", pattern);
+    json_writer_object_end(&writer);
+    if(!json_writer_finish(&writer)) return;
+
+    // text frames, UART data always goes in binary ones
+    network_websocket_broadcast_text(text);
+    network_websocket_publish(NetworkWebsocketChannelEvents, text, writer.used);
+}
 
-#define WEBSOCKET_STREAM_BUFFER_SIZE_BYTES 512 * 1024
-static uint8_t websocket_stream_storage[WEBSOCKET_STREAM_BUFFER_SIZE_BYTES + 1] EXT_RAM_ATTR;
-static StaticStreamBuffer_t websocket_stream_buffer_struct;
-static StreamBufferHandle_t websocket_stream = NULL;
+static void uart_config_write(JsonWriter* writer) {
+    UsbUartConfig config = usb_uart_get_line_coding();
 
-void network_http_uart_write_data(uint8_t* data, size_t size) {
-    if(websocket_stream == NULL) {
-        return;
+    json_writer_object_begin(writer, NULL);
+    json_writer_uint(writer, "bit_rate", config.bit_rate);
+    json_writer_uint(writer, "actual_bit_rate", usb_uart_get_actual_bit_rate());
+    json_writer_uint(writer, "stop_bits", config.stop_bits);
+    json_writer_uint(writer, "parity", config.parity);
+    json_writer_uint(writer, "data_bits", config.data_bits);
+    json_writer_object_end(writer);
+}
+
+static esp_err_t uart_get_config_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    uart_config_write(&writer);
+    return http_json_end(req, &writer);
+}
+
+static void http_add_compress_stats(JsonWriter* writer, const UartCompressStats* stats) {
+    json_writer_object_begin(writer, "compress");
+    json_writer_uint(writer, "frames", stats->frames);
+    json_writer_uint(writer, "raw_bytes", stats->raw_bytes);
+    json_writer_uint(writer, "compressed_bytes", stats->compressed_bytes);
+    json_writer_double(
+        writer,
+        "ratio",
+        stats->compressed_bytes ? (double)stats->raw_bytes / stats->compressed_bytes : 0);
+    json_writer_uint(writer, "cpu_us", stats->cpu_us);
+    json_writer_double(
+        writer,
+        "cpu_us_per_kb",
+        stats->raw_bytes ? (double)stats->cpu_us * 1024 / stats->raw_bytes : 0);
+    json_writer_object_end(writer);
+}
+
+static void uart_stats_write(JsonWriter* writer) {
+    json_writer_object_begin(writer, NULL);
+
+    UartStats uart_stats;
+    usb_uart_get_stats(&uart_stats);
+
+    json_writer_object_begin(writer, "uart");
+    json_writer_uint(writer, "rx_bytes", uart_stats.rx_bytes);
+    json_writer_uint(writer, "tx_bytes", uart_stats.tx_bytes);
+    json_writer_uint(writer, "fifo_overflows", uart_stats.fifo_overflows);
+    json_writer_uint(writer, "frame_errors", uart_stats.frame_errors);
+    json_writer_uint(writer, "parity_errors", uart_stats.parity_errors);
+    json_writer_uint(writer, "breaks", uart_stats.breaks);
+    json_writer_uint(writer, "dma_stalls", uart_stats.dma_stalls);
+    json_writer_uint(writer, "rx_high_water", uart_stats.rx_high_water);
+    json_writer_uint(writer, "tx_high_water", uart_stats.tx_high_water);
+    json_writer_object_end(writer);
+
+    UartCaptureStats capture_stats;
+    uart_capture_get_stats(&capture_stats);
+
+    json_writer_object_begin(writer, "capture");
+    json_writer_uint(writer, "size", capture_stats.size);
+    json_writer_uint(writer, "received", capture_stats.received);
+    json_writer_uint(writer, "overruns", capture_stats.overruns);
+    json_writer_object_end(writer);
+
+    json_writer_array_begin(writer, "sinks");
+    UartSinkStats sink_stats;
+    for(size_t i = 0; uart_capture_get_sink_stats(i, &sink_stats); i++) {
+        json_writer_object_begin(writer, NULL);
+        json_writer_string(writer, "name", sink_stats.name);
+        json_writer_string(writer, "policy", uart_capture_policy_name(sink_stats.policy));
+        json_writer_uint(writer, "sent", sink_stats.sent);
+        json_writer_uint(writer, "dropped", sink_stats.dropped);
+        json_writer_uint(writer, "failed", sink_stats.failed);
+        json_writer_uint(writer, "lag", sink_stats.lag);
+        json_writer_uint(writer, "high_water", sink_stats.high_water);
+        json_writer_object_end(writer);
     }
+    json_writer_array_end(writer);
+
+    json_writer_object_begin(writer, "websocket");
+    json_writer_array_begin(writer, "clients");
+    NetworkWebsocketStats websocket_stats;
+    for(size_t i = 0; network_websocket_get_client_stats(i, &websocket_stats); i++) {
+        json_writer_object_begin(writer, NULL);
+        json_writer_bool(writer, "connected", websocket_stats.connected);
+        json_writer_bool(writer, "compressed", websocket_stats.compressed);
+        json_writer_bool(writer, "mux", websocket_stats.mux);
+        json_writer_string(writer, "policy", uart_capture_policy_name(websocket_stats.policy));
+        json_writer_uint(writer, "frames", websocket_stats.frames);
+        json_writer_uint(writer, "bytes", websocket_stats.bytes);
+        json_writer_uint(writer, "text_frames", websocket_stats.text_frames);
+        json_writer_uint(writer, "text_dropped", websocket_stats.text_dropped);
+        json_writer_uint(writer, "credit_stalls", websocket_stats.credit_stalls);
+        json_writer_uint(writer, "input_dropped", websocket_stats.input_dropped);
+        json_writer_uint(writer, "errors", websocket_stats.errors);
+        if(websocket_stats.compressed) {
+            http_add_compress_stats(writer, &websocket_stats.compress);
+        }
+        json_writer_object_end(writer);
+    }
+    json_writer_array_end(writer);
+    json_writer_object_end(writer);
+
+    UartRecorderStats recorder_stats;
+    uart_recorder_get_stats(&recorder_stats);
+
+    json_writer_object_begin(writer, "recorder");
+    json_writer_bool(writer, "enabled", recorder_stats.enabled);
+    json_writer_uint(writer, "size", recorder_stats.size);
+    json_writer_uint(writer, "used", recorder_stats.used);
+    json_writer_uint(writer, "chunks", recorder_stats.chunks);
+    json_writer_uint(writer, "recorded", recorder_stats.recorded);
+    json_writer_uint(writer, "lost", recorder_stats.lost);
+    json_writer_uint(writer, "evicted", recorder_stats.evicted);
+    json_writer_object_end(writer);
+
+    UartBlackboxStats blackbox_stats;
+    uart_blackbox_get_stats(&blackbox_stats);
+
+    json_writer_object_begin(writer, "blackbox");
+    json_writer_bool(writer, "present", blackbox_stats.present);
+    json_writer_bool(writer, "enabled", blackbox_stats.enabled);
+    json_writer_uint(writer, "size", blackbox_stats.size);
+    json_writer_uint(writer, "boot", blackbox_stats.boot);
+    json_writer_uint(writer, "pages_written", blackbox_stats.pages_written);
+    json_writer_uint(writer, "raw_bytes", blackbox_stats.raw_bytes);
+    json_writer_uint(writer, "stored_bytes", blackbox_stats.stored_bytes);
+    json_writer_uint(writer, "lost", blackbox_stats.lost);
+    json_writer_object_end(writer);
+
+    json_writer_object_begin(writer, "tcp");
+    json_writer_string(
+        writer, "slow_policy", network_uart_slow_policy_name(network_uart_get_slow_policy()));
+
+    json_writer_array_begin(writer, "clients");
+    NetworkUartStats tcp_stats;
+    for(size_t i = 0; network_uart_get_client_stats(i, &tcp_stats); i++) {
+        json_writer_object_begin(writer, NULL);
+        json_writer_bool(writer, "connected", tcp_stats.connected);
+        json_writer_bool(writer, "observer", tcp_stats.observer);
+        json_writer_uint(writer, "bytes", tcp_stats.bytes);
+        json_writer_uint(writer, "segments", tcp_stats.segments);
+        json_writer_uint(writer, "rate", tcp_stats.rate);
+        json_writer_uint(writer, "window_us", tcp_stats.window_us);
+        json_writer_uint(writer, "flush_size", tcp_stats.coalesce.flush_size);
+        json_writer_uint(writer, "max_window_ms", tcp_stats.coalesce.max_window_ms);
+        json_writer_bool(writer, "flush_on_newline", tcp_stats.coalesce.flush_on_newline);
+        json_writer_uint(writer, "latency_avg_us", tcp_stats.latency_avg_us);
+        json_writer_uint(writer, "latency_max_us", tcp_stats.latency_max_us);
+        json_writer_uint(writer, "slow_disconnects", tcp_stats.slow_disconnects);
+        json_writer_bool(writer, "compressed", tcp_stats.compressed);
+        if(tcp_stats.compressed) {
+            http_add_compress_stats(writer, &tcp_stats.compress);
+        }
+        json_writer_object_end(writer);
+    }
+    json_writer_array_end(writer);
+    json_writer_object_end(writer);
 
-    size_t written = xStreamBufferSend(websocket_stream, data, size, 0);
-    (void)written;
+    json_writer_object_end(writer);
 }
 
-static void websocket_read_task(void* pvParameters) {
-    const size_t websocket_buffer_size = 4096;
-    uint8_t* buffer = malloc(websocket_buffer_size);
+static esp_err_t uart_stats_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    uart_stats_write(&writer);
+    return http_json_end(req, &writer);
+}
 
-    httpd_ws_frame_t ws_pkt;
-    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-    ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+// frames go out whole, so documents are built in one piece, only the stats task uses it
+static char websocket_stats_text[WEBSOCKET_STATS_TEXT_SIZE] EXT_RAM_ATTR;
 
-    while(true) {
-        size_t read =
-            xStreamBufferReceive(websocket_stream, buffer, websocket_buffer_size, portMAX_DELAY);
+static void websocket_stats_push(void) {
+    JsonWriter writer;
+    json_writer_init(&writer, websocket_stats_text, sizeof(websocket_stats_text), NULL, NULL);
+    uart_stats_write(&writer);
+    if(!json_writer_finish(&writer)) {
+        ESP_LOGE(TAG, "stats do not fit in %u bytes", sizeof(websocket_stats_text));
+        return;
+    }
 
-        if(read == 0) continue;
+    network_websocket_publish(NetworkWebsocketChannelStats, websocket_stats_text, writer.used);
+}
 
-        ws_pkt.payload = buffer;
-        ws_pkt.len = read;
+static void websocket_metrics_push(bool full) {
+    JsonWriter writer;
+    json_writer_init(&writer, websocket_stats_text, sizeof(websocket_stats_text), NULL, NULL);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_int64(&writer, "uptime_ms", esp_timer_get_time() / 1000);
+    json_writer_bool(&writer, "full", full);
+    metrics_write_json(&writer, "metrics", !full);
+    json_writer_object_end(&writer);
+    if(!json_writer_finish(&writer)) {
+        ESP_LOGE(TAG, "metrics do not fit in %u bytes", sizeof(websocket_stats_text));
+        return;
+    }
 
-        static size_t max_clients = CONFIG_LWIP_MAX_LISTENING_TCP;
-        size_t fds = max_clients;
-        int client_fds[max_clients];
+    network_websocket_publish(NetworkWebsocketChannelMetrics, websocket_stats_text, writer.used);
+}
 
-        esp_err_t ret = httpd_get_client_list(server, &fds, client_fds);
+static void websocket_stats_task(void* pvParameters) {
+    uint32_t metrics_pushes = 0;
 
-        if(ret != ESP_OK) {
-            return;
+    while(true) {
+        vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_STATS_PERIOD_MS));
+
+        if(network_websocket_has_subscribers(NetworkWebsocketChannelStats)) {
+            websocket_stats_push();
         }
 
-        for(int i = 0; i < fds; i++) {
-            int client_info = httpd_ws_get_fd_info(server, client_fds[i]);
-            if(client_info == HTTPD_WS_CLIENT_WEBSOCKET) {
-                httpd_ws_send_frame_async(server, client_fds[i], &ws_pkt);
-            }
+        // the first push to a new audience and every few after it carry all series,
+        // so a client that joins late is complete within a few seconds
+        if(network_websocket_has_subscribers(NetworkWebsocketChannelMetrics)) {
+            websocket_metrics_push(metrics_pushes % WEBSOCKET_METRICS_FULL_EVERY == 0);
+            metrics_pushes++;
+        } else {
+            metrics_pushes = 0;
         }
     }
 }
 
-static esp_err_t uart_get_config_handler(httpd_req_t* req) {
-    httpd_resp_common(req);
+static esp_err_t uart_record_handler(httpd_req_t* req) {
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"uart.bmrec\"");
+    httpd_resp_set_type(req, "application/octet-stream");
 
-    cJSON* root = cJSON_CreateObject();
+    uint8_t* buffer = malloc(UART_RECORDER_READ_MIN * 2);
+    if(buffer == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory");
+        return ESP_FAIL;
+    }
 
-    UsbUartConfig config = usb_uart_get_line_coding();
+    UartRecordHeader header;
+    uart_recorder_get_header(&header);
+    esp_err_t err = httpd_resp_send_chunk(req, (const char*)&header, sizeof(header));
+
+    // whole chunks only, the recorder keeps writing while we send
+    UartRecorderCursor cursor;
+    uart_recorder_read_begin(&cursor);
+    while(err == ESP_OK) {
+        size_t length = uart_recorder_read(&cursor, buffer, UART_RECORDER_READ_MIN * 2);
+        if(length == 0) break;
+        err = httpd_resp_send_chunk(req, (const char*)buffer, length);
+    }
 
-    cJSON_AddNumberToObject(root, "bit_rate", config.bit_rate);
-    cJSON_AddNumberToObject(root, "stop_bits", config.stop_bits);
-    cJSON_AddNumberToObject(root, "parity", config.parity);
-    cJSON_AddNumberToObject(root, "data_bits", config.data_bits);
+    free(buffer);
 
-    const char* json_text = cJSON_Print(root);
-    httpd_resp_sendstr(req, json_text);
-    free((void*)json_text);
-    cJSON_Delete(root);
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "record sending failed, %d", err);
+        return ESP_FAIL;
+    }
+
+    if(cursor.skipped > 0) {
+        ESP_LOGW(TAG, "record sending was too slow, %u bytes overwritten", cursor.skipped);
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
-static esp_err_t uart_set_config_handler(httpd_req_t* req) {
+static bool http_query_get_uint(httpd_req_t* req, const char* key, uint32_t* value) {
+    char query[64];
+    char text[16];
+
+    if(httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return false;
+    if(httpd_query_key_value(query, key, text, sizeof(text)) != ESP_OK) return false;
+
+    char* end;
+    *value = strtoul(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+typedef struct {
+    httpd_req_t* req;
+    bool filter_boot;
+    uint32_t boot;
+    uint32_t from_ms;
+    uint32_t to_ms;
+    esp_err_t err;
+} BlackboxDownload;
+
+static bool uart_blackbox_download_page(
+    const UartBlackboxPage* page,
+    const uint8_t* data,
+    void* context) {
+    BlackboxDownload* download = context;
+
+    if(download->filter_boot && page->boot != download->boot) return true;
+    if(page->last_ms < download->from_ms || page->first_ms > download->to_ms) return true;
+
+    download->err = httpd_resp_send_chunk(download->req, (const char*)page, sizeof(*page));
+    if(download->err == ESP_OK) {
+        download->err = httpd_resp_send_chunk(download->req, (const char*)data, page->data_size);
+    }
+
+    return download->err == ESP_OK;
+}
+
+static esp_err_t uart_blackbox_handler(httpd_req_t* req) {
+    BlackboxDownload download = {
+        .req = req,
+        .from_ms = 0,
+        .to_ms = UINT32_MAX,
+        .err = ESP_OK,
+    };
+    download.filter_boot = http_query_get_uint(req, "boot", &download.boot);
+    http_query_get_uint(req, "from", &download.from_ms);
+    http_query_get_uint(req, "to", &download.to_ms);
+
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"uart.bmbx\"");
+    httpd_resp_set_type(req, "application/octet-stream");
+
+    uart_blackbox_for_each_page(uart_blackbox_download_page, &download);
+
+    if(download.err != ESP_OK) {
+        ESP_LOGE(TAG, "blackbox sending failed, %d", download.err);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+typedef struct {
+    JsonWriter* writer;
+    bool started;
+    uint32_t boot;
+    uint32_t first_ms;
+    uint32_t last_ms;
+    uint32_t pages;
+    uint32_t bytes;
+} BlackboxIndex;
+
+static void uart_blackbox_index_flush(BlackboxIndex* index) {
+    if(!index->started) return;
+
+    json_writer_object_begin(index->writer, NULL);
+    json_writer_uint(index->writer, "boot", index->boot);
+    json_writer_uint(index->writer, "first_ms", index->first_ms);
+    json_writer_uint(index->writer, "last_ms", index->last_ms);
+    json_writer_uint(index->writer, "pages", index->pages);
+    json_writer_uint(index->writer, "bytes", index->bytes);
+    json_writer_object_end(index->writer);
+}
+
+static bool uart_blackbox_index_page(
+    const UartBlackboxPage* page,
+    const uint8_t* data,
+    void* context) {
+    BlackboxIndex* index = context;
+
+    // pages come in write order, a new boot starts a new entry
+    if(!index->started || index->boot != page->boot) {
+        uart_blackbox_index_flush(index);
+        index->started = true;
+        index->boot = page->boot;
+        index->first_ms = page->first_ms;
+        index->pages = 0;
+        index->bytes = 0;
+    }
+
+    index->last_ms = page->last_ms;
+    index->pages++;
+    index->bytes += page->raw_size;
+
+    return !index->writer->error;
+}
+
+static esp_err_t uart_blackbox_index_handler(httpd_req_t* req) {
     httpd_resp_common(req);
 
-    int total_length = req->content_len;
-    int current_length = 0;
-    char* buffer = malloc(256);
-    const char* error_text = JSON_ERROR("unknown error");
-    int received = 0;
-    uint32_t uart_bit_rate = 0;
-    uint8_t uart_stop_bits = 0;
-    uint8_t uart_parity = 0;
-    uint8_t uart_data_bits = 0;
-    bool error = false;
-
-    if(total_length >= 256) {
-        error_text = JSON_ERROR("request too long");
-        goto err_fail;
+    UartBlackboxStats stats;
+    uart_blackbox_get_stats(&stats);
+
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_bool(&writer, "present", stats.present);
+    json_writer_uint(&writer, "boot", stats.boot);
+    json_writer_array_begin(&writer, "boots");
+
+    BlackboxIndex index = {
+        .writer = &writer,
+        .started = false,
+    };
+    uart_blackbox_for_each_page(uart_blackbox_index_page, &index);
+    uart_blackbox_index_flush(&index);
+
+    json_writer_array_end(&writer);
+    json_writer_object_end(&writer);
+    return http_json_end(req, &writer);
+}
+
+static esp_err_t uart_autobaud_get_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    UartAutobaudStatus status;
+    uart_autobaud_get_status(&status);
+
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_string(&writer, "state", uart_autobaud_state_name(status.state));
+    json_writer_uint(&writer, "bit_rate", status.bit_rate);
+    json_writer_uint(&writer, "measured", status.measured);
+    json_writer_uint(&writer, "edges", status.edges);
+    json_writer_uint(&writer, "checked_bytes", status.checked_bytes);
+    json_writer_uint(&writer, "errors", status.errors);
+    json_writer_bool(&writer, "cached", status.cached);
+    json_writer_object_end(&writer);
+    return http_json_end(req, &writer);
+}
+
+static esp_err_t uart_autobaud_start_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    // ?cache=0 forces a new measurement
+    uint32_t use_cache = 1;
+    http_query_get_uint(req, "cache", &use_cache);
+
+    if(uart_autobaud_start(use_cache != 0) != ESP_OK) {
+        httpd_resp_send_err(
+            req, HTTPD_500_INTERNAL_SERVER_ERROR, JSON_ERROR("detection is already running"));
+        return ESP_FAIL;
     }
 
-    while(current_length < total_length) {
-        received = httpd_req_recv(req, buffer + current_length, total_length);
-        if(received <= 0) {
-            error_text = JSON_ERROR("cannot receive request data");
-            goto err_fail;
+    httpd_resp_sendstr(req, JSON_RESULT("OK"));
+    return ESP_OK;
+}
+
+static esp_err_t uart_triggers_get_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    JsonWriter writer;
+    http_json_begin(req, &writer);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_array_begin(&writer, "triggers");
+
+    UartTriggerInfo info;
+    for(size_t i = 0; uart_trigger_get(i, &info); i++) {
+        json_writer_object_begin(&writer, NULL);
+        json_writer_string(&writer, "pattern", info.config.pattern);
+
+        json_writer_array_begin(&writer, "actions");
+        for(uint32_t bit = 0; bit < 32; bit++) {
+            if(info.config.actions & (1 << bit)) {
+                json_writer_string(&writer, NULL, uart_trigger_action_name(1 << bit));
+            }
         }
-        current_length += received;
+        json_writer_array_end(&writer);
+
+        json_writer_int(&writer, "gpio", info.config.gpio);
+        json_writer_uint(&writer, "hits", info.hits);
+        json_writer_uint(&writer, "halt_failures", info.halt_failures);
+        json_writer_int64(&writer, "last_hit_us", info.last_hit_us);
+        json_writer_object_end(&writer);
     }
-    buffer[total_length] = '\0';
+    json_writer_array_end(&writer);
 
-    cJSON* root = cJSON_Parse(buffer);
-    cJSON* element;
-    element = cJSON_GetObjectItem(root, "bit_rate");
-    if(element != NULL && element->type == cJSON_Number) {
-        uart_bit_rate = element->valuedouble;
-    } else {
-        error = true;
+    UartTriggerStats stats;
+    uart_trigger_get_stats(&stats);
+
+    json_writer_object_begin(&writer, "matcher");
+    json_writer_uint(&writer, "bytes", stats.bytes);
+    json_writer_uint(&writer, "cpu_us", stats.cpu_us);
+    json_writer_uint(&writer, "lost", stats.lost);
+    json_writer_uint(&writer, "states", stats.states);
+    json_writer_uint(&writer, "classes", stats.classes);
+    json_writer_object_end(&writer);
+
+    json_writer_object_end(&writer);
+    return http_json_end(req, &writer);
+}
+
+static bool uart_trigger_parse(JsonReader* reader, int item, UartTriggerConfig* config) {
+    const char* pattern =
+        json_reader_get_string(reader, json_reader_find(reader, item, "pattern"));
+    int actions = json_reader_find(reader, item, "actions");
+    int32_t gpio;
+
+    if(pattern == NULL || strlen(pattern) > UART_TRIGGER_PATTERN_MAX) {
+        return false;
+    }
+    if(!json_reader_is(reader, actions, JsonTypeArray)) return false;
+
+    strcpy(config->pattern, pattern);
+    config->gpio = json_reader_get_int(reader, json_reader_find(reader, item, "gpio"), &gpio) ?
+                       gpio :
+                       UART_TRIGGER_GPIO_NONE;
+    config->actions = 0;
+
+    for(int action = json_reader_array_first(reader, actions); action >= 0;
+        action = json_reader_array_next(reader, actions, action)) {
+        const char* name = json_reader_get_string(reader, action);
+        UartTriggerAction value;
+        if(name == NULL || !uart_trigger_action_parse(name, &value)) {
+            return false;
+        }
+        config->actions |= value;
     }
 
-    element = cJSON_GetObjectItem(root, "stop_bits");
-    if(element != NULL && element->type == cJSON_Number) {
-        uart_stop_bits = element->valuedouble;
-    } else {
-        error = true;
+    return true;
+}
+
+static esp_err_t uart_triggers_set_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    JsonReader reader;
+    UartTriggerConfig* configs = malloc(sizeof(UartTriggerConfig) * UART_TRIGGER_MAX);
+    const char* error_text = NULL;
+    size_t count = 0;
+
+    if(configs == NULL) {
+        error_text = JSON_ERROR("no memory");
+        goto err_fail;
     }
 
-    element = cJSON_GetObjectItem(root, "parity");
-    if(element != NULL && element->type == cJSON_Number) {
-        uart_parity = element->valuedouble;
-    } else {
-        error = true;
+    error_text = http_json_read(req, &reader);
+    if(error_text != NULL) {
+        goto err_fail;
     }
 
-    element = cJSON_GetObjectItem(root, "data_bits");
-    if(element != NULL && element->type == cJSON_Number) {
-        uart_data_bits = element->valuedouble;
-    } else {
-        error = true;
+    int triggers = json_reader_find(&reader, JSON_READER_ROOT, "triggers");
+    bool error = !json_reader_is(&reader, triggers, JsonTypeArray) ||
+                 json_reader_size(&reader, triggers) > UART_TRIGGER_MAX;
+
+    if(!error) {
+        for(int item = json_reader_array_first(&reader, triggers); item >= 0;
+            item = json_reader_array_next(&reader, triggers, item)) {
+            if(!uart_trigger_parse(&reader, item, &configs[count++])) {
+                error = true;
+                break;
+            }
+        }
     }
-    cJSON_Delete(root);
 
     if(error) {
-        error_text = JSON_ERROR("expected [bit_rate], [stop_bits], [parity], [data_bits]");
+        error_text =
+            JSON_ERROR("expected [triggers] of {pattern, actions[halt|mark|gpio|notify], gpio}");
         goto err_fail;
     }
 
+    esp_err_t err = uart_trigger_set(configs, count);
+    if(err == ESP_ERR_INVALID_ARG) {
+        error_text = JSON_ERROR("bad pattern, or gpio is not a spare pin");
+        goto err_fail;
+    } else if(err != ESP_OK) {
+        error_text = JSON_ERROR("cannot compile triggers");
+        goto err_fail;
+    }
+
+    httpd_resp_sendstr(req, JSON_RESULT("OK"));
+    free(configs);
+    return ESP_OK;
+
+err_fail:
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, error_text);
+    free(configs);
+    return ESP_FAIL;
+}
+
+static esp_err_t uart_set_config_handler(httpd_req_t* req) {
+    httpd_resp_common(req);
+
+    JsonReader reader;
+    const char* error_text = http_json_read(req, &reader);
+    const char* keys[] = {"bit_rate", "stop_bits", "parity", "data_bits"};
+    uint32_t values[COUNT_OF(keys)];
+
+    if(error_text != NULL) {
+        goto err_fail;
+    }
+
+    for(size_t i = 0; i < COUNT_OF(keys); i++) {
+        int element = json_reader_find(&reader, JSON_READER_ROOT, keys[i]);
+        if(!json_reader_get_uint(&reader, element, &values[i])) {
+            error_text = JSON_ERROR("expected [bit_rate], [stop_bits], [parity], [data_bits]");
+            goto err_fail;
+        }
+    }
+
     UsbUartConfig config = {
-        .bit_rate = uart_bit_rate,
-        .stop_bits = uart_stop_bits,
-        .parity = uart_parity,
-        .data_bits = uart_data_bits,
+        .bit_rate = values[0],
+        .stop_bits = values[1],
+        .parity = values[2],
+        .data_bits = values[3],
     };
 
     usb_uart_set_line_coding(config);
 
     httpd_resp_sendstr(req, JSON_RESULT("OK"));
-    free(buffer);
     return ESP_OK;
 
 err_fail:
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, error_text);
-    free(buffer);
     return ESP_FAIL;
 }
 
+static void uart_websocket_config(int fd, char* request, size_t length) {
+    JsonToken tokens[WEBSOCKET_CONFIG_TOKENS];
+    JsonReader reader;
+    const char* keys[] = {"bit_rate", "stop_bits", "parity", "data_bits"};
+    uint32_t values[COUNT_OF(keys)];
+    bool changed = false;
+
+    UsbUartConfig config = usb_uart_get_line_coding();
+    values[0] = config.bit_rate;
+    values[1] = config.stop_bits;
+    values[2] = config.parity;
+    values[3] = config.data_bits;
+
+    // fields that are not there keep their value, an empty request only reads the config
+    if(json_reader_parse(&reader, request, length, tokens, COUNT_OF(tokens))) {
+        for(size_t i = 0; i < COUNT_OF(keys); i++) {
+            int element = json_reader_find(&reader, JSON_READER_ROOT, keys[i]);
+            if(json_reader_get_uint(&reader, element, &values[i])) {
+                changed = true;
+            }
+        }
+    }
+
+    if(changed) {
+        config.bit_rate = values[0];
+        config.stop_bits = values[1];
+        config.parity = values[2];
+        config.data_bits = values[3];
+        usb_uart_set_line_coding(config);
+    }
+
+    char text[WEBSOCKET_CONFIG_TEXT_SIZE];
+    JsonWriter writer;
+    json_writer_init(&writer, text, sizeof(text), NULL, NULL);
+    uart_config_write(&writer);
+    if(!json_writer_finish(&writer)) return;
+
+    network_websocket_send(fd, NetworkWebsocketChannelConfig, text, writer.used);
+}
+
 static esp_err_t uart_websocket_handler(httpd_req_t* req) {
     if(req->method == HTTP_GET) {
+        uint32_t compress = 0;
+        uint32_t backlog = 0;
+        uint32_t mux = 0;
+        http_query_get_uint(req, "compress", &compress);
+        // ?backlog=1 keeps the newest data for a slow client instead of jumping ahead
+        http_query_get_uint(req, "backlog", &backlog);
+        http_query_get_uint(req, "mux", &mux);
+
+        NetworkWebsocketOptions options = {
+            .compressed = compress != 0,
+            .mux = mux != 0,
+            .policy = backlog ? UartSinkPolicyDropOldest : UartSinkPolicySkip,
+        };
+        if(!network_websocket_open(httpd_req_to_sockfd(req), &options)) {
+            return ESP_FAIL;
+        }
+
         ESP_LOGI(TAG, "Handshake done, the new connection was opened");
         return ESP_OK;
     }
@@ -853,7 +1534,12 @@ static esp_err_t uart_websocket_handler(httpd_req_t* req) {
             return ret;
         }
 
-        usb_uart_write(ws_pkt.payload, ws_pkt.len);
+        int fd = httpd_req_to_sockfd(req);
+        if(network_websocket_is_mux(fd) && ws_pkt.payload[0] == NetworkWebsocketChannelConfig) {
+            uart_websocket_config(fd, (char*)ws_pkt.payload + 1, ws_pkt.len - 1);
+        } else {
+            network_websocket_receive(fd, ws_pkt.payload, ws_pkt.len);
+        }
     }
 
     if(buf) {
@@ -885,6 +1571,18 @@ const httpd_uri_t uri_handlers[] = {
      .user_ctx = NULL,
      .is_websocket = false},
 
+    {.uri = "/api/v1/system/metrics",
+     .method = HTTP_GET,
+     .handler = system_metrics_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/metrics",
+     .method = HTTP_GET,
+     .handler = system_metrics_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
     {.uri = "/api/v1/system/reboot",
      .method = HTTP_POST,
      .handler = system_reboot,
@@ -933,6 +1631,54 @@ const httpd_uri_t uri_handlers[] = {
      .user_ctx = NULL,
      .is_websocket = false},
 
+    {.uri = "/api/v1/uart/stats",
+     .method = HTTP_GET,
+     .handler = uart_stats_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/record",
+     .method = HTTP_GET,
+     .handler = uart_record_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/blackbox",
+     .method = HTTP_GET,
+     .handler = uart_blackbox_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/blackbox/index",
+     .method = HTTP_GET,
+     .handler = uart_blackbox_index_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/autobaud",
+     .method = HTTP_GET,
+     .handler = uart_autobaud_get_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/autobaud",
+     .method = HTTP_POST,
+     .handler = uart_autobaud_start_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/triggers",
+     .method = HTTP_GET,
+     .handler = uart_triggers_get_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
+    {.uri = "/api/v1/uart/triggers",
+     .method = HTTP_POST,
+     .handler = uart_triggers_set_handler,
+     .user_ctx = NULL,
+     .is_websocket = false},
+
     {.uri = "/api/v1/uart/websocket",
      .method = HTTP_GET,
      .handler = uart_websocket_handler,
@@ -948,22 +1694,20 @@ const httpd_uri_t uri_handlers[] = {
      .is_websocket = false},
 };
 
+static void http_session_close(httpd_handle_t hd, int sockfd) {
+    network_websocket_close(sockfd);
+    close(sockfd);
+}
+
 void network_http_server_init(void) {
     ESP_LOGI(TAG, "init http server");
 
-    {
-        websocket_stream = xStreamBufferCreateStatic(
-            WEBSOCKET_STREAM_BUFFER_SIZE_BYTES,
-            1,
-            websocket_stream_storage,
-            &websocket_stream_buffer_struct);
-
-        xTaskCreate(websocket_read_task, "websocket_read_task", 4096, NULL, 5, NULL);
-    }
+    http_resources_init();
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.max_uri_handlers = COUNT_OF(uri_handlers);
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.close_fn = http_session_close;
 
     ESP_LOGI(TAG, "starting http server");
     if(httpd_start(&server, &config) != ESP_OK) {
@@ -971,6 +1715,10 @@ void network_http_server_init(void) {
         return;
     }
 
+    network_websocket_init(server);
+    uart_trigger_set_notify(websocket_trigger_notify, NULL);
+    xTaskCreate(websocket_stats_task, "websocket_stats", 4096, NULL, 3, NULL);
+
     for(size_t i = 0; i < COUNT_OF(uri_handlers); i++) {
         ESP_ERROR_CHECK(httpd_register_uri_handler(server, &uri_handlers[i]));
     }
@@ -11,6 +11,4 @@
 /**
  * Start HTTP server
  */
-void network_http_server_init(void);
-
-void network_http_uart_write_data(uint8_t* data, size_t size);
\ No newline at end of file
+void network_http_server_init(void);
\ No newline at end of file
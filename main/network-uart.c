@@ -1,14 +1,16 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/stream_buffer.h>
 #include <esp_system.h>
 #include <esp_wifi.h>
 #include <esp_event.h>
 #include <esp_log.h>
 #include <nvs_flash.h>
 #include <esp_netif.h>
+#include <esp_timer.h>
 
 #include <lwip/err.h>
 #include <lwip/sockets.h>
@@ -20,138 +22,597 @@
 #include "delay.h"
 #include "network-uart.h"
 #include "usb-uart.h"
+#include "uart-capture.h"
 
 #define PORT 3456
+#define OBSERVER_PORT 3457
+#define COMPRESSED_PORT 3458
+#define MAX_CLIENTS 4
 #define KEEPALIVE_IDLE 5
 #define KEEPALIVE_INTERVAL 5
 #define KEEPALIVE_COUNT 3
 #define TAG "network-uart"
+#define SINK_MAX_LAG (256 * 1024)
+#define SLOW_CLIENT_LAG (SINK_MAX_LAG * 3 / 4) // disconnect before the sink starts dropping
+#define SEND_CHUNK_SIZE (4096)
+#define RECEIVE_CHUNK_SIZE (1024)
+#define RATE_PERIOD_US (100 * 1000)
+#define THROTTLE_POLL_US (10 * 1000)
+#define SEND_TIMEOUT_MS (100) // a client that takes nothing for this long gives the ring back
+#define POLL_MS (50)
+
+#define COALESCE_DEFAULT_FLUSH_SIZE (1436) // one TCP segment
+#define COALESCE_DEFAULT_MAX_WINDOW_MS (20)
+
+/*
+ * Every client slot has its own capture sink and tx task, so a client that reads slowly
+ * only delays itself. One server task accepts clients on all ports and moves data from
+ * the control clients to the UART, observers can only watch. Clients of the compressed port
+ * get uart-compress frames, their input is plain.
+ *
+ * The tx task may be in send() when the server task sees a connection end, so the server
+ * only releases the socket and the tx task closes it and frees the slot. The socket number
+ * cannot be reused before that. Every accept bumps the slot generation and the tx task
+ * resets its own state when it sees a new one.
+ */
+
+typedef struct {
+    int socket_id; /*!< set at accept, back to -1 once the tx task closed it*/
+    volatile bool connected;
+    bool released; /*!< the server task no longer reads the socket*/
+    uint32_t generation; /*!< bumped by every accept on the slot*/
+    TaskHandle_t task;
+    bool observer;
+    bool compressed;
+    char name[8];
+    UartSink* sink;
+    UartCompressor* compressor;
+
+    NetworkUartCoalesce coalesce;
+    NetworkUartStats stats;
+    uint64_t latency_sum_us;
+    uint32_t rate_bytes;
+    int64_t rate_start;
+} NetworkUartClient;
 
 typedef struct {
-    bool connected;
-    int socket_id;
+    NetworkUartClient clients[MAX_CLIENTS];
+    NetworkUartCoalesce coalesce;
+    NetworkUartSlowPolicy slow_policy;
 } NetworkUART;
 
-static NetworkUART network_uart;
+static NetworkUART network_uart = {
+    .coalesce =
+        {
+            .flush_size = COALESCE_DEFAULT_FLUSH_SIZE,
+            .max_window_ms = COALESCE_DEFAULT_MAX_WINDOW_MS,
+            .flush_on_newline = true,
+        },
+    .slow_policy = NetworkUartSlowDropOldest,
+};
+static portMUX_TYPE network_uart_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void network_uart_set_coalesce(const NetworkUartCoalesce* coalesce) {
+    portENTER_CRITICAL(&network_uart_mux);
+    network_uart.coalesce = *coalesce;
+    network_uart.coalesce.flush_size = MAX(network_uart.coalesce.flush_size, 1);
+    portEXIT_CRITICAL(&network_uart_mux);
+}
+
+bool network_uart_set_client_coalesce(size_t index, const NetworkUartCoalesce* coalesce) {
+    if(index >= MAX_CLIENTS) return false;
+    NetworkUartClient* client = &network_uart.clients[index];
+
+    portENTER_CRITICAL(&network_uart_mux);
+    bool connected = client->connected;
+    if(connected) {
+        client->coalesce = *coalesce;
+        client->coalesce.flush_size = MAX(client->coalesce.flush_size, 1);
+    }
+    portEXIT_CRITICAL(&network_uart_mux);
+
+    return connected;
+}
+
+void network_uart_get_coalesce(NetworkUartCoalesce* coalesce) {
+    portENTER_CRITICAL(&network_uart_mux);
+    *coalesce = network_uart.coalesce;
+    portEXIT_CRITICAL(&network_uart_mux);
+}
+
+void network_uart_set_slow_policy(NetworkUartSlowPolicy policy) {
+    network_uart.slow_policy = policy;
+}
+
+NetworkUartSlowPolicy network_uart_get_slow_policy(void) {
+    return network_uart.slow_policy;
+}
+
+const char* network_uart_slow_policy_name(NetworkUartSlowPolicy policy) {
+    switch(policy) {
+    case NetworkUartSlowDropOldest:
+        return "drop_oldest";
+    case NetworkUartSlowDisconnect:
+        return "disconnect";
+    default:
+        return "unknown";
+    }
+}
+
+bool network_uart_get_client_stats(size_t index, NetworkUartStats* stats) {
+    if(index >= MAX_CLIENTS) return false;
+    NetworkUartClient* client = &network_uart.clients[index];
+
+    portENTER_CRITICAL(&network_uart_mux);
+    *stats = client->stats;
+    stats->connected = client->connected;
+    stats->observer = client->observer;
+    stats->compressed = client->compressed;
+    stats->coalesce = client->coalesce;
+    portEXIT_CRITICAL(&network_uart_mux);
+
+    if(client->compressor != NULL) {
+        uart_compressor_get_stats(client->compressor, &stats->compress);
+    } else {
+        memset(&stats->compress, 0, sizeof(stats->compress));
+    }
+
+    return true;
+}
+
+static void network_uart_reset_client(
+    NetworkUartClient* client,
+    int sock,
+    bool observer,
+    bool compressed) {
+    portENTER_CRITICAL(&network_uart_mux);
+    // disconnects belong to the slot, everything else to the connection
+    uint32_t slow_disconnects = client->stats.slow_disconnects;
+    memset(&client->stats, 0, sizeof(client->stats));
+    client->stats.slow_disconnects = slow_disconnects;
+    client->coalesce = network_uart.coalesce;
+    client->latency_sum_us = 0;
+    client->rate_bytes = 0;
+    client->rate_start = esp_timer_get_time();
+    client->observer = observer;
+    client->compressed = compressed;
+    client->socket_id = sock;
+    client->generation++;
+    client->connected = true;
+    portEXIT_CRITICAL(&network_uart_mux);
+
+    xTaskNotifyGive(client->task);
+}
 
 bool network_uart_connected(void) {
-    return network_uart.connected;
+    for(size_t i = 0; i < MAX_CLIENTS; i++) {
+        if(network_uart.clients[i].connected) return true;
+    }
+
+    return false;
 }
 
-void network_uart_send(uint8_t* buffer, size_t size) {
-    int to_write = size;
-    while(to_write > 0) {
-        int written = send(network_uart.socket_id, buffer + (size - to_write), to_write, 0);
-        to_write -= written;
+// returns bytes sent, less than size if the client window stayed closed, -1 on error
+static int network_uart_send(int sock, const uint8_t* buffer, size_t size) {
+    size_t sent = 0;
+    while(sent < size) {
+        int written = send(sock, buffer + sent, size - sent, 0);
+        if(written < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        sent += written;
     }
+
+    return sent;
 };
 
-static void receive_and_send_to_uart(void) {
-    size_t rx_size = SIZE_MAX;
-    const size_t data_size = 1024;
-    uint8_t* buffer_rx = malloc(data_size);
+// applies the disconnect policy, returns true if the client is gone
+static bool network_uart_check_slow(NetworkUartClient* client, int sock) {
+    if(network_uart.slow_policy != NetworkUartSlowDisconnect) return false;
+    if(uart_capture_sink_available(client->sink) <= SLOW_CLIENT_LAG) return false;
 
-    do {
-        rx_size = recv(network_uart.socket_id, buffer_rx, data_size, 0);
-        if(rx_size > 0) {
-            usb_uart_write(buffer_rx, rx_size);
-        }
-    } while(rx_size > 0);
+    ESP_LOGW(TAG, "%s is too slow, disconnecting", client->name);
+    portENTER_CRITICAL(&network_uart_mux);
+    client->stats.slow_disconnects++;
+    client->connected = false;
+    portEXIT_CRITICAL(&network_uart_mux);
 
-    free(buffer_rx);
+    // server task sees the socket closing and releases it
+    shutdown(sock, SHUT_RDWR);
+    return true;
 }
 
-static void network_uart_server_task(void* pvParameters) {
-    char addr_str[128];
-    int addr_family = (int)pvParameters;
-    int ip_protocol = 0;
-    int keepAlive = 1;
-    int keepIdle = KEEPALIVE_IDLE;
-    int keepInterval = KEEPALIVE_INTERVAL;
-    int keepCount = KEEPALIVE_COUNT;
-    network_uart.connected = false;
-    struct sockaddr_storage dest_addr;
+// frames must not be cut, so keep trying while the client is there and keeps up
+static bool network_uart_send_frame(
+    NetworkUartClient* client,
+    int sock,
+    const uint8_t* frame,
+    size_t size) {
+    size_t sent = 0;
+    while(sent < size) {
+        if(!client->connected) return false;
+
+        int written = network_uart_send(sock, frame + sent, size - sent);
+        if(written < 0) return false;
+        sent += written;
+
+        // send timed out, the window is still closed
+        if(sent < size && network_uart_check_slow(client, sock)) return false;
+    }
+
+    return true;
+}
+
+/*
+ * Coalescing: waiting makes sense only if a full segment will arrive soon. The window is the
+ * time to fill flush_size at the recent rate. If that is longer than max_window, data is sent
+ * right away, so slow interactive traffic is not delayed at all.
+ */
+
+// must be called with network_uart_mux held
+static void network_uart_update_rate(NetworkUartClient* client, int64_t now, size_t sent) {
+    client->rate_bytes += sent;
+
+    int64_t elapsed = now - client->rate_start;
+    if(elapsed < RATE_PERIOD_US) return;
+
+    uint32_t rate = (uint64_t)client->rate_bytes * 1000000 / elapsed;
+    client->stats.rate = (client->stats.rate + rate) / 2;
+    client->rate_bytes = 0;
+    client->rate_start = now;
+
+    uint32_t window_us = UINT32_MAX;
+    if(client->stats.rate > 0) {
+        window_us = (uint64_t)client->coalesce.flush_size * 1000000 / client->stats.rate;
+    }
+    client->stats.window_us = window_us <= client->coalesce.max_window_ms * 1000 ? window_us : 0;
+}
+
+static bool network_uart_should_flush(
+    NetworkUartClient* client,
+    const uint8_t* data,
+    size_t length,
+    size_t available,
+    int64_t pending_us) {
+    // data wraps around the capture ring, no reason to wait for the second part
+    if(length < available) return true;
+    if(available >= client->coalesce.flush_size) return true;
+    if(pending_us >= client->stats.window_us) return true;
+    if(client->coalesce.flush_on_newline && memchr(data, '\n', length) != NULL) return true;
+
+    return false;
+}
+
+static void network_uart_tx_task(void* pvParameters) {
+    NetworkUartClient* client = pvParameters;
+    UartSink* sink = client->sink;
+    int64_t pending_since = 0;
+    uint32_t generation = 0;
+
+    while(1) {
+        bool has_data = uart_capture_sink_wait(sink, pdMS_TO_TICKS(POLL_MS));
+
+        portENTER_CRITICAL(&network_uart_mux);
+        int sock = client->socket_id;
+        bool connected = client->connected;
+        bool released = client->released;
+        bool reset = client->generation != generation;
+        generation = client->generation;
+        portEXIT_CRITICAL(&network_uart_mux);
+
+        if(released) {
+            // nobody else uses the socket now, the slot is free once it is closed
+            shutdown(sock, SHUT_RDWR);
+            close(sock);
+            portENTER_CRITICAL(&network_uart_mux);
+            client->socket_id = -1;
+            client->released = false;
+            portEXIT_CRITICAL(&network_uart_mux);
+        }
+
+        if(!connected || reset) {
+            // don't keep old data for the next client
+            uart_capture_sink_skip(sink);
+            pending_since = 0;
+            if(reset && client->compressor != NULL) {
+                uart_compressor_reset_stats(client->compressor);
+            }
+            if(!connected && !has_data) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if(!has_data) continue;
+
+        size_t available = uart_capture_sink_available(sink);
+
+        // also runs after every send timeout, a stuck client cannot hide in send()
+        if(network_uart_check_slow(client, sock)) {
+            uart_capture_sink_skip(sink);
+            pending_since = 0;
+            continue;
+        }
 
-    if(addr_family == AF_INET) {
-        struct sockaddr_in* dest_addr_ip4 = (struct sockaddr_in*)&dest_addr;
-        dest_addr_ip4->sin_addr.s_addr = htonl(INADDR_ANY);
-        dest_addr_ip4->sin_family = AF_INET;
-        dest_addr_ip4->sin_port = htons(PORT);
-        ip_protocol = IPPROTO_IP;
+        int64_t now = esp_timer_get_time();
+        if(pending_since == 0) pending_since = now;
+
+        const uint8_t* data;
+        size_t length = MIN(uart_capture_sink_peek(sink, &data), SEND_CHUNK_SIZE);
+
+        portENTER_CRITICAL(&network_uart_mux);
+        network_uart_update_rate(client, now, 0);
+        bool flush =
+            network_uart_should_flush(client, data, length, available, now - pending_since);
+        portEXIT_CRITICAL(&network_uart_mux);
+
+        if(!flush) {
+            // keep the data in the capture ring and wait for more
+            uart_capture_sink_consume(sink, 0);
+            vTaskDelay(1);
+            continue;
+        }
+
+        /*
+         * Never block on the socket while holding the peek, the sink would pin the capture
+         * ring and hold back every other sink. Plain data is sent with a timeout and
+         * released as far as it got, a frame is a copy, so the peek is released first.
+         */
+        int sent;
+        if(client->compressed) {
+            const uint8_t* frame;
+            size_t frame_size = uart_compressor_frame(client->compressor, data, length, &frame);
+            uart_capture_sink_consume(sink, length);
+            sent = network_uart_send_frame(client, sock, frame, frame_size) ? length : -1;
+        } else {
+            sent = network_uart_send(sock, data, length);
+            uart_capture_sink_consume(sink, sent < 0 ? length : (size_t)sent);
+        }
+
+        if(sent < 0) {
+            // connection is broken, server task will release it
+            uart_capture_sink_failed(sink, length);
+            uart_capture_sink_skip(sink);
+            pending_since = 0;
+            vTaskDelay(1);
+            continue;
+        }
+
+        // client window is closed, the data stays in the ring under the sink policy
+        if(sent == 0) continue;
+
+        uint32_t latency_us = now - pending_since;
+        portENTER_CRITICAL(&network_uart_mux);
+        NetworkUartStats* stats = &client->stats;
+        stats->bytes += sent;
+        stats->segments++;
+        stats->latency_max_us = MAX(stats->latency_max_us, latency_us);
+        client->latency_sum_us += latency_us;
+        stats->latency_avg_us = client->latency_sum_us / stats->segments;
+        network_uart_update_rate(client, now, sent);
+        portEXIT_CRITICAL(&network_uart_mux);
+
+        // the rest, if any, has been waiting at least since now
+        pending_since = available > (size_t)sent ? now : 0;
     }
+}
+
+static int network_uart_listen(int port) {
+    struct sockaddr_in dest_addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
 
-    int listen_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
     if(listen_sock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        vTaskDelete(NULL);
-        return;
+        return -1;
     }
     int opt = 1;
     setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-    ESP_LOGI(TAG, "Socket created");
-
     int err = bind(listen_sock, (struct sockaddr*)&dest_addr, sizeof(dest_addr));
     if(err != 0) {
         ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
-        ESP_LOGE(TAG, "IPPROTO: %d", addr_family);
-        goto CLEAN_UP;
+        close(listen_sock);
+        return -1;
     }
-    ESP_LOGI(TAG, "Socket bound, port %d", PORT);
 
-    err = listen(listen_sock, 1);
+    err = listen(listen_sock, MAX_CLIENTS);
     if(err != 0) {
         ESP_LOGE(TAG, "Error occurred during listen: errno %d", errno);
-        goto CLEAN_UP;
+        close(listen_sock);
+        return -1;
     }
 
-    while(1) {
-        ESP_LOGI(TAG, "Socket listening");
+    ESP_LOGI(TAG, "Socket listening, port %d", port);
+    return listen_sock;
+}
+
+static void network_uart_accept(int listen_sock, bool observer, bool compressed) {
+    char addr_str[128] = {0};
+    int keepAlive = 1;
+    int keepIdle = KEEPALIVE_IDLE;
+    int keepInterval = KEEPALIVE_INTERVAL;
+    int keepCount = KEEPALIVE_COUNT;
+    int noDelay = 1;
+    struct timeval send_timeout = {
+        .tv_sec = 0,
+        .tv_usec = SEND_TIMEOUT_MS * 1000,
+    };
+
+    struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
+    socklen_t addr_len = sizeof(source_addr);
+    int sock = accept(listen_sock, (struct sockaddr*)&source_addr, &addr_len);
+    if(sock < 0) {
+        ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+        return;
+    }
 
-        struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
-        socklen_t addr_len = sizeof(source_addr);
-        int sock = accept(listen_sock, (struct sockaddr*)&source_addr, &addr_len);
-        if(sock < 0) {
-            ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+    NetworkUartClient* client = NULL;
+    for(size_t i = 0; i < MAX_CLIENTS; i++) {
+        if(network_uart.clients[i].socket_id < 0) {
+            client = &network_uart.clients[i];
             break;
         }
+    }
+
+    if(client == NULL) {
+        ESP_LOGW(TAG, "Too many clients, connection refused");
+        close(sock);
+        return;
+    }
 
-        // Set tcp keepalive option
-        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
-        // setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &keepIdle, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
-
-        // Convert ip address to string
-        if(source_addr.ss_family == PF_INET) {
-            inet_ntoa_r(
-                ((struct sockaddr_in*)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+    // allocated once per slot, on the first compressed client
+    if(compressed && client->compressor == NULL) {
+        client->compressor = uart_compressor_alloc();
+        if(client->compressor == NULL) {
+            ESP_LOGE(TAG, "No memory for compression, connection refused");
+            close(sock);
+            return;
         }
+    }
+
+    // Set tcp keepalive option
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+    // segments are coalesced by the tx task, Nagle would only add delay on top of it
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(int));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+    // tx task must get control back from a client with a closed window
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    // Convert ip address to string
+    if(source_addr.ss_family == PF_INET) {
+        inet_ntoa_r(((struct sockaddr_in*)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+    }
 
-        ESP_LOGI(TAG, "Socket accepted ip address: %s", addr_str);
+    ESP_LOGI(
+        TAG,
+        "%s accepted ip address: %s%s",
+        client->name,
+        addr_str,
+        observer ? " (observer)" : (compressed ? " (compressed)" : ""));
 
-        network_uart.socket_id = sock;
-        network_uart.connected = true;
+    network_uart_reset_client(client, sock, observer, compressed);
+}
 
-        receive_and_send_to_uart();
+// the tx task may still be in send(), it closes the socket and frees the slot
+static void network_uart_release(NetworkUartClient* client) {
+    ESP_LOGI(TAG, "%s closed", client->name);
 
-        network_uart.connected = false;
-        network_uart.socket_id = -1;
+    portENTER_CRITICAL(&network_uart_mux);
+    client->connected = false;
+    client->released = true;
+    portEXIT_CRITICAL(&network_uart_mux);
 
-        shutdown(sock, 0);
-        close(sock);
+    xTaskNotifyGive(client->task);
+}
+
+// socket the server task reads from, -1 if there is none
+static int network_uart_reading_socket(NetworkUartClient* client) {
+    portENTER_CRITICAL(&network_uart_mux);
+    int sock = client->released ? -1 : client->socket_id;
+    portEXIT_CRITICAL(&network_uart_mux);
+
+    return sock;
+}
+
+static void network_uart_server_task(void* pvParameters) {
+    uint8_t* buffer_rx = malloc(RECEIVE_CHUNK_SIZE);
+    int listen_sock = network_uart_listen(PORT);
+    int observer_sock = network_uart_listen(OBSERVER_PORT);
+    int compressed_sock = network_uart_listen(COMPRESSED_PORT);
+
+    if(listen_sock < 0 && observer_sock < 0 && compressed_sock < 0) {
+        free(buffer_rx);
+        vTaskDelete(NULL);
+        return;
     }
 
-CLEAN_UP:
-    close(listen_sock);
-    vTaskDelete(NULL);
+    while(1) {
+        fd_set read_set;
+        int max_fd = MAX(MAX(listen_sock, observer_sock), compressed_sock);
+        bool throttled = false;
+
+        FD_ZERO(&read_set);
+        if(listen_sock >= 0) FD_SET(listen_sock, &read_set);
+        if(observer_sock >= 0) FD_SET(observer_sock, &read_set);
+        if(compressed_sock >= 0) FD_SET(compressed_sock, &read_set);
+
+        // take from the sockets only what the UART can queue, TCP flow control does the rest
+        size_t tx_free = usb_uart_get_tx_free();
+
+        for(size_t i = 0; i < MAX_CLIENTS; i++) {
+            NetworkUartClient* client = &network_uart.clients[i];
+            int sock = network_uart_reading_socket(client);
+            if(sock < 0) continue;
+
+            if(!client->observer && tx_free == 0) {
+                throttled = true;
+                continue;
+            }
+
+            FD_SET(sock, &read_set);
+            max_fd = MAX(max_fd, sock);
+        }
+
+        struct timeval timeout = {.tv_sec = 0, .tv_usec = THROTTLE_POLL_US};
+        int ready = select(max_fd + 1, &read_set, NULL, NULL, throttled ? &timeout : NULL);
+        if(ready < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        if(listen_sock >= 0 && FD_ISSET(listen_sock, &read_set)) {
+            network_uart_accept(listen_sock, false, false);
+        }
+
+        if(observer_sock >= 0 && FD_ISSET(observer_sock, &read_set)) {
+            network_uart_accept(observer_sock, true, false);
+        }
+
+        if(compressed_sock >= 0 && FD_ISSET(compressed_sock, &read_set)) {
+            network_uart_accept(compressed_sock, false, true);
+        }
+
+        for(size_t i = 0; i < MAX_CLIENTS; i++) {
+            NetworkUartClient* client = &network_uart.clients[i];
+            int sock = network_uart_reading_socket(client);
+            if(sock < 0 || !FD_ISSET(sock, &read_set)) continue;
+
+            size_t max_size = RECEIVE_CHUNK_SIZE;
+            if(!client->observer) {
+                max_size = MIN(usb_uart_get_tx_free(), max_size);
+                if(max_size == 0) continue;
+            }
+
+            int rx_size = recv(sock, buffer_rx, max_size, 0);
+            if(rx_size <= 0) {
+                network_uart_release(client);
+            } else if(!client->observer) {
+                usb_uart_write(buffer_rx, rx_size);
+            }
+        }
+    }
 }
 
 void network_uart_server_init(void) {
-    network_uart.connected = false;
-    network_uart.socket_id = -1;
+    for(size_t i = 0; i < MAX_CLIENTS; i++) {
+        NetworkUartClient* client = &network_uart.clients[i];
+        client->socket_id = -1;
+        client->connected = false;
+        snprintf(client->name, sizeof(client->name), "tcp%u", (unsigned)i);
+        client->sink = uart_capture_sink_add(client->name, UartSinkPolicyDropOldest, SINK_MAX_LAG);
+
+        // task names are the metrics labels, keep them unique per slot
+        char task_name[configMAX_TASK_NAME_LEN];
+        snprintf(task_name, sizeof(task_name), "%s_tx", client->name);
+        xTaskCreate(network_uart_tx_task, task_name, 4096, client, 5, &client->task);
+    }
 
     esp_wifi_set_ps(WIFI_PS_NONE);
-    xTaskCreate(network_uart_server_task, "network_uart_server", 4096, (void*)AF_INET, 5, NULL);
+    xTaskCreate(network_uart_server_task, "network_uart_server", 4096, NULL, 5, NULL);
 }
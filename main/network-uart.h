@@ -1,5 +1,8 @@
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "uart-compress.h"
 
 /**
  * Start uart server
@@ -12,9 +15,75 @@ void network_uart_server_init(void);
  */
 bool network_uart_connected(void);
 
+typedef enum {
+    NetworkUartSlowDropOldest, // keep the client, it loses the oldest data
+    NetworkUartSlowDisconnect, // close the client once it falls too far behind
+} NetworkUartSlowPolicy;
+
+typedef struct {
+    uint32_t flush_size; /*!< send as soon as this much data is pending*/
+    uint32_t max_window_ms; /*!< longest time to hold data, 0 disables coalescing*/
+    bool flush_on_newline; /*!< send right away if pending data has a newline*/
+} NetworkUartCoalesce;
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t segments;
+    uint32_t rate; /*!< bytes per second, recent*/
+    uint32_t window_us; /*!< current coalescing window*/
+    uint32_t latency_avg_us; /*!< from first pending byte to send*/
+    uint32_t latency_max_us;
+    uint32_t slow_disconnects; /*!< kept across connections of the slot*/
+    bool connected;
+    bool observer; /*!< read-only client, input is discarded*/
+    bool compressed; /*!< client gets compressed frames*/
+    NetworkUartCoalesce coalesce; /*!< of the current connection*/
+    UartCompressStats compress;
+} NetworkUartStats;
+
+/**
+ * Set the default coalescing policy, every new connection starts with a copy of it
+ * @param coalesce
+ */
+void network_uart_set_coalesce(const NetworkUartCoalesce* coalesce);
+
+/**
+ * Get the default coalescing policy
+ * @param coalesce
+ */
+void network_uart_get_coalesce(NetworkUartCoalesce* coalesce);
+
+/**
+ * Set coalescing policy of the current connection of a client slot
+ * @param index
+ * @param coalesce
+ * @return bool false if there is no such slot or nobody is connected to it
+ */
+bool network_uart_set_client_coalesce(size_t index, const NetworkUartCoalesce* coalesce);
+
+/**
+ * Set what happens to a client that reads slower than the target writes
+ * @param policy
+ */
+void network_uart_set_slow_policy(NetworkUartSlowPolicy policy);
+
+/**
+ * Get slow client policy
+ * @return NetworkUartSlowPolicy
+ */
+NetworkUartSlowPolicy network_uart_get_slow_policy(void);
+
+/**
+ * Get slow client policy name
+ * @param policy
+ * @return const char*
+ */
+const char* network_uart_slow_policy_name(NetworkUartSlowPolicy policy);
+
 /**
- * Send data
- * @param buffer data
- * @param size data size
+ * Get counters of a client slot
+ * @param index
+ * @param stats
+ * @return bool false if there is no such slot
  */
-void network_uart_send(uint8_t* buffer, size_t size);
\ No newline at end of file
+bool network_uart_get_client_stats(size_t index, NetworkUartStats* stats);
@@ -0,0 +1,149 @@
+#include <string.h>
+#include <stdlib.h>
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <usb-glue.h>
+#include "network-usb.h"
+
+#define TAG "network-usb"
+
+#define NETWORK_USB_IP "192.168.7.1"
+#define NETWORK_USB_NETMASK "255.255.255.0"
+#define NETWORK_USB_TX_QUEUE_LENGTH 16
+#define NETWORK_USB_TX_RETRY_COUNT 10
+
+typedef struct {
+    uint16_t length;
+    uint8_t data[];
+} NetworkUsbFrame;
+
+static esp_netif_t* network_usb_netif = NULL;
+static QueueHandle_t network_usb_tx_queue = NULL;
+
+static void network_usb_tx_task(void* arg) {
+    NetworkUsbFrame* frame;
+
+    while(1) {
+        xQueueReceive(network_usb_tx_queue, &frame, portMAX_DELAY);
+
+        // TinyUSB holds at most one outgoing NTB, wait a bit for the previous one to finish
+        for(size_t i = 0; i < NETWORK_USB_TX_RETRY_COUNT; i++) {
+            if(usb_glue_net_send(frame->data, frame->length)) {
+                break;
+            }
+            vTaskDelay(1);
+        }
+
+        // the frame is copied into the NTB, or the host is gone and it is dropped
+        free(frame);
+    }
+}
+
+static esp_err_t network_usb_transmit(void* handle, void* buffer, size_t length) {
+    // called from the tcpip thread, it must never wait for the USB endpoint
+    NetworkUsbFrame* frame = malloc(sizeof(NetworkUsbFrame) + length);
+    if(frame == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    frame->length = length;
+    memcpy(frame->data, buffer, length);
+
+    if(xQueueSend(network_usb_tx_queue, &frame, 0) != pdTRUE) {
+        free(frame);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+static void network_usb_free_rx_buffer(void* handle, void* buffer) {
+    free(buffer);
+}
+
+static bool network_usb_receive(const uint8_t* data, uint16_t size, void* context) {
+    // lwIP references the frame until it is processed, so give it a copy
+    void* buffer = malloc(size);
+    if(buffer == NULL) {
+        return true;
+    }
+
+    memcpy(buffer, data, size);
+    esp_netif_receive(network_usb_netif, buffer, size, NULL);
+    return true;
+}
+
+uint32_t network_usb_get_ip(void) {
+    esp_netif_ip_info_t ip_info = {0};
+
+    if(network_usb_netif != NULL) {
+        esp_netif_get_ip_info(network_usb_netif, &ip_info);
+    }
+
+    return ip_info.ip.addr;
+}
+
+void network_usb_init(void) {
+    ESP_LOGI(TAG, "init");
+
+    network_usb_tx_queue = xQueueCreate(NETWORK_USB_TX_QUEUE_LENGTH, sizeof(NetworkUsbFrame*));
+    xTaskCreate(network_usb_tx_task, "network_usb_tx", 2048, NULL, 5, NULL);
+
+    esp_netif_ip_info_t ip_info = {0};
+    ip_info.ip.addr = esp_ip4addr_aton(NETWORK_USB_IP);
+    ip_info.gw.addr = esp_ip4addr_aton(NETWORK_USB_IP);
+    ip_info.netmask.addr = esp_ip4addr_aton(NETWORK_USB_NETMASK);
+
+    esp_netif_inherent_config_t base_config = ESP_NETIF_INHERENT_DEFAULT_ETH();
+    base_config.flags = ESP_NETIF_DHCP_SERVER | ESP_NETIF_FLAG_AUTOUP;
+    base_config.ip_info = &ip_info;
+    base_config.if_key = "USB_NCM";
+    base_config.if_desc = "usb ncm";
+    // never take the default route from WiFi
+    base_config.route_prio = 10;
+
+    esp_netif_driver_ifconfig_t driver_config = {
+        .handle = (void*)1,
+        .transmit = network_usb_transmit,
+        .driver_free_rx_buffer = network_usb_free_rx_buffer,
+    };
+
+    esp_netif_config_t config = {
+        .base = &base_config,
+        .driver = &driver_config,
+        .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
+    };
+
+    network_usb_netif = esp_netif_new(&config);
+    ESP_ERROR_CHECK(network_usb_netif == NULL ? ESP_FAIL : ESP_OK);
+
+    // device side MAC must differ from the host side one
+    uint8_t mac[6];
+    usb_glue_net_get_mac(mac);
+    mac[5] ^= 0x01;
+    ESP_ERROR_CHECK(esp_netif_set_mac(network_usb_netif, mac));
+
+    usb_glue_net_set_receive_callback(network_usb_receive, NULL);
+
+    esp_netif_action_start(network_usb_netif, NULL, 0, NULL);
+
+    // host must not use us as a router or DNS server
+    uint8_t offer = 0;
+    esp_netif_dhcps_stop(network_usb_netif);
+    esp_netif_dhcps_option(
+        network_usb_netif,
+        ESP_NETIF_OP_SET,
+        ESP_NETIF_ROUTER_SOLICITATION_ADDRESS,
+        &offer,
+        sizeof(offer));
+    esp_netif_dhcps_option(
+        network_usb_netif, ESP_NETIF_OP_SET, ESP_NETIF_DOMAIN_NAME_SERVER, &offer, sizeof(offer));
+    esp_netif_dhcps_start(network_usb_netif);
+
+    esp_netif_action_connected(network_usb_netif, NULL, 0, NULL);
+
+    ESP_LOGI(TAG, "init done, ip: " NETWORK_USB_IP);
+}
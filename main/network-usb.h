@@ -0,0 +1,18 @@
+/**
+ * @file network-usb.h
+ * 
+ * USB network interface (CDC-NCM), same socket services as over WiFi
+ */
+#pragma once
+#include <stdint.h>
+
+/**
+ * Init lwIP interface on top of the USB NCM function, with DHCP server
+ */
+void network_usb_init(void);
+
+/**
+ * Get USB network interface IP address
+ * @return uint32_t 
+ */
+uint32_t network_usb_get_ip(void);
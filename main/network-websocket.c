@@ -0,0 +1,578 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/param.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_log.h>
+#include "usb-uart.h"
+#include "network-websocket.h"
+
+#define TAG "network-websocket"
+#define WEBSOCKET_MAX_CLIENTS 4
+#define WEBSOCKET_SINK_MAX_LAG (64 * 1024)
+#define WEBSOCKET_FRAME_SIZE (UART_COMPRESS_INPUT_MAX)
+#define WEBSOCKET_COALESCE_MS 10
+#define WEBSOCKET_QUEUE_SIZE 8
+#define WEBSOCKET_POLL_MS 50
+#define WEBSOCKET_CREDIT_MAX (1024 * 1024)
+#define WEBSOCKET_INPUT_CREDIT (4 * 1024) // UART input in flight, at most half the TX ring
+#define WEBSOCKET_DEFAULT_CHANNELS                                             \
+    ((1 << NetworkWebsocketChannelUart) | (1 << NetworkWebsocketChannelConfig) | \
+     (1 << NetworkWebsocketChannelEvents))
+
+/*
+ * Subscribers are added at the handshake and removed by the server close callback or after
+ * a failed send. UART data stays in the capture ring until every slot has sent it, other
+ * frames are allocated once and reference counted across the slot queues. Only the slot task
+ * writes to its socket, so frames never interleave, and a send only blocks its own slot.
+ * Only the slot task touches its sink and queue too: a new connection bumps the generation
+ * and the task resets the slot once it is done with the previous one.
+ * Data frames are coalesced: if less than a full frame is waiting, the task waits a bit
+ * for more, browsers redraw at most 60 times a second anyway.
+ */
+
+typedef struct {
+    uint32_t refs;
+    httpd_ws_type_t type;
+    size_t size;
+    uint8_t data[];
+} WebsocketFrame;
+
+typedef struct {
+    volatile int fd;
+    volatile bool connected;
+    uint32_t generation; /*!< bumped by every new connection on the slot*/
+    bool compressed;
+    bool mux;
+    uint32_t channels; /*!< subscribed channel bits*/
+    uint32_t credit[NetworkWebsocketChannelCount];
+    uint32_t input_owed; /*!< UART input credit spent by the peer, returned as the TX ring drains*/
+    char name[8];
+    UartSink* sink;
+    UartCompressor* compressor;
+    uint8_t* mux_buffer;
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    NetworkWebsocketStats stats;
+} WebsocketClient;
+
+static httpd_handle_t websocket_server = NULL;
+static WebsocketClient websocket_clients[WEBSOCKET_MAX_CLIENTS];
+static portMUX_TYPE websocket_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static WebsocketFrame* websocket_frame_alloc(
+    httpd_ws_type_t type,
+    int channel,
+    const void* data,
+    size_t size) {
+    size_t header = channel < 0 ? 0 : 1;
+    WebsocketFrame* frame = malloc(sizeof(WebsocketFrame) + header + size);
+    if(frame == NULL) return NULL;
+
+    // the reference of the caller
+    frame->refs = 1;
+    frame->type = type;
+    frame->size = header + size;
+    if(header) frame->data[0] = channel;
+    memcpy(frame->data + header, data, size);
+    return frame;
+}
+
+static void websocket_frame_release(WebsocketFrame* frame) {
+    portENTER_CRITICAL(&websocket_mux);
+    bool last = --frame->refs == 0;
+    portEXIT_CRITICAL(&websocket_mux);
+
+    if(last) free(frame);
+}
+
+// must be called with websocket_mux held
+static bool websocket_take_credit(WebsocketClient* client, int channel, size_t size) {
+    if(!client->mux || channel < 0) return true;
+    if(client->credit[channel] < size) return false;
+
+    client->credit[channel] -= size;
+    return true;
+}
+
+// must be called with websocket_mux held
+static void websocket_add_credit(WebsocketClient* client, int channel, uint32_t credit) {
+    uint32_t total = client->credit[channel] + credit;
+    client->credit[channel] = MIN(total < credit ? UINT32_MAX : total, WEBSOCKET_CREDIT_MAX);
+}
+
+static void websocket_enqueue(WebsocketClient* client, WebsocketFrame* frame, int channel) {
+    size_t payload = frame->size - (channel < 0 ? 0 : 1);
+
+    portENTER_CRITICAL(&websocket_mux);
+    bool accepted = client->connected && websocket_take_credit(client, channel, payload);
+    if(accepted) frame->refs++;
+    portEXIT_CRITICAL(&websocket_mux);
+
+    if(accepted && xQueueSend(client->queue, &frame, 0) != pdTRUE) {
+        websocket_frame_release(frame);
+        accepted = false;
+    }
+
+    if(!accepted) {
+        portENTER_CRITICAL(&websocket_mux);
+        client->stats.text_dropped++;
+        portEXIT_CRITICAL(&websocket_mux);
+    }
+}
+
+static void websocket_queue_flush(WebsocketClient* client) {
+    WebsocketFrame* frame;
+    while(xQueueReceive(client->queue, &frame, 0) == pdTRUE) {
+        websocket_frame_release(frame);
+    }
+}
+
+static WebsocketClient* websocket_find(int fd) {
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        if(websocket_clients[i].fd == fd && websocket_clients[i].connected) {
+            return &websocket_clients[i];
+        }
+    }
+    return NULL;
+}
+
+static void websocket_client_drop(WebsocketClient* client, int fd) {
+    portENTER_CRITICAL(&websocket_mux);
+    bool current = client->connected && client->fd == fd;
+    if(current) {
+        client->connected = false;
+        client->fd = -1;
+        client->stats.errors++;
+    }
+    portEXIT_CRITICAL(&websocket_mux);
+
+    if(current) {
+        ESP_LOGW(TAG, "%s send failed, closing", client->name);
+        httpd_sess_trigger_close(websocket_server, fd);
+    }
+}
+
+/*
+ * UART input credit is counted instead of queued, so a full queue cannot lose it. It goes
+ * back only as far as the TX ring has room, so input waits in the peer while the UART drains
+ * and the server task never has to block on it.
+ */
+static bool websocket_send_credit(WebsocketClient* client, int fd, uint32_t generation) {
+    size_t tx_free = usb_uart_get_tx_free();
+
+    portENTER_CRITICAL(&websocket_mux);
+    uint32_t credit = 0;
+    if(client->generation == generation) {
+        credit = MIN(client->input_owed, tx_free);
+        client->input_owed -= credit;
+    }
+    portEXIT_CRITICAL(&websocket_mux);
+    if(credit == 0) return true;
+
+    uint8_t control[] = {
+        NetworkWebsocketChannelControl,
+        NetworkWebsocketOpCredit,
+        NetworkWebsocketChannelUart,
+        credit,
+        credit >> 8,
+        credit >> 16,
+        credit >> 24,
+    };
+    httpd_ws_frame_t ws_pkt = {
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = control,
+        .len = sizeof(control),
+    };
+    if(httpd_ws_send_frame_async(websocket_server, fd, &ws_pkt) != ESP_OK) return false;
+
+    portENTER_CRITICAL(&websocket_mux);
+    client->stats.text_frames++;
+    portEXIT_CRITICAL(&websocket_mux);
+    return true;
+}
+
+static bool websocket_send_queued(WebsocketClient* client, int fd) {
+    WebsocketFrame* frame;
+    while(xQueueReceive(client->queue, &frame, 0) == pdTRUE) {
+        httpd_ws_frame_t ws_pkt = {
+            .type = frame->type,
+            .payload = frame->data,
+            .len = frame->size,
+        };
+        esp_err_t err = httpd_ws_send_frame_async(websocket_server, fd, &ws_pkt);
+        websocket_frame_release(frame);
+        if(err != ESP_OK) return false;
+
+        portENTER_CRITICAL(&websocket_mux);
+        client->stats.text_frames++;
+        portEXIT_CRITICAL(&websocket_mux);
+    }
+
+    return true;
+}
+
+static bool websocket_send_data(WebsocketClient* client, int fd) {
+    UartSink* sink = client->sink;
+
+    if(uart_capture_sink_available(sink) < WEBSOCKET_FRAME_SIZE) {
+        vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_COALESCE_MS));
+    }
+
+    const uint8_t* data;
+    size_t length = MIN(uart_capture_sink_peek(sink, &data), WEBSOCKET_FRAME_SIZE);
+    if(length == 0) return true;
+
+    if(client->mux) {
+        // reserve for the worst case, a raw frame, and give back what compression saved
+        size_t overhead = client->compressed ? UART_COMPRESS_HEADER_SIZE : 0;
+
+        portENTER_CRITICAL(&websocket_mux);
+        uint32_t credit = client->credit[NetworkWebsocketChannelUart];
+        bool granted = credit > overhead;
+        if(granted) {
+            length = MIN(length, credit - overhead);
+            client->credit[NetworkWebsocketChannelUart] -= length + overhead;
+        } else {
+            client->stats.credit_stalls++;
+        }
+        portEXIT_CRITICAL(&websocket_mux);
+
+        if(!granted) {
+            // the data stays in the capture ring, the sink policy decides what is lost
+            uart_capture_sink_consume(sink, 0);
+            vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_COALESCE_MS));
+            return true;
+        }
+    }
+
+    // the payload stays valid in the capture ring until consumed
+    const uint8_t* payload = data;
+    size_t payload_size = length;
+
+    if(client->compressed) {
+        payload_size = uart_compressor_frame(client->compressor, data, length, &payload);
+    }
+
+    if(client->mux) {
+        size_t reserved = length + (client->compressed ? UART_COMPRESS_HEADER_SIZE : 0);
+        portENTER_CRITICAL(&websocket_mux);
+        websocket_add_credit(client, NetworkWebsocketChannelUart, reserved - payload_size);
+        portEXIT_CRITICAL(&websocket_mux);
+
+        client->mux_buffer[0] = NetworkWebsocketChannelUart;
+        memcpy(client->mux_buffer + 1, payload, payload_size);
+        payload = client->mux_buffer;
+        payload_size += 1;
+    }
+
+    httpd_ws_frame_t ws_pkt = {
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = (uint8_t*)payload,
+        .len = payload_size,
+    };
+
+    esp_err_t err = httpd_ws_send_frame_async(websocket_server, fd, &ws_pkt);
+    uart_capture_sink_consume(sink, length);
+
+    if(err != ESP_OK) {
+        uart_capture_sink_failed(sink, length);
+        return false;
+    }
+
+    portENTER_CRITICAL(&websocket_mux);
+    client->stats.frames++;
+    client->stats.bytes += length;
+    portEXIT_CRITICAL(&websocket_mux);
+    return true;
+}
+
+// slot task only, drops what was left for the previous connection
+static void websocket_client_reset(WebsocketClient* client) {
+    portENTER_CRITICAL(&websocket_mux);
+    UartSinkPolicy policy = client->stats.policy;
+    portEXIT_CRITICAL(&websocket_mux);
+
+    websocket_queue_flush(client);
+    uart_capture_sink_set_policy(client->sink, policy, WEBSOCKET_SINK_MAX_LAG);
+    uart_capture_sink_skip(client->sink);
+    if(client->compressor != NULL) {
+        uart_compressor_reset_stats(client->compressor);
+    }
+}
+
+static void websocket_client_task(void* pvParameters) {
+    WebsocketClient* client = pvParameters;
+    uint32_t generation = 0;
+
+    while(true) {
+        TickType_t timeout = pdMS_TO_TICKS(WEBSOCKET_POLL_MS);
+        bool has_data = uart_capture_sink_wait(client->sink, timeout);
+
+        if(!client->connected) {
+            // nobody to send to, don't keep old data for the next client
+            uart_capture_sink_skip(client->sink);
+            websocket_queue_flush(client);
+            if(!has_data) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        portENTER_CRITICAL(&websocket_mux);
+        int fd = client->fd;
+        bool reset = client->generation != generation;
+        generation = client->generation;
+        portEXIT_CRITICAL(&websocket_mux);
+
+        if(reset) {
+            websocket_client_reset(client);
+            has_data = false;
+        }
+
+        bool uart = !client->mux || (client->channels & (1 << NetworkWebsocketChannelUart));
+        bool sent = websocket_send_credit(client, fd, generation) &&
+                    websocket_send_queued(client, fd);
+
+        if(sent && has_data && uart) {
+            sent = websocket_send_data(client, fd);
+        } else if(has_data && !uart) {
+            uart_capture_sink_skip(client->sink);
+        }
+
+        if(!sent) {
+            websocket_client_drop(client, fd);
+            uart_capture_sink_skip(client->sink);
+        }
+    }
+}
+
+void network_websocket_init(httpd_handle_t server) {
+    websocket_server = server;
+
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        WebsocketClient* client = &websocket_clients[i];
+        client->fd = -1;
+        snprintf(client->name, sizeof(client->name), "ws%u", (unsigned)i);
+        // browser terminal wants fresh data, not a backlog
+        client->sink =
+            uart_capture_sink_add(client->name, UartSinkPolicySkip, WEBSOCKET_SINK_MAX_LAG);
+        client->queue = xQueueCreate(WEBSOCKET_QUEUE_SIZE, sizeof(WebsocketFrame*));
+
+        // task names are the metrics labels, keep them unique per slot
+        char task_name[configMAX_TASK_NAME_LEN];
+        snprintf(task_name, sizeof(task_name), "%s_tx", client->name);
+        xTaskCreate(websocket_client_task, task_name, 3072, client, 5, &client->task);
+    }
+}
+
+bool network_websocket_open(int fd, const NetworkWebsocketOptions* options) {
+    WebsocketClient* client = NULL;
+
+    // a reconnect on the same socket replaces the old subscription
+    network_websocket_close(fd);
+
+    portENTER_CRITICAL(&websocket_mux);
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        if(websocket_clients[i].fd < 0) {
+            client = &websocket_clients[i];
+            client->fd = fd;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&websocket_mux);
+
+    if(client == NULL) {
+        ESP_LOGW(TAG, "Too many clients, subscription refused");
+        return false;
+    }
+
+    // allocated once per slot, on the first client that needs them
+    if(options->compressed && client->compressor == NULL) {
+        client->compressor = uart_compressor_alloc();
+    }
+    if(options->mux && client->mux_buffer == NULL) {
+        client->mux_buffer = malloc(1 + UART_COMPRESS_FRAME_MAX);
+    }
+
+    // the slot task may still be sending for the previous connection, it resets the rest
+    portENTER_CRITICAL(&websocket_mux);
+    client->generation++;
+    memset(&client->stats, 0, sizeof(client->stats));
+    client->compressed = options->compressed && client->compressor != NULL;
+    client->mux = options->mux && client->mux_buffer != NULL;
+    client->channels = WEBSOCKET_DEFAULT_CHANNELS;
+    for(size_t i = 0; i < NetworkWebsocketChannelCount; i++) {
+        client->credit[i] = NETWORK_WEBSOCKET_INITIAL_CREDIT;
+    }
+    client->input_owed = client->mux ? WEBSOCKET_INPUT_CREDIT : 0;
+    client->stats.policy = options->policy;
+    client->connected = true;
+    portEXIT_CRITICAL(&websocket_mux);
+
+    xTaskNotifyGive(client->task);
+
+    ESP_LOGI(
+        TAG,
+        "%s subscribed, %s%s%s",
+        client->name,
+        uart_capture_policy_name(options->policy),
+        client->compressed ? ", compressed" : "",
+        client->mux ? ", multiplexed" : "");
+    return true;
+}
+
+void network_websocket_close(int fd) {
+    portENTER_CRITICAL(&websocket_mux);
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        WebsocketClient* client = &websocket_clients[i];
+        if(client->fd == fd) {
+            client->connected = false;
+            client->fd = -1;
+        }
+    }
+    portEXIT_CRITICAL(&websocket_mux);
+}
+
+bool network_websocket_is_mux(int fd) {
+    portENTER_CRITICAL(&websocket_mux);
+    WebsocketClient* client = websocket_find(fd);
+    bool mux = client != NULL && client->mux;
+    portEXIT_CRITICAL(&websocket_mux);
+
+    return mux;
+}
+
+static void websocket_receive_control(WebsocketClient* client, const uint8_t* data, size_t size) {
+    if(size < 2 || data[1] >= NetworkWebsocketChannelCount) return;
+    uint8_t channel = data[1];
+
+    portENTER_CRITICAL(&websocket_mux);
+    if(data[0] == NetworkWebsocketOpCredit && size >= 6) {
+        uint32_t credit = data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24);
+        websocket_add_credit(client, channel, credit);
+    } else if(data[0] == NetworkWebsocketOpSubscribe && size >= 3) {
+        if(data[2]) {
+            client->channels |= 1 << channel;
+        } else {
+            client->channels &= ~(1 << channel);
+        }
+    }
+    portEXIT_CRITICAL(&websocket_mux);
+}
+
+// runs in the server task, so it must never wait for the UART
+static void websocket_write_uart(WebsocketClient* client, const uint8_t* data, size_t size) {
+    size_t written = usb_uart_write_nonblock(data, size);
+    if(written < size) {
+        portENTER_CRITICAL(&websocket_mux);
+        client->stats.input_dropped += size - written;
+        portEXIT_CRITICAL(&websocket_mux);
+    }
+}
+
+void network_websocket_receive(int fd, const uint8_t* data, size_t size) {
+    if(size < 1) return;
+
+    portENTER_CRITICAL(&websocket_mux);
+    WebsocketClient* client = websocket_find(fd);
+    portEXIT_CRITICAL(&websocket_mux);
+    if(client == NULL) return;
+
+    if(!client->mux) {
+        // plain clients have no credit, they can only lose input
+        websocket_write_uart(client, data, size);
+        return;
+    }
+
+    switch(data[0]) {
+    case NetworkWebsocketChannelControl:
+        websocket_receive_control(client, data + 1, size - 1);
+        break;
+    case NetworkWebsocketChannelUart:
+        // a client within its credit always fits, the credit goes back as the ring drains
+        websocket_write_uart(client, data + 1, size - 1);
+        portENTER_CRITICAL(&websocket_mux);
+        client->input_owed += size - 1;
+        portEXIT_CRITICAL(&websocket_mux);
+        break;
+    default:
+        break;
+    }
+}
+
+void network_websocket_send(
+    int fd,
+    NetworkWebsocketChannel channel,
+    const void* data,
+    size_t size) {
+    portENTER_CRITICAL(&websocket_mux);
+    WebsocketClient* client = websocket_find(fd);
+    portEXIT_CRITICAL(&websocket_mux);
+    if(client == NULL || !client->mux) return;
+
+    WebsocketFrame* frame = websocket_frame_alloc(HTTPD_WS_TYPE_BINARY, channel, data, size);
+    if(frame == NULL) return;
+
+    websocket_enqueue(client, frame, channel);
+    websocket_frame_release(frame);
+}
+
+void network_websocket_publish(NetworkWebsocketChannel channel, const void* data, size_t size) {
+    WebsocketFrame* frame = websocket_frame_alloc(HTTPD_WS_TYPE_BINARY, channel, data, size);
+    if(frame == NULL) return;
+
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        WebsocketClient* client = &websocket_clients[i];
+        if(client->connected && client->mux && (client->channels & (1 << channel))) {
+            websocket_enqueue(client, frame, channel);
+        }
+    }
+
+    websocket_frame_release(frame);
+}
+
+bool network_websocket_has_subscribers(NetworkWebsocketChannel channel) {
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        WebsocketClient* client = &websocket_clients[i];
+        if(client->connected && client->mux && (client->channels & (1 << channel))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void network_websocket_broadcast_text(const char* text) {
+    WebsocketFrame* frame = websocket_frame_alloc(HTTPD_WS_TYPE_TEXT, -1, text, strlen(text));
+    if(frame == NULL) return;
+
+    for(size_t i = 0; i < WEBSOCKET_MAX_CLIENTS; i++) {
+        WebsocketClient* client = &websocket_clients[i];
+        if(client->connected && !client->mux) {
+            websocket_enqueue(client, frame, -1);
+        }
+    }
+
+    websocket_frame_release(frame);
+}
+
+bool network_websocket_get_client_stats(size_t index, NetworkWebsocketStats* stats) {
+    if(index >= WEBSOCKET_MAX_CLIENTS) return false;
+    WebsocketClient* client = &websocket_clients[index];
+
+    portENTER_CRITICAL(&websocket_mux);
+    *stats = client->stats;
+    stats->connected = client->connected;
+    stats->compressed = client->compressed;
+    stats->mux = client->mux;
+    portEXIT_CRITICAL(&websocket_mux);
+
+    if(client->compressor != NULL) {
+        uart_compressor_get_stats(client->compressor, &stats->compress);
+    } else {
+        memset(&stats->compress, 0, sizeof(stats->compress));
+    }
+
+    return true;
+}
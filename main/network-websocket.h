@@ -0,0 +1,144 @@
+/**
+ * @file network-websocket.h
+ * Target UART over WebSocket. Every subscriber has its own capture sink, send task and
+ * queue of shared frames, so a slow browser tab only delays itself.
+ *
+ * Plain clients get UART data in binary frames and events in text frames.
+ * Multiplexed clients (?mux=1) get every frame as u8 channel + payload, both ways:
+ *  - control: u8 op, u8 channel, then op arguments
+ *    - credit, u32 bytes: the peer may send that many more payload bytes on the channel,
+ *      the device grants UART input credit as it writes to the target
+ *    - subscribe, u8 enable: start or stop a device to client channel
+ *  - uart: target output (uart-compress frames if ?compress=1) and input
+ *  - stats: JSON counters, pushed every second, off by default
+ *  - config: UART config JSON, a request with fields sets them, every request is answered
+ *    with the current config
+ *  - events: JSON target events, e.g. trigger hits
+ *  - metrics: JSON series of the metrics registry, pushed every second, off by default;
+ *    "full" pushes carry every series, the others only the ones that changed
+ * Device to client payloads are limited by the credit of the channel, each channel starts
+ * with NETWORK_WEBSOCKET_INITIAL_CREDIT.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_http_server.h>
+#include "uart-capture.h"
+#include "uart-compress.h"
+
+#define NETWORK_WEBSOCKET_INITIAL_CREDIT (16 * 1024)
+
+typedef enum {
+    NetworkWebsocketChannelControl = 0,
+    NetworkWebsocketChannelUart = 1,
+    NetworkWebsocketChannelStats = 2,
+    NetworkWebsocketChannelConfig = 3,
+    NetworkWebsocketChannelEvents = 4,
+    NetworkWebsocketChannelMetrics = 5,
+    NetworkWebsocketChannelCount,
+} NetworkWebsocketChannel;
+
+typedef enum {
+    NetworkWebsocketOpCredit = 1,
+    NetworkWebsocketOpSubscribe = 2,
+} NetworkWebsocketOp;
+
+typedef struct {
+    bool compressed; /*!< UART data as uart-compress frames*/
+    bool mux; /*!< channel framing*/
+    UartSinkPolicy policy; /*!< Skip for a live view, DropOldest to keep a backlog*/
+} NetworkWebsocketOptions;
+
+typedef struct {
+    bool connected;
+    bool compressed;
+    bool mux;
+    UartSinkPolicy policy; /*!< what the client loses when it falls behind*/
+    uint32_t frames; /*!< UART data frames sent*/
+    uint32_t bytes; /*!< UART data bytes sent, before compression*/
+    uint32_t text_frames; /*!< queued frames sent, e.g. events, stats, credits*/
+    uint32_t text_dropped; /*!< queued frames dropped, queue full or no channel credit*/
+    uint32_t credit_stalls; /*!< times UART data waited for credit*/
+    uint32_t input_dropped; /*!< UART input bytes the TX ring had no room for*/
+    uint32_t errors; /*!< failed sends, each one closes the connection*/
+    UartCompressStats compress;
+} NetworkWebsocketStats;
+
+/**
+ * Start the send tasks
+ * @param server
+ */
+void network_websocket_init(httpd_handle_t server);
+
+/**
+ * Subscribe a socket after the handshake
+ * @param fd
+ * @param options
+ * @return bool false if all slots are taken
+ */
+bool network_websocket_open(int fd, const NetworkWebsocketOptions* options);
+
+/**
+ * Unsubscribe a socket, safe to call for sockets that were never subscribed
+ * @param fd
+ */
+void network_websocket_close(int fd);
+
+/**
+ * Check if a socket uses channel framing
+ * @param fd
+ * @return bool
+ */
+bool network_websocket_is_mux(int fd);
+
+/**
+ * Handle input frames, UART data of a plain client or channel frames of a multiplexed one.
+ * Never blocks, UART input that does not fit the TX ring is dropped and counted.
+ * @param fd
+ * @param data frame, starting with the channel if multiplexed
+ * @param size
+ */
+void network_websocket_receive(int fd, const uint8_t* data, size_t size);
+
+/**
+ * Queue a frame to one multiplexed client
+ * @param fd
+ * @param channel
+ * @param data
+ * @param size
+ */
+void network_websocket_send(
+    int fd,
+    NetworkWebsocketChannel channel,
+    const void* data,
+    size_t size);
+
+/**
+ * Queue a frame to every multiplexed client subscribed to the channel, the data is copied once
+ * @param channel
+ * @param data
+ * @param size
+ */
+void network_websocket_publish(NetworkWebsocketChannel channel, const void* data, size_t size);
+
+/**
+ * Check if a multiplexed client is subscribed to the channel, to skip building the data
+ * @param channel
+ * @return bool
+ */
+bool network_websocket_has_subscribers(NetworkWebsocketChannel channel);
+
+/**
+ * Queue a text frame to every plain client, the text is copied once and shared
+ * @param text
+ */
+void network_websocket_broadcast_text(const char* text);
+
+/**
+ * Get counters of a subscriber slot
+ * @param index
+ * @param stats
+ * @return bool false if there is no such slot
+ */
+bool network_websocket_get_client_stats(size_t index, NetworkWebsocketStats* stats);
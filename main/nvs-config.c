@@ -1,4 +1,6 @@
+#include <stdlib.h>
 #include <m-string.h>
+#include "helpers.h"
 #include "nvs.h"
 #include "nvs-config.h"
 
@@ -11,6 +13,11 @@
 
 #define USB_MODE_KEY "usb_mode"
 
+#define UART_FLOW_KEY "uart_flow"
+#define UART_RTS_PIN_KEY "uart_rts_pin"
+#define UART_CTS_PIN_KEY "uart_cts_pin"
+#define UART_DTR_PIN_KEY "uart_dtr_pin"
+
 #define ESP_WIFI_DEFAULT_SSID "blackmagic"
 #define ESP_WIFI_DEFAULT_PASS "iamwitcher"
 #define ESP_WIFI_DEFAULT_HOSTNAME "blackmagic"
@@ -46,6 +53,12 @@ esp_err_t nvs_config_set_usb_mode(UsbMode value) {
     case UsbModeDAP:
         mstring_set(mode, CFG_USB_MODE_DAP);
         break;
+    case UsbModeNET:
+        mstring_set(mode, CFG_USB_MODE_NET);
+        break;
+    case UsbModeMSC:
+        mstring_set(mode, CFG_USB_MODE_MSC);
+        break;
     }
 
     esp_err_t err = nvs_save_string(USB_MODE_KEY, mode);
@@ -54,6 +67,43 @@ esp_err_t nvs_config_set_usb_mode(UsbMode value) {
     return err;
 }
 
+// GPIOs that are not used by the board
+static const int uart_spare_pins[] = {7, 8, 9, 14, 15, 16, 21, 33, 34, 35, 36, 37};
+
+bool nvs_config_pin_is_spare(int pin) {
+    for(size_t i = 0; i < COUNT_OF(uart_spare_pins); i++) {
+        if(uart_spare_pins[i] == pin) return true;
+    }
+
+    return false;
+}
+
+static bool nvs_config_uart_pin_valid(int pin) {
+    return pin == CFG_UART_PIN_NONE || nvs_config_pin_is_spare(pin);
+}
+
+static esp_err_t nvs_config_save_int(const char* key, int value) {
+    mstring_t* text = mstring_alloc();
+    mstring_printf(text, "%d", value);
+    esp_err_t err = nvs_save_string(key, text);
+    mstring_free(text);
+    return err;
+}
+
+static esp_err_t nvs_config_load_int(const char* key, int* value, int default_value) {
+    mstring_t* text = mstring_alloc();
+    esp_err_t err = nvs_load_string(key, text);
+
+    if(err == ESP_OK) {
+        *value = atoi(mstring_get_cstr(text));
+    } else {
+        *value = default_value;
+    }
+
+    mstring_free(text);
+    return err;
+}
+
 esp_err_t nvs_config_set_ap_ssid(const mstring_t* ssid) {
     esp_err_t err = ESP_FAIL;
 
@@ -104,6 +154,43 @@ esp_err_t nvs_config_set_hostname(const mstring_t* hostname) {
     return err;
 }
 
+esp_err_t nvs_config_set_uart_flow(UartFlow value) {
+    mstring_t* flow = mstring_alloc();
+
+    switch(value) {
+    case UartFlowNone:
+        mstring_set(flow, CFG_UART_FLOW_NONE);
+        break;
+    case UartFlowRtsCts:
+        mstring_set(flow, CFG_UART_FLOW_RTS_CTS);
+        break;
+    }
+
+    esp_err_t err = nvs_save_string(UART_FLOW_KEY, flow);
+
+    mstring_free(flow);
+    return err;
+}
+
+esp_err_t nvs_config_set_uart_pins(const UartLinePins* pins) {
+    if(!nvs_config_uart_pin_valid(pins->rts) || !nvs_config_uart_pin_valid(pins->cts) ||
+       !nvs_config_uart_pin_valid(pins->dtr)) {
+        return ESP_FAIL;
+    }
+
+    // the same pin cannot have two roles
+    if((pins->rts != CFG_UART_PIN_NONE && (pins->rts == pins->cts || pins->rts == pins->dtr)) ||
+       (pins->cts != CFG_UART_PIN_NONE && pins->cts == pins->dtr)) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = nvs_config_save_int(UART_RTS_PIN_KEY, pins->rts);
+    if(err == ESP_OK) err = nvs_config_save_int(UART_CTS_PIN_KEY, pins->cts);
+    if(err == ESP_OK) err = nvs_config_save_int(UART_DTR_PIN_KEY, pins->dtr);
+
+    return err;
+}
+
 esp_err_t nvs_config_get_wifi_mode(WiFiMode* value) {
     mstring_t* mode = mstring_alloc();
     esp_err_t err = nvs_load_string(WIFI_MODE_KEY, mode);
@@ -127,6 +214,10 @@ esp_err_t nvs_config_get_usb_mode(UsbMode* value) {
 
     if(err == ESP_OK && mstring_cmp_cstr(mode, CFG_USB_MODE_DAP) == 0) {
         *value = UsbModeDAP;
+    } else if(err == ESP_OK && mstring_cmp_cstr(mode, CFG_USB_MODE_NET) == 0) {
+        *value = UsbModeNET;
+    } else if(err == ESP_OK && mstring_cmp_cstr(mode, CFG_USB_MODE_MSC) == 0) {
+        *value = UsbModeMSC;
     } else {
         // USB mode by default
         *value = UsbModeBM;
@@ -185,3 +276,32 @@ esp_err_t nvs_config_get_hostname(mstring_t* hostname) {
 
     return err;
 }
+
+esp_err_t nvs_config_get_uart_flow(UartFlow* value) {
+    mstring_t* flow = mstring_alloc();
+    esp_err_t err = nvs_load_string(UART_FLOW_KEY, flow);
+
+    if(err == ESP_OK && mstring_cmp_cstr(flow, CFG_UART_FLOW_RTS_CTS) == 0) {
+        *value = UartFlowRtsCts;
+    } else {
+        // no flow control by default
+        *value = UartFlowNone;
+    }
+
+    mstring_free(flow);
+    return err;
+}
+
+esp_err_t nvs_config_get_uart_pins(UartLinePins* pins) {
+    // all line pins are disabled by default
+    esp_err_t err = nvs_config_load_int(UART_RTS_PIN_KEY, &pins->rts, CFG_UART_PIN_NONE);
+    nvs_config_load_int(UART_CTS_PIN_KEY, &pins->cts, CFG_UART_PIN_NONE);
+    nvs_config_load_int(UART_DTR_PIN_KEY, &pins->dtr, CFG_UART_PIN_NONE);
+
+    // config may have been written by a different board revision
+    if(!nvs_config_uart_pin_valid(pins->rts)) pins->rts = CFG_UART_PIN_NONE;
+    if(!nvs_config_uart_pin_valid(pins->cts)) pins->cts = CFG_UART_PIN_NONE;
+    if(!nvs_config_uart_pin_valid(pins->dtr)) pins->dtr = CFG_UART_PIN_NONE;
+
+    return err;
+}
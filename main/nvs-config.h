@@ -8,6 +8,7 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include <m-string.h>
 #include <esp_err.h>
 
@@ -17,10 +18,19 @@
 
 #define CFG_USB_MODE_BM "BM"
 #define CFG_USB_MODE_DAP "DAP"
+#define CFG_USB_MODE_NET "NET"
+#define CFG_USB_MODE_MSC "MSC"
+
+#define CFG_UART_FLOW_NONE "None"
+#define CFG_UART_FLOW_RTS_CTS "RTS_CTS"
+
+#define CFG_UART_PIN_NONE (-1)
 
 typedef enum {
     UsbModeBM, // Blackmagic-probe
     UsbModeDAP, // Dap-link
+    UsbModeNET, // USB network (CDC-NCM)
+    UsbModeMSC, // USB mass storage flasher
 } UsbMode;
 
 typedef enum {
@@ -29,6 +39,17 @@ typedef enum {
     WiFiModeDisabled, // disabled
 } WiFiMode;
 
+typedef enum {
+    UartFlowNone, // no flow control, RTS pin follows the CDC RTS line
+    UartFlowRtsCts, // hardware RTS/CTS flow control
+} UartFlow;
+
+typedef struct {
+    int rts; // CFG_UART_PIN_NONE if not used
+    int cts;
+    int dtr;
+} UartLinePins;
+
 esp_err_t nvs_config_set_wifi_mode(WiFiMode value);
 esp_err_t nvs_config_set_usb_mode(UsbMode value);
 esp_err_t nvs_config_set_ap_ssid(const mstring_t* ssid);
@@ -36,6 +57,8 @@ esp_err_t nvs_config_set_ap_pass(const mstring_t* pass);
 esp_err_t nvs_config_set_sta_ssid(const mstring_t* ssid);
 esp_err_t nvs_config_set_sta_pass(const mstring_t* pass);
 esp_err_t nvs_config_set_hostname(const mstring_t* hostname);
+esp_err_t nvs_config_set_uart_flow(UartFlow value);
+esp_err_t nvs_config_set_uart_pins(const UartLinePins* pins);
 
 esp_err_t nvs_config_get_wifi_mode(WiFiMode* value);
 esp_err_t nvs_config_get_usb_mode(UsbMode* value);
@@ -44,3 +67,12 @@ esp_err_t nvs_config_get_ap_pass(mstring_t* pass);
 esp_err_t nvs_config_get_sta_ssid(mstring_t* ssid);
 esp_err_t nvs_config_get_sta_pass(mstring_t* pass);
 esp_err_t nvs_config_get_hostname(mstring_t* hostname);
+esp_err_t nvs_config_get_uart_flow(UartFlow* value);
+esp_err_t nvs_config_get_uart_pins(UartLinePins* pins);
+
+/**
+ * Check that a GPIO is not used by the board, UART line pins are spare pins too
+ * @param pin
+ * @return bool
+ */
+bool nvs_config_pin_is_spare(int pin);
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/stream_buffer.h>
+#include <simple-uart.h>
+#include <usb-glue.h>
+#include "cli-uart.h"
+#include "swo.h"
+
+/*
+ * There are only two UARTs on the ESP32-S2, UART0 is the target UART bridge,
+ * so the SWO capture borrows UART1 from the CLI while trace is running.
+ */
+#define SWO_UART_PORT_NUM UART_NUM_1
+#define SWO_RXD_PIN (10)
+#define SWO_BAUD_RATE_MIN (300)
+#define SWO_BAUD_RATE_MAX (5 * 1000 * 1000)
+
+#define SWO_STREAM_BUFFER_SIZE_BYTES (256 * 1024)
+#define SWO_ISR_CHUNK_SIZE (128)
+#define SWO_PACKET_SIZE (512)
+#define SWO_TASK_STACK_SIZE 4096
+#define SWO_TASK_PRIORITY 5
+
+// DAP commands
+#define ID_DAP_INFO 0x00
+#define ID_DAP_SWO_TRANSPORT 0x17
+#define ID_DAP_SWO_MODE 0x18
+#define ID_DAP_SWO_BAUDRATE 0x19
+#define ID_DAP_SWO_CONTROL 0x1A
+#define ID_DAP_SWO_STATUS 0x1B
+#define ID_DAP_SWO_DATA 0x1C
+#define ID_DAP_SWO_EXTENDED_STATUS 0x1E
+
+#define DAP_INFO_CAPABILITIES 0xF0
+#define DAP_INFO_SWO_BUFFER_SIZE 0xFD
+
+#define DAP_OK 0x00
+#define DAP_ERROR 0xFF
+
+#define DAP_CAP_SWO_UART (1 << 2)
+#define DAP_CAP_SWO_STREAMING (1 << 6)
+
+#define SWO_STATUS_ACTIVE (1 << 0)
+#define SWO_STATUS_ERROR (1 << 6)
+#define SWO_STATUS_OVERRUN (1 << 7)
+
+typedef enum {
+    SwoTransportNone = 0,
+    SwoTransportData = 1,
+    SwoTransportEndpoint = 2,
+} SwoTransport;
+
+typedef enum {
+    SwoModeOff = 0,
+    SwoModeUart = 1,
+    SwoModeManchester = 2,
+} SwoMode;
+
+typedef struct {
+    SwoTransport transport;
+    SwoMode mode;
+    uint32_t baud_rate;
+    volatile bool active;
+    volatile bool overrun;
+    TaskHandle_t task;
+} SwoState;
+
+static const char* TAG = "swo";
+
+static uint8_t swo_stream_storage[SWO_STREAM_BUFFER_SIZE_BYTES + 1] EXT_RAM_ATTR;
+static StaticStreamBuffer_t swo_stream_buffer_struct;
+static StreamBufferHandle_t swo_stream = NULL;
+
+static SwoState swo = {
+    .transport = SwoTransportNone,
+    .mode = SwoModeOff,
+    .baud_rate = 0,
+    .active = false,
+    .overrun = false,
+    .task = NULL,
+};
+
+static void swo_rx_isr(void* context) {
+    StreamBufferHandle_t stream = context;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    uint8_t data[SWO_ISR_CHUNK_SIZE];
+    uint32_t length;
+    while((length = simple_uart_read(SWO_UART_PORT_NUM, data, SWO_ISR_CHUNK_SIZE)) > 0) {
+        size_t sent = xStreamBufferSendFromISR(stream, data, length, &xHigherPriorityTaskWoken);
+        if(sent < length) {
+            swo.overrun = true;
+        }
+    }
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void swo_send_complete_callback(void* context) {
+    xTaskNotifyGive(swo.task);
+}
+
+static void swo_task(void* pvParameters) {
+    // static, the completion callback notifies this task so it must never fail to start
+    static uint8_t data[SWO_PACKET_SIZE];
+
+    while(1) {
+        if(!swo.active || swo.transport != SwoTransportEndpoint) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        size_t length = xStreamBufferReceive(swo_stream, data, SWO_PACKET_SIZE, 1);
+        if(length == 0) continue;
+
+        // endpoint is busy with the previous packet, wait for its completion
+        while(usb_glue_swo_send(data, length) == 0) {
+            ulTaskNotifyTake(pdTRUE, 1);
+            if(!swo.active) break;
+        }
+    }
+}
+
+static uint32_t swo_get_actual_baud_rate(uint32_t baud_rate) {
+    if(baud_rate < SWO_BAUD_RATE_MIN || baud_rate > SWO_BAUD_RATE_MAX) {
+        return 0;
+    }
+
+    return simple_uart_calc_baud_rate(baud_rate);
+}
+
+static uint8_t swo_get_status(void) {
+    uint8_t status = 0;
+    if(swo.active) status |= SWO_STATUS_ACTIVE;
+    if(swo.overrun) status |= SWO_STATUS_OVERRUN;
+    return status;
+}
+
+static bool swo_start(void) {
+    if(swo.active) return true;
+    if(swo.mode != SwoModeUart || swo.baud_rate == 0) return false;
+    if(swo.transport == SwoTransportNone) return false;
+
+    ESP_LOGI(TAG, "start, %d baud", (int)swo.baud_rate);
+    cli_uart_suspend();
+
+    xStreamBufferReset(swo_stream);
+    swo.overrun = false;
+
+    simple_uart_set_baud_rate(SWO_UART_PORT_NUM, swo.baud_rate);
+    simple_uart_set_data_bits(SWO_UART_PORT_NUM, UART_DATA_8_BITS);
+    simple_uart_set_parity(SWO_UART_PORT_NUM, UART_PARITY_DISABLE);
+    simple_uart_set_stop_bits(SWO_UART_PORT_NUM, UART_STOP_BITS_1);
+    simple_uart_set_rx_pin(SWO_UART_PORT_NUM, SWO_RXD_PIN);
+    simple_uart_set_rx_isr(SWO_UART_PORT_NUM, swo_rx_isr, swo_stream);
+
+    swo.active = true;
+    xTaskNotifyGive(swo.task);
+    return true;
+}
+
+void swo_stop(void) {
+    if(!swo.active) return;
+
+    ESP_LOGI(TAG, "stop");
+    simple_uart_set_rx_isr(SWO_UART_PORT_NUM, NULL, NULL);
+    swo.active = false;
+    cli_uart_resume();
+    xTaskNotifyGive(swo.task);
+}
+
+static void swo_put_u32(uint8_t* buffer, uint32_t value) {
+    buffer[0] = (value >> 0) & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t swo_get_u32(const uint8_t* buffer) {
+    return ((uint32_t)buffer[0] << 0) | ((uint32_t)buffer[1] << 8) |
+           ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static size_t swo_dap_data(
+    const uint8_t* request,
+    size_t request_size,
+    uint8_t* response,
+    size_t response_size) {
+    size_t max_count = response_size - 4;
+    size_t count = 0;
+
+    if(request_size >= 3) {
+        count = request[1] | (request[2] << 8);
+    }
+    if(count > max_count) count = max_count;
+
+    // data is delivered in DAP responses only in the "SWO_Data" transport mode
+    if(swo.transport != SwoTransportData) count = 0;
+
+    response[1] = swo_get_status();
+    if(count > 0) {
+        count = xStreamBufferReceive(swo_stream, &response[4], count, 0);
+    }
+    response[2] = count & 0xFF;
+    response[3] = (count >> 8) & 0xFF;
+
+    return 4 + count;
+}
+
+static size_t swo_dap_extended_status(
+    const uint8_t* request,
+    size_t request_size,
+    uint8_t* response,
+    size_t response_size) {
+    uint8_t control = request_size >= 2 ? request[1] : 0;
+    size_t length = 1;
+
+    if(control & (1 << 0)) {
+        response[length++] = swo_get_status();
+    }
+
+    if(control & (1 << 1)) {
+        swo_put_u32(&response[length], xStreamBufferBytesAvailable(swo_stream));
+        length += 4;
+    }
+
+    // index and timestamp are not supported
+
+    return length;
+}
+
+bool swo_dap_process_request(
+    const uint8_t* request,
+    size_t request_size,
+    uint8_t* response,
+    size_t response_size,
+    size_t* response_length) {
+    if(swo_stream == NULL || request_size < 1 || response_size < 16) return false;
+
+    response[0] = request[0];
+    *response_length = 2;
+
+    switch(request[0]) {
+    case ID_DAP_INFO:
+        if(request_size < 2 || request[1] != DAP_INFO_SWO_BUFFER_SIZE) return false;
+        response[1] = 4;
+        swo_put_u32(&response[2], SWO_STREAM_BUFFER_SIZE_BYTES);
+        *response_length = 6;
+        break;
+    case ID_DAP_SWO_TRANSPORT:
+        if(request_size >= 2 && !swo.active && request[1] <= SwoTransportEndpoint) {
+            swo.transport = request[1];
+            response[1] = DAP_OK;
+        } else {
+            response[1] = DAP_ERROR;
+        }
+        break;
+    case ID_DAP_SWO_MODE:
+        if(request_size >= 2 && !swo.active &&
+           (request[1] == SwoModeOff || request[1] == SwoModeUart)) {
+            swo.mode = request[1];
+            response[1] = DAP_OK;
+        } else {
+            response[1] = DAP_ERROR;
+        }
+        break;
+    case ID_DAP_SWO_BAUDRATE: {
+        uint32_t baud_rate = 0;
+        if(request_size >= 5) {
+            baud_rate = swo_get_actual_baud_rate(swo_get_u32(&request[1]));
+        }
+
+        swo.baud_rate = baud_rate;
+        if(swo.active) {
+            if(baud_rate != 0) {
+                simple_uart_set_baud_rate(SWO_UART_PORT_NUM, baud_rate);
+            } else {
+                swo_stop();
+            }
+        }
+
+        swo_put_u32(&response[1], baud_rate);
+        *response_length = 5;
+    } break;
+    case ID_DAP_SWO_CONTROL:
+        if(request_size >= 2 && request[1] == 1) {
+            response[1] = swo_start() ? DAP_OK : DAP_ERROR;
+        } else if(request_size >= 2 && request[1] == 0) {
+            swo_stop();
+            response[1] = DAP_OK;
+        } else {
+            response[1] = DAP_ERROR;
+        }
+        break;
+    case ID_DAP_SWO_STATUS:
+        response[1] = swo_get_status();
+        swo_put_u32(&response[2], xStreamBufferBytesAvailable(swo_stream));
+        *response_length = 6;
+        break;
+    case ID_DAP_SWO_EXTENDED_STATUS:
+        *response_length =
+            swo_dap_extended_status(request, request_size, response, response_size);
+        break;
+    case ID_DAP_SWO_DATA:
+        *response_length = swo_dap_data(request, request_size, response, response_size);
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+void swo_dap_patch_response(const uint8_t* request, uint8_t* response, size_t response_length) {
+    if(swo_stream == NULL || response_length < 3) return;
+
+    if(request[0] == ID_DAP_INFO && request[1] == DAP_INFO_CAPABILITIES && response[1] >= 1) {
+        response[2] |= DAP_CAP_SWO_UART | DAP_CAP_SWO_STREAMING;
+    }
+}
+
+void swo_init(void) {
+    ESP_LOGI(TAG, "init");
+
+    swo_stream = xStreamBufferCreateStatic(
+        SWO_STREAM_BUFFER_SIZE_BYTES, 1, swo_stream_storage, &swo_stream_buffer_struct);
+
+    xTaskCreate(
+        swo_task, "swo_task", SWO_TASK_STACK_SIZE, NULL, SWO_TASK_PRIORITY, &swo.task);
+    usb_glue_swo_set_send_complete_callback(swo_send_complete_callback, NULL);
+
+    ESP_LOGI(TAG, "init done");
+}
@@ -0,0 +1,42 @@
+/**
+ * @file swo.h
+ * CMSIS-DAP SWO trace capture (UART/NRZ mode)
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Init SWO capture, DAP-Link mode only
+ */
+void swo_init(void);
+
+/**
+ * Process SWO related DAP request
+ * @param request 
+ * @param request_size 
+ * @param response 
+ * @param response_size 
+ * @param response_length length of the written response
+ * @return true if the request was handled
+ */
+bool swo_dap_process_request(
+    const uint8_t* request,
+    size_t request_size,
+    uint8_t* response,
+    size_t response_size,
+    size_t* response_length);
+
+/**
+ * Patch DAP response produced by the generic DAP handler, to announce SWO capabilities
+ * @param request 
+ * @param response 
+ * @param response_length 
+ */
+void swo_dap_patch_response(const uint8_t* request, uint8_t* response, size_t response_length);
+
+/**
+ * Stop SWO capture and give UART back to the CLI
+ */
+void swo_stop(void);
@@ -0,0 +1,221 @@
+#include <string.h>
+#include <sys/param.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include "helpers.h"
+#include "usb-uart.h"
+#include "uart-autobaud.h"
+
+/*
+ * The shortest pulse on a busy line is one bit, unless the text has no single bits at all,
+ * then it is two. Low and high pulses differ a bit because of slow edges, the average of
+ * both cancels that out. Standard rates within 3% of the guess win over the raw number.
+ * Below ~20 kBd the pulse counters overflow, then the low standard rates are tried in turn.
+ */
+
+#define UART_AUTOBAUD_MIN_EDGES 200
+#define UART_AUTOBAUD_MEASURE_MS 5000
+#define UART_AUTOBAUD_CONFIRM_BYTES 256
+#define UART_AUTOBAUD_CONFIRM_MS 3000
+#define UART_AUTOBAUD_POLL_MS 20
+#define UART_AUTOBAUD_SNAP_TOLERANCE 30 // per mille
+#define UART_AUTOBAUD_MAX_ERROR_RATE 128 // at most one bad byte in that many
+
+static const uint32_t uart_autobaud_standard_rates[] = {
+    300,    600,    1200,   2400,   4800,    9600,    14400,   19200,   28800,   38400,  57600,
+    74880,  115200, 230400, 250000, 460800,  500000,  921600,  1000000, 1500000, 2000000,
+};
+
+static const uint32_t uart_autobaud_slow_rates[] = {
+    19200, 14400, 9600, 4800, 2400, 1200, 600, 300,
+};
+
+static UartAutobaudStatus autobaud_status = {.state = UartAutobaudIdle};
+static uint32_t autobaud_cached_rate = 0;
+static bool autobaud_running = false;
+static portMUX_TYPE autobaud_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* TAG = "uart-autobaud";
+
+static void uart_autobaud_update(const UartAutobaudStatus* status) {
+    portENTER_CRITICAL(&autobaud_mux);
+    autobaud_status = *status;
+    portEXIT_CRITICAL(&autobaud_mux);
+}
+
+static uint32_t uart_autobaud_snap(uint32_t rate) {
+    for(size_t i = 0; i < COUNT_OF(uart_autobaud_standard_rates); i++) {
+        uint32_t standard = uart_autobaud_standard_rates[i];
+        uint32_t error = rate > standard ? rate - standard : standard - rate;
+        if((uint64_t)error * 1000 <= (uint64_t)standard * UART_AUTOBAUD_SNAP_TOLERANCE) {
+            return standard;
+        }
+    }
+
+    return rate;
+}
+
+static void uart_autobaud_apply(uint32_t bit_rate) {
+    UsbUartConfig config = usb_uart_get_line_coding();
+    config.bit_rate = bit_rate;
+    usb_uart_set_line_coding(config);
+}
+
+static uint32_t uart_autobaud_errors(const UartStats* stats) {
+    return stats->frame_errors + stats->parity_errors + stats->breaks;
+}
+
+static bool uart_autobaud_confirm(UartAutobaudStatus* status, uint32_t bit_rate) {
+    UartStats start, now;
+
+    status->state = UartAutobaudConfirming;
+    status->bit_rate = bit_rate;
+    status->checked_bytes = 0;
+    status->errors = 0;
+    uart_autobaud_update(status);
+
+    uart_autobaud_apply(bit_rate);
+    // bytes that were already in flight at the old rate do not count
+    vTaskDelay(pdMS_TO_TICKS(UART_AUTOBAUD_POLL_MS));
+    usb_uart_get_stats(&start);
+
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(UART_AUTOBAUD_CONFIRM_MS);
+    while(xTaskGetTickCount() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(UART_AUTOBAUD_POLL_MS));
+        usb_uart_get_stats(&now);
+
+        status->checked_bytes = now.rx_bytes - start.rx_bytes;
+        status->errors = uart_autobaud_errors(&now) - uart_autobaud_errors(&start);
+        uart_autobaud_update(status);
+
+        // a wrong rate shows up as errors long before the byte count is reached
+        if(status->errors > UART_AUTOBAUD_CONFIRM_BYTES / UART_AUTOBAUD_MAX_ERROR_RATE) break;
+        if(status->checked_bytes >= UART_AUTOBAUD_CONFIRM_BYTES) break;
+    }
+
+    return status->checked_bytes >= UART_AUTOBAUD_CONFIRM_BYTES &&
+           status->errors * UART_AUTOBAUD_MAX_ERROR_RATE <= status->checked_bytes;
+}
+
+static uint32_t uart_autobaud_measure(UartAutobaudStatus* status) {
+    UartAutobaud sample = {0};
+
+    status->state = UartAutobaudMeasuring;
+    uart_autobaud_update(status);
+
+    usb_uart_autobaud_start();
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(UART_AUTOBAUD_MEASURE_MS);
+    while(xTaskGetTickCount() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(UART_AUTOBAUD_POLL_MS));
+        usb_uart_autobaud_get(&sample);
+
+        status->edges = sample.edges;
+        uart_autobaud_update(status);
+        if(sample.edges >= UART_AUTOBAUD_MIN_EDGES) break;
+    }
+    usb_uart_autobaud_stop();
+
+    if(sample.edges < UART_AUTOBAUD_MIN_EDGES) return 0;
+
+    uint32_t low = sample.low_pulse;
+    uint32_t high = sample.high_pulse;
+    uint32_t pulse;
+    if(low == 0 || high == 0) {
+        pulse = MAX(low, high);
+    } else if(MAX(low, high) * 4 < MIN(low, high) * 5) {
+        pulse = (low + high) / 2;
+    } else {
+        pulse = MIN(low, high);
+    }
+
+    return pulse != 0 ? sample.clock / pulse : 0;
+}
+
+static void uart_autobaud_task(void* pvParameters) {
+    bool use_cache = (bool)pvParameters;
+    UartAutobaudStatus status = {0};
+    uint32_t previous_rate = usb_uart_get_line_coding().bit_rate;
+    bool confirmed = false;
+
+    if(use_cache && autobaud_cached_rate != 0) {
+        confirmed = uart_autobaud_confirm(&status, autobaud_cached_rate);
+        status.cached = confirmed;
+    }
+
+    if(!confirmed) {
+        status.measured = uart_autobaud_measure(&status);
+
+        if(status.measured != 0) {
+            uint32_t candidates[] = {
+                uart_autobaud_snap(status.measured),
+                uart_autobaud_snap(status.measured * 2),
+            };
+            for(size_t i = 0; i < COUNT_OF(candidates) && !confirmed; i++) {
+                confirmed = uart_autobaud_confirm(&status, candidates[i]);
+            }
+        } else if(status.edges >= UART_AUTOBAUD_MIN_EDGES) {
+            for(size_t i = 0; i < COUNT_OF(uart_autobaud_slow_rates) && !confirmed; i++) {
+                confirmed = uart_autobaud_confirm(&status, uart_autobaud_slow_rates[i]);
+            }
+        }
+    }
+
+    if(confirmed) {
+        autobaud_cached_rate = status.bit_rate;
+        status.state = UartAutobaudDone;
+        ESP_LOGI(TAG, "detected %u", status.bit_rate);
+    } else {
+        uart_autobaud_apply(previous_rate);
+        status.state = UartAutobaudFailed;
+        ESP_LOGW(TAG, "no rate found, %u edges, measured %u", status.edges, status.measured);
+    }
+
+    portENTER_CRITICAL(&autobaud_mux);
+    autobaud_status = status;
+    autobaud_running = false;
+    portEXIT_CRITICAL(&autobaud_mux);
+
+    vTaskDelete(NULL);
+}
+
+esp_err_t uart_autobaud_start(bool use_cache) {
+    bool running;
+
+    portENTER_CRITICAL(&autobaud_mux);
+    running = autobaud_running;
+    if(!running) {
+        autobaud_running = true;
+        memset(&autobaud_status, 0, sizeof(autobaud_status));
+        autobaud_status.state = UartAutobaudMeasuring;
+    }
+    portEXIT_CRITICAL(&autobaud_mux);
+
+    if(running) return ESP_ERR_INVALID_STATE;
+
+    xTaskCreate(uart_autobaud_task, "uart_autobaud", 3072, (void*)use_cache, 4, NULL);
+    return ESP_OK;
+}
+
+void uart_autobaud_get_status(UartAutobaudStatus* status) {
+    portENTER_CRITICAL(&autobaud_mux);
+    *status = autobaud_status;
+    portEXIT_CRITICAL(&autobaud_mux);
+}
+
+const char* uart_autobaud_state_name(UartAutobaudState state) {
+    switch(state) {
+    case UartAutobaudIdle:
+        return "idle";
+    case UartAutobaudMeasuring:
+        return "measuring";
+    case UartAutobaudConfirming:
+        return "confirming";
+    case UartAutobaudDone:
+        return "done";
+    case UartAutobaudFailed:
+        return "failed";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,47 @@
+/**
+ * @file uart-autobaud.h
+ * Target UART baud rate detection. The RX pulse widths give a guess, the guess is applied
+ * and kept only if the next few hundred bytes come in without framing errors.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+typedef enum {
+    UartAutobaudIdle,
+    UartAutobaudMeasuring, // waiting for enough RX edges
+    UartAutobaudConfirming, // a rate is applied, counting errors
+    UartAutobaudDone,
+    UartAutobaudFailed, // the previous rate is restored
+} UartAutobaudState;
+
+typedef struct {
+    UartAutobaudState state;
+    uint32_t bit_rate; /*!< rate being confirmed or the result*/
+    uint32_t measured; /*!< raw rate from the shortest pulse, 0 if the line was too slow*/
+    uint32_t edges;
+    uint32_t checked_bytes; /*!< received at the candidate rate*/
+    uint32_t errors; /*!< framing, parity and break errors at the candidate rate*/
+    bool cached; /*!< the result was taken from this session cache and confirmed again*/
+} UartAutobaudStatus;
+
+/**
+ * Start detection in the background
+ * @param use_cache try the last confirmed rate first
+ * @return esp_err_t ESP_ERR_INVALID_STATE if a detection is running
+ */
+esp_err_t uart_autobaud_start(bool use_cache);
+
+/**
+ * Get detection progress or result
+ * @param status
+ */
+void uart_autobaud_get_status(UartAutobaudStatus* status);
+
+/**
+ * Get state name
+ * @param state
+ * @return const char*
+ */
+const char* uart_autobaud_state_name(UartAutobaudState state);
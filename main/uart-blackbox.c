@@ -0,0 +1,321 @@
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "lz4-block.h"
+#include "uart-capture.h"
+#include "uart-blackbox.h"
+#include "usb-uart.h"
+
+/*
+ * A low priority task reads the capture as a lossy sink, so flash erase and write time
+ * never holds back the live sinks. Data is batched in PSRAM and compressed into a page once
+ * there is enough of it or it gets old. Pages are written whole and never modified, the
+ * newest page is found at boot by its sequence number.
+ *
+ * A sector erase turns the flash cache off for tens of milliseconds. Nothing but the UART
+ * DMA runs then, and its 8 KB of RX descriptors fill in less than that at a few Mbaud. So
+ * the next page is erased ahead of time, while the target UART is quiet. Only at rates
+ * where the DMA ring outlasts an erase may a page be erased right before it is written,
+ * above that the blackbox waits for a quiet moment and loses data, not the live bridge.
+ */
+
+#define UART_BLACKBOX_PARTITION_SUBTYPE 0x40
+#define UART_BLACKBOX_PARTITION_LABEL "blackbox"
+#define UART_BLACKBOX_SINK_MAX_LAG (256 * 1024)
+#define UART_BLACKBOX_RAW_SIZE (16 * 1024)
+#define UART_BLACKBOX_DATA_SIZE (UART_BLACKBOX_PAGE_SIZE - sizeof(UartBlackboxPage))
+#define UART_BLACKBOX_FLUSH_MS (30 * 1000)
+#define UART_BLACKBOX_IDLE_MS (50) // line quiet for this long, the next page may be erased
+#define UART_BLACKBOX_BUSY_POLL_MS (10)
+#define UART_BLACKBOX_ERASE_MAX_BAUD (460800) // 8 KB of DMA descriptors last about 170 ms
+
+#define UART_BLACKBOX_HASH_BITS 12
+
+typedef struct {
+    const esp_partition_t* partition;
+    size_t pages;
+    size_t head; /*!< next page to write*/
+    bool head_erased; /*!< head page is erased and ready for writing*/
+    uint32_t seq;
+    uint32_t boot;
+    volatile bool enabled;
+    SemaphoreHandle_t mutex;
+
+    size_t raw_size;
+    uint32_t first_ms;
+    uint32_t last_ms;
+    uint32_t lost;
+
+    UartBlackboxStats stats;
+} UartBlackbox;
+
+static uint8_t blackbox_raw[UART_BLACKBOX_RAW_SIZE] EXT_RAM_ATTR;
+static UartBlackbox blackbox = {
+    .enabled = true,
+};
+
+static const char* TAG = "uart-blackbox";
+
+static size_t uart_blackbox_page_offset(size_t page) {
+    return page * UART_BLACKBOX_PAGE_SIZE;
+}
+
+static bool uart_blackbox_read_header(size_t page, UartBlackboxPage* header) {
+    esp_err_t err = esp_partition_read(
+        blackbox.partition, uart_blackbox_page_offset(page), header, sizeof(UartBlackboxPage));
+
+    return err == ESP_OK && header->magic == UART_BLACKBOX_MAGIC &&
+           header->data_size <= UART_BLACKBOX_DATA_SIZE;
+}
+
+static void uart_blackbox_scan(void) {
+    UartBlackboxPage header;
+    bool found = false;
+
+    blackbox.head = 0;
+    blackbox.head_erased = false;
+    blackbox.seq = 0;
+    blackbox.boot = 0;
+
+    for(size_t i = 0; i < blackbox.pages; i++) {
+        if(!uart_blackbox_read_header(i, &header)) continue;
+
+        if(!found || (int32_t)(header.seq - blackbox.seq) >= 0) {
+            blackbox.seq = header.seq + 1;
+            blackbox.head = (i + 1) % blackbox.pages;
+        }
+        if(!found || (int32_t)(header.boot - blackbox.boot) >= 0) {
+            blackbox.boot = header.boot + 1;
+        }
+        found = true;
+    }
+}
+
+// must be called with the mutex held
+static void uart_blackbox_erase_head(void) {
+    size_t offset = uart_blackbox_page_offset(blackbox.head);
+    esp_err_t err =
+        esp_partition_erase_range(blackbox.partition, offset, UART_BLACKBOX_PAGE_SIZE);
+    if(err != ESP_OK) {
+        // the write fails too and the page is skipped
+        ESP_LOGE(TAG, "page %u erase failed, %s", blackbox.head, esp_err_to_name(err));
+    }
+
+    blackbox.head_erased = true;
+}
+
+// must be called with the mutex held, returns false if the page has to wait for a quiet line
+static bool uart_blackbox_write_page(uint8_t* page, uint16_t* table) {
+    if(!blackbox.head_erased) {
+        if(usb_uart_get_actual_bit_rate() > UART_BLACKBOX_ERASE_MAX_BAUD) return false;
+        uart_blackbox_erase_head();
+    }
+
+    UartBlackboxPage* header = (UartBlackboxPage*)page;
+    uint8_t* data = page + sizeof(UartBlackboxPage);
+
+    // incompressible data may not fit, then the rest goes to the next page
+    size_t raw_size = blackbox.raw_size;
+    size_t data_size = 0;
+    while(data_size == 0) {
+        data_size = lz4_block_compress(
+            blackbox_raw,
+            raw_size,
+            data,
+            UART_BLACKBOX_DATA_SIZE,
+            table,
+            UART_BLACKBOX_HASH_BITS);
+        if(data_size == 0) raw_size /= 2;
+    }
+
+    header->magic = UART_BLACKBOX_MAGIC;
+    header->seq = blackbox.seq;
+    header->boot = blackbox.boot;
+    header->first_ms = blackbox.first_ms;
+    header->last_ms = blackbox.last_ms;
+    header->lost = blackbox.lost;
+    header->raw_size = raw_size;
+    header->data_size = data_size;
+    header->crc = esp_rom_crc32_le(0, data, data_size);
+
+    size_t offset = uart_blackbox_page_offset(blackbox.head);
+    esp_err_t err = esp_partition_write(
+        blackbox.partition, offset, page, sizeof(UartBlackboxPage) + data_size);
+
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "page %u write failed, %s", blackbox.head, esp_err_to_name(err));
+    } else {
+        blackbox.stats.pages_written++;
+        blackbox.stats.raw_bytes += raw_size;
+        blackbox.stats.stored_bytes += data_size;
+    }
+
+    // a bad sector is skipped like any other, the next pass will try it again
+    blackbox.seq++;
+    blackbox.head = (blackbox.head + 1) % blackbox.pages;
+    blackbox.head_erased = false;
+    blackbox.lost = 0;
+
+    blackbox.raw_size -= raw_size;
+    memmove(blackbox_raw, blackbox_raw + raw_size, blackbox.raw_size);
+    return true;
+}
+
+static void uart_blackbox_task(void* pvParameters) {
+    UartSink* sink = uart_capture_sink_add(
+        "blackbox", UartSinkPolicyDropOldest, UART_BLACKBOX_SINK_MAX_LAG);
+    uint8_t* page = malloc(UART_BLACKBOX_PAGE_SIZE);
+    uint16_t* table = malloc(LZ4_BLOCK_TABLE_SIZE(UART_BLACKBOX_HASH_BITS));
+    uint32_t dropped = 0;
+
+    if(sink == NULL || page == NULL || table == NULL) {
+        ESP_LOGE(TAG, "init failed");
+        free(page);
+        free(table);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while(1) {
+        bool ready = uart_capture_sink_wait(sink, pdMS_TO_TICKS(UART_BLACKBOX_IDLE_MS));
+
+        if(!blackbox.enabled) {
+            uart_capture_sink_skip(sink);
+            dropped = uart_capture_sink_dropped(sink);
+            continue;
+        }
+
+        uint32_t now_ms = esp_timer_get_time() / 1000;
+
+        xSemaphoreTake(blackbox.mutex, portMAX_DELAY);
+        if(!ready && !blackbox.head_erased) {
+            uart_blackbox_erase_head();
+        }
+
+        if(ready) {
+            const uint8_t* data;
+            size_t length = uart_capture_sink_peek(sink, &data);
+            length = MIN(length, UART_BLACKBOX_RAW_SIZE - blackbox.raw_size);
+
+            uint32_t lost = uart_capture_sink_dropped(sink) - dropped;
+            dropped += lost;
+            blackbox.lost += lost;
+            blackbox.stats.lost += lost;
+
+            if(blackbox.raw_size == 0) blackbox.first_ms = now_ms;
+            blackbox.last_ms = now_ms;
+
+            memcpy(blackbox_raw + blackbox.raw_size, data, length);
+            blackbox.raw_size += length;
+            uart_capture_sink_consume(sink, length);
+        }
+
+        // a full buffer compresses to about a page of text, quiet targets are flushed by time
+        bool stuck = false;
+        if(blackbox.raw_size == UART_BLACKBOX_RAW_SIZE ||
+           (blackbox.raw_size > 0 && now_ms - blackbox.first_ms >= UART_BLACKBOX_FLUSH_MS)) {
+            stuck = !uart_blackbox_write_page(page, table) &&
+                    blackbox.raw_size == UART_BLACKBOX_RAW_SIZE;
+        }
+        xSemaphoreGive(blackbox.mutex);
+
+        if(stuck) {
+            // no room until the page is written, skip ahead and wait for the line to go quiet
+            uart_capture_sink_skip(sink);
+            vTaskDelay(pdMS_TO_TICKS(UART_BLACKBOX_BUSY_POLL_MS));
+        }
+    }
+}
+
+void uart_blackbox_init(void) {
+    blackbox.partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, UART_BLACKBOX_PARTITION_SUBTYPE, UART_BLACKBOX_PARTITION_LABEL);
+
+    if(blackbox.partition == NULL) {
+        ESP_LOGI(TAG, "no partition, disabled");
+        return;
+    }
+
+    blackbox.pages = blackbox.partition->size / UART_BLACKBOX_PAGE_SIZE;
+    blackbox.mutex = xSemaphoreCreateMutex();
+    uart_blackbox_scan();
+
+    blackbox.stats.present = true;
+    blackbox.stats.size = blackbox.partition->size;
+    blackbox.stats.boot = blackbox.boot;
+
+    ESP_LOGI(TAG, "boot %u, next page %u of %u", blackbox.boot, blackbox.head, blackbox.pages);
+    xTaskCreate(uart_blackbox_task, "uart_blackbox", 4096, NULL, 2, NULL);
+}
+
+void uart_blackbox_set_enabled(bool enabled) {
+    blackbox.enabled = enabled;
+}
+
+esp_err_t uart_blackbox_erase(void) {
+    if(blackbox.partition == NULL) return ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(blackbox.mutex, portMAX_DELAY);
+    // asked for by the user, the live bridge may overrun at high rates meanwhile
+    esp_err_t err = esp_partition_erase_range(blackbox.partition, 0, blackbox.partition->size);
+    blackbox.head = 0;
+    blackbox.head_erased = err == ESP_OK;
+    blackbox.seq = 0;
+    xSemaphoreGive(blackbox.mutex);
+
+    return err;
+}
+
+void uart_blackbox_get_stats(UartBlackboxStats* stats) {
+    if(blackbox.partition == NULL) {
+        memset(stats, 0, sizeof(UartBlackboxStats));
+        return;
+    }
+
+    xSemaphoreTake(blackbox.mutex, portMAX_DELAY);
+    *stats = blackbox.stats;
+    stats->enabled = blackbox.enabled;
+    xSemaphoreGive(blackbox.mutex);
+}
+
+void uart_blackbox_for_each_page(UartBlackboxPageCallback callback, void* context) {
+    if(blackbox.partition == NULL) return;
+
+    uint8_t* page = malloc(UART_BLACKBOX_PAGE_SIZE);
+    if(page == NULL) return;
+
+    UartBlackboxPage* header = (UartBlackboxPage*)page;
+    uint8_t* data = page + sizeof(UartBlackboxPage);
+
+    xSemaphoreTake(blackbox.mutex, portMAX_DELAY);
+    size_t head = blackbox.head;
+    xSemaphoreGive(blackbox.mutex);
+
+    // the oldest page is the one that will be overwritten next
+    for(size_t i = 0; i < blackbox.pages; i++) {
+        size_t index = (head + i) % blackbox.pages;
+        if(!uart_blackbox_read_header(index, header)) continue;
+
+        // the writer may erase the page under us, the crc tells
+        esp_err_t err = esp_partition_read(
+            blackbox.partition,
+            uart_blackbox_page_offset(index) + sizeof(UartBlackboxPage),
+            data,
+            header->data_size);
+        if(err != ESP_OK || esp_rom_crc32_le(0, data, header->data_size) != header->crc) {
+            continue;
+        }
+
+        if(!callback(header, data, context)) break;
+    }
+
+    free(page);
+}
@@ -0,0 +1,81 @@
+/**
+ * @file uart-blackbox.h
+ * Persistent target UART log in the "blackbox" flash partition.
+ *
+ * The partition is a circular log of 4 KB pages, one page per flash sector, so every sector
+ * is erased once per pass over the partition. A page holds a header and an LZ4 block with
+ * target UART data. Time is the boot number and milliseconds since that boot.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#define UART_BLACKBOX_MAGIC 0x58424d42 // "BMBX"
+#define UART_BLACKBOX_PAGE_SIZE 4096
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t seq; /*!< page number since the partition was erased*/
+    uint32_t boot; /*!< boot number*/
+    uint32_t first_ms; /*!< since boot, when the first byte was taken*/
+    uint32_t last_ms; /*!< since boot, when the last byte was taken*/
+    uint32_t lost; /*!< bytes lost before this page*/
+    uint16_t raw_size; /*!< data size after decompression*/
+    uint16_t data_size; /*!< LZ4 block size*/
+    uint32_t crc; /*!< crc32 of the LZ4 block*/
+} UartBlackboxPage;
+
+typedef struct {
+    bool present; /*!< partition exists*/
+    bool enabled;
+    uint32_t size; /*!< partition size*/
+    uint32_t boot;
+    uint32_t pages_written; /*!< since boot*/
+    uint32_t raw_bytes; /*!< since boot, before compression*/
+    uint32_t stored_bytes; /*!< since boot, after compression*/
+    uint32_t lost; /*!< since boot, bytes the task did not keep up with*/
+} UartBlackboxStats;
+
+/**
+ * Called for every valid page, oldest first
+ * @param page header
+ * @param data LZ4 block
+ * @param context
+ * @return bool false to stop
+ */
+typedef bool (*UartBlackboxPageCallback)(
+    const UartBlackboxPage* page,
+    const uint8_t* data,
+    void* context);
+
+/**
+ * Find the partition and start logging, does nothing if there is no partition
+ */
+void uart_blackbox_init(void);
+
+/**
+ * Enable or disable logging
+ * @param enabled
+ */
+void uart_blackbox_set_enabled(bool enabled);
+
+/**
+ * Erase the log
+ * @return esp_err_t
+ */
+esp_err_t uart_blackbox_erase(void);
+
+/**
+ * Get counters
+ * @param stats
+ */
+void uart_blackbox_get_stats(UartBlackboxStats* stats);
+
+/**
+ * Read pages, oldest first
+ * @param callback
+ * @param context
+ */
+void uart_blackbox_for_each_page(UartBlackboxPageCallback callback, void* context);
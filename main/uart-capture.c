@@ -0,0 +1,319 @@
+#include <string.h>
+#include <sys/param.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "helpers.h"
+#include "metrics.h"
+#include "uart-capture.h"
+
+/*
+ * Head and sink cursors are free running counters, the index is counter % size.
+ * The producer may only overwrite data that every sink has released, lossy sinks are moved
+ * forward by their policy. A sink that is in the middle of reading is never moved, so the
+ * data it peeked stays valid.
+ * Every byte a sink sees ends up in exactly one counter: received = sent + dropped + failed + lag.
+ */
+
+#define UART_CAPTURE_SIZE (1024 * 1024)
+#define UART_CAPTURE_MAX_SINKS 16
+
+struct UartSink {
+    const char* name;
+    bool used;
+    UartSinkPolicy policy;
+    size_t max_lag;
+    size_t cursor;
+    bool reading;
+    TaskHandle_t task;
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t failed;
+    uint32_t high_water;
+};
+
+typedef struct {
+    size_t head;
+    uint32_t overruns;
+    UartSink sinks[UART_CAPTURE_MAX_SINKS];
+} UartCapture;
+
+static uint8_t capture_storage[UART_CAPTURE_SIZE] EXT_RAM_ATTR;
+static UartCapture capture;
+static portMUX_TYPE capture_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// must be called with capture_mux held
+static void uart_capture_apply_policy(UartSink* sink) {
+    size_t lag = capture.head - sink->cursor;
+    sink->high_water = MAX(sink->high_water, lag);
+
+    if(sink->policy == UartSinkPolicyLossless || sink->reading) return;
+    if(lag <= sink->max_lag) return;
+
+    size_t keep = sink->policy == UartSinkPolicySkip ? 0 : sink->max_lag;
+    sink->dropped += lag - keep;
+    sink->cursor = capture.head - keep;
+}
+
+UartSink* uart_capture_sink_add(const char* name, UartSinkPolicy policy, size_t max_lag) {
+    UartSink* sink = NULL;
+
+    portENTER_CRITICAL(&capture_mux);
+    for(size_t i = 0; i < UART_CAPTURE_MAX_SINKS; i++) {
+        if(!capture.sinks[i].used) {
+            sink = &capture.sinks[i];
+            sink->name = name;
+            sink->used = true;
+            sink->policy = policy;
+            // keep some room for the producer, even if the sink is stuck
+            sink->max_lag = MIN(max_lag, UART_CAPTURE_SIZE / 2);
+            sink->cursor = capture.head;
+            sink->reading = false;
+            sink->task = NULL;
+            sink->sent = 0;
+            sink->dropped = 0;
+            sink->failed = 0;
+            sink->high_water = 0;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&capture_mux);
+
+    return sink;
+}
+
+void uart_capture_sink_set_policy(UartSink* sink, UartSinkPolicy policy, size_t max_lag) {
+    portENTER_CRITICAL(&capture_mux);
+    sink->policy = policy;
+    sink->max_lag = MIN(max_lag, UART_CAPTURE_SIZE / 2);
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+bool uart_capture_sink_wait(UartSink* sink, TickType_t timeout) {
+    TimeOut_t time_out;
+    vTaskSetTimeOutState(&time_out);
+
+    portENTER_CRITICAL(&capture_mux);
+    sink->task = xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&capture_mux);
+
+    while(capture.head == sink->cursor) {
+        if(xTaskCheckForTimeOut(&time_out, &timeout) == pdTRUE) break;
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+
+    return capture.head != sink->cursor;
+}
+
+size_t uart_capture_sink_available(UartSink* sink) {
+    portENTER_CRITICAL(&capture_mux);
+    uart_capture_apply_policy(sink);
+    size_t available = capture.head - sink->cursor;
+    portEXIT_CRITICAL(&capture_mux);
+
+    return available;
+}
+
+size_t uart_capture_sink_peek(UartSink* sink, const uint8_t** data) {
+    portENTER_CRITICAL(&capture_mux);
+    uart_capture_apply_policy(sink);
+
+    size_t index = sink->cursor % UART_CAPTURE_SIZE;
+    size_t length = MIN(capture.head - sink->cursor, UART_CAPTURE_SIZE - index);
+    sink->reading = length > 0;
+    portEXIT_CRITICAL(&capture_mux);
+
+    *data = &capture_storage[index];
+    return length;
+}
+
+void uart_capture_sink_consume(UartSink* sink, size_t size) {
+    portENTER_CRITICAL(&capture_mux);
+    sink->cursor += size;
+    sink->sent += size;
+    sink->reading = false;
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+void uart_capture_sink_skip(UartSink* sink) {
+    portENTER_CRITICAL(&capture_mux);
+    sink->dropped += capture.head - sink->cursor;
+    sink->cursor = capture.head;
+    sink->reading = false;
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+uint32_t uart_capture_sink_dropped(UartSink* sink) {
+    portENTER_CRITICAL(&capture_mux);
+    uart_capture_apply_policy(sink);
+    uint32_t dropped = sink->dropped;
+    portEXIT_CRITICAL(&capture_mux);
+
+    return dropped;
+}
+
+void uart_capture_sink_failed(UartSink* sink, size_t size) {
+    portENTER_CRITICAL(&capture_mux);
+    sink->sent -= MIN(sink->sent, size);
+    sink->failed += size;
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+size_t uart_capture_reserve(uint8_t** data) {
+    size_t max_lag = 0;
+
+    portENTER_CRITICAL(&capture_mux);
+    for(size_t i = 0; i < UART_CAPTURE_MAX_SINKS; i++) {
+        UartSink* sink = &capture.sinks[i];
+        if(!sink->used) continue;
+
+        uart_capture_apply_policy(sink);
+        max_lag = MAX(max_lag, capture.head - sink->cursor);
+    }
+
+    size_t index = capture.head % UART_CAPTURE_SIZE;
+    portEXIT_CRITICAL(&capture_mux);
+
+    *data = &capture_storage[index];
+    return MIN(UART_CAPTURE_SIZE - max_lag, UART_CAPTURE_SIZE - index);
+}
+
+void uart_capture_commit(size_t size) {
+    TaskHandle_t wake[UART_CAPTURE_MAX_SINKS];
+    size_t wake_count = 0;
+
+    if(size == 0) return;
+
+    portENTER_CRITICAL(&capture_mux);
+    for(size_t i = 0; i < UART_CAPTURE_MAX_SINKS; i++) {
+        UartSink* sink = &capture.sinks[i];
+        // wake up only sinks that had nothing to read
+        if(sink->used && sink->task != NULL && sink->cursor == capture.head) {
+            wake[wake_count++] = sink->task;
+        }
+    }
+    capture.head += size;
+    portEXIT_CRITICAL(&capture_mux);
+
+    for(size_t i = 0; i < wake_count; i++) {
+        xTaskNotifyGive(wake[i]);
+    }
+}
+
+void uart_capture_overrun(size_t size) {
+    portENTER_CRITICAL(&capture_mux);
+    capture.overruns += size;
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+const char* uart_capture_policy_name(UartSinkPolicy policy) {
+    switch(policy) {
+    case UartSinkPolicyLossless:
+        return "lossless";
+    case UartSinkPolicyDropOldest:
+        return "drop_oldest";
+    case UartSinkPolicySkip:
+        return "skip";
+    default:
+        return "unknown";
+    }
+}
+
+void uart_capture_get_stats(UartCaptureStats* stats) {
+    portENTER_CRITICAL(&capture_mux);
+    stats->received = capture.head;
+    stats->overruns = capture.overruns;
+    stats->size = UART_CAPTURE_SIZE;
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+bool uart_capture_get_sink_stats(size_t index, UartSinkStats* stats) {
+    if(index >= UART_CAPTURE_MAX_SINKS) return false;
+
+    portENTER_CRITICAL(&capture_mux);
+    UartSink* sink = &capture.sinks[index];
+    bool used = sink->used;
+    if(used) {
+        stats->name = sink->name;
+        stats->policy = sink->policy;
+        stats->sent = sink->sent;
+        stats->dropped = sink->dropped;
+        stats->failed = sink->failed;
+        stats->lag = capture.head - sink->cursor;
+        stats->high_water = MAX(sink->high_water, stats->lag);
+    }
+    portEXIT_CRITICAL(&capture_mux);
+
+    return used;
+}
+
+static bool uart_capture_metric_read(size_t index, MetricSample* sample, void* context) {
+    if(index > 0) return false;
+
+    UartCaptureStats stats;
+    uart_capture_get_stats(&stats);
+    sample->value = metrics_read_field(&stats, context);
+    return true;
+}
+
+static bool uart_capture_sink_metric_read(size_t index, MetricSample* sample, void* context) {
+    UartSinkStats stats;
+    if(!uart_capture_get_sink_stats(index, &stats)) return false;
+
+    strlcpy(sample->label, stats.name, sizeof(sample->label));
+    sample->value = metrics_read_field(&stats, context);
+    return true;
+}
+
+static const Metric uart_capture_metrics[] = {
+    {
+        .name = "bm_uart_capture_received_bytes_total",
+        .help = "Target UART bytes put in the capture ring",
+        .type = MetricTypeCounter,
+        .read = uart_capture_metric_read,
+        .context = METRIC_FIELD(UartCaptureStats, received),
+    },
+    {
+        .name = "bm_uart_capture_overrun_bytes_total",
+        .help = "Target UART bytes lost because the capture ring was full",
+        .type = MetricTypeCounter,
+        .read = uart_capture_metric_read,
+        .context = METRIC_FIELD(UartCaptureStats, overruns),
+    },
+    {
+        .name = "bm_uart_sink_sent_bytes_total",
+        .help = "Target UART bytes delivered to a consumer",
+        .type = MetricTypeCounter,
+        .label = "sink",
+        .read = uart_capture_sink_metric_read,
+        .context = METRIC_FIELD(UartSinkStats, sent),
+    },
+    {
+        .name = "bm_uart_sink_dropped_bytes_total",
+        .help = "Target UART bytes a consumer lost to its drop policy",
+        .type = MetricTypeCounter,
+        .label = "sink",
+        .read = uart_capture_sink_metric_read,
+        .context = METRIC_FIELD(UartSinkStats, dropped),
+    },
+    {
+        .name = "bm_uart_sink_failed_bytes_total",
+        .help = "Target UART bytes a consumer took but could not deliver",
+        .type = MetricTypeCounter,
+        .label = "sink",
+        .read = uart_capture_sink_metric_read,
+        .context = METRIC_FIELD(UartSinkStats, failed),
+    },
+    {
+        .name = "bm_uart_sink_lag_bytes",
+        .help = "Target UART bytes waiting for a consumer",
+        .type = MetricTypeGauge,
+        .label = "sink",
+        .read = uart_capture_sink_metric_read,
+        .context = METRIC_FIELD(UartSinkStats, lag),
+    },
+};
+
+void uart_capture_init(void) {
+    metrics_register(uart_capture_metrics, COUNT_OF(uart_capture_metrics));
+}
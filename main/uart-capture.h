@@ -0,0 +1,149 @@
+/**
+ * @file uart-capture.h
+ * Target UART capture ring, one producer, many sinks with their own read cursors.
+ * Sinks read straight out of the ring, a slow sink only loses its own data.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+
+typedef enum {
+    UartSinkPolicyLossless, // never skip data, holds the producer back when the ring is full
+    UartSinkPolicyDropOldest, // keep only the newest max_lag bytes
+    UartSinkPolicySkip, // jump to the newest data when lag exceeds max_lag
+} UartSinkPolicy;
+
+typedef struct UartSink UartSink;
+
+typedef struct {
+    const char* name;
+    UartSinkPolicy policy;
+    uint32_t sent; /*!< bytes consumed and delivered*/
+    uint32_t dropped; /*!< bytes lost to the drop policy*/
+    uint32_t failed; /*!< bytes consumed but not delivered, e.g. socket errors*/
+    uint32_t lag; /*!< bytes waiting right now*/
+    uint32_t high_water; /*!< max bytes waiting*/
+} UartSinkStats;
+
+typedef struct {
+    uint32_t received; /*!< bytes committed by the producer*/
+    uint32_t overruns; /*!< bytes lost because the ring was full*/
+    uint32_t size;
+} UartCaptureStats;
+
+/**
+ * Register the capture metrics
+ */
+void uart_capture_init(void);
+
+/**
+ * Register a sink, it starts reading from the current head
+ * @param name
+ * @param policy
+ * @param max_lag ignored for lossless sinks
+ * @return UartSink* NULL if there are no free slots
+ */
+UartSink* uart_capture_sink_add(const char* name, UartSinkPolicy policy, size_t max_lag);
+
+/**
+ * Change the drop policy of a sink, e.g. for the next client of a slot
+ * @param sink
+ * @param policy
+ * @param max_lag ignored for lossless sinks
+ */
+void uart_capture_sink_set_policy(UartSink* sink, UartSinkPolicy policy, size_t max_lag);
+
+/**
+ * Wait for data
+ * @param sink
+ * @param timeout
+ * @return true if there is data
+ */
+bool uart_capture_sink_wait(UartSink* sink, TickType_t timeout);
+
+/**
+ * Get number of bytes waiting for the sink, may be more than one peek returns
+ * @param sink
+ * @return size_t
+ */
+size_t uart_capture_sink_available(UartSink* sink);
+
+/**
+ * Get contiguous data at the sink cursor, without copying
+ * Data stays valid until uart_capture_sink_consume()
+ * The drop policy cannot move a sink that holds a peek, so never block before consuming,
+ * e.g. send with a timeout and consume as far as it got
+ * @param sink
+ * @param data
+ * @return size_t
+ */
+size_t uart_capture_sink_peek(UartSink* sink, const uint8_t** data);
+
+/**
+ * Release data returned by uart_capture_sink_peek
+ * @param sink
+ * @param size may be less than peeked
+ */
+void uart_capture_sink_consume(UartSink* sink, size_t size);
+
+/**
+ * Move the sink cursor to the head, pending data is counted as dropped
+ * @param sink
+ */
+void uart_capture_sink_skip(UartSink* sink);
+
+/**
+ * Get number of bytes the sink has lost so far, to detect gaps in its stream
+ * @param sink
+ * @return uint32_t
+ */
+uint32_t uart_capture_sink_dropped(UartSink* sink);
+
+/**
+ * Mark consumed data as not delivered, e.g. because the socket failed
+ * @param sink
+ * @param size
+ */
+void uart_capture_sink_failed(UartSink* sink, size_t size);
+
+/**
+ * Get contiguous free space for the producer
+ * @param data
+ * @return size_t 0 if the ring is held by a lossless sink
+ */
+size_t uart_capture_reserve(uint8_t** data);
+
+/**
+ * Publish data written to the reserved region and wake up sinks
+ * @param size
+ */
+void uart_capture_commit(size_t size);
+
+/**
+ * Account data the producer had to throw away
+ * @param size
+ */
+void uart_capture_overrun(size_t size);
+
+/**
+ * Get policy name
+ * @param policy
+ * @return const char*
+ */
+const char* uart_capture_policy_name(UartSinkPolicy policy);
+
+/**
+ * Get ring counters
+ * @param stats
+ */
+void uart_capture_get_stats(UartCaptureStats* stats);
+
+/**
+ * Get sink counters
+ * @param index
+ * @param stats
+ * @return bool false if there is no such sink
+ */
+bool uart_capture_get_sink_stats(size_t index, UartSinkStats* stats);
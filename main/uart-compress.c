@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+#include "lz4-block.h"
+#include "uart-compress.h"
+
+// 2 KB table, frames are small, a bigger one barely helps
+#define UART_COMPRESS_HASH_BITS 10
+
+struct UartCompressor {
+    uint16_t table[1 << UART_COMPRESS_HASH_BITS];
+    uint8_t frame[UART_COMPRESS_FRAME_MAX];
+    UartCompressStats stats;
+};
+
+static portMUX_TYPE compress_mux = portMUX_INITIALIZER_UNLOCKED;
+
+UartCompressor* uart_compressor_alloc(void) {
+    UartCompressor* compressor = malloc(sizeof(UartCompressor));
+    if(compressor != NULL) {
+        memset(&compressor->stats, 0, sizeof(compressor->stats));
+    }
+
+    return compressor;
+}
+
+size_t uart_compressor_frame(
+    UartCompressor* compressor,
+    const uint8_t* data,
+    size_t size,
+    const uint8_t** frame) {
+    int64_t start = esp_timer_get_time();
+    uint8_t* payload = compressor->frame + UART_COMPRESS_HEADER_SIZE;
+    uint8_t type = UART_COMPRESS_TYPE_LZ4;
+
+    size = MIN(size, UART_COMPRESS_INPUT_MAX);
+
+    // data that does not get smaller goes as is
+    size_t capacity = size > 0 ? size - 1 : 0;
+    size_t payload_size = lz4_block_compress(
+        data, size, payload, capacity, compressor->table, UART_COMPRESS_HASH_BITS);
+    if(payload_size == 0) {
+        type = UART_COMPRESS_TYPE_RAW;
+        payload_size = size;
+        memcpy(payload, data, size);
+    }
+
+    compressor->frame[0] = type;
+    compressor->frame[1] = payload_size;
+    compressor->frame[2] = payload_size >> 8;
+    compressor->frame[3] = size;
+    compressor->frame[4] = size >> 8;
+
+    size_t frame_size = UART_COMPRESS_HEADER_SIZE + payload_size;
+    uint32_t cpu_us = esp_timer_get_time() - start;
+
+    portENTER_CRITICAL(&compress_mux);
+    compressor->stats.frames++;
+    compressor->stats.raw_bytes += size;
+    compressor->stats.compressed_bytes += frame_size;
+    compressor->stats.cpu_us += cpu_us;
+    portEXIT_CRITICAL(&compress_mux);
+
+    *frame = compressor->frame;
+    return frame_size;
+}
+
+void uart_compressor_get_stats(UartCompressor* compressor, UartCompressStats* stats) {
+    portENTER_CRITICAL(&compress_mux);
+    *stats = compressor->stats;
+    portEXIT_CRITICAL(&compress_mux);
+}
+
+void uart_compressor_reset_stats(UartCompressor* compressor) {
+    portENTER_CRITICAL(&compress_mux);
+    memset(&compressor->stats, 0, sizeof(compressor->stats));
+    portEXIT_CRITICAL(&compress_mux);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file uart-compress.h
+ * Compressed framing for UART streams. Every frame is independent, so a client can start
+ * decoding at any frame boundary.
+ *
+ * Frame, little endian: u8 type, u16 payload size, u16 data size, then the payload.
+ * Type UART_COMPRESS_TYPE_LZ4 payload is an LZ4 block, UART_COMPRESS_TYPE_RAW is the data as is.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define UART_COMPRESS_TYPE_RAW 0
+#define UART_COMPRESS_TYPE_LZ4 1
+#define UART_COMPRESS_HEADER_SIZE 5
+#define UART_COMPRESS_INPUT_MAX 4096
+#define UART_COMPRESS_FRAME_MAX (UART_COMPRESS_HEADER_SIZE + UART_COMPRESS_INPUT_MAX)
+
+typedef struct {
+    uint32_t frames;
+    uint32_t raw_bytes; /*!< before compression*/
+    uint32_t compressed_bytes; /*!< frames, headers included*/
+    uint32_t cpu_us; /*!< time spent compressing*/
+} UartCompressStats;
+
+typedef struct UartCompressor UartCompressor;
+
+/**
+ * Allocate compressor, about 8 KB
+ * @return UartCompressor* NULL if there is no memory
+ */
+UartCompressor* uart_compressor_alloc(void);
+
+/**
+ * Compress data into a frame
+ * @param compressor
+ * @param data
+ * @param size up to UART_COMPRESS_INPUT_MAX
+ * @param frame valid until the next call
+ * @return size_t frame size
+ */
+size_t uart_compressor_frame(
+    UartCompressor* compressor,
+    const uint8_t* data,
+    size_t size,
+    const uint8_t** frame);
+
+/**
+ * Get counters
+ * @param compressor
+ * @param stats
+ */
+void uart_compressor_get_stats(UartCompressor* compressor, UartCompressStats* stats);
+
+/**
+ * Reset counters
+ * @param compressor
+ */
+void uart_compressor_reset_stats(UartCompressor* compressor);
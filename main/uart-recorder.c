@@ -0,0 +1,198 @@
+#include <string.h>
+#include <sys/param.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "uart-capture.h"
+#include "uart-recorder.h"
+
+/*
+ * The recorder is a lossy capture sink, so it never holds back the live sinks. It copies
+ * what it reads into its own ring, every chunk gets the time it was taken from the capture.
+ * Head and tail are free running counters, the tail always points to a chunk header.
+ */
+
+#define UART_RECORDER_SIZE (512 * 1024)
+#define UART_RECORDER_SINK_MAX_LAG (256 * 1024)
+
+typedef struct {
+    size_t head;
+    size_t tail;
+    volatile bool enabled;
+    uint32_t chunks;
+    uint32_t recorded;
+    uint32_t lost;
+    uint32_t evicted;
+    SemaphoreHandle_t mutex;
+} UartRecorder;
+
+static uint8_t recorder_storage[UART_RECORDER_SIZE] EXT_RAM_ATTR;
+static UartRecorder recorder = {
+    .enabled = true,
+};
+
+static const char* TAG = "uart-recorder";
+
+static void uart_recorder_copy_in(size_t position, const void* data, size_t size) {
+    size_t index = position % UART_RECORDER_SIZE;
+    size_t first = MIN(size, UART_RECORDER_SIZE - index);
+
+    memcpy(&recorder_storage[index], data, first);
+    memcpy(recorder_storage, (const uint8_t*)data + first, size - first);
+}
+
+static void uart_recorder_copy_out(size_t position, void* data, size_t size) {
+    size_t index = position % UART_RECORDER_SIZE;
+    size_t first = MIN(size, UART_RECORDER_SIZE - index);
+
+    memcpy(data, &recorder_storage[index], first);
+    memcpy((uint8_t*)data + first, recorder_storage, size - first);
+}
+
+static size_t uart_recorder_chunk_size(const UartRecordChunk* chunk) {
+    if(chunk->length & UART_RECORD_GAP) return sizeof(UartRecordChunk) + sizeof(uint32_t);
+    return sizeof(UartRecordChunk) + (chunk->length & UART_RECORD_LENGTH_MASK);
+}
+
+// must be called with the mutex held
+static void uart_recorder_write(uint16_t length, const void* data, size_t size) {
+    UartRecordChunk chunk;
+    uint64_t now = esp_timer_get_time();
+    chunk.time_low = now;
+    chunk.time_high = now >> 32;
+    chunk.length = length;
+
+    size_t need = sizeof(chunk) + size;
+    while(recorder.head + need - recorder.tail > UART_RECORDER_SIZE) {
+        UartRecordChunk oldest;
+        uart_recorder_copy_out(recorder.tail, &oldest, sizeof(oldest));
+        recorder.tail += uart_recorder_chunk_size(&oldest);
+        recorder.chunks--;
+        recorder.evicted++;
+    }
+
+    uart_recorder_copy_in(recorder.head, &chunk, sizeof(chunk));
+    uart_recorder_copy_in(recorder.head + sizeof(chunk), data, size);
+    recorder.head += need;
+    recorder.chunks++;
+}
+
+static void uart_recorder_task(void* pvParameters) {
+    UartSink* sink = uart_capture_sink_add(
+        "recorder", UartSinkPolicyDropOldest, UART_RECORDER_SINK_MAX_LAG);
+    uint32_t dropped = 0;
+
+    if(sink == NULL) {
+        ESP_LOGE(TAG, "no free capture sink");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while(1) {
+        uart_capture_sink_wait(sink, portMAX_DELAY);
+
+        if(!recorder.enabled) {
+            uart_capture_sink_skip(sink);
+            dropped = uart_capture_sink_dropped(sink);
+            continue;
+        }
+
+        const uint8_t* data;
+        size_t length = MIN(uart_capture_sink_peek(sink, &data), UART_RECORD_CHUNK_MAX);
+        uint32_t lost = uart_capture_sink_dropped(sink) - dropped;
+        dropped += lost;
+
+        xSemaphoreTake(recorder.mutex, portMAX_DELAY);
+        if(lost > 0) {
+            uart_recorder_write(UART_RECORD_GAP, &lost, sizeof(lost));
+            recorder.lost += lost;
+        }
+        if(length > 0) {
+            uart_recorder_write(length, data, length);
+            recorder.recorded += length;
+        }
+        xSemaphoreGive(recorder.mutex);
+
+        uart_capture_sink_consume(sink, length);
+    }
+}
+
+void uart_recorder_init(void) {
+    recorder.mutex = xSemaphoreCreateMutex();
+    xTaskCreate(uart_recorder_task, "uart_recorder", 2048, NULL, 5, NULL);
+}
+
+void uart_recorder_set_enabled(bool enabled) {
+    recorder.enabled = enabled;
+}
+
+void uart_recorder_clear(void) {
+    xSemaphoreTake(recorder.mutex, portMAX_DELAY);
+    recorder.tail = recorder.head;
+    recorder.chunks = 0;
+    xSemaphoreGive(recorder.mutex);
+}
+
+void uart_recorder_mark(const char* text) {
+    size_t length = MIN(strlen(text), UART_RECORD_LENGTH_MASK);
+
+    xSemaphoreTake(recorder.mutex, portMAX_DELAY);
+    uart_recorder_write(UART_RECORD_MARK | length, text, length);
+    xSemaphoreGive(recorder.mutex);
+}
+
+void uart_recorder_get_stats(UartRecorderStats* stats) {
+    xSemaphoreTake(recorder.mutex, portMAX_DELAY);
+    stats->enabled = recorder.enabled;
+    stats->size = UART_RECORDER_SIZE;
+    stats->used = recorder.head - recorder.tail;
+    stats->chunks = recorder.chunks;
+    stats->recorded = recorder.recorded;
+    stats->lost = recorder.lost;
+    stats->evicted = recorder.evicted;
+    xSemaphoreGive(recorder.mutex);
+}
+
+void uart_recorder_get_header(UartRecordHeader* header) {
+    memcpy(header->magic, UART_RECORD_MAGIC, sizeof(header->magic));
+    header->version = UART_RECORD_VERSION;
+    header->header_size = sizeof(UartRecordHeader);
+    header->now_us = esp_timer_get_time();
+}
+
+void uart_recorder_read_begin(UartRecorderCursor* cursor) {
+    xSemaphoreTake(recorder.mutex, portMAX_DELAY);
+    cursor->position = recorder.tail;
+    cursor->end = recorder.head;
+    cursor->skipped = 0;
+    xSemaphoreGive(recorder.mutex);
+}
+
+size_t uart_recorder_read(UartRecorderCursor* cursor, uint8_t* buffer, size_t size) {
+    size_t length = 0;
+
+    xSemaphoreTake(recorder.mutex, portMAX_DELAY);
+    // the writer went past the cursor, the only safe place to continue is the tail
+    if((int32_t)(recorder.tail - cursor->position) > 0) {
+        cursor->skipped += recorder.tail - cursor->position;
+        cursor->position = recorder.tail;
+    }
+
+    while((int32_t)(cursor->end - cursor->position) > 0) {
+        UartRecordChunk chunk;
+        uart_recorder_copy_out(cursor->position, &chunk, sizeof(chunk));
+
+        size_t chunk_size = uart_recorder_chunk_size(&chunk);
+        if(length + chunk_size > size) break;
+
+        uart_recorder_copy_out(cursor->position, buffer + length, chunk_size);
+        cursor->position += chunk_size;
+        length += chunk_size;
+    }
+    xSemaphoreGive(recorder.mutex);
+
+    return length;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file uart-recorder.h
+ * Records target UART RX as timestamped chunks in a PSRAM ring, the oldest chunks are
+ * overwritten. The recording is kept from boot, so it is there after a target crash.
+ *
+ * Recording format, little endian:
+ *   header: "BMRC", u16 version, u16 header size, u64 device time of the download, us
+ *   chunk:  u32 time low, u16 time high (us since boot, when the chunk was recorded),
+ *           u16 length, then length bytes of data
+ *   if length has UART_RECORD_GAP set, the chunk holds u32 number of bytes lost before it
+ *   if length has UART_RECORD_MARK set, the chunk holds the text of a mark, e.g. a trigger
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define UART_RECORD_MAGIC "BMRC"
+#define UART_RECORD_VERSION 2
+#define UART_RECORD_GAP 0x8000
+#define UART_RECORD_MARK 0x4000
+#define UART_RECORD_LENGTH_MASK 0x3FFF
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint64_t now_us;
+} UartRecordHeader;
+
+typedef struct __attribute__((packed)) {
+    uint32_t time_low;
+    uint16_t time_high;
+    uint16_t length;
+} UartRecordChunk;
+
+#define UART_RECORD_CHUNK_MAX 4096
+#define UART_RECORDER_READ_MIN (sizeof(UartRecordChunk) + UART_RECORD_CHUNK_MAX)
+
+typedef struct {
+    bool enabled;
+    uint32_t size; /*!< ring size*/
+    uint32_t used; /*!< bytes stored, headers included*/
+    uint32_t chunks; /*!< chunks stored*/
+    uint32_t recorded; /*!< data bytes recorded since boot*/
+    uint32_t lost; /*!< data bytes the recorder did not keep up with*/
+    uint32_t evicted; /*!< chunks overwritten by newer ones*/
+} UartRecorderStats;
+
+typedef struct {
+    size_t position;
+    size_t end;
+    uint32_t skipped; /*!< bytes overwritten while reading*/
+} UartRecorderCursor;
+
+/**
+ * Start recording
+ */
+void uart_recorder_init(void);
+
+/**
+ * Enable or disable recording, the recording is kept
+ * @param enabled
+ */
+void uart_recorder_set_enabled(bool enabled);
+
+/**
+ * Drop everything recorded so far
+ */
+void uart_recorder_clear(void);
+
+/**
+ * Put a mark into the recording, it has the same timeline as the data
+ * @param text
+ */
+void uart_recorder_mark(const char* text);
+
+/**
+ * Get recorder counters
+ * @param stats
+ */
+void uart_recorder_get_stats(UartRecorderStats* stats);
+
+/**
+ * Fill recording header
+ * @param header
+ */
+void uart_recorder_get_header(UartRecordHeader* header);
+
+/**
+ * Start reading the recording, data recorded after this call is not read
+ * @param cursor
+ */
+void uart_recorder_read_begin(UartRecorderCursor* cursor);
+
+/**
+ * Read whole chunks, if the writer overwrote data under the cursor, reading continues
+ * from the oldest chunk
+ * @param cursor
+ * @param buffer
+ * @param size must be at least UART_RECORDER_READ_MIN
+ * @return size_t 0 at the end of the recording
+ */
+size_t uart_recorder_read(UartRecorderCursor* cursor, uint8_t* buffer, size_t size);
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/param.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <general.h>
+#include <exception.h>
+#include <target.h>
+#include <gdb-glue.h>
+#include "nvs-config.h"
+#include "uart-capture.h"
+#include "uart-recorder.h"
+#include "uart-trigger.h"
+
+/*
+ * Aho-Corasick automaton, compiled into a full DFA so matching is one table lookup per byte.
+ * Bytes that are not in any pattern share class 0, so a row has one entry per distinct
+ * pattern byte instead of 256.
+ */
+
+#define UART_TRIGGER_SINK_MAX_LAG (64 * 1024)
+#define UART_TRIGGER_DFA_MAX_SIZE (64 * 1024)
+#define UART_TRIGGER_PULSE_US (10 * 1000)
+#define UART_TRIGGER_NO_STATE UINT16_MAX
+
+typedef struct {
+    uint16_t states;
+    uint16_t classes;
+    uint8_t class_map[256];
+    uint16_t* next; /*!< states * classes*/
+    uint16_t* output; /*!< bit per trigger that ends in the state*/
+} UartMatcher;
+
+typedef struct {
+    UartTriggerInfo triggers[UART_TRIGGER_MAX];
+    size_t count;
+    UartMatcher* matcher;
+    uint16_t state;
+    uint16_t halt_pending; /*!< bit per trigger, the task halts once the mutex is free*/
+    SemaphoreHandle_t mutex;
+    esp_timer_handle_t pulse_timers[UART_TRIGGER_MAX];
+
+    UartTriggerNotify notify;
+    void* notify_context;
+    UartTriggerStats stats;
+} UartTrigger;
+
+static UartTrigger trigger;
+
+static const char* TAG = "uart-trigger";
+
+static void* uart_trigger_malloc(size_t size) {
+    // the DFA is hot, PSRAM only if there is no room inside
+    void* data = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if(data == NULL) data = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    return data;
+}
+
+static void uart_matcher_free(UartMatcher* matcher) {
+    if(matcher == NULL) return;
+    free(matcher->next);
+    free(matcher->output);
+    free(matcher);
+}
+
+static esp_err_t uart_matcher_compile(
+    const UartTriggerInfo* triggers,
+    size_t count,
+    UartMatcher** result) {
+    UartMatcher* matcher = calloc(1, sizeof(UartMatcher));
+    if(matcher == NULL) return ESP_ERR_NO_MEM;
+
+    size_t max_states = 1;
+    matcher->classes = 1;
+    for(size_t i = 0; i < count; i++) {
+        const uint8_t* pattern = (const uint8_t*)triggers[i].config.pattern;
+        for(; *pattern != '\0'; pattern++) {
+            if(matcher->class_map[*pattern] == 0) {
+                matcher->class_map[*pattern] = matcher->classes++;
+            }
+            max_states++;
+        }
+    }
+
+    size_t classes = matcher->classes;
+    if(max_states * classes * sizeof(uint16_t) > UART_TRIGGER_DFA_MAX_SIZE) {
+        free(matcher);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint16_t* next = uart_trigger_malloc(max_states * classes * sizeof(uint16_t));
+    uint16_t* output = calloc(max_states, sizeof(uint16_t));
+    uint16_t* fail = malloc(max_states * sizeof(uint16_t));
+    uint16_t* queue = malloc(max_states * sizeof(uint16_t));
+    if(next == NULL || output == NULL || fail == NULL || queue == NULL) {
+        free(next);
+        free(output);
+        free(fail);
+        free(queue);
+        free(matcher);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // trie
+    memset(next, 0xFF, max_states * classes * sizeof(uint16_t));
+    size_t states = 1;
+    for(size_t i = 0; i < count; i++) {
+        const uint8_t* pattern = (const uint8_t*)triggers[i].config.pattern;
+        size_t state = 0;
+        for(; *pattern != '\0'; pattern++) {
+            uint16_t* edge = &next[state * classes + matcher->class_map[*pattern]];
+            if(*edge == UART_TRIGGER_NO_STATE) *edge = states++;
+            state = *edge;
+        }
+        output[state] |= 1 << i;
+    }
+
+    // failure links in breadth first order, missing edges become DFA transitions
+    size_t head = 0, tail = 0;
+    for(size_t c = 0; c < classes; c++) {
+        uint16_t* edge = &next[c];
+        if(*edge == UART_TRIGGER_NO_STATE) {
+            *edge = 0;
+        } else {
+            fail[*edge] = 0;
+            queue[tail++] = *edge;
+        }
+    }
+
+    while(head < tail) {
+        size_t state = queue[head++];
+        output[state] |= output[fail[state]];
+
+        for(size_t c = 0; c < classes; c++) {
+            uint16_t* edge = &next[state * classes + c];
+            uint16_t fallback = next[fail[state] * classes + c];
+            if(*edge == UART_TRIGGER_NO_STATE) {
+                *edge = fallback;
+            } else {
+                fail[*edge] = fallback;
+                queue[tail++] = *edge;
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+
+    matcher->states = states;
+    matcher->next = next;
+    matcher->output = output;
+    *result = matcher;
+    return ESP_OK;
+}
+
+// stops right after a match, returns bytes consumed
+static size_t uart_matcher_scan(
+    const UartMatcher* matcher,
+    uint16_t* state,
+    const uint8_t* data,
+    size_t size,
+    uint16_t* matched) {
+    const uint16_t* next = matcher->next;
+    const uint8_t* class_map = matcher->class_map;
+    size_t classes = matcher->classes;
+    uint16_t current = *state;
+
+    for(size_t i = 0; i < size; i++) {
+        current = next[current * classes + class_map[data[i]]];
+        if(matcher->output[current]) {
+            *state = current;
+            *matched = matcher->output[current];
+            return i + 1;
+        }
+    }
+
+    *state = current;
+    *matched = 0;
+    return size;
+}
+
+static void uart_trigger_target_printf(struct target_controller* tc, const char* fmt, va_list ap) {
+    (void)tc;
+    (void)fmt;
+    (void)ap;
+}
+
+static struct target_controller uart_trigger_controller = {
+    .printf = uart_trigger_target_printf,
+};
+
+/*
+ * A GDB host owns the target, so it gets Ctrl-C. Without one the target is halted over
+ * SWD with the same scan and attach as the MSC flasher. Attaching halts the core and the
+ * target is left attached, detaching would let it run again.
+ */
+static bool uart_trigger_halt(void) {
+    if(gdb_glue_connected()) return gdb_glue_interrupt();
+    if(!gdb_glue_swd_claim()) return false;
+
+    target* halted = NULL;
+    volatile struct exception e;
+    TRY_CATCH (e, EXCEPTION_ALL) {
+        if(adiv5_swdp_scan(0) > 0) {
+            halted = target_attach_n(1, &uart_trigger_controller);
+        }
+    }
+    gdb_glue_swd_release();
+
+    return halted != NULL && !e.type;
+}
+
+static void uart_trigger_pulse_end(void* arg) {
+    gpio_set_level((int)arg, 0);
+}
+
+// must be called with the mutex held
+static void uart_trigger_fire(size_t index) {
+    UartTriggerInfo* info = &trigger.triggers[index];
+    const UartTriggerConfig* config = &info->config;
+
+    info->hits++;
+    info->last_hit_us = esp_timer_get_time();
+    ESP_LOGW(TAG, "trigger %u: \"%s\"", index, config->pattern);
+
+    if(config->actions & UartTriggerActionHalt) {
+        // SWD is slow, the task halts after it lets go of the mutex
+        trigger.halt_pending |= 1 << index;
+    }
+
+    if(config->actions & UartTriggerActionMark) {
+        uart_recorder_mark(config->pattern);
+    }
+
+    if((config->actions & UartTriggerActionGpio) && trigger.pulse_timers[index] != NULL) {
+        gpio_set_level(config->gpio, 1);
+        esp_timer_stop(trigger.pulse_timers[index]);
+        esp_timer_start_once(trigger.pulse_timers[index], UART_TRIGGER_PULSE_US);
+    }
+
+    if((config->actions & UartTriggerActionNotify) && trigger.notify != NULL) {
+        trigger.notify(index, config->pattern, trigger.notify_context);
+    }
+}
+
+static void uart_trigger_task(void* pvParameters) {
+    UartSink* sink =
+        uart_capture_sink_add("trigger", UartSinkPolicyDropOldest, UART_TRIGGER_SINK_MAX_LAG);
+    uint32_t dropped = 0;
+
+    if(sink == NULL) {
+        ESP_LOGE(TAG, "no free capture sink");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while(1) {
+        uart_capture_sink_wait(sink, portMAX_DELAY);
+
+        xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+        if(trigger.matcher == NULL) {
+            xSemaphoreGive(trigger.mutex);
+            uart_capture_sink_skip(sink);
+            dropped = uart_capture_sink_dropped(sink);
+            continue;
+        }
+
+        const uint8_t* data;
+        size_t length = uart_capture_sink_peek(sink, &data);
+
+        // a match must not span a gap
+        uint32_t lost = uart_capture_sink_dropped(sink) - dropped;
+        if(lost > 0) {
+            dropped += lost;
+            trigger.stats.lost += lost;
+            trigger.state = 0;
+        }
+
+        int64_t start = esp_timer_get_time();
+        size_t offset = 0;
+        while(offset < length) {
+            uint16_t matched;
+            offset += uart_matcher_scan(
+                trigger.matcher, &trigger.state, data + offset, length - offset, &matched);
+
+            for(size_t i = 0; matched != 0; i++, matched >>= 1) {
+                if(matched & 1) uart_trigger_fire(i);
+            }
+        }
+        trigger.stats.bytes += length;
+        trigger.stats.cpu_us += esp_timer_get_time() - start;
+        uint16_t halt = trigger.halt_pending;
+        trigger.halt_pending = 0;
+        xSemaphoreGive(trigger.mutex);
+
+        uart_capture_sink_consume(sink, length);
+
+        if(halt != 0 && !uart_trigger_halt()) {
+            ESP_LOGE(TAG, "halt failed");
+            xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+            for(size_t i = 0; i < trigger.count; i++) {
+                if(halt & (1 << i)) trigger.triggers[i].halt_failures++;
+            }
+            xSemaphoreGive(trigger.mutex);
+        }
+    }
+}
+
+void uart_trigger_init(void) {
+    trigger.mutex = xSemaphoreCreateMutex();
+    xTaskCreate(uart_trigger_task, "uart_trigger", 3072, NULL, 5, NULL);
+}
+
+// a trigger must not take over SWD, UART, USB, LED or flash pins, or a UART line pin
+static bool uart_trigger_gpio_valid(int gpio) {
+    if(!nvs_config_pin_is_spare(gpio) || !GPIO_IS_VALID_OUTPUT_GPIO(gpio)) return false;
+
+    UartLinePins pins;
+    nvs_config_get_uart_pins(&pins);
+    return gpio != pins.rts && gpio != pins.cts && gpio != pins.dtr;
+}
+
+esp_err_t uart_trigger_set(const UartTriggerConfig* triggers, size_t count) {
+    UartTriggerInfo infos[UART_TRIGGER_MAX];
+    UartMatcher* matcher = NULL;
+
+    if(count > UART_TRIGGER_MAX) return ESP_ERR_INVALID_ARG;
+
+    for(size_t i = 0; i < count; i++) {
+        const UartTriggerConfig* config = &triggers[i];
+        size_t length = strnlen(config->pattern, sizeof(config->pattern));
+        if(length == 0 || length > UART_TRIGGER_PATTERN_MAX) return ESP_ERR_INVALID_ARG;
+        if((config->actions & UartTriggerActionGpio) && !uart_trigger_gpio_valid(config->gpio)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        infos[i].config = *config;
+        infos[i].hits = 0;
+        infos[i].halt_failures = 0;
+        infos[i].last_hit_us = 0;
+    }
+
+    if(count > 0) {
+        esp_err_t err = uart_matcher_compile(infos, count, &matcher);
+        if(err != ESP_OK) return err;
+    }
+
+    xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+    // keep counters of triggers that did not change
+    for(size_t i = 0; i < count; i++) {
+        for(size_t j = 0; j < trigger.count; j++) {
+            if(strcmp(infos[i].config.pattern, trigger.triggers[j].config.pattern) == 0) {
+                infos[i].hits = trigger.triggers[j].hits;
+                infos[i].halt_failures = trigger.triggers[j].halt_failures;
+                infos[i].last_hit_us = trigger.triggers[j].last_hit_us;
+                break;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < UART_TRIGGER_MAX; i++) {
+        if(trigger.pulse_timers[i] != NULL) {
+            esp_timer_stop(trigger.pulse_timers[i]);
+            esp_timer_delete(trigger.pulse_timers[i]);
+            trigger.pulse_timers[i] = NULL;
+        }
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        trigger.triggers[i] = infos[i];
+        if(!(infos[i].config.actions & UartTriggerActionGpio)) continue;
+
+        int gpio = infos[i].config.gpio;
+        gpio_reset_pin(gpio);
+        gpio_set_level(gpio, 0);
+        gpio_set_direction(gpio, GPIO_MODE_OUTPUT);
+
+        esp_timer_create_args_t timer_args = {
+            .callback = uart_trigger_pulse_end,
+            .arg = (void*)gpio,
+            .name = "uart_trigger_pulse",
+        };
+        esp_timer_create(&timer_args, &trigger.pulse_timers[i]);
+    }
+
+    UartMatcher* old = trigger.matcher;
+    trigger.matcher = matcher;
+    trigger.count = count;
+    trigger.state = 0;
+    trigger.stats.states = matcher != NULL ? matcher->states : 0;
+    trigger.stats.classes = matcher != NULL ? matcher->classes : 0;
+    xSemaphoreGive(trigger.mutex);
+
+    uart_matcher_free(old);
+    return ESP_OK;
+}
+
+bool uart_trigger_get(size_t index, UartTriggerInfo* info) {
+    bool found = false;
+
+    xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+    if(index < trigger.count) {
+        *info = trigger.triggers[index];
+        found = true;
+    }
+    xSemaphoreGive(trigger.mutex);
+
+    return found;
+}
+
+void uart_trigger_get_stats(UartTriggerStats* stats) {
+    xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+    *stats = trigger.stats;
+    xSemaphoreGive(trigger.mutex);
+}
+
+void uart_trigger_set_notify(UartTriggerNotify notify, void* context) {
+    xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+    trigger.notify = notify;
+    trigger.notify_context = context;
+    xSemaphoreGive(trigger.mutex);
+}
+
+uint32_t uart_trigger_benchmark(size_t size) {
+    uint8_t* data = malloc(size);
+    if(data == NULL) return 0;
+
+    // something like a target log, so the DFA walks its usual paths
+    size_t length = 0;
+    for(uint32_t line = 0; length < size; line++) {
+        char text[64];
+        int text_length = snprintf(
+            text, sizeof(text), "I (%u) app: step %u value=%u\r\n", line * 10, line, line * 7);
+        text_length = MIN((size_t)text_length, size - length);
+        memcpy(data + length, text, text_length);
+        length += text_length;
+    }
+
+    uint32_t rate = 0;
+    xSemaphoreTake(trigger.mutex, portMAX_DELAY);
+    if(trigger.matcher != NULL) {
+        uint16_t state = 0;
+        int64_t start = esp_timer_get_time();
+
+        size_t offset = 0;
+        while(offset < size) {
+            uint16_t matched;
+            offset +=
+                uart_matcher_scan(trigger.matcher, &state, data + offset, size - offset, &matched);
+        }
+
+        int64_t elapsed = MAX(esp_timer_get_time() - start, 1);
+        rate = (uint64_t)size * 1000000 / elapsed;
+    }
+    xSemaphoreGive(trigger.mutex);
+
+    free(data);
+    return rate;
+}
+
+const char* uart_trigger_action_name(UartTriggerAction action) {
+    switch(action) {
+    case UartTriggerActionHalt:
+        return "halt";
+    case UartTriggerActionMark:
+        return "mark";
+    case UartTriggerActionGpio:
+        return "gpio";
+    case UartTriggerActionNotify:
+        return "notify";
+    default:
+        return "unknown";
+    }
+}
+
+bool uart_trigger_action_parse(const char* name, UartTriggerAction* action) {
+    for(uint32_t bit = 0; bit < 4; bit++) {
+        if(strcmp(name, uart_trigger_action_name(1 << bit)) == 0) {
+            *action = 1 << bit;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file uart-trigger.h
+ * Streaming multi-pattern matcher on target UART output. Patterns are compiled once into
+ * a DFA, a match fires the trigger actions right on the device.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#define UART_TRIGGER_MAX 8
+#define UART_TRIGGER_PATTERN_MAX 48
+#define UART_TRIGGER_GPIO_NONE (-1)
+
+typedef enum {
+    UartTriggerActionHalt = (1 << 0), // halt the target, Ctrl-C to a GDB host or over SWD
+    UartTriggerActionMark = (1 << 1), // put a mark into the UART recording
+    UartTriggerActionGpio = (1 << 2), // pulse the trigger GPIO high
+    UartTriggerActionNotify = (1 << 3), // tell web clients
+} UartTriggerAction;
+
+typedef struct {
+    char pattern[UART_TRIGGER_PATTERN_MAX + 1];
+    uint32_t actions; /*!< UartTriggerAction bits*/
+    int gpio; /*!< UART_TRIGGER_GPIO_NONE if not used*/
+} UartTriggerConfig;
+
+typedef struct {
+    UartTriggerConfig config;
+    uint32_t hits;
+    uint32_t halt_failures; /*!< halt actions that did not reach the target*/
+    int64_t last_hit_us; /*!< esp_timer time, 0 if never*/
+} UartTriggerInfo;
+
+typedef struct {
+    uint32_t bytes; /*!< scanned*/
+    uint32_t cpu_us; /*!< spent scanning*/
+    uint32_t lost; /*!< bytes the matcher did not keep up with*/
+    uint32_t states; /*!< DFA size*/
+    uint32_t classes;
+} UartTriggerStats;
+
+typedef void (*UartTriggerNotify)(size_t index, const char* pattern, void* context);
+
+/**
+ * Start matching
+ */
+void uart_trigger_init(void);
+
+/**
+ * Compile and set triggers, replaces the current ones
+ * @param triggers
+ * @param count up to UART_TRIGGER_MAX, 0 disables matching
+ * @return esp_err_t ESP_ERR_INVALID_ARG for bad triggers or a gpio that is not a spare pin,
+ * ESP_ERR_NO_MEM if the DFA is too big
+ */
+esp_err_t uart_trigger_set(const UartTriggerConfig* triggers, size_t count);
+
+/**
+ * Get trigger
+ * @param index
+ * @param info
+ * @return bool false if there is no such trigger
+ */
+bool uart_trigger_get(size_t index, UartTriggerInfo* info);
+
+/**
+ * Get matcher counters
+ * @param stats
+ */
+void uart_trigger_get_stats(UartTriggerStats* stats);
+
+/**
+ * Set callback for UartTriggerActionNotify, it runs in the matcher task
+ * @param notify
+ * @param context
+ */
+void uart_trigger_set_notify(UartTriggerNotify notify, void* context);
+
+/**
+ * Run the current DFA over generated log text, actions are not fired
+ * @param size bytes to scan
+ * @return uint32_t bytes per second, 0 if there are no triggers or no memory
+ */
+uint32_t uart_trigger_benchmark(size_t size);
+
+/**
+ * Get action name
+ * @param action
+ * @return const char*
+ */
+const char* uart_trigger_action_name(UartTriggerAction action);
+
+/**
+ * Parse action name
+ * @param name
+ * @param action
+ * @return bool
+ */
+bool uart_trigger_action_parse(const char* name, UartTriggerAction* action);
@@ -0,0 +1,276 @@
+#include <string.h>
+#include <esp_log.h>
+#include <usb-glue.h>
+#include "msc-flasher.h"
+#include "usb-msc.h"
+
+/*
+ * Virtual FAT16 volume.
+ * Nothing is stored: reads are generated on the fly, writes to the data area are streamed
+ * to the flasher, writes to the root directory are parsed to learn the file size.
+ */
+
+#define MSC_SECTOR_SIZE 512
+#define MSC_SECTOR_COUNT (64 * 1024)
+#define MSC_SECTORS_PER_CLUSTER 8
+#define MSC_RESERVED_SECTORS 1
+#define MSC_FAT_COUNT 2
+#define MSC_FAT_SECTORS 32
+#define MSC_ROOT_ENTRIES 512
+#define MSC_ROOT_SECTORS ((MSC_ROOT_ENTRIES * 32) / MSC_SECTOR_SIZE)
+
+#define MSC_FAT_START MSC_RESERVED_SECTORS
+#define MSC_ROOT_START (MSC_FAT_START + MSC_FAT_COUNT * MSC_FAT_SECTORS)
+#define MSC_DATA_START (MSC_ROOT_START + MSC_ROOT_SECTORS)
+
+#define MSC_CLUSTER_README 2
+#define MSC_CLUSTER_STATUS 3
+
+#define MSC_STATUS_FILE_SIZE 512
+
+#define MSC_ATTR_READ_ONLY 0x01
+#define MSC_ATTR_VOLUME_ID 0x08
+#define MSC_ATTR_DIRECTORY 0x10
+#define MSC_ATTR_LONG_NAME 0x0F
+
+#define TAG "usb-msc"
+
+typedef struct __attribute__((packed)) {
+    uint8_t jump[3];
+    char oem_name[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t fat_count;
+    uint16_t root_entries;
+    uint16_t total_sectors_16;
+    uint8_t media;
+    uint16_t sectors_per_fat;
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t total_sectors_32;
+    uint8_t drive_number;
+    uint8_t reserved;
+    uint8_t boot_signature;
+    uint32_t volume_id;
+    char volume_label[11];
+    char fs_type[8];
+} MscBootSector;
+
+typedef struct __attribute__((packed)) {
+    char name[11];
+    uint8_t attr;
+    uint8_t nt_reserved;
+    uint8_t create_time_tenth;
+    uint16_t create_time;
+    uint16_t create_date;
+    uint16_t access_date;
+    uint16_t first_cluster_high;
+    uint16_t write_time;
+    uint16_t write_date;
+    uint16_t first_cluster_low;
+    uint32_t size;
+} MscDirEntry;
+
+_Static_assert(sizeof(MscBootSector) == 62, "Wrong boot sector layout");
+_Static_assert(sizeof(MscDirEntry) == 32, "Wrong directory entry layout");
+
+static const char msc_readme[] =
+    "Blackmagic ESP32 drag-and-drop flasher\r\n"
+    "\r\n"
+    "Copy a .bin, .hex or .uf2 file to this drive to program the connected target.\r\n"
+    ".bin files are written to the start of the target flash.\r\n"
+    "The drive is re-mounted when programming is finished, see STATUS.TXT for the result.\r\n";
+
+// 2022-01-01 00:00
+#define MSC_FAT_DATE ((42 << 9) | (1 << 5) | 1)
+#define MSC_FAT_TIME 0
+
+static void usb_msc_fill_entry(
+    MscDirEntry* entry,
+    const char* name,
+    uint8_t attr,
+    uint16_t cluster,
+    uint32_t size) {
+    memset(entry, 0, sizeof(MscDirEntry));
+    memcpy(entry->name, name, sizeof(entry->name));
+    entry->attr = attr;
+    entry->create_date = MSC_FAT_DATE;
+    entry->create_time = MSC_FAT_TIME;
+    entry->write_date = MSC_FAT_DATE;
+    entry->write_time = MSC_FAT_TIME;
+    entry->access_date = MSC_FAT_DATE;
+    entry->first_cluster_low = cluster;
+    entry->size = size;
+}
+
+static void usb_msc_read_boot_sector(uint8_t* sector) {
+    MscBootSector* boot = (MscBootSector*)sector;
+
+    boot->jump[0] = 0xEB;
+    boot->jump[1] = 0x3C;
+    boot->jump[2] = 0x90;
+    memcpy(boot->oem_name, "MSWIN4.1", sizeof(boot->oem_name));
+    boot->bytes_per_sector = MSC_SECTOR_SIZE;
+    boot->sectors_per_cluster = MSC_SECTORS_PER_CLUSTER;
+    boot->reserved_sectors = MSC_RESERVED_SECTORS;
+    boot->fat_count = MSC_FAT_COUNT;
+    boot->root_entries = MSC_ROOT_ENTRIES;
+    boot->total_sectors_16 = 0;
+    boot->media = 0xF8;
+    boot->sectors_per_fat = MSC_FAT_SECTORS;
+    boot->sectors_per_track = 1;
+    boot->heads = 1;
+    boot->hidden_sectors = 0;
+    boot->total_sectors_32 = MSC_SECTOR_COUNT;
+    boot->drive_number = 0x80;
+    boot->boot_signature = 0x29;
+    boot->volume_id = 0x424D4553;
+    memcpy(boot->volume_label, "BLACKMAGIC ", sizeof(boot->volume_label));
+    memcpy(boot->fs_type, "FAT16   ", sizeof(boot->fs_type));
+
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+}
+
+static void usb_msc_read_fat_sector(uint32_t fat_sector, uint8_t* sector) {
+    if(fat_sector != 0) return;
+
+    uint16_t* fat = (uint16_t*)sector;
+    fat[0] = 0xFFF8;
+    fat[1] = 0xFFFF;
+    fat[MSC_CLUSTER_README] = 0xFFFF;
+    fat[MSC_CLUSTER_STATUS] = 0xFFFF;
+}
+
+static void usb_msc_read_root_sector(uint32_t root_sector, uint8_t* sector) {
+    if(root_sector != 0) return;
+
+    MscDirEntry* entries = (MscDirEntry*)sector;
+    usb_msc_fill_entry(&entries[0], "BLACKMAGIC ", MSC_ATTR_VOLUME_ID, 0, 0);
+    usb_msc_fill_entry(
+        &entries[1],
+        "README  TXT",
+        MSC_ATTR_READ_ONLY,
+        MSC_CLUSTER_README,
+        sizeof(msc_readme) - 1);
+    usb_msc_fill_entry(
+        &entries[2], "STATUS  TXT", MSC_ATTR_READ_ONLY, MSC_CLUSTER_STATUS, MSC_STATUS_FILE_SIZE);
+}
+
+static void usb_msc_read_data_sector(uint32_t data_sector, uint8_t* sector) {
+    uint32_t cluster = data_sector / MSC_SECTORS_PER_CLUSTER + 2;
+    uint32_t cluster_sector = data_sector % MSC_SECTORS_PER_CLUSTER;
+
+    if(cluster_sector != 0) return;
+
+    if(cluster == MSC_CLUSTER_README) {
+        memcpy(sector, msc_readme, sizeof(msc_readme) - 1);
+    } else if(cluster == MSC_CLUSTER_STATUS) {
+        // file size is fixed, pad the text with spaces
+        memset(sector, ' ', MSC_STATUS_FILE_SIZE);
+        size_t length = msc_flasher_get_status((char*)sector, MSC_STATUS_FILE_SIZE);
+        if(length < MSC_STATUS_FILE_SIZE) sector[length] = ' ';
+        sector[MSC_STATUS_FILE_SIZE - 2] = '\r';
+        sector[MSC_STATUS_FILE_SIZE - 1] = '\n';
+    }
+}
+
+static void usb_msc_write_root_sector(uint32_t root_sector, const uint8_t* sector) {
+    const MscDirEntry* entries = (const MscDirEntry*)sector;
+
+    for(size_t i = 0; i < MSC_SECTOR_SIZE / sizeof(MscDirEntry); i++) {
+        const MscDirEntry* entry = &entries[i];
+
+        if(entry->name[0] == 0x00) break;
+        if((uint8_t)entry->name[0] == 0xE5) continue;
+        if(entry->attr == MSC_ATTR_LONG_NAME) continue;
+        if(entry->attr & (MSC_ATTR_VOLUME_ID | MSC_ATTR_DIRECTORY)) continue;
+        if(entry->first_cluster_low < 2 || entry->size == 0) continue;
+
+        uint32_t cluster = entry->first_cluster_low;
+        msc_flasher_set_file_size((cluster - 2) * MSC_SECTORS_PER_CLUSTER, entry->size);
+    }
+}
+
+static void usb_msc_capacity(uint32_t* block_count, uint16_t* block_size, void* context) {
+    *block_count = MSC_SECTOR_COUNT;
+    *block_size = MSC_SECTOR_SIZE;
+}
+
+static bool usb_msc_ready(void* context) {
+    // report "medium changed" once after programming, so the host re-reads the volume
+    return !msc_flasher_take_media_changed();
+}
+
+static int32_t
+    usb_msc_read(uint32_t lba, uint32_t offset, void* buffer, uint32_t size, void* context) {
+    uint8_t* data = buffer;
+    uint32_t processed = 0;
+
+    // stack asks for whole sectors
+    while(processed + MSC_SECTOR_SIZE <= size) {
+        uint32_t sector = lba + (offset + processed) / MSC_SECTOR_SIZE;
+        uint8_t* sector_data = data + processed;
+        memset(sector_data, 0, MSC_SECTOR_SIZE);
+
+        if(sector == 0) {
+            usb_msc_read_boot_sector(sector_data);
+        } else if(sector < MSC_ROOT_START) {
+            usb_msc_read_fat_sector((sector - MSC_FAT_START) % MSC_FAT_SECTORS, sector_data);
+        } else if(sector < MSC_DATA_START) {
+            usb_msc_read_root_sector(sector - MSC_ROOT_START, sector_data);
+        } else {
+            usb_msc_read_data_sector(sector - MSC_DATA_START, sector_data);
+        }
+
+        processed += MSC_SECTOR_SIZE;
+    }
+
+    return processed;
+}
+
+static int32_t usb_msc_write(
+    uint32_t lba,
+    uint32_t offset,
+    const uint8_t* buffer,
+    uint32_t size,
+    void* context) {
+    uint32_t processed = 0;
+
+    while(processed + MSC_SECTOR_SIZE <= size) {
+        uint32_t sector = lba + (offset + processed) / MSC_SECTOR_SIZE;
+        const uint8_t* sector_data = buffer + processed;
+
+        if(sector >= MSC_DATA_START) {
+            // flasher queue is full, never wait here, the TinyUSB task serves every interface.
+            // The stack calls again with the rest, with nothing consumed the host retries.
+            if(!msc_flasher_write_sector(sector - MSC_DATA_START, sector_data)) {
+                return processed > 0 ? (int32_t)processed : USB_GLUE_MSC_BUSY;
+            }
+        } else if(sector >= MSC_ROOT_START) {
+            usb_msc_write_root_sector(sector - MSC_ROOT_START, sector_data);
+        }
+
+        processed += MSC_SECTOR_SIZE;
+    }
+
+    return processed;
+}
+
+void usb_msc_init(void) {
+    ESP_LOGI(TAG, "init");
+
+    msc_flasher_init();
+
+    UsbGlueMscCallbacks callbacks = {
+        .capacity = usb_msc_capacity,
+        .ready = usb_msc_ready,
+        .read = usb_msc_read,
+        .write = usb_msc_write,
+    };
+    usb_glue_msc_set_callbacks(&callbacks, NULL);
+
+    ESP_LOGI(TAG, "init done");
+}
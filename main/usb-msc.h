@@ -0,0 +1,11 @@
+/**
+ * @file usb-msc.h
+ * 
+ * Virtual FAT drive for drag-and-drop target flashing
+ */
+#pragma once
+
+/**
+ * Init mass storage callbacks and the flasher
+ */
+void usb_msc_init(void);
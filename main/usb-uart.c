@@ -1,35 +1,123 @@
+#include <stdlib.h>
+#include <sys/param.h>
 #include <simple-uart.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/stream_buffer.h>
 #include <esp_log.h>
+#include <driver/gpio.h>
 #include "usb.h"
+#include "nvs-config.h"
 #include "usb-uart.h"
-#include "network-uart.h"
+#include "uart-capture.h"
+#include "helpers.h"
+#include "metrics.h"
 
 #define USB_UART_PORT_NUM UART_NUM_0
 #define USB_UART_TXD_PIN (43)
 #define USB_UART_RXD_PIN (44)
 #define USB_UART_BAUD_RATE (230400)
 #define USB_UART_RX_BUF_SIZE (1024)
+#define USB_UART_DROP_BUF_SIZE (64)
+#define USB_UART_TX_BUF_SIZE (8 * 1024)
+#define USB_UART_HOST_BUF_SIZE (512)
 
-#define UART_RX_STREAM_BUFFER_SIZE_BYTES 1024 * 1024
-static uint8_t uart_rx_stream_storage[UART_RX_STREAM_BUFFER_SIZE_BYTES + 1] EXT_RAM_ATTR;
-static StaticStreamBuffer_t uart_rx_stream_buffer_struct;
-static StreamBufferHandle_t uart_rx_stream = NULL;
+#define USB_UART_SINK_MAX_LAG (256 * 1024)
+
+static TaskHandle_t uart_dma_task = NULL;
+static TaskHandle_t uart_host_task = NULL;
+static UartLinePins line_pins = {
+    .rts = CFG_UART_PIN_NONE,
+    .cts = CFG_UART_PIN_NONE,
+    .dtr = CFG_UART_PIN_NONE,
+};
+static UartFlow line_flow = UartFlowNone;
 
 static void usb_uart_rx_isr(void* context);
 static void usb_uart_rx_task(void* pvParameters);
+static void usb_uart_dma_task(void* pvParameters);
+static void usb_uart_host_task(void* pvParameters);
 
 static const char* TAG = "usb-uart";
 
+static bool usb_uart_metric_read(size_t index, MetricSample* sample, void* context) {
+    if(index > 0) return false;
+
+    UartStats stats;
+    usb_uart_get_stats(&stats);
+    sample->value = metrics_read_field(&stats, context);
+    return true;
+}
+
+static const Metric usb_uart_metrics[] = {
+    {
+        .name = "bm_uart_rx_bytes_total",
+        .help = "Bytes received from the target UART",
+        .type = MetricTypeCounter,
+        .read = usb_uart_metric_read,
+        .context = METRIC_FIELD(UartStats, rx_bytes),
+    },
+    {
+        .name = "bm_uart_tx_bytes_total",
+        .help = "Bytes queued for the target UART",
+        .type = MetricTypeCounter,
+        .read = usb_uart_metric_read,
+        .context = METRIC_FIELD(UartStats, tx_bytes),
+    },
+    {
+        .name = "bm_uart_fifo_overflows_total",
+        .help = "Target UART RX FIFO overflows, data was lost",
+        .type = MetricTypeCounter,
+        .read = usb_uart_metric_read,
+        .context = METRIC_FIELD(UartStats, fifo_overflows),
+    },
+    {
+        .name = "bm_uart_frame_errors_total",
+        .help = "Target UART framing errors",
+        .type = MetricTypeCounter,
+        .read = usb_uart_metric_read,
+        .context = METRIC_FIELD(UartStats, frame_errors),
+    },
+    {
+        .name = "bm_uart_parity_errors_total",
+        .help = "Target UART parity errors",
+        .type = MetricTypeCounter,
+        .read = usb_uart_metric_read,
+        .context = METRIC_FIELD(UartStats, parity_errors),
+    },
+    {
+        .name = "bm_uart_dma_stalls_total",
+        .help = "Target UART DMA ran out of RX descriptors",
+        .type = MetricTypeCounter,
+        .read = usb_uart_metric_read,
+        .context = METRIC_FIELD(UartStats, dma_stalls),
+    },
+};
+
+static void usb_uart_init_line_pin(int pin) {
+    if(pin == CFG_UART_PIN_NONE) return;
+
+    // line signals are active low, start deasserted
+    gpio_reset_pin(pin);
+    gpio_set_level(pin, 1);
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+}
+
 void usb_uart_init() {
     ESP_LOGI(TAG, "init");
 
-    uart_rx_stream = xStreamBufferCreateStatic(
-        UART_RX_STREAM_BUFFER_SIZE_BYTES, 1, uart_rx_stream_storage, &uart_rx_stream_buffer_struct);
+    metrics_register(usb_uart_metrics, COUNT_OF(usb_uart_metrics));
+
+    nvs_config_get_uart_flow(&line_flow);
+    nvs_config_get_uart_pins(&line_pins);
+
+    usb_uart_init_line_pin(line_pins.dtr);
+    if(line_flow == UartFlowNone) {
+        // without flow control RTS is just another line for the host to drive
+        usb_uart_init_line_pin(line_pins.rts);
+    }
 
     xTaskCreate(usb_uart_rx_task, "usb_uart_rx", 4096, NULL, 5, NULL);
+    xTaskCreate(usb_uart_dma_task, "usb_uart_dma", 2048, NULL, 6, &uart_dma_task);
 
     UartConfig config = {
         .uart_num = USB_UART_PORT_NUM,
@@ -39,11 +127,19 @@ void usb_uart_init() {
         .stop_bits = UART_STOP_BITS_1,
         .tx_pin_num = USB_UART_TXD_PIN,
         .rx_pin_num = USB_UART_RXD_PIN,
-        .isr_context = uart_rx_stream,
+        .isr_context = NULL,
         .rx_isr = usb_uart_rx_isr,
+        .dma = true,
+        .tx_buffer_size = USB_UART_TX_BUF_SIZE,
+        .hw_flow_control = line_flow == UartFlowRtsCts,
+        .rts_pin_num = line_pins.rts,
+        .cts_pin_num = line_pins.cts,
     };
 
     simple_uart_init(&config);
+
+    // after the UART, the task writes to it right away
+    xTaskCreate(usb_uart_host_task, "usb_uart_host", 2048, NULL, 5, &uart_host_task);
     ESP_LOGI(TAG, "init done");
 }
 
@@ -51,12 +147,55 @@ void usb_uart_write(const uint8_t* data, size_t data_size) {
     simple_uart_write(USB_UART_PORT_NUM, data, data_size);
 }
 
+size_t usb_uart_write_nonblock(const uint8_t* data, size_t data_size) {
+    return simple_uart_write_nonblock(USB_UART_PORT_NUM, data, data_size);
+}
+
+size_t usb_uart_get_tx_free(void) {
+    return simple_uart_get_tx_free(USB_UART_PORT_NUM);
+}
+
+void usb_uart_host_data_ready(void) {
+    if(uart_host_task != NULL) {
+        xTaskNotifyGive(uart_host_task);
+    }
+}
+
+void usb_uart_get_stats(UartStats* stats) {
+    simple_uart_get_stats(USB_UART_PORT_NUM, stats);
+}
+
+void usb_uart_autobaud_start(void) {
+    simple_uart_autobaud_start(USB_UART_PORT_NUM);
+}
+
+void usb_uart_autobaud_get(UartAutobaud* result) {
+    simple_uart_autobaud_get(USB_UART_PORT_NUM, result);
+}
+
+void usb_uart_autobaud_stop(void) {
+    simple_uart_autobaud_stop(USB_UART_PORT_NUM);
+}
+
 void usb_uart_set_line_state(bool dtr, bool rts) {
-    // do nothing, we don't have rts and dtr pins
+    // same polarity as usb-uart adapters, asserted line is low
+    if(line_pins.dtr != CFG_UART_PIN_NONE) {
+        gpio_set_level(line_pins.dtr, !dtr);
+    }
+
+    if(line_flow == UartFlowNone && line_pins.rts != CFG_UART_PIN_NONE) {
+        gpio_set_level(line_pins.rts, !rts);
+    }
 }
 
 void usb_uart_set_line_coding(UsbUartConfig config) {
-    simple_uart_set_baud_rate(USB_UART_PORT_NUM, config.bit_rate);
+    if(!simple_uart_set_baud_rate(USB_UART_PORT_NUM, config.bit_rate)) {
+        ESP_LOGW(
+            TAG,
+            "baud rate %d is not accurate, actual %d",
+            (int)config.bit_rate,
+            (int)simple_uart_calc_baud_rate(config.bit_rate));
+    }
 
     // cdc.h
     // 0: 1 stop bit
@@ -98,7 +237,7 @@ void usb_uart_set_line_coding(UsbUartConfig config) {
 
     // cdc.h
     // 5, 6, 7, 8 or 16
-    switch(config.parity) {
+    switch(config.data_bits) {
     case 5:
         simple_uart_set_data_bits(USB_UART_PORT_NUM, UART_DATA_5_BITS);
         break;
@@ -116,6 +255,10 @@ void usb_uart_set_line_coding(UsbUartConfig config) {
     }
 }
 
+uint32_t usb_uart_get_actual_bit_rate(void) {
+    return simple_uart_get_actual_baud_rate(USB_UART_PORT_NUM);
+}
+
 UsbUartConfig usb_uart_get_line_coding() {
     UsbUartConfig config = {
         .bit_rate = simple_uart_get_baud_rate(USB_UART_PORT_NUM),
@@ -172,42 +315,78 @@ UsbUartConfig usb_uart_get_line_coding() {
     return config;
 }
 
-#include "network-http.h"
 static void usb_uart_rx_task(void* pvParameters) {
-    uint8_t* data = malloc(USB_UART_RX_BUF_SIZE);
+    // USB host may not read the port at all, so keep only the newest data for it
+    UartSink* sink = uart_capture_sink_add("usb", UartSinkPolicyDropOldest, USB_UART_SINK_MAX_LAG);
 
     while(1) {
-        size_t length =
-            xStreamBufferReceive(uart_rx_stream, data, USB_UART_RX_BUF_SIZE, portMAX_DELAY);
+        uart_capture_sink_wait(sink, portMAX_DELAY);
+
+        const uint8_t* data;
+        size_t length = MIN(uart_capture_sink_peek(sink, &data), USB_UART_RX_BUF_SIZE);
 
         if(length > 0) {
-            for(size_t i = 0; i < length; i++) {
-                if((i + 1) == length) {
-                    usb_uart_tx_char(data[i], true);
-                } else {
-                    usb_uart_tx_char(data[i], false);
-                }
-            }
-            network_http_uart_write_data(data, length);
-            if(network_uart_connected()) {
-                network_uart_send(data, length);
+            size_t written = usb_uart_tx(data, length, true);
+            uart_capture_sink_consume(sink, written);
+
+            if(written < length) {
+                // CDC FIFO is full, let the host catch up
+                vTaskDelay(1);
             }
         }
     }
 }
 
-static void usb_uart_rx_isr(void* context) {
-    StreamBufferHandle_t stream = context;
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+static void usb_uart_dma_task(void* pvParameters) {
+    while(1) {
+        uint8_t* data;
+        size_t length = uart_capture_reserve(&data);
 
-    uint8_t data;
-    while(simple_uart_available(USB_UART_PORT_NUM)) {
-        simple_uart_read(USB_UART_PORT_NUM, &data, 1);
+        if(length > 0) {
+            length = simple_uart_read(USB_UART_PORT_NUM, data, length);
+            uart_capture_commit(length);
+        } else if(line_flow == UartFlowRtsCts && line_pins.rts != CFG_UART_PIN_NONE) {
+            // leave data in the DMA ring, once it is full the RX FIFO fills up
+            // and RTS stops the target
+            vTaskDelay(1);
+            continue;
+        } else {
+            // we will drop data if a lossless sink holds the capture ring
+            uint8_t drop[USB_UART_DROP_BUF_SIZE];
+            length = simple_uart_read(USB_UART_PORT_NUM, drop, sizeof(drop));
+            uart_capture_overrun(length);
+        }
 
-        size_t ret __attribute__((unused));
-        // we will drop data if the stream overflows
-        ret = xStreamBufferSendFromISR(stream, &data, 1, &xHigherPriorityTaskWoken);
+        if(length == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
     }
+}
 
+static void usb_uart_host_task(void* pvParameters) {
+    uint8_t* buffer = malloc(USB_UART_HOST_BUF_SIZE);
+
+    while(1) {
+        // take from the CDC only what the UART can queue, the rest waits in TinyUSB
+        size_t tx_free = usb_uart_get_tx_free();
+        if(tx_free == 0) {
+            simple_uart_wait_tx_space(USB_UART_PORT_NUM, 1);
+            continue;
+        }
+
+        size_t length = usb_uart_rx(buffer, MIN(tx_free, USB_UART_HOST_BUF_SIZE));
+        if(length > 0) {
+            // network-uart may have taken some space meanwhile, it is fine to wait here
+            usb_uart_write(buffer, length);
+        } else {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+}
+
+static void usb_uart_rx_isr(void* context) {
+    // DMA has already stored the data, just wake up the task that moves it out of the ring
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(uart_dma_task, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
\ No newline at end of file
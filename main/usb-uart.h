@@ -7,11 +7,31 @@
  * 
  */
 #pragma once
+#include <simple-uart.h>
 
 void usb_uart_init();
 
 void usb_uart_write(const uint8_t* data, size_t data_size);
 
+/**
+ * Queue data for the target without blocking
+ * @return size_t number of bytes accepted
+ */
+size_t usb_uart_write_nonblock(const uint8_t* data, size_t data_size);
+
+size_t usb_uart_get_tx_free(void);
+
+/**
+ * Wake up the task that moves USB-UART data from the host to the target
+ */
+void usb_uart_host_data_ready(void);
+
+/**
+ * Get target UART counters
+ * @param stats
+ */
+void usb_uart_get_stats(UartStats* stats);
+
 void usb_uart_set_line_state(bool dtr, bool rts);
 
 typedef struct {
@@ -23,4 +43,26 @@ typedef struct {
 
 void usb_uart_set_line_coding(UsbUartConfig config);
 
-UsbUartConfig usb_uart_get_line_coding();
\ No newline at end of file
+UsbUartConfig usb_uart_get_line_coding();
+
+/**
+ * Get the rate the target UART really runs at, after divider rounding
+ * @return uint32_t
+ */
+uint32_t usb_uart_get_actual_bit_rate(void);
+
+/**
+ * Start the target UART baud rate detector
+ */
+void usb_uart_autobaud_start(void);
+
+/**
+ * Get target UART baud rate detector readings
+ * @param result
+ */
+void usb_uart_autobaud_get(UartAutobaud* result);
+
+/**
+ * Stop the target UART baud rate detector
+ */
+void usb_uart_autobaud_stop(void);
@@ -16,8 +16,10 @@
 #include "usb.h"
 #include "usb-uart.h"
 #include "led.h"
-#include "delay.h"
 #include "nvs-config.h"
+#include "swo.h"
+#include "network-usb.h"
+#include "usb-msc.h"
 #include <gdb-glue.h>
 #include <usb-glue.h>
 #include <class/cdc/cdc_device.h>
@@ -25,12 +27,8 @@
 #define USB_DN_PIN (19)
 #define USB_DP_PIN (20)
 
-#define GDB_BUF_RX_SIZE 64
-#define UART_BUF_RX_SIZE 64
-
 static const char* TAG = "usb";
-static uint8_t gdb_buffer_rx[GDB_BUF_RX_SIZE];
-static uint8_t uart_buffer_rx[UART_BUF_RX_SIZE];
+static bool gdb_rx_enabled = false; // only in the GDB CDC mode
 
 typedef struct {
     volatile bool connected;
@@ -46,28 +44,39 @@ void usb_uart_tx_char(uint8_t c, bool flush) {
     usb_glue_cdc_send(&c, 1, flush);
 }
 
+size_t usb_uart_tx(const uint8_t* data, size_t size, bool flush) {
+    return usb_glue_cdc_send(data, size, flush);
+}
+
+size_t usb_uart_rx(uint8_t* data, size_t size) {
+    return usb_glue_cdc_receive(data, size);
+}
+
+static void usb_gdb_rx_drain(void) {
+    // the TinyUSB task and the gdb thread both drain, the glue keeps the data in order.
+    // What does not fit stays in the CDC FIFO, the host is NAKed until gdb catches up.
+    gdb_glue_receive_from(usb_glue_gdb_receive);
+}
+
 static void usb_gdb_rx_callback(void* context) {
-    if(gdb_glue_can_receive()) {
-        size_t max_len = gdb_glue_get_free_size();
-        if(max_len > GDB_BUF_RX_SIZE) max_len = GDB_BUF_RX_SIZE;
-        uint32_t rx_size = usb_glue_gdb_receive(gdb_buffer_rx, max_len);
+    // drain the CDC FIFO, callback is called once per transfer
+    usb_gdb_rx_drain();
+}
 
-        if(rx_size > 0) {
-            gdb_glue_receive(gdb_buffer_rx, rx_size);
-        }
-    } else {
-        esp_system_abort("No free space in GDB buffer");
+void usb_gdb_rx_resume(void) {
+    // no transfer completes while the CDC FIFO is full, so nothing would call us back
+    if(gdb_rx_enabled) {
+        usb_gdb_rx_drain();
     }
 }
 
-static void usb_uart_rx_callback(void* context) {
-    size_t max_len = gdb_glue_get_free_size();
-    if(max_len > UART_BUF_RX_SIZE) max_len = UART_BUF_RX_SIZE;
-    uint32_t rx_size = usb_glue_cdc_receive(uart_buffer_rx, max_len);
+bool usb_gdb_connected(void) {
+    return gdb_rx_enabled && usb_glue_gdb_connected();
+}
 
-    if(rx_size > 0) {
-        usb_uart_write(uart_buffer_rx, rx_size);
-    }
+static void usb_uart_rx_callback(void* context) {
+    // runs in the TinyUSB task, the data is picked up by the usb-uart host task
+    usb_uart_host_data_ready();
 }
 
 static void usb_line_state_cb(bool dtr, bool rts, void* context) {
@@ -89,10 +98,10 @@ static void usb_set_line_coding_callback(cdc_line_coding_t const* p_line_coding,
 // Device callbacks
 //--------------------------------------------------------------------+
 
+#define USB_EVENT_BLINK_MS 50
+
 static void usb_event_blink(void) {
-    led_set_blue(255);
-    delay(10);
-    led_set_blue(0);
+    led_blink(0, 0, 255, USB_EVENT_BLINK_MS);
 }
 
 static void usb_to_connected(void* context) {
@@ -108,6 +117,9 @@ static void usb_from_connected(void* context) {
         usb_event_blink();
     }
 
+    // host is gone, give the UART back to the CLI
+    swo_stop();
+
     usb_state.connected = false;
     ESP_LOGI(TAG, "disconnect");
 }
@@ -147,7 +159,6 @@ bool dap_is_connected(void) {
 static void dap_task(void* arg) {
     ESP_LOGI(DAP_TAG, "started");
     uint32_t notified_value;
-    size_t counter = 0;
     dap_init();
 
     while(1) {
@@ -162,18 +173,16 @@ static void dap_task(void* arg) {
                     memset(tx_data, 0, DAP_CONFIG_PACKET_SIZE);
                     memset(rx_data, 0, DAP_CONFIG_PACKET_SIZE);
 
-                    if(counter % 512 == 0) {
-                        led_set_blue(255);
-                    } else if(counter % 512 == 256) {
-                        led_set_blue(0);
-                    }
+                    led_activity();
 
                     size_t rx_size = usb_glue_dap_receive(rx_data, sizeof(rx_data));
-                    size_t tx_size =
-                        dap_process_request(rx_data, rx_size, tx_data, sizeof(tx_data));
+                    size_t tx_size = 0;
+                    if(!swo_dap_process_request(
+                           rx_data, rx_size, tx_data, sizeof(tx_data), &tx_size)) {
+                        tx_size = dap_process_request(rx_data, rx_size, tx_data, sizeof(tx_data));
+                        swo_dap_patch_response(rx_data, tx_data, tx_size);
+                    }
                     usb_glue_dap_send(tx_data, tx_size, true);
-
-                    counter++;
                 }
             } else {
                 ESP_LOGE(TAG, "GDB is connected, DAP is disabled");
@@ -184,6 +193,7 @@ static void dap_task(void* arg) {
 
 static void usb_dap_init() {
     ESP_LOGI(DAP_TAG, "init");
+    swo_init();
     xTaskCreate(
         dap_task,
         "dap_thread",
@@ -208,11 +218,22 @@ void usb_init(void) {
     usb_glue_cdc_set_receive_callback(usb_uart_rx_callback, NULL);
 
     if(usb_mode == UsbModeBM) {
+        gdb_rx_enabled = true;
         usb_glue_gdb_set_receive_callback(usb_gdb_rx_callback, NULL);
 
         usb_state.connected = false;
         usb_uart_init();
         usb_glue_init(USBDeviceTypeDualCDC);
+    } else if(usb_mode == UsbModeNET) {
+        usb_state.connected = false;
+        usb_uart_init();
+        network_usb_init();
+        usb_glue_init(USBDeviceTypeNCM);
+    } else if(usb_mode == UsbModeMSC) {
+        usb_state.connected = false;
+        usb_uart_init();
+        usb_msc_init();
+        usb_glue_init(USBDeviceTypeMSC);
     } else {
         usb_glue_dap_set_receive_callback(dap_rx_callback, NULL);
 
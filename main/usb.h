@@ -7,6 +7,35 @@ void usb_init(void);
 
 void usb_gdb_tx_char(uint8_t c, bool flush);
 
+/**
+ * Pick up GDB data left in the CDC FIFO, call once the gdb rx stream has room again
+ */
+void usb_gdb_rx_resume(void);
+
+/**
+ * Check if a host has the GDB CDC port open
+ * @return bool
+ */
+bool usb_gdb_connected(void);
+
 void usb_uart_tx_char(uint8_t c, bool flush);
 
+/**
+ * Send data to the USB-UART CDC
+ * @param data
+ * @param size
+ * @param flush
+ * @return size_t number of bytes accepted, the rest did not fit in the CDC FIFO
+ */
+size_t usb_uart_tx(const uint8_t* data, size_t size, bool flush);
+
+/**
+ * Read data from the USB-UART CDC
+ * Data that is not read stays in the CDC FIFO, once it is full the host is held off
+ * @param data
+ * @param size
+ * @return size_t
+ */
+size_t usb_uart_rx(uint8_t* data, size_t size);
+
 bool dap_is_connected(void);
\ No newline at end of file
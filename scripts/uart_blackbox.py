@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+
+"""Convert the UART black-box log (GET /api/v1/uart/blackbox) to text.
+
+Every line gets the boot number and the time since that boot of the page it started in.
+"""
+
+import sys
+import struct
+import argparse
+import urllib.parse
+import urllib.request
+
+MAGIC = 0x58424D42
+PAGE = struct.Struct("<IIIIIIHHI")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("source", help="log file or http:// url of the device")
+    parser.add_argument("-o", "--output", help="output file, stdout by default")
+    parser.add_argument("--boot", type=int, help="only this boot")
+    parser.add_argument("--from-ms", type=int, help="only after this time since boot")
+    parser.add_argument("--to-ms", type=int, help="only before this time since boot")
+    parser.add_argument("--raw", action="store_true", help="write data only, no timestamps")
+    parser.add_argument("--encoding", default="utf-8", help="target text encoding")
+    return parser.parse_args()
+
+
+def load(args):
+    source = args.source
+    if not (source.startswith("http://") or source.startswith("https://")):
+        with open(source, "rb") as file:
+            return file.read()
+
+    if not source.rstrip("/").endswith("/api/v1/uart/blackbox"):
+        source = source.rstrip("/") + "/api/v1/uart/blackbox"
+
+    query = {}
+    if args.boot is not None:
+        query["boot"] = args.boot
+    if args.from_ms is not None:
+        query["from"] = args.from_ms
+    if args.to_ms is not None:
+        query["to"] = args.to_ms
+    if query:
+        source += "?" + urllib.parse.urlencode(query)
+
+    with urllib.request.urlopen(source) as response:
+        return response.read()
+
+
+def lz4_length(data, index, length):
+    if length == 15:
+        while True:
+            byte = data[index]
+            index += 1
+            length += byte
+            if byte != 255:
+                break
+    return index, length
+
+
+def lz4_decompress(data):
+    out = bytearray()
+    index = 0
+    while index < len(data):
+        token = data[index]
+        index += 1
+
+        index, length = lz4_length(data, index, token >> 4)
+        out += data[index : index + length]
+        index += length
+        if index >= len(data):
+            break
+
+        offset = data[index] | data[index + 1] << 8
+        index += 2
+        index, length = lz4_length(data, index, token & 15)
+
+        start = len(out) - offset
+        for i in range(length + 4):
+            out.append(out[start + i])
+
+    return bytes(out)
+
+
+def pages(data):
+    offset = 0
+    while offset + PAGE.size <= len(data):
+        magic, seq, boot, first_ms, last_ms, lost, raw_size, data_size, crc = PAGE.unpack_from(
+            data, offset
+        )
+        if magic != MAGIC:
+            raise ValueError(f"bad page at {offset}")
+        offset += PAGE.size
+
+        payload = lz4_decompress(data[offset : offset + data_size])
+        offset += data_size
+        if len(payload) != raw_size:
+            raise ValueError(f"page {seq} is corrupted")
+
+        yield boot, first_ms, lost, payload
+
+
+def main():
+    args = parse_args()
+    data = load(args)
+    output = open(args.output, "wb") if args.output else sys.stdout.buffer
+
+    line_start = True
+    for boot, time_ms, lost, payload in pages(data):
+        if args.raw:
+            output.write(payload)
+            continue
+
+        stamp = f"[boot {boot} {time_ms / 1000:10.3f}] "
+        if lost:
+            if not line_start:
+                output.write(b"\n")
+            output.write(f"{stamp}<{lost} bytes lost>\n".encode())
+            line_start = True
+
+        text = payload.decode(args.encoding, errors="replace")
+        for line in text.splitlines(keepends=True):
+            if line_start:
+                output.write(stamp.encode())
+            output.write(line.encode(args.encoding, errors="replace"))
+            line_start = line.endswith(("\n", "\r"))
+
+    if not line_start and not args.raw:
+        output.write(b"\n")
+
+
+if __name__ == "__main__":
+    main()
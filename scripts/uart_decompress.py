@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+
+"""Read the compressed UART port (3458) and write plain target output to stdout.
+
+Input typed on stdin is sent to the target as is.
+"""
+
+import sys
+import socket
+import struct
+import argparse
+import threading
+
+from uart_blackbox import lz4_decompress
+
+HEADER = struct.Struct("<BHH")
+TYPE_RAW = 0
+TYPE_LZ4 = 1
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("host", help="device address, e.g. blackmagic.local")
+    parser.add_argument("--port", type=int, default=3458)
+    parser.add_argument("--no-input", action="store_true", help="do not forward stdin")
+    return parser.parse_args()
+
+
+def read_exact(sock, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return bytes(data)
+
+
+def forward_input(sock):
+    for line in sys.stdin.buffer:
+        sock.sendall(line)
+
+
+def main():
+    args = parse_args()
+    sock = socket.create_connection((args.host, args.port))
+
+    if not args.no_input:
+        threading.Thread(target=forward_input, args=(sock,), daemon=True).start()
+
+    try:
+        while True:
+            kind, payload_size, size = HEADER.unpack(read_exact(sock, HEADER.size))
+            payload = read_exact(sock, payload_size)
+
+            if kind == TYPE_LZ4:
+                payload = lz4_decompress(payload)
+            elif kind != TYPE_RAW:
+                raise ValueError(f"unknown frame type {kind}")
+            if len(payload) != size:
+                raise ValueError("corrupted frame")
+
+            sys.stdout.buffer.write(payload)
+            sys.stdout.buffer.flush()
+    except (EOFError, KeyboardInterrupt):
+        pass
+
+
+if __name__ == "__main__":
+    main()
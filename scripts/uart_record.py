@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+
+"""Convert a UART recording (GET /api/v1/uart/record) to text.
+
+Every line gets the device time of the chunk it started in, seconds since boot,
+or local wall clock time with --wall.
+"""
+
+import sys
+import struct
+import argparse
+import datetime
+import urllib.request
+
+MAGIC = b"BMRC"
+GAP = 0x8000
+MARK = 0x4000
+LENGTH_MASK = 0x3FFF
+HEADER = struct.Struct("<4sHHQ")
+CHUNK = struct.Struct("<IHH")
+LOST = struct.Struct("<I")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("source", help="recording file or http:// url of the device")
+    parser.add_argument("-o", "--output", help="output file, stdout by default")
+    parser.add_argument("--raw", action="store_true", help="write data only, no timestamps")
+    parser.add_argument(
+        "--wall", action="store_true", help="wall clock time, assumes download just now"
+    )
+    parser.add_argument("--encoding", default="utf-8", help="target text encoding")
+    return parser.parse_args()
+
+
+def load(source):
+    if source.startswith("http://") or source.startswith("https://"):
+        if not source.rstrip("/").endswith("/api/v1/uart/record"):
+            source = source.rstrip("/") + "/api/v1/uart/record"
+        with urllib.request.urlopen(source) as response:
+            return response.read(), datetime.datetime.now()
+
+    with open(source, "rb") as file:
+        return file.read(), None
+
+
+def chunks(data):
+    magic, version, header_size, _ = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a UART recording")
+    if version not in (1, 2):
+        raise ValueError(f"unsupported recording version {version}")
+
+    offset = header_size
+    while offset + CHUNK.size <= len(data):
+        time_low, time_high, length = CHUNK.unpack_from(data, offset)
+        offset += CHUNK.size
+        time_us = time_high << 32 | time_low
+
+        if length & GAP:
+            (lost,) = LOST.unpack_from(data, offset)
+            offset += LOST.size
+            yield time_us, None, f"<{lost} bytes lost>"
+        elif length & MARK:
+            length &= LENGTH_MASK
+            text = data[offset : offset + length].decode(errors="replace")
+            offset += length
+            yield time_us, None, f"<mark: {text}>"
+        else:
+            yield time_us, data[offset : offset + length], None
+            offset += length
+
+
+def main():
+    args = parse_args()
+    data, downloaded = load(args.source)
+    now_us = HEADER.unpack_from(data, 0)[3]
+    output = open(args.output, "wb") if args.output else sys.stdout.buffer
+
+    def stamp(time_us):
+        if args.wall and downloaded is not None:
+            time = downloaded - datetime.timedelta(microseconds=now_us - time_us)
+            return f"[{time.isoformat(sep=' ', timespec='microseconds')}] "
+        return f"[{time_us / 1000000:12.6f}] "
+
+    line_start = True
+    for time_us, payload, event in chunks(data):
+        if args.raw:
+            if payload:
+                output.write(payload)
+            continue
+
+        if payload is None:
+            if not line_start:
+                output.write(b"\n")
+            output.write(f"{stamp(time_us)}{event}\n".encode())
+            line_start = True
+            continue
+
+        text = payload.decode(args.encoding, errors="replace")
+        for line in text.splitlines(keepends=True):
+            if line_start:
+                output.write(stamp(time_us).encode())
+            output.write(line.encode(args.encoding, errors="replace"))
+            line_start = line.endswith(("\n", "\r"))
+
+    if not line_start and not args.raw:
+        output.write(b"\n")
+
+
+if __name__ == "__main__":
+    main()